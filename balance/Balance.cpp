@@ -7,96 +7,488 @@
 //*************************************************************************************
 
 #include "Balance.h"						    // Include header file for project
+#include "motorDriver.h"                        // Has the full scale actuation signal
+#include "task_table.h"                         // Has the controller's period
+
+#if (BALANCE_USE_DSP_KERNELS == 1)
+// The tilt rate filters' coefficients: a difference of successive tilts, with the 
+// coefficients in time reversed order, and a first order low pass filter as a biquad
+static const float LQR_RATE_DIFF[2] = { -1.0f / LQR_DT, 1.0f / LQR_DT };
+static const float LQR_RATE_LOWPASS[5] = 
+	{ LQR_RATE_FILTER, 0.0f, 0.0f, 1.0f - LQR_RATE_FILTER, 0.0f };
+#endif
+
+#if (BALANCE_USE_LQR == 1)
+static_assert (LQR_DT * 1000.0f > app_tasks[TASK_CONTROLLER].period_ms - 0.5f
+			   && LQR_DT * 1000.0f < app_tasks[TASK_CONTROLLER].period_ms + 0.5f,
+			   "lqr_gains.h was designed for a different controller period; "
+			   "run lqr_design.py again");
+#endif
 
 
 //-------------------------------------------------------------------------------------
 /** @brief   Creates a controller which holds the functions that determine actuation signal.
- *  @details This is a simple constructor. It does not require any setup.
+ *  @details This is a simple constructor. It only sets up the accelerometer fusion, the
+ *  handle motion estimators, the relay auto-tuners, and the tilt rate filters if the 
+ *  DSP kernels are used; the estimators and tuners run at the controller task's rate,
+ *  and the tuners on errors normalized like the PI cores' errors.
  */
 
 Balance::Balance (void)
+	: fusion (IMU_A_LEVER_MM, IMU_B_LEVER_MM),
+	  ff_x (HANDLE_FF_TAU_S, HANDLE_FF_LEAK_S, HANDLE_FF_MAX_RAD, 
+			app_tasks[TASK_CONTROLLER].period_ms / 1000.0f, MOTOR_COUNTS_PER_RAD),
+	  ff_y (HANDLE_FF_TAU_S, HANDLE_FF_LEAK_S, HANDLE_FF_MAX_RAD, 
+			app_tasks[TASK_CONTROLLER].period_ms / 1000.0f, MOTOR_COUNTS_PER_RAD),
+#if (BALANCE_USE_DSP_KERNELS == 1)
+	  rate_diff_x (LQR_RATE_DIFF), rate_diff_y (LQR_RATE_DIFF),
+	  rate_lpf_x (LQR_RATE_LOWPASS), rate_lpf_y (LQR_RATE_LOWPASS),
+#endif
+	  tune_x (AUTOTUNE_RELAY, AUTOTUNE_HYSTERESIS_MG / ACCEL_FULL_SCALE_MG, 
+			  AUTOTUNE_CYCLES, AUTOTUNE_TIMEOUT_S, 
+			  app_tasks[TASK_CONTROLLER].period_ms / 1000.0f),
+	  tune_y (AUTOTUNE_RELAY, AUTOTUNE_HYSTERESIS_MG / ACCEL_FULL_SCALE_MG, 
+			  AUTOTUNE_CYCLES, AUTOTUNE_TIMEOUT_S, 
+			  app_tasks[TASK_CONTROLLER].period_ms / 1000.0f)
 {
 }
 
 //-------------------------------------------------------------------------------------
 /** @brief   Set proportional and integral control gains.
- *  @details Allows the user to input the  necessary control gains.
+ *  @details Allows the user to input the  necessary control gains, in percent duty 
+ *  cycle per mG of error. They are scaled for the PI cores, whose error and output 
+ *  are normalized, and the integral gain is scaled by the controller task's period.
  */
 
 void Balance::set_gains (void)
 {
-	kp = 0.15;								    // Adjust proportional control
-	ki = 0.1;								    // Adjust integral control
+	kp = 0.15f;								    // Adjust proportional control
+	ki = 0.1f;								    // Adjust integral control
+
+	apply_gains (false);
 }
 
 
 //-------------------------------------------------------------------------------------
-/** @brief   Averages the previous 5 IMU values to avoid unwanted noise.
+/** @brief   Put the proportional and integral gains into the PI cores.
+ *  @details The gains in percent duty cycle per mG are scaled for the PI cores, whose
+ *  error and output are normalized, and the integral gain by the controller task's 
+ *  period. They're kept as the base gains which the gain schedule scales.
+ *  @param   keep_integral True to keep the cores' integrals, as when the gains are 
+ *           changed while balancing
+ */
+
+void Balance::apply_gains (bool keep_integral)
+{
+	float scale = ACCEL_FULL_SCALE_MG / MOTOR_MAX_PWM;
+	float dt = app_tasks[TASK_CONTROLLER].period_ms / 1000.0f;
+	base_kp_x = base_kp_y = kp * scale;
+	base_ki_x = base_ki_y = ki * scale;
+	pi_x.set_gains (base_kp_x, base_ki_x, dt, keep_integral);
+	pi_y.set_gains (base_kp_y, base_ki_y, dt, keep_integral);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add the controller's gains and setpoints to a parameter registry.
+ *  @details A host can then read and set them while the controller runs. Setting
+ *  "autotune" to 1 starts relay auto-tuning; it reads as 0 again once tuning starts,
+ *  and it isn't saved in flash, so tuning doesn't start again after every reset.
+ *  Setting "gain_sched" to 0 turns the gain schedule off, leaving the gains fixed;
+ *  with @c BALANCE_USE_DSP_KERNELS it's always off.
+ *  "ff_cpr" is the measured encoder counts per radian; see @c MOTOR_COUNTS_PER_RAD.
+ *  @param   p_params The registry to which the parameters are added
+ */
+
+void Balance::register_params (param_registry* p_params)
+{
+	p_params->add ("kp", &kp, 0.0f, 10.0f);
+	p_params->add ("ki", &ki, 0.0f, 10.0f);
+	p_params->add ("set_x", &set_x, -1000.0f, 1000.0f);
+	p_params->add ("set_y", &set_y, -1000.0f, 1000.0f);
+	p_params->add ("autotune", &autotune_request, false);
+	p_params->add ("lever_a", &lever_A, -500.0f, 500.0f);
+	p_params->add ("lever_b", &lever_B, -500.0f, 500.0f);
+	p_params->add ("ff_gain", &ff_gain, 0.0f, 1.0f);
+	p_params->add ("ff_cpr", &counts_per_rad, -100000.0f, 100000.0f);
+	p_params->add ("gain_sched", &scheduling);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Use parameters which have just been set through a parameter registry.
+ *  @details This is called between control cycles after new values have been copied
+ *  into the controller's variables. The gains are put into the PI cores without 
+ *  resetting their integrals, so the motors don't jump, and the accelerometers' 
+ *  distances into the fusion stage.
+ */
+
+void Balance::apply_params (void)
+{
+	apply_gains (true);
+	fusion.set_levers (lever_A, lever_B);
+	ff_x.set_counts_per_radian (counts_per_rad);
+	ff_y.set_counts_per_radian (counts_per_rad);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Averages the previous @c ACCEL_BUF_SIZE IMU values to avoid unwanted noise.
  *  @details Takes the accelBuf structure, creates a total of all available X, Y and Z
  *  values and finds the average
- *  @param buffer A structure that holds the previous 5 acceleration data points for X,
- *  Y, and Z axis of the IMU
+ *  @param buffer A structure that holds the previous @c ACCEL_BUF_SIZE acceleration 
+ *  data points for X, Y, and Z axis of the IMU
  */
 
-void Balance::convert (accelBuf buffer)
+void Balance::convert (const accelBuf& buffer)
 {
-    int16_t xaccel_tot = 0;
-    int16_t yaccel_tot = 0;
-    int16_t zaccel_tot = 0;
-    for(uint8_t i = 0; i < 5; i++)
+    float xaccel_tot = 0.0f;
+    float yaccel_tot = 0.0f;
+    float zaccel_tot = 0.0f;
+    for(uint8_t i = 0; i < ACCEL_BUF_SIZE; i++)
     {
         xaccel_tot += buffer.accel_buffer[i].data[0];
         yaccel_tot += buffer.accel_buffer[i].data[1];
         zaccel_tot += buffer.accel_buffer[i].data[2];
     }
-    x_accel = xaccel_tot/5;
-    y_accel = yaccel_tot/5;
-    z_accel = zaccel_tot/5;
+    x_accel = xaccel_tot * (1.0f / ACCEL_BUF_SIZE);
+    y_accel = yaccel_tot * (1.0f / ACCEL_BUF_SIZE);
+    z_accel = zaccel_tot * (1.0f / ACCEL_BUF_SIZE);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Combines the two accelerometers' samples, then averages them.
+ *  @details Each pair of samples from accelerometers A and B, which were read one 
+ *  after the other, is combined by @c accel_fusion into the acceleration at the 
+ *  platform's pivot, removing what the platform's rotation adds at each sensor and
+ *  averaging their noise. The combined samples are then averaged as in 
+ *  @c convert(const accelBuf&). The two buffers are filled in step, so their samples
+ *  at each place were taken at about the same time.
+ *  @param buffer The recent samples from accelerometer A
+ *  @param buffer_B The recent samples from accelerometer B
+ */
+
+void Balance::convert (const accelBuf& buffer, const accelBuf& buffer_B)
+{
+    accelBuf fused;
+    for(uint8_t i = 0; i < ACCEL_BUF_SIZE; i++)
+    {
+        fusion.fuse (buffer.accel_buffer[i], buffer_B.accel_buffer[i], 
+                     fused.accel_buffer[i]);
+    }
+    convert (fused);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Feeds the handle's estimated motion forward into the setpoints.
+ *  @details The accelerometers can't tell the handle's motion from the platform's 
+ *  tilt, so a jolt or swing of the handle reaches the feedback loop as error, which it
+ *  only starts to correct after the averaging in @c convert() and the PI cores' 
+ *  response. Here the handle's motion is estimated from the acceleration at the pivot
+ *  and the motors' speeds by @c handle_feedforward, and @c ff_gain times it is added
+ *  to the setpoints @c set_x and @c set_y, so the controller is already aiming for 
+ *  where the handle is taking the readings. This is called after @c convert() and 
+ *  before @c control(). Without the motors' speed estimators, or while auto-tuning,
+ *  the setpoints are used as they are.
+ */
+
+void Balance::set_setpoint (void)
+{
+	ref_x = set_x;
+	ref_y = set_y;
+
+	if (p_speed_A == NULL || p_speed_B == NULL)
+	{
+		return;
+	}
+
+	float handle_x = ff_x.update (x_accel, p_speed_A->get_speed ());
+	float handle_y = ff_y.update (y_accel, p_speed_B->get_speed ());
+	if (!tuning)
+	{
+		ref_x += ff_gain * handle_x;
+		ref_y += ff_gain * handle_y;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Forgets the handle's motion, after the motors have been stopped.
+ *  @details The handle estimators integrate the motors' speeds to track the platform's
+ *  rotation relative to the handle, which no longer holds once the motors have been 
+ *  stopped or driven by something other than this controller. This should be called
+ *  then, so the estimators start again from the next call to @c set_setpoint().
+ */
+
+void Balance::reset_feedforward (void)
+{
+	ff_x.reset ();
+	ff_y.reset ();
 }
 
 
 //-------------------------------------------------------------------------------------
-/** @brief   Dynamically adjusts the setpoint value.
- *  @details Uses acceleration information from both IMUs to output an appropriate
- *			 reference value to compare against the feedback. This function was left
- *			 simple for the controller used, but would ultimately be used to change
- *			 the set points of the controller.
+/** @brief   Forgets the controller's state, so that it starts again from rest.
+ *  @details The PI cores' integrals, the tilt rate filters, and the handle estimators
+ *  all follow what the motors have been doing, which no longer holds once they have
+ *  been stopped or driven by something other than this controller. This should be 
+ *  called before the controller takes them over again. Auto-tuning which was cut 
+ *  short is given up, leaving the gains as they were.
  */
 
- // Currently implementing simple control, disregarding the magnitude of either IMU
- // and not caring about the IMU on the handle.
- void Balance::set_setpoint (void)
+void Balance::reset (void)
 {
-    set_x = 0;					        // Simple control for now
-	set_y = 0;
-	// Don't care about these readings for now.
-	set_z = -1000;
-	set_x2 = 0;                           // Currently disregarding handle IMU
-	set_y2 = 0;
-	set_z2 = 0;
+	apply_gains (false);
+	tuning = false;
+	have_tilt = false;
+	tilt_rate_x = 0;
+	tilt_rate_y = 0;
+#if (BALANCE_USE_DSP_KERNELS == 1)
+	rate_diff_x.reset ();
+	rate_diff_y.reset ();
+	rate_lpf_x.reset ();
+	rate_lpf_y.reset ();
+#endif
+	reset_feedforward ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Start finding the PI gains by relay feedback.
+ *  @details From the next call to @c control(), relays take the place of the PI 
+ *  controllers on both axes at once until each has measured its ultimate gain and 
+ *  period. The Ziegler-Nichols PI gains found from them are averaged over the two 
+ *  axes, which share one pair of gains, and become @c kp and @c ki, so tuning takes
+ *  effect without reflashing and can be saved with the other parameters. If either 
+ *  axis fails to oscillate steadily, both keep their old gains.
+ */
+
+void Balance::start_autotune (void)
+{
+	tune_x.start ();
+	tune_y.start ();
+	tuning = true;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print the results of the most recent auto-tuning.
+ *  @details For each axis this shows the measured ultimate gain and period and the 
+ *  PI gains found from them, converted to the units of @c kp and @c ki; those are
+ *  set to the average of the two axes' gains.
+ *  @param   ser_dev A reference to the serial device on which to print the results
+ */
+
+void Balance::print_autotune (emstream& ser_dev)
+{
+	relay_tuner* tuners[] = {&tune_x, &tune_y};
+	const float scale = MOTOR_MAX_PWM / ACCEL_FULL_SCALE_MG;
+
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		float kp_tuned, ki_tuned;
+		ser_dev << (axis == 0 ? PMS ("X: ") : PMS ("Y: "));
+		if (tuners[axis]->get_pi_gains (kp_tuned, ki_tuned))
+		{
+			ser_dev << PMS ("Ku ") << tuners[axis]->get_ultimate_gain () 
+					<< PMS (", Tu ") << tuners[axis]->get_ultimate_period ()
+					<< PMS (" s, kp ") << kp_tuned * scale 
+					<< PMS (", ki ") << ki_tuned * scale << endl;
+		}
+		else
+		{
+			ser_dev << PMS ("no result") << endl;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Give the controller the motors' speed estimators for LQR control.
+ *  @details The LQR controller feeds back each motor's speed as well as the tilt and
+ *  tilt rate it balances, so it can only be used once these have been set. The 
+ *  handle's motion is also estimated with them, for @c set_setpoint().
+ *  @param   p_A The speed estimator for motor A, which the x tilt drives
+ *  @param   p_B The speed estimator for motor B, which the y tilt drives
+ */
+
+void Balance::set_speed_sensors (quad_speed* p_A, quad_speed* p_B)
+{
+	p_speed_A = p_A;
+	p_speed_B = p_B;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Sets the PI cores' gains from the gain schedule.
+ *  @details The base gains from @c apply_gains() or auto-tuning are multiplied by the
+ *  factors which @c gain_schedule looks up for each axis's tilt. The @c pi_core 
+ *  cores keep their integrals, which are in output units, so the gains can change 
+ *  every cycle without jumps in the motors' efforts.
+ *  This isn't so for @c dsp_pid, which keeps its last output instead: the 
+ *  proportional part of that output stays at whatever gain made it, and only later 
+ *  changes in the error see a new gain, so with @c BALANCE_USE_DSP_KERNELS the 
+ *  schedule isn't used. This runs in the same time each cycle; the lookups don't 
+ *  search.
+ *  @param   error_x The error in the x direction in mG
+ *  @param   error_y The error in the y direction in mG
+ */
+
+void Balance::schedule_gains (float error_x, float error_y)
+{
+	float dt = app_tasks[TASK_CONTROLLER].period_ms / 1000.0f;
+	float kp_factor, ki_factor;
+	schedule.lookup (error_x, kp_factor, ki_factor);
+	pi_x.set_gains (base_kp_x * kp_factor, base_ki_x * ki_factor, dt, true);
+	schedule.lookup (error_y, kp_factor, ki_factor);
+	pi_y.set_gains (base_kp_y * kp_factor, base_ki_y * ki_factor, dt, true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Finds the tilt rates for the LQR controller.
+ *  @details Each tilt rate is the difference between successive tilts, divided by the
+ *  controller's period, through a first order low pass filter. With the DSP kernels 
+ *  the difference is an FIR filter and the low pass filter a biquad, which give the 
+ *  same results. The first tilts only start the filters.
+ *  @param   tilt_x The tilt in radians from the setpoint in the x direction
+ *  @param   tilt_y The tilt in radians from the setpoint in the y direction
+ */
+
+void Balance::update_tilt_rates (float tilt_x, float tilt_y)
+{
+#if (BALANCE_USE_DSP_KERNELS == 1)
+	float diff_x = rate_diff_x.step (tilt_x);
+	float diff_y = rate_diff_y.step (tilt_y);
+	if (have_tilt)
+	{
+		tilt_rate_x = rate_lpf_x.step (diff_x);
+		tilt_rate_y = rate_lpf_y.step (diff_y);
+	}
+#else
+	if (have_tilt)
+	{
+		tilt_rate_x += LQR_RATE_FILTER 
+					   * ((tilt_x - last_tilt_x) * (1.0f / LQR_DT) - tilt_rate_x);
+		tilt_rate_y += LQR_RATE_FILTER 
+					   * ((tilt_y - last_tilt_y) * (1.0f / LQR_DT) - tilt_rate_y);
+	}
+	last_tilt_x = tilt_x;
+	last_tilt_y = tilt_y;
+#endif
+	have_tilt = true;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Computes one motor's effort by LQR state feedback.
+ *  @details The tilt is found from the acceleration by the small angle approximation
+ *  (1000 mG of acceleration is 1 radian), and the tilt rate by 
+ *  @c update_tilt_rates(). The effort is minus the dot product of the gains in 
+ *  lqr_gains.h with the state, limited to the motors' range of -1.0 to 1.0.
+ *  @param   tilt The tilt in radians from the setpoint
+ *  @param   tilt_rate The filtered tilt rate in radians per second
+ *  @param   speed The motor's speed in encoder counts per second
+ *  @return  The motor's effort from -1.0 to 1.0
+ */
+
+float Balance::lqr_effort (float tilt, float tilt_rate, float speed)
+{
+	float effort = -(LQR_K[0] * tilt + LQR_K[1] * tilt_rate + LQR_K[2] * speed);
+	if (effort > 1.0f)
+	{
+		effort = 1.0f;
+	}
+	else if (effort < -1.0f)
+	{
+		effort = -1.0f;
+	}
+	return (effort);
 }
 
 
 //-------------------------------------------------------------------------------------
 /** @brief   Applies PI control to output a duty cycle for each motor.
- *  @details Uses the error signal calculated from the setpoints for x and y to the
- *           current accelerations sensed in the x and y directions to calculate the
- *           appropriate actuation signal. The control gains convert the error in mG to
- *           voltage.
+ *  @details Uses the error signal calculated from the setpoints for x and y, with the
+ *           handle's motion fed forward by @c set_setpoint(), to the current 
+ *           accelerations sensed in the x and y directions to calculate the
+ *           appropriate actuation signal. The errors are normalized to the 
+ *           accelerometer's full scale and run through the PI cores, whose outputs are
+ *           the motors' efforts from -1.0 to 1.0; with @c BALANCE_USE_DSP_KERNELS 
+ *           these are @c dsp_pid controllers. Unless it's turned off, or the cores
+ *           are @c dsp_pid controllers, the gain schedule first sets the cores' gains
+ *           for each axis's tilt. All the arithmetic is single precision or fixed 
+ *           point, so none of it runs as software double math.
+ *           If @c BALANCE_USE_LQR is set and the motors' speed estimators have been
+ *           given, the LQR state feedback controller is used instead. While 
+ *           auto-tuning, the relay tuners drive the motors.
  */
 
  void Balance::control ()
  {
-     // Integral sum of the error, delta T = .005s from the rate at which the controller is run
-     esum_x += (set_x - x_accel) * .005;
-     // PI control
-     int16_t signalVal = (set_x - x_accel)*kp + esum_x*ki;
-     motor_A_actuation_signal->put(signalVal);
-
-     // Integral sum of the error, delta T = .005s from the rate at which the controller is run
-     esum_y += (set_y - y_accel) * .01;
-     // PI control
-     signalVal = (set_y - y_accel)*kp + esum_y*ki;
-     motor_B_actuation_signal->put(signalVal);
- }
+     if (autotune_request)
+     {
+         autotune_request = false;
+         start_autotune ();
+     }
+
+     if (tuning)
+     {
+         // An axis which finishes first goes back to its old PI gains meanwhile
+         float error_x = (ref_x - x_accel) * (1.0f / ACCEL_FULL_SCALE_MG);
+         motor_A_actuation_signal->put (tune_x.get_state () == RELAY_RUNNING 
+                                        ? tune_x.step (error_x) 
+                                        : pi_x.step_float (error_x));
+
+         float error_y = (ref_y - y_accel) * (1.0f / ACCEL_FULL_SCALE_MG);
+         motor_B_actuation_signal->put (tune_y.get_state () == RELAY_RUNNING 
+                                        ? tune_y.step (error_y) 
+                                        : pi_y.step_float (error_y));
 
+         // Both axes share one pair of gains, so the two axes' results are averaged
+         // and written back in percent duty per mG; the registry then reports them, 
+         // saves them, and keeps them when some other parameter is set
+         if (tune_x.get_state () != RELAY_RUNNING && tune_y.get_state () != RELAY_RUNNING)
+         {
+             float kp_x, ki_x, kp_y, ki_y;
+             if (tune_x.get_pi_gains (kp_x, ki_x) && tune_y.get_pi_gains (kp_y, ki_y))
+             {
+                 const float scale = MOTOR_MAX_PWM / ACCEL_FULL_SCALE_MG;
+                 kp = 0.5f * (kp_x + kp_y) * scale;
+                 ki = 0.5f * (ki_x + ki_y) * scale;
+                 apply_gains (false);
+             }
+             tuning = false;
+         }
+         return;
+     }
+
+#if (BALANCE_USE_LQR == 1)
+     if (p_speed_A != NULL && p_speed_B != NULL)
+     {
+         float tilt_x = (x_accel - ref_x) * 0.001f;
+         float tilt_y = (y_accel - ref_y) * 0.001f;
+         update_tilt_rates (tilt_x, tilt_y);
+         motor_A_actuation_signal->put (lqr_effort (tilt_x, tilt_rate_x, 
+                                                    p_speed_A->get_speed ()));
+         motor_B_actuation_signal->put (lqr_effort (tilt_y, tilt_rate_y, 
+                                                    p_speed_B->get_speed ()));
+         return;
+     }
+#endif
+
+     float error_x = ref_x - x_accel;
+     float error_y = ref_y - y_accel;
+#if (BALANCE_USE_DSP_KERNELS == 0)
+     if (scheduling)
+     {
+         schedule_gains (error_x, error_y);
+     }
+#endif
+     motor_A_actuation_signal->put (pi_x.step_float (error_x 
+                                                     * (1.0f / ACCEL_FULL_SCALE_MG)));
+     motor_B_actuation_signal->put (pi_y.step_float (error_y 
+                                                     * (1.0f / ACCEL_FULL_SCALE_MG)));
+ }
@@ -12,6 +12,117 @@
 #include "emstream.h"
 #include "shares.h"
 #include "acceldata.h"
+#include "pi_core.h"
+#include "quad_speed.h"
+#include "lqr_gains.h"
+#include "relay_tuner.h"
+#include "param_registry.h"
+#include "accel_fusion.h"
+#include "handle_feedforward.h"
+#include "dsp_kernels.h"
+#include "gain_schedule.h"
+
+/** @brief   Set to 1 to balance with the LQR state feedback gains in lqr_gains.h, or
+ *           to 0 to use the PI controllers on the acceleration error.
+ *  @details The LQR controller also needs the motors' speeds, so it falls back to
+ *  the PI controllers until @c Balance::set_speed_sensors() has been called.
+ */
+#define BALANCE_USE_LQR             0
+
+/** @brief   Set to 1 to run the controller's PI and tilt rate filter stages on the
+ *           CMSIS DSP style kernels in dsp_kernels.h, or to 0 to use @c pi_core.
+ *  @details The kernels are the CMSIS DSP library's if @c USE_CMSIS_DSP is 1 and 
+ *  portable versions of them otherwise. They work in float only, so @c control_t is
+ *  then not used. Nor is the gain schedule, which the incremental PID can't follow;
+ *  see @c Balance::schedule_gains().
+ */
+#define BALANCE_USE_DSP_KERNELS     0
+
+/** @brief   The numbers used by the controller's PI cores.
+ *  @details This may be @c float, @c int16_t for Q15 fixed point, or @c int32_t for 
+ *  Q31. The gains and results are the same to within the fixed point resolution; the
+ *  time each takes is printed at startup so the quickest can be chosen.
+ */
+typedef float control_t;
+
+/** @brief   The acceleration error, in mG, which is normalized to 1.0 for the cores.
+ */
+const float ACCEL_FULL_SCALE_MG = 2048.0f;
+
+/** @brief   The type of the controller's PI stages.
+ */
+#if (BALANCE_USE_DSP_KERNELS == 1)
+typedef dsp_pid balance_pi_t;
+#else
+typedef pi_core<control_t> balance_pi_t;
+#endif
+
+/** @brief   Weight of each new tilt rate sample in the LQR controller's rate filter.
+ *  @details The tilt rate is the difference between successive tilts, which is noisy,
+ *  so it is low pass filtered; 1.0 turns the filter off.
+ */
+const float LQR_RATE_FILTER = 0.5f;
+
+/** @brief   Accelerometer A's signed distance from the platform's pivot, in mm.
+ *  @details Accelerometers A and B are on one line through the pivot; see 
+ *  @c accel_fusion. Mounting them on opposite sides at equal distances gives the 
+ *  least noise.
+ */
+const float IMU_A_LEVER_MM = 60.0f;
+
+/** @brief   Accelerometer B's signed distance from the platform's pivot, in mm.
+ */
+const float IMU_B_LEVER_MM = -60.0f;
+
+/** @brief   Default motor encoder counts per radian of the platform's rotation, as 
+ *           in lqr_design.py.
+ *  @details This is only the design model's figure; each platform's should be 
+ *  measured by turning the platform by hand through a known angle relative to the 
+ *  handle with the motors off and dividing the change in the encoder count by the 
+ *  angle. The result is set as the "ff_cpr" parameter and saved in flash. It is 
+ *  negative if a motor's counts increase as its axis's acceleration decreases.
+ */
+const float MOTOR_COUNTS_PER_RAD = 1000.0f;
+
+/** @brief   Time constant in seconds of the filter which separates the handle's motion
+ *           from its steady tilt; see @c handle_feedforward.
+ */
+const float HANDLE_FF_TAU_S = 0.3f;
+
+/** @brief   Time constant in seconds with which the handle estimators' integrated 
+ *           rotation leaks away, so a bias in the motors' speeds can't build up.
+ *  @details The leak also takes away from real rotation, which then shows up as 
+ *  handle motion of about 1000 mG per radian times the rotation rate times 
+ *  @c HANDLE_FF_TAU_S over this, so it's made much longer than that filter's time.
+ */
+const float HANDLE_FF_LEAK_S = 10.0f;
+
+/** @brief   The largest rotation of the platform relative to the handle, in radians,
+ *           which the handle estimators integrate.
+ */
+const float HANDLE_FF_MAX_RAD = 0.35f;
+
+/** @brief   Fraction of the handle's estimated motion fed forward into the setpoints.
+ *  @details 0 turns the feedforward off and 1 removes all of the handle's estimated
+ *  motion from the error.
+ */
+const float HANDLE_FF_GAIN = 0.5f;
+
+/** @brief   Relay output during auto-tuning, as a fraction of the motors' full effort.
+ */
+const float AUTOTUNE_RELAY = 0.3f;
+
+/** @brief   Relay hysteresis during auto-tuning in mG; a little above the IMU's noise.
+ */
+const float AUTOTUNE_HYSTERESIS_MG = 20.0f;
+
+/** @brief   Number of relay oscillation cycles measured on each axis when auto-tuning.
+ */
+const uint8_t AUTOTUNE_CYCLES = 4;
+
+/** @brief   Time in seconds after which auto-tuning gives up and keeps the old gains.
+ */
+const float AUTOTUNE_TIMEOUT_S = 20.0f;
 
 //-------------------------------------------------------------------------------------
 class Balance
@@ -38,13 +149,21 @@ protected:
      */
     float set_y = 0;
 
-    /** @brief Error sum for integral control in x direction
+    /** @brief Gains for the x direction's PI core, before the gain schedule's factors
+     */
+    float base_kp_x = 0, base_ki_x = 0;
+
+    /** @brief Gains for the y direction's PI core, before the gain schedule's factors
      */
-    float esum_x = 0;
+    float base_kp_y = 0, base_ki_y = 0;
+
+    /** @brief PI controller core for the x direction, which drives motor A
+     */
+    balance_pi_t pi_x;
     
-    /** @brief Error sum for integral control in y direction
+    /** @brief PI controller core for the y direction, which drives motor B
      */
-    float esum_y = 0;
+    balance_pi_t pi_y;
 
     /** @brief Averaged acceleration in the x direction
      */
@@ -58,13 +177,121 @@ protected:
      */
     float z_accel;
 
+    /** @brief Accelerometers' signed distances from the pivot in mm, A then B
+     */
+    float lever_A = IMU_A_LEVER_MM, lever_B = IMU_B_LEVER_MM;
 
+    /** @brief Combines accelerometers A and B into the acceleration at the pivot
+     */
+    accel_fusion fusion;
+
+    /** @brief Setpoints with the handle's motion fed forward, which the controller uses
+     */
+    float ref_x = 0, ref_y = 0;
+
+    /** @brief Fraction of the handle's estimated motion fed forward into the setpoints
+     */
+    float ff_gain = HANDLE_FF_GAIN;
+
+    /** @brief Estimators of the handle's motion in the x and y directions
+     */
+    handle_feedforward ff_x, ff_y;
+
+    /** @brief Measured motor encoder counts per radian of the platform's rotation
+     */
+    float counts_per_rad = MOTOR_COUNTS_PER_RAD;
+
+    /** @brief Speed estimator for motor A, or NULL until one is given for LQR control
+     */
+    quad_speed* p_speed_A = NULL;
+
+    /** @brief Speed estimator for motor B
+     */
+    quad_speed* p_speed_B = NULL;
+
+    /** @brief Scales the PI gains by tilt
+     */
+    gain_schedule schedule;
+
+    /** @brief True to use the gain schedule, false for fixed gains
+     */
+    bool scheduling = true;
+
+#if (BALANCE_USE_DSP_KERNELS == 1)
+    /** @brief Filters which take the difference of successive tilts, per second
+     */
+    dsp_fir<2> rate_diff_x, rate_diff_y;
+
+    /** @brief Low pass filters for the tilt rates
+     */
+    dsp_biquad<1> rate_lpf_x, rate_lpf_y;
+#else
+    /** @brief Tilts in radians when the LQR controller last ran, for the tilt rates
+     */
+    float last_tilt_x = 0;
+
+    /** @brief Tilt in the y direction when the LQR controller last ran
+     */
+    float last_tilt_y = 0;
+#endif
+
+    /** @brief Filtered tilt rates in radians per second
+     */
+    float tilt_rate_x = 0;
+
+    /** @brief Filtered tilt rate in the y direction
+     */
+    float tilt_rate_y = 0;
+
+    /** @brief True once the tilts have been read, so the tilt rates can be found
+     */
+    bool have_tilt = false;
+
+    /** @brief Relay feedback auto-tuners for the x and y directions
+     */
+    relay_tuner tune_x, tune_y;
+
+    /** @brief True while the relay auto-tuners are driving the motors
+     */
+    bool tuning = false;
+
+    /** @brief Set to start auto-tuning at the next control cycle
+     */
+    bool autotune_request = false;
+
+    // Puts kp and ki into the PI cores
+    void apply_gains (bool keep_integral);
+
+    // Sets the PI cores' gains from the gain schedule
+    void schedule_gains (float error_x, float error_y);
+
+    // Finds the filtered tilt rates for the LQR controller
+    void update_tilt_rates (float tilt_x, float tilt_y);
+
+    // Computes one motor's effort from the LQR state feedback gains
+    float lqr_effort (float tilt, float tilt_rate, float speed);
 
 public:
     Balance ();                             // Simple constructor
     void set_gains (void);					 // Input proportional and integral gains
-    void convert (accelBuf buffer); 		 // Converts IMU signals to mG
-    void set_setpoint (void);               // Acquire appropriate setpoint value
+    void convert (const accelBuf& buffer);  // Converts IMU signals to mG
+    void convert (const accelBuf& buffer, const accelBuf& buffer_B);  // Fuses, averages
+    void set_setpoint (void);               // Feeds the handle's motion forward
+    void reset_feedforward (void);          // Forgets the handle's motion
+    void reset (void);                      // Starts again from rest
     void control ();           			     // Applies PI control to output actuation signal
+    void set_speed_sensors (quad_speed* p_A, quad_speed* p_B);  // For LQR, feedforward
+    void start_autotune (void);              // Finds PI gains by relay feedback
+    void print_autotune (emstream& ser_dev); // Shows the auto-tuning results
+    void register_params (param_registry* p_params);  // Makes gains tunable by a host
+    void apply_params (void);                // Uses newly set parameters
+
+    /** @brief   Check whether relay auto-tuning is in progress.
+     *  @return  True while the auto-tuners are driving the motors
+     */
+    bool autotune_running (void)
+    {
+        return (tuning);
+    }
 };
 #endif
\ No newline at end of file
@@ -158,8 +158,11 @@
 /// @brief Switch that enables RTOS code to be compiled to keep run time statistics.
 #define configGENERATE_RUN_TIME_STATS         0
 
-/// @brief Switch which enables run-time checking for stack overflows.
-#define configCHECK_FOR_STACK_OVERFLOW        0
+/** @brief Switch which enables run-time checking for stack overflows.
+ *  @details Method 2 checks both the stack pointer and a fill pattern at the end of
+ *           the stack at each context switch; @c vApplicationStackOverflowHook() in
+ *           @c taskbase_stackprt.cpp halts the system if an overflow is found.  */
+#define configCHECK_FOR_STACK_OVERFLOW        2
 
 /// @brief Switch which enables the use of recursive mutexes. 
 #define configUSE_RECURSIVE_MUTEXES           0
@@ -40,6 +40,9 @@ polydaq2::polydaq2 (emstream* serpt = NULL)
 	// Save the serial port pointer
 	p_serial = serpt;
 
+	// Oversampled readings are taken on request until a decimator is given
+	p_decimator = NULL;
+
 
 
 	// Set up the I2C driver
@@ -127,3 +130,37 @@ int16_t polydaq2::get_ext_accel (uint8_t channel)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** @brief   Get an oversampled reading of one A/D channel.
+ *  @details If a decimator is scanning the channel in the background, its newest 
+ *           output is returned at once, and the number of samples is set by the
+ *           decimator's ratio instead. Otherwise the channel is read the given number
+ *           of times and the readings are averaged, which blocks for all of those 
+ *           conversions. 
+ *  @param   channel The A/D channel to be read, from 0 to 15
+ *  @param   samples The number of readings to average if there's no decimator
+ *  @return  The average reading, rounded to the nearest A/D count
+ */
+
+int16_t polydaq2::read_ADC_oversampled (uint8_t channel, uint8_t samples)
+{
+	if (p_decimator)
+	{
+		float reading = p_decimator->get (channel);
+		if (reading >= 0.0f)
+		{
+			return ((int16_t)(reading + 0.5f));
+		}
+	}
+
+	if (samples == 0)
+	{
+		samples = 1;
+	}
+	uint32_t sum = 0;
+	for (uint8_t count = 0; count < samples; count++)
+	{
+		sum += p_adc->read_once (channel);
+	}
+	return ((int16_t)((sum + samples / 2) / samples));
+}
@@ -33,6 +33,7 @@
 #include "stm32f4xx_tim.h"                  // Header for STM32F4 timer/counters
 #include "taskbase.h"                       // Header for Cal Poly ME405 style tasks
 #include "adc_driver.h"                     // Driver for the A/D converter
+#include "adc_decimator.h"                  // Background oversampling of A/D channels
 #include "dac_driver.h"                     // Driver for digital to analog converter
 #include "sdio_card.h"                      // Header for SD card driver class
 #include "i2c_bitbang.h"                    // Driver for I2C bus driver class
@@ -155,6 +156,11 @@ protected:
 	 */
 	adc_driver* p_adc;
 
+	/** This pointer points to a task which oversamples A/D channels in the 
+	 *  background, or is @c NULL if oversampled readings are taken on request.
+	 */
+	adc_decimator* p_decimator;
+
 	/** This pointer points to a serial port which can be used for debugging. If left
 	 *  at @c NULL, debugging printouts won't take place.
 	 */
@@ -220,6 +226,20 @@ public:
 		return (p_adc->read_once (channel));
 	}
 
+	// Get an oversampled reading of an A/D channel, from the decimator if it has one
+	int16_t read_ADC_oversampled (uint8_t channel, uint8_t samples);
+
+	/** @brief   Use a background decimating filter for oversampled readings.
+	 *  @details Once this is set, oversampled readings of the channels which the 
+	 *           decimator scans are returned at once instead of being taken on 
+	 *           request. Other channels are still read one sample at a time.
+	 *  @param   p_decim A pointer to the decimator task, or @c NULL to stop using one
+	 */
+	void use_decimator (adc_decimator* p_decim)
+	{
+		p_decimator = p_decim;
+	}
+
 	/** @brief   Set the output of the given D/A channel to the given value.
 	 *  @details This method calls the PolyDAQ 2's D/A converter driver, telling it to
 	 *           set the output of one of its channels to the requested value.
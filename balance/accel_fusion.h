@@ -0,0 +1,82 @@
+//**************************************************************************************
+/** @file accel_fusion.h
+ *    This file contains a class which combines the readings of two accelerometers on
+ *    the platform into one reading at the platform's pivot.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _ACCEL_FUSION_H_
+#define _ACCEL_FUSION_H_
+
+#include <math.h>
+#include "acceldata.h"
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Combines two accelerometers into one with lever arm compensation.
+ *  @details An accelerometer which isn't at the platform's pivot also measures the
+ *  platform's rotation: angular acceleration and the centripetal acceleration of 
+ *  spinning both add terms proportional to the distance from the pivot. If the two
+ *  accelerometers are on one line through the pivot, at signed distances @a dA and 
+ *  @a dB along it, the weighted sum with weights @f$ d_B / (d_B - d_A) @f$ and 
+ *  @f$ -d_A / (d_B - d_A) @f$ cancels those terms exactly and leaves the 
+ *  acceleration at the pivot, which is gravity plus the pivot's own motion. With the
+ *  sensors on opposite sides of the pivot both weights are positive and their 
+ *  independent noise is averaged; at equal distances the weights are one half each,
+ *  which cuts the noise by @f$ \sqrt{2} @f$. As this is a sum of simultaneous 
+ *  samples rather than a filter, it adds no lag. If the distances are the same, the 
+ *  sensors are taken to be together and are simply averaged.
+ */
+
+class accel_fusion
+{
+protected:
+	/** @brief The weights given to accelerometers A and B
+	 */
+	float weight_A, weight_B;
+
+public:
+	/** @brief   Make a fusion stage for accelerometers at the given distances.
+	 *  @param   lever_A The signed distance of accelerometer A from the pivot
+	 *  @param   lever_B The signed distance of accelerometer B, in the same units
+	 */
+	accel_fusion (float lever_A, float lever_B)
+	{
+		set_levers (lever_A, lever_B);
+	}
+
+	/** @brief   Set the accelerometers' distances from the pivot.
+	 *  @param   lever_A The signed distance of accelerometer A from the pivot
+	 *  @param   lever_B The signed distance of accelerometer B, in the same units
+	 */
+	void set_levers (float lever_A, float lever_B)
+	{
+		float span = lever_B - lever_A;
+		if (fabsf (span) <= 1e-3f * (fabsf (lever_A) + fabsf (lever_B)))
+		{
+			weight_A = 0.5f;
+			weight_B = 0.5f;
+		}
+		else
+		{
+			weight_A = lever_B / span;
+			weight_B = -lever_A / span;
+		}
+	}
+
+	/** @brief   Combine one simultaneous pair of samples.
+	 *  @param   a The sample from accelerometer A
+	 *  @param   b The sample from accelerometer B
+	 *  @param   fused Set to the acceleration at the pivot on each axis
+	 */
+	void fuse (const accelData& a, const accelData& b, accelData& fused)
+	{
+		for (uint8_t axis = 0; axis < 3; axis++)
+		{
+			fused.data[axis] = weight_A * a.data[axis] + weight_B * b.data[axis];
+		}
+	}
+};
+
+#endif // _ACCEL_FUSION_H_
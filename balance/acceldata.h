@@ -9,6 +9,20 @@
 #ifndef _ACCEL_DATA_H_
 #define _ACCEL_DATA_H_
 
+#include <stdint.h>
+#include "task_table.h"                     // Has the IMU's sampling period
+
+/** @brief   The time in milliseconds over which the controller averages samples.
+ */
+const uint16_t ACCEL_AVERAGE_MS = 25;
+
+/** @brief   The number of recent samples kept in each accelerometer's share.
+ *  @details The controller averages all of them, so there are as many as the IMU 
+ *  takes in @c ACCEL_AVERAGE_MS: five at 5 ms and 25 at 1 ms, which keeps the noise 
+ *  and the delay of the average the same at either rate.
+ */
+const uint8_t ACCEL_BUF_SIZE = ACCEL_AVERAGE_MS / app_tasks[TASK_IMU].period_ms;
+
 /** @brief   Structure to hold X, Y, and Z axis accelerations.
  *  @details data[0] = X-axis acceleration data[1] = Y-axis acceleration
  *  data[2] = Z-axis acceleration
@@ -20,15 +34,15 @@ typedef struct
     float data[3];
 } accelData;
 
-/** @brief   Structure to hold 5 accelData structs
- *  @details The current buffer size used is 5. A larger buffer would allow for the
- *  averaging of more data points from the accelerometer to filter noise
+/** @brief   Structure to hold the @c ACCEL_BUF_SIZE most recent accelData structs
+ *  @details A larger buffer would allow for the averaging of more data points from the
+ *  accelerometer to filter noise
  */
 typedef struct
 {
     /** @brief Buffer of acceleration data
      */
-    accelData accel_buffer[5];
+    accelData accel_buffer[ACCEL_BUF_SIZE];
 }accelBuf;
 
 #endif // _ACCEL_DATA_H_
@@ -0,0 +1,238 @@
+//**************************************************************************************
+/** @file current_loop.cpp
+ *    This file contains the source for the motors' inner current (torque) loops, 
+ *    which run in the A/D interrupt.
+ */
+//**************************************************************************************
+
+#include "current_loop.h"
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Constructor for a current loop.
+ *  @param   amps_per_count_in The current sensor's scaling in amps per A/D count
+ *  @param   zero_counts_in The A/D reading at zero current, or zero if the sensor 
+ *  measures only the magnitude of the current
+ *  @param   max_current_in The current in amps for a torque command of 1.0
+ *  @param   kp_in The proportional gain in effort per amp of error
+ *  @param   ki_in The integral gain in effort per amp-second of accumulated error
+ *  @param   dt_s The time between calls to @c step() in seconds
+ */
+
+current_loop::current_loop (float amps_per_count_in, adc_sample_t zero_counts_in, 
+							float max_current_in, float kp_in, float ki_in, 
+							float dt_s)
+{
+	amps_per_count = amps_per_count_in;
+	zero_counts = zero_counts_in;
+	max_current = max_current_in;
+	kp = kp_in;
+	ki = ki_in;
+	dt = dt_s;
+	integral = 0.0f;
+	effort = 0.0f;
+	setpoint = 0.0f;
+	current = 0.0f;
+	p_shaper = NULL;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set the torque command for the motor.
+ *  @details If a shaping stage has been set, the torque is reshaped by it first.
+ *  @param   torque The torque as a fraction of full current, saturated to -1.0 to 1.0
+ */
+
+void current_loop::set_torque (float torque)
+{
+	if (p_shaper != NULL)
+	{
+		torque = p_shaper->shape (torque);
+	}
+	if (torque > 1.0f)
+	{
+		torque = 1.0f;
+	}
+	else if (torque < -1.0f)
+	{
+		torque = -1.0f;
+	}
+	setpoint = torque * max_current;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set the torque command and the loop's integral to zero.
+ *  @details This is for when the loop hasn't been run for a while, so that it starts
+ *  again from rest rather than from the effort it had then.
+ */
+
+void current_loop::reset (void)
+{
+	setpoint = 0.0f;
+	integral = 0.0f;
+	effort = 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the current loop once.
+ *  @details This method converts a current sample to amps, compares it with the 
+ *  commanded current, and finds a new effort with PI control, saturated to between 
+ *  -1.0 and 1.0. While the output is saturated the integral is not allowed to grow 
+ *  further in the same direction. It is called from the A/D interrupt.
+ *  @param   raw_counts The current sample, or an average of several, in A/D counts
+ *  @return  The effort to be given to the motor, -1.0 to 1.0
+ */
+
+float current_loop::step (float raw_counts)
+{
+	float amps = (raw_counts - zero_counts) * amps_per_count;
+	if (zero_counts == 0 && effort < 0.0f)
+	{
+		amps = -amps;
+	}
+	current = amps;
+
+	float error = setpoint - amps;
+	float new_integral = integral + ki * error * dt;
+	float new_effort = kp * error + new_integral;
+
+	// Saturate, keeping the integral only if it isn't pushing further into the limit
+	if (new_effort > 1.0f)
+	{
+		new_effort = 1.0f;
+		if (new_integral < integral)
+		{
+			integral = new_integral;
+		}
+	}
+	else if (new_effort < -1.0f)
+	{
+		new_effort = -1.0f;
+		if (new_integral > integral)
+		{
+			integral = new_integral;
+		}
+	}
+	else
+	{
+		integral = new_integral;
+	}
+
+	effort = new_effort;
+	return (effort);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Constructor for the pair of current loops.
+ *  @param   motors_in A pointer to the pair of motor drivers, motor A first
+ *  @param   loop_A A pointer to motor A's current loop
+ *  @param   loop_B A pointer to motor B's current loop
+ *  @param   p_adc_in A pointer to the A/D converter which samples the currents
+ *  @param   decimation_in The number of PWM periods' samples averaged each time the
+ *  loops run
+ */
+
+torque_drive::torque_drive (MotorPair* motors_in, current_loop* loop_A, 
+							current_loop* loop_B, adc_driver* p_adc_in, 
+							uint8_t decimation_in)
+{
+	motors = motors_in;
+	p_loop_A = loop_A;
+	p_loop_B = loop_B;
+	p_adc = p_adc_in;
+	decimation = (decimation_in > 0) ? decimation_in : 1;
+	sample_count = 0;
+	sum_A = 0;
+	sum_B = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Start sampling the motor currents and running the current loops.
+ *  @param   channel_A The A/D channel of motor A's current sense output
+ *  @param   channel_B The A/D channel of motor B's current sense output
+ *  @param   trigger The timer event which starts each pair of conversions, such as
+ *  @c ADC_ExternalTrigInjecConv_T3_CC4
+ *  @return  @c true if the A/D was set up, @c false if it wasn't
+ */
+
+bool torque_drive::start (uint8_t channel_A, uint8_t channel_B, uint32_t trigger)
+{
+	uint8_t channels[2] = {channel_A, channel_B};
+
+	return (p_adc->timer_injected_mode (channels, 2, trigger, on_samples, this));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set both motors' torque commands.
+ *  @param   torque_A Motor A's torque as a fraction of full current, -1.0 to 1.0
+ *  @param   torque_B Motor B's torque as a fraction of full current, -1.0 to 1.0
+ */
+
+void torque_drive::set_torques (float torque_A, float torque_B)
+{
+	p_loop_A->set_torque (torque_A);
+	p_loop_B->set_torque (torque_B);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Stop running the current loops from the A/D interrupt.
+ *  @details The currents are still converted, but nothing sets the motors until 
+ *  @c resume() is called, so whoever calls this must set them. This is for times 
+ *  when the interrupt can't be relied on, as when erasing flash stalls it.
+ */
+
+void torque_drive::pause (void)
+{
+	p_adc->set_injected_interrupt (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the current loops again after @c pause().
+ *  @details The loops and the current sums start again from zero, so the motors 
+ *  start from zero torque until the next torque commands are set.
+ */
+
+void torque_drive::resume (void)
+{
+	p_loop_A->reset ();
+	p_loop_B->reset ();
+	sum_A = 0;
+	sum_B = 0;
+	sample_count = 0;
+	p_adc->set_injected_interrupt (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add a pair of current samples, running the loops every few periods.
+ *  @details This function is called by the A/D interrupt once in each PWM period. 
+ *  Efforts written to the motors take effect at the start of the next PWM period.
+ *  @param   p_self A pointer to the @c torque_drive object
+ */
+
+void torque_drive::on_samples (void* p_self)
+{
+	torque_drive* p_drive = (torque_drive*)p_self;
+
+	p_drive->sum_A += p_drive->p_adc->injected (0);
+	p_drive->sum_B += p_drive->p_adc->injected (1);
+
+	if (++(p_drive->sample_count) >= p_drive->decimation)
+	{
+		float scale = 1.0f / p_drive->sample_count;
+		float effort_A = p_drive->p_loop_A->step (p_drive->sum_A * scale);
+		float effort_B = p_drive->p_loop_B->step (p_drive->sum_B * scale);
+		p_drive->motors->set_both (effort_A, effort_B);
+
+		p_drive->sample_count = 0;
+		p_drive->sum_A = 0;
+		p_drive->sum_B = 0;
+	}
+}
@@ -0,0 +1,206 @@
+//**************************************************************************************
+/** @file current_loop.h
+ *    This file contains the headers for the motors' inner current (torque) loops, 
+ *    which run in the A/D interrupt on current samples taken at the same point in 
+ *    every PWM period, so the motors give the torque that is commanded whatever the 
+ *    battery voltage.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _CURRENT_LOOP_H_
+#define _CURRENT_LOOP_H_
+
+#include "adc_driver.h"                     // A/D converter which samples the current
+#include "motorDriver.h"                    // Class for a motor driver
+
+
+/** @brief   Current sense scaling in amps per A/D count.
+ *  @details This is the 3.3 V A/D reference over 4095 counts, divided by the motor 
+ *  driver's current sense output of 0.14 V per amp.
+ */
+const float MOTOR_AMPS_PER_COUNT = 3.3f / 4095.0f / 0.14f;
+
+/** @brief   The motor current which a torque command of 1.0 asks for, in amps.
+ */
+const float MOTOR_MAX_CURRENT = 2.0f;
+
+/** @brief   Current loop proportional gain in effort per amp of error.
+ */
+const float MOTOR_CUR_KP = 0.2f;
+
+/** @brief   Current loop integral gain, a one millisecond time constant.
+ */
+const float MOTOR_CUR_KI = 1000.0f * MOTOR_CUR_KP;
+
+/** @brief   The number of PWM periods whose current samples are averaged for each 
+ *  run of the current loops; at 20 kHz PWM, 4 runs the loops at 5 kHz.
+ */
+const uint8_t MOTOR_CUR_DECIMATE = 4;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   PI loop which makes one motor's current follow a torque command
+ *  @details The torque command is a fraction from -1.0 to 1.0 of @c max_current. The 
+ *  loop compares it with the measured current and finds the effort, from -1.0 to 1.0,
+ *  to give the motor. Since motor torque is proportional to current, the torque 
+ *  doesn't depend on the battery voltage or the motor's speed. If the current sensor 
+ *  only measures magnitude, as most H-bridge sense outputs do, its zero offset is 
+ *  given as zero and the current is taken to have the sign of the last effort.
+ */
+
+class current_loop
+{
+protected:
+	/** @brief Amps per A/D count of the current sensor
+	 */
+	float amps_per_count;
+
+	/** @brief The A/D reading at zero current, or zero for a magnitude-only sensor
+	 */
+	adc_sample_t zero_counts;
+
+	/** @brief The current for a torque command of 1.0, in amps
+	 */
+	float max_current;
+
+	/** @brief Proportional gain in effort per amp of error
+	 */
+	float kp;
+
+	/** @brief Integral gain in effort per amp-second of accumulated error
+	 */
+	float ki;
+
+	/** @brief The time between runs of the loop in seconds
+	 */
+	float dt;
+
+	/** @brief The integral term's present contribution to the effort
+	 */
+	float integral;
+
+	/** @brief The effort most recently found by the loop
+	 */
+	float effort;
+
+	/** @brief The commanded current in amps, written by the motor task
+	 */
+	volatile float setpoint;
+
+	/** @brief The stage which reshapes torque commands, or NULL to use them as given
+	 */
+	ActuationShaper* p_shaper;
+
+	/** @brief The most recently measured current in amps
+	 */
+	volatile float current;
+
+public:
+	/** @brief The constructor saves the sensor scaling and gains
+	 */
+	current_loop (float amps_per_count_in, adc_sample_t zero_counts_in, 
+				  float max_current_in, float kp_in, float ki_in, float dt_s);
+
+	/** @brief Set the torque command as a fraction of full current, -1.0 to 1.0
+	 */
+	void set_torque (float torque);
+
+	/** @brief Reshape torque commands with a shaping stage, or stop with NULL
+	 *  @details Stiction is a deadband in torque, so with the current loop running
+	 *  its compensation belongs here rather than on the effort.
+	 */
+	void set_shaper (ActuationShaper* shaper)
+	{
+		p_shaper = shaper;
+	}
+
+	/** @brief Set the torque command and the loop's integral to zero
+	 */
+	void reset (void);
+
+	/** @brief Run the loop once on a current sample, returning the motor's effort
+	 */
+	float step (float raw_counts);
+
+	/** @brief Get the most recently measured motor current in amps
+	 */
+	float get_current (void)
+	{
+		return (current);
+	}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Runs both motors' current loops from the A/D interrupt
+ *  @details The A/D converts both motors' current sense channels as an injected group
+ *  triggered by the motor PWM timer, so each period's samples are taken at the same 
+ *  point in the PWM cycle. Every interrupt adds the samples to a sum; after 
+ *  @c decimation periods, the loops run on the averages and both motors are set 
+ *  together.
+ */
+
+class torque_drive
+{
+protected:
+	/** @brief A pointer to the pair of motor drivers
+	 */
+	MotorPair* motors;
+
+	/** @brief Current loop for motor A
+	 */
+	current_loop* p_loop_A;
+
+	/** @brief Current loop for motor B
+	 */
+	current_loop* p_loop_B;
+
+	/** @brief A pointer to the A/D converter, whose injected ranks 0 and 1 hold
+	 *  motor A and motor B's current samples
+	 */
+	adc_driver* p_adc;
+
+	/** @brief The number of PWM periods averaged for each run of the loops
+	 */
+	uint8_t decimation;
+
+	/** @brief The number of samples added to the sums so far
+	 */
+	uint8_t sample_count;
+
+	/** @brief Sum of motor A's current samples in A/D counts
+	 */
+	uint32_t sum_A;
+
+	/** @brief Sum of motor B's current samples in A/D counts
+	 */
+	uint32_t sum_B;
+
+	// Run by the A/D interrupt each time both currents have been converted
+	static void on_samples (void* p_self);
+
+public:
+	/** @brief The constructor saves the motors, loops, and A/D converter
+	 */
+	torque_drive (MotorPair* motors_in, current_loop* loop_A, current_loop* loop_B,
+				  adc_driver* p_adc_in, uint8_t decimation_in);
+
+	/** @brief Start current sampling on both motors' channels from a timer trigger
+	 */
+	bool start (uint8_t channel_A, uint8_t channel_B, uint32_t trigger);
+
+	/** @brief Set both motors' torque commands, -1.0 to 1.0
+	 */
+	void set_torques (float torque_A, float torque_B);
+
+	/** @brief Stop running the current loops, leaving the motors as they are
+	 */
+	void pause (void);
+
+	/** @brief Run the current loops again from zero torque
+	 */
+	void resume (void);
+};
+
+#endif // _CURRENT_LOOP_H_
@@ -0,0 +1,123 @@
+//**************************************************************************************
+/** @file gain_schedule.h
+ *    This file contains a lookup table which scales the balance controller's gains
+ *    according to how far the platform is from level. The battery voltage isn't
+ *    measured, as the board has no divider on a free analog pin; should one be added,
+ *    the tables could be given a second axis for it.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _GAIN_SCHEDULE_H_
+#define _GAIN_SCHEDULE_H_
+
+#include <stdint.h>
+#include <math.h>
+
+
+/** @brief   The number of tilt breakpoints in the gain schedule.
+ */
+const uint8_t SCHED_TILTS = 5;
+
+/** @brief   The tilt at the first breakpoint, in mG of error from the setpoint.
+ */
+const float SCHED_TILT_FIRST_MG = 0.0f;
+
+/** @brief   The tilt between breakpoints in mG; 1000 mG is about one radian.
+ */
+const float SCHED_TILT_STEP_MG = 100.0f;
+
+/** @brief   Factors by which the proportional gain is multiplied at each tilt.
+ *  @details Near level the gain is turned down, so the IMU's noise moves the motors
+ *  less, and far from level it's turned up so the platform comes back quickly. The
+ *  current loops keep the torque per unit of effort the same whatever the battery
+ *  voltage, so one set of factors serves whatever charge the pack has left.
+ */
+const float SCHED_KP[SCHED_TILTS] =
+	//  0 mG   100    200    300    400
+	{   0.6f,  0.8f,  1.0f,  1.3f,  1.6f };
+
+/** @brief   Factors by which the integral gain is multiplied at each tilt.
+ *  @details The integral isn't turned up far from level, where it would only wind up.
+ */
+const float SCHED_KI[SCHED_TILTS] =
+	//  0 mG   100    200    300    400
+	{   0.8f,  0.9f,  1.0f,  1.0f,  1.0f };
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Interpolates gain factors from tables over tilt.
+ *  @details The breakpoints are evenly spaced, so the cell in which a tilt falls is
+ *  found by one multiplication rather than by searching, and the factors are 
+ *  interpolated linearly between the cell's two ends. There are no loops, so 
+ *  @c lookup() takes the same time every control cycle whatever the tables' sizes.
+ *  Tilts beyond the tables get the factors at the last breakpoint.
+ */
+
+class gain_schedule
+{
+protected:
+	/** @brief The proportional gain factors, by tilt
+	 */
+	const float* p_kp;
+
+	/** @brief The integral gain factors, by tilt
+	 */
+	const float* p_ki;
+
+	/** @brief   Find the cell in which a value falls and how far across it the value is.
+	 *  @param   value The value, such as a tilt
+	 *  @param   first The value at the first breakpoint
+	 *  @param   step The value between breakpoints
+	 *  @param   points The number of breakpoints
+	 *  @param   fraction Set to how far across the cell the value is, 0.0 to 1.0
+	 *  @return  The index of the breakpoint at the cell's lower edge
+	 */
+	static uint8_t find_cell (float value, float first, float step, uint8_t points,
+							  float& fraction)
+	{
+		float position = (value - first) * (1.0f / step);
+		if (position <= 0.0f)
+		{
+			fraction = 0.0f;
+			return (0);
+		}
+		if (position >= points - 1)
+		{
+			fraction = 1.0f;
+			return (points - 2);
+		}
+		uint8_t index = (uint8_t)position;
+		fraction = position - index;
+		return (index);
+	}
+
+public:
+	/** @brief   Make a schedule from tables of gain factors.
+	 *  @param   kp_table The proportional gain factors, such as @c SCHED_KP
+	 *  @param   ki_table The integral gain factors, such as @c SCHED_KI
+	 */
+	gain_schedule (const float kp_table[SCHED_TILTS] = SCHED_KP,
+				   const float ki_table[SCHED_TILTS] = SCHED_KI)
+	{
+		p_kp = kp_table;
+		p_ki = ki_table;
+	}
+
+	/** @brief   Find the gain factors for a tilt.
+	 *  @param   tilt The tilt from the setpoint in mG; its sign doesn't matter
+	 *  @param   kp_factor Set to the factor for the proportional gain
+	 *  @param   ki_factor Set to the factor for the integral gain
+	 */
+	void lookup (float tilt, float& kp_factor, float& ki_factor)
+	{
+		float across;
+		uint8_t col = find_cell (fabsf (tilt), SCHED_TILT_FIRST_MG, SCHED_TILT_STEP_MG,
+								 SCHED_TILTS, across);
+
+		kp_factor = p_kp[col] + across * (p_kp[col + 1] - p_kp[col]);
+		ki_factor = p_ki[col] + across * (p_ki[col + 1] - p_ki[col]);
+	}
+};
+
+#endif // _GAIN_SCHEDULE_H_
@@ -0,0 +1,151 @@
+//**************************************************************************************
+/** @file handle_feedforward.h
+ *    This file contains a class which estimates how the handle is moving from the
+ *    acceleration at the platform's pivot, so the controller's setpoint can allow for
+ *    it before the feedback sees it as error.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _HANDLE_FEEDFORWARD_H_
+#define _HANDLE_FEEDFORWARD_H_
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Estimates the handle's motion along one axis of the platform.
+ *  @details The platform's pivot is carried by the handle, so the acceleration at the
+ *  pivot from @c accel_fusion is gravity, tilted by the handle's tilt and the
+ *  platform's rotation relative to the handle, plus the handle's own acceleration.
+ *  The platform's rotation relative to the handle is found by integrating its motor's
+ *  speed, and the acceleration it accounts for (1000 mG per radian at small angles) is
+ *  taken away, leaving what the user is doing with the handle. A first order high pass
+ *  filter then removes the handle's steady tilt, which the feedback loop must still
+ *  correct, so the estimate is the handle's recent motion: the jolts and swings which
+ *  otherwise reach the controller only as error. 
+ *
+ *  The integrated rotation would drift without limit from any bias in the speed, and
+ *  a large sum would lose the float resolution needed to add small steps to it, so it
+ *  leaks away with a time constant several times the filter's and is limited to the
+ *  largest rotation the platform can make. A steady bias then leaves only a steady 
+ *  offset, which the filter removes. The estimator should be reset whenever the 
+ *  motors have been stopped or driven by something other than the controller, since
+ *  its rotation no longer matches the platform's.
+ */
+
+class handle_feedforward
+{
+protected:
+	/** @brief The platform's rotation relative to the handle in radians
+	 */
+	float rotation;
+
+	/** @brief The slowly varying part of the handle frame acceleration in mG
+	 */
+	float baseline;
+
+	/** @brief The most recent estimate of the handle's motion in mG
+	 */
+	float estimate;
+
+	/** @brief The high pass filter's coefficient, from its time constant and period
+	 */
+	float alpha;
+
+	/** @brief The fraction of the rotation kept each update, from its leak time
+	 */
+	float keep;
+
+	/** @brief The largest rotation in radians, either way, which is integrated
+	 */
+	float max_rotation;
+
+	/** @brief The time between updates in seconds
+	 */
+	float dt;
+
+	/** @brief Radians of the platform's rotation per motor encoder count
+	 */
+	float rad_per_count;
+
+	/** @brief False until the first update, which starts the filter at its input
+	 */
+	bool started;
+
+public:
+	/** @brief   Make an estimator for one axis.
+	 *  @param   time_constant The high pass filter's time constant in seconds; motion
+	 *           much slower than this is left to the feedback loop
+	 *  @param   leak_time The time constant in seconds with which the integrated 
+	 *           rotation leaks away
+	 *  @param   max_rad The largest rotation relative to the handle in radians
+	 *  @param   period The time between calls to @c update() in seconds
+	 *  @param   counts_per_radian Motor encoder counts per radian of the platform's
+	 *           rotation; negative if the motor's counts run opposite to the tilt
+	 */
+	handle_feedforward (float time_constant, float leak_time, float max_rad, 
+						float period, float counts_per_radian)
+	{
+		alpha = period / (time_constant + period);
+		keep = leak_time / (leak_time + period);
+		max_rotation = max_rad;
+		dt = period;
+		set_counts_per_radian (counts_per_radian);
+		reset ();
+	}
+
+	/** @brief   Set the motor encoder counts per radian of the platform's rotation.
+	 *  @param   counts_per_radian The counts per radian, negative if the counts run
+	 *           opposite to the tilt, or 0 to leave the rotation out of the estimate
+	 */
+	void set_counts_per_radian (float counts_per_radian)
+	{
+		rad_per_count = (counts_per_radian != 0.0f) ? 1.0f / counts_per_radian : 0.0f;
+	}
+
+	/** @brief   Forget the handle's past motion, as when the motors have been stopped.
+	 */
+	void reset (void)
+	{
+		rotation = 0.0f;
+		baseline = 0.0f;
+		estimate = 0.0f;
+		started = false;
+	}
+
+	/** @brief   Update the estimate from one control cycle's measurements.
+	 *  @param   accel The acceleration at the pivot along this axis in mG
+	 *  @param   speed The motor's speed in encoder counts per second
+	 *  @return  The handle's recent motion as acceleration along this axis in mG
+	 */
+	float update (float accel, float speed)
+	{
+		rotation = keep * rotation + speed * dt * rad_per_count;
+		if (rotation > max_rotation)
+		{
+			rotation = max_rotation;
+		}
+		else if (rotation < -max_rotation)
+		{
+			rotation = -max_rotation;
+		}
+		float handle_accel = accel - 1000.0f * rotation;
+		if (!started)
+		{
+			baseline = handle_accel;
+			started = true;
+		}
+		baseline += alpha * (handle_accel - baseline);
+		estimate = handle_accel - baseline;
+		return (estimate);
+	}
+
+	/** @brief   Get the most recent estimate without updating it.
+	 *  @return  The handle's recent motion as acceleration along this axis in mG
+	 */
+	float get_estimate (void)
+	{
+		return (estimate);
+	}
+};
+
+#endif // _HANDLE_FEEDFORWARD_H_
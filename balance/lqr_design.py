@@ -0,0 +1,201 @@
+# Design the balance controller's LQR gains from a linearized model of one axis of the
+# platform and write them to lqr_gains.h as constants for the embedded controller.
+#
+# The model has three states for each axis:
+#     tilt        Platform tilt from level, in radians
+#     tilt_rate   Platform tilt rate, in radians per second
+#     motor_speed Motor speed from the encoder, in counts per second
+# and one input, the controller's output from -1.0 to 1.0, which the motor's velocity
+# loop turns into a speed command of (output * FULL_SPEED_CPS). The velocity loop is
+# modelled as a first order lag. The motor drags the platform towards the tilt rate
+# matching its speed through the drive train, modelled as viscous coupling, and the
+# platform's centre of mass above the axis makes gravity tip it further from level.
+#
+# Usage:  python lqr_design.py [output_file]
+# Only the Python standard library is needed, so this runs on any host with Python.
+
+from __future__ import print_function
+import sys
+import os
+
+
+#--------------------------------------------------------------------------------------
+# Plant parameters; these are estimates and should be replaced by measured values
+
+PLATFORM_INERTIA = 2.0e-3       # Platform moment of inertia about the axis, kg m^2
+GRAVITY_STIFFNESS = 0.05        # Gravity torque per radian of tilt (m g l), N m / rad
+DRIVE_COUPLING = 0.2            # Drive train torque per rad/s of slip, N m s / rad
+COUNTS_PER_RAD = 1000.0         # Encoder counts per radian of platform rotation
+FULL_SPEED_CPS = 20000.0        # Motor speed at full command, counts/s (task_motor.h)
+VELOCITY_LAG_S = 0.05           # Time constant of the motor's velocity loop, s
+CONTROL_DT_S = 0.01             # Controller period, s (task_table.h)
+
+# Weights from Bryson's rule: each state's weight is one over the square of the
+# largest value it should reach, and the input's over the square of full output
+MAX_TILT = 0.05                 # rad
+MAX_TILT_RATE = 1.0             # rad/s
+MAX_MOTOR_SPEED = FULL_SPEED_CPS
+MAX_OUTPUT = 1.0
+
+
+#--------------------------------------------------------------------------------------
+# Small dense matrix helpers; matrices are lists of rows
+
+def mat_mul (a, b):
+	return [[sum (a[i][k] * b[k][j] for k in range (len (b))) 
+			for j in range (len (b[0]))] for i in range (len (a))]
+
+def mat_add (a, b):
+	return [[a[i][j] + b[i][j] for j in range (len (a[0]))] for i in range (len (a))]
+
+def mat_sub (a, b):
+	return [[a[i][j] - b[i][j] for j in range (len (a[0]))] for i in range (len (a))]
+
+def mat_scale (a, s):
+	return [[a[i][j] * s for j in range (len (a[0]))] for i in range (len (a))]
+
+def transpose (a):
+	return [list (row) for row in zip (*a)]
+
+def identity (n):
+	return [[1.0 if i == j else 0.0 for j in range (n)] for i in range (n)]
+
+def inverse (a):
+	"""Invert a square matrix by Gauss-Jordan elimination with partial pivoting."""
+	n = len (a)
+	work = [list (a[i]) + identity (n)[i] for i in range (n)]
+	for col in range (n):
+		pivot = max (range (col, n), key = lambda r: abs (work[r][col]))
+		if abs (work[pivot][col]) < 1e-15:
+			raise ValueError ('Singular matrix')
+		work[col], work[pivot] = work[pivot], work[col]
+		scale = work[col][col]
+		work[col] = [x / scale for x in work[col]]
+		for row in range (n):
+			if row != col:
+				factor = work[row][col]
+				work[row] = [x - factor * y for x, y in zip (work[row], work[col])]
+	return [row[n:] for row in work]
+
+def expm (a):
+	"""Matrix exponential by scaling and squaring with a Taylor series."""
+	norm = max (sum (abs (x) for x in row) for row in a)
+	squarings = 0
+	while norm > 0.5:
+		norm /= 2.0
+		squarings += 1
+	scaled = mat_scale (a, 1.0 / (2 ** squarings))
+	result = identity (len (a))
+	term = identity (len (a))
+	for k in range (1, 20):
+		term = mat_scale (mat_mul (term, scaled), 1.0 / k)
+		result = mat_add (result, term)
+	for _ in range (squarings):
+		result = mat_mul (result, result)
+	return result
+
+
+#--------------------------------------------------------------------------------------
+
+def continuous_model ():
+	"""Return the continuous time state matrix A and input matrix B."""
+	j = PLATFORM_INERTIA
+	a = [[0.0, 1.0, 0.0],
+		 [GRAVITY_STIFFNESS / j, -DRIVE_COUPLING / j, 
+		  DRIVE_COUPLING / (j * COUNTS_PER_RAD)],
+		 [0.0, 0.0, -1.0 / VELOCITY_LAG_S]]
+	b = [[0.0], [0.0], [FULL_SPEED_CPS / VELOCITY_LAG_S]]
+	return a, b
+
+
+def discretize (a, b, dt):
+	"""Zero order hold discretization, from the exponential of [[A, B], [0, 0]] dt."""
+	n = len (a)
+	m = len (b[0])
+	aug = [list (a[i]) + list (b[i]) for i in range (n)] + [[0.0] * (n + m)] * m
+	phi = expm (mat_scale (aug, dt))
+	ad = [row[:n] for row in phi[:n]]
+	bd = [row[n:] for row in phi[:n]]
+	return ad, bd
+
+
+def dlqr (ad, bd, q, r):
+	"""Solve the discrete Riccati equation by iteration and return the gain K."""
+	p = q
+	for _ in range (100000):
+		bt_p = mat_mul (transpose (bd), p)
+		gain = mat_mul (inverse (mat_add (r, mat_mul (bt_p, bd))), mat_mul (bt_p, ad))
+		p_next = mat_add (q, mat_mul (mat_mul (transpose (ad), p), 
+									  mat_sub (ad, mat_mul (bd, gain))))
+		change = max (abs (p_next[i][j] - p[i][j]) 
+					  for i in range (len (p)) for j in range (len (p)))
+		p = p_next
+		if change < 1e-12 * max (1.0, max (abs (x) for row in p for x in row)):
+			return gain
+	raise RuntimeError ('Riccati iteration did not converge')
+
+
+def closed_loop_radius (ad, bd, gain):
+	"""Estimate the spectral radius of A - B K by repeated squaring of its norm."""
+	acl = mat_sub (ad, mat_mul (bd, gain))
+	power = acl
+	for _ in range (10):
+		power = mat_mul (power, power)
+	norm = max (sum (abs (x) for x in row) for row in power)
+	return norm ** (1.0 / 1024)
+
+
+def write_header (filename, gain, radius):
+	names = ['tilt (rad)', 'tilt rate (rad/s)', 'motor speed (counts/s)']
+	with open (filename, 'w') as out:
+		out.write ('//' + '*' * 86 + '\n')
+		out.write ('/** @file lqr_gains.h\n')
+		out.write (' *    This file contains the state feedback gains for the balance '
+				   'controller. It was\n')
+		out.write (' *    written by lqr_design.py; change the model there and run it '
+				   'again rather than\n')
+		out.write (' *    editing this file.\n */\n')
+		out.write ('//' + '*' * 86 + '\n\n')
+		out.write ('// This define prevents this .h file from being included multiple '
+				   'times in a .cpp file\n')
+		out.write ('#ifndef _LQR_GAINS_H_\n#define _LQR_GAINS_H_\n\n')
+		out.write ('#include <stdint.h>\n\n')
+		out.write ('/** @brief   The number of states fed back by the LQR controller.\n'
+				   ' */\n')
+		out.write ('constexpr uint8_t LQR_NUM_STATES = %d;\n\n' % len (gain[0]))
+		out.write ('/** @brief   The controller period the gains were designed for, '
+				   'in seconds.\n */\n')
+		out.write ('constexpr float LQR_DT = %.6gf;\n\n' % CONTROL_DT_S)
+		out.write ('/** @brief   State feedback gains; the output is minus their dot '
+				   'product with the state.\n')
+		out.write (' *  @details The states are ' + ', '.join (names) + '. The\n')
+		out.write (' *  closed loop spectral radius of the design model is %.4f.\n'
+				   % radius)
+		out.write (' */\n')
+		out.write ('constexpr float LQR_K[LQR_NUM_STATES] = {%s};\n\n' 
+				   % ', '.join ('%.6ef' % k for k in gain[0]))
+		out.write ('#endif // _LQR_GAINS_H_\n')
+
+
+#--------------------------------------------------------------------------------------
+
+if __name__ == '__main__':
+	if len (sys.argv) > 1:
+		output_file = sys.argv[1]
+	else:
+		output_file = os.path.join (os.path.dirname (os.path.abspath (__file__)), 
+									'lqr_gains.h')
+
+	a, b = continuous_model ()
+	ad, bd = discretize (a, b, CONTROL_DT_S)
+	q = [[1.0 / MAX_TILT ** 2, 0.0, 0.0],
+		 [0.0, 1.0 / MAX_TILT_RATE ** 2, 0.0],
+		 [0.0, 0.0, 1.0 / MAX_MOTOR_SPEED ** 2]]
+	r = [[1.0 / MAX_OUTPUT ** 2]]
+	gain = dlqr (ad, bd, q, r)
+	radius = closed_loop_radius (ad, bd, gain)
+
+	print ('K =', ', '.join ('%.6g' % k for k in gain[0]))
+	print ('Closed loop spectral radius %.4f' % radius)
+	write_header (output_file, gain, radius)
+	print ('Wrote', output_file)
@@ -0,0 +1,29 @@
+//**************************************************************************************
+/** @file lqr_gains.h
+ *    This file contains the state feedback gains for the balance controller. It was
+ *    written by lqr_design.py; change the model there and run it again rather than
+ *    editing this file.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _LQR_GAINS_H_
+#define _LQR_GAINS_H_
+
+#include <stdint.h>
+
+/** @brief   The number of states fed back by the LQR controller.
+ */
+constexpr uint8_t LQR_NUM_STATES = 3;
+
+/** @brief   The controller period the gains were designed for, in seconds.
+ */
+constexpr float LQR_DT = 0.01f;
+
+/** @brief   State feedback gains; the output is minus their dot product with the state.
+ *  @details The states are tilt (rad), tilt rate (rad/s), motor speed (counts/s). The
+ *  closed loop spectral radius of the design model is 0.8268.
+ */
+constexpr float LQR_K[LQR_NUM_STATES] = {8.028540e+00f, 1.670207e-01f, 2.889001e-04f};
+
+#endif // _LQR_GAINS_H_
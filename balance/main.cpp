@@ -33,10 +33,19 @@
 #include "taskqueue.h"                      // Queues transmit data between tasks
 #include "motorDriver.h"                    // Header for motor class
 #include "task_motor.h"                     // Header for motor task
+#include "quad_counter.h"                   // Encoder counters for the motors
+#include "quad_speed.h"                     // Speed estimates from the encoders
 #include "task_controller.h"                // Header for controller task
 #include "task_imu.h"                       // Header for sensor task
+#include "task_health.h"                    // Header for memory health task
+#include "task_params.h"                    // Serves parameters to a host computer
+#include "sysid.h"                          // System identification experiments
+#include "flash_store.h"                    // Saves parameters in internal flash
+#include "stm32f4xx_flash.h"                // Numbers of the flash sectors
 #include "Balance.h"                        // Header for controller object
 #include "acceldata.h"                      // Header for acceleration data struct
+#include "task_table.h"                     // Task priorities, stacks, and periods
+#include "cyclic_exec.h"                    // Runs periodic jobs from one task
 
 //-------------------------------------------------------------------------------------
 // The pointers in the following section are for shares and queues that transfer data,
@@ -50,25 +59,75 @@
 
 /** @brief   Pointer to a share of the motor A actuation signal.
  *  @details This shared pointer contains the memory address of the motorA actuation
- *           signal.
+ *           signal, an effort from -1.0 to 1.0.
  */
-TaskShare<int16_t>* motor_A_actuation_signal;
+TaskShare<float>* motor_A_actuation_signal;
 
 /** @brief   Pointer to a share of the motor B actuation signal.
  *  @details This shared pointer contains the memory address of the motorB actuation
- *           signal.
+ *           signal, an effort from -1.0 to 1.0.
  */
-TaskShare<int16_t>* motor_B_actuation_signal;
+TaskShare<float>* motor_B_actuation_signal;
 
 /** @brief   Pointer to a share for accelerometer A data.
  *  @details Buffer size 10 of X,Y, and Z axis of accelerometer A
  */
-TaskShare <accelBuf>* accelerometer_A_data;
+StampedShare <accelBuf>* accelerometer_A_data;
 
 /** @brief   Pointer to a share for accelerometer B data.
  *  @details Buffer size 10 of X,Y, and Z axis of accelerometer B
  */
-TaskShare <accelBuf>* accelerometer_B_data;
+StampedShare <accelBuf>* accelerometer_B_data;
+
+/** @brief   Mutex which protects the serial port from being written by two tasks.
+ *  @details The parameter task's replies to the host are framed, and a report from
+ *           another task printed in the middle of one would corrupt it. 
+ */
+SemaphoreHandle_t serial_mutex;
+
+
+#if (USE_CYCLIC_EXECUTIVE == 1)
+//-------------------------------------------------------------------------------------
+// These functions are the jobs run by the cyclic executive. Each is given a pointer to
+// the object on which it works.
+
+/// Read one accelerometer sample
+static void imu_job (void* p_sampler)
+{
+	((imu_sampler*)p_sampler)->sample ();
+}
+
+/// Run a system identification experiment's step after both accelerometers' samples
+static void sysid_job (void* p_sysid)
+{
+	((sysid_exciter*)p_sysid)->step ();
+}
+
+/// Run the balance controller once
+static void controller_job (void* p_runner)
+{
+	((controller_runner*)p_runner)->step ();
+}
+
+/// Run the motors' velocity loops and set both motors on the same PWM edge
+static void motors_job (void* p_runner)
+{
+	((motor_runner*)p_runner)->step ();
+}
+#endif // USE_CYCLIC_EXECUTIVE
+
+
+/// Stop the motors before parameters are saved, since erasing flash stops the CPU
+static void stop_motors (void* p_runner)
+{
+	((motor_runner*)p_runner)->stop ();
+}
+
+/// Let the motors run again once the parameters have been saved
+static void restart_motors (void* p_runner)
+{
+	((motor_runner*)p_runner)->restart ();
+}
 
 
 //-------------------------------------------------------------------------------------
@@ -83,6 +142,11 @@ TaskShare <accelBuf>* accelerometer_B_data;
 
 int main (void)
 {
+	// FreeRTOS needs all the interrupt priority bits to be preemption priority. This
+	// must be done before any driver sets up an interrupt with NVIC_Init(), which 
+	// interprets the priority it's given according to the grouping
+	NVIC_PriorityGroupConfig (NVIC_PriorityGroup_4);
+
 	// Create the serial port which will be used for programing and communicating with PC
 	RS232* usart_2 = new RS232 (USART2, 115200);
 	*usart_2 << endl << clrscr << "FreeRTOS Program on STM32" << endl;
@@ -91,19 +155,23 @@ int main (void)
 
 	/*  This share holds the motor A actuation signal.
 	 */
-	motor_A_actuation_signal = new TaskShare<int16_t> ("MotorA act");
+	motor_A_actuation_signal = new TaskShare<float> (app_shares[SHARE_MOTOR_A].name);
 
     /*  This share holds the motor B actuation signal.
      */
-	motor_B_actuation_signal = new TaskShare<int16_t> ("MotorB act");
+	motor_B_actuation_signal = new TaskShare<float> (app_shares[SHARE_MOTOR_B].name);
 
     /*  Buffer size 10 of X,Y, and Z axis of accelerometer A
      */
-    accelerometer_A_data = new TaskShare <accelBuf> ("Accel A data");
+    accelerometer_A_data = new StampedShare <accelBuf> (app_shares[SHARE_ACCEL_A].name);
 
    /*  Buffer size 10 of X,Y, and Z axis of accelerometer B
     */
-    accelerometer_B_data = new TaskShare <accelBuf> ("Accel B data");
+    accelerometer_B_data = new StampedShare <accelBuf> (app_shares[SHARE_ACCEL_B].name);
+
+	/*  Tasks which write to the serial port take turns with this mutex
+	 */
+	serial_mutex = xSemaphoreCreateMutex ();
 
 	//--------------------------------- Device Drivers --------------------------------
 
@@ -116,23 +184,38 @@ int main (void)
 	accel1->initialize();
 	accel1->active();
 
+	// The second accelerometer is on the same bus with its SA0 pin low, on the other
+	// side of the platform's pivot; if it isn't found, accelerometer A is used alone
+	mma8452q* accel2 = new mma8452q(i2c1, 0x38, usart_2);
+	accel2->initialize();
+	accel2->active();
+
 	// Print statement to serial port to show IMU created if connected correctly
 	*usart_2 << endl << "IMU activated" << endl;
+	if (!accel2->is_working ())
+	{
+		*usart_2 << "Second IMU not found" << endl;
+	}
+
+    // The motor PWM's run at 20 kHz with as many counts per period as the timers can
+    // manage at that frequency, so the motors' effort can be set in fine steps
+    const uint32_t MOTOR_PWM_FREQ = 20000;
+    uint16_t motor_pwm_res = hw_pwm::full_resolution (MOTOR_PWM_FREQ);
 
     // Motor 1 pwm pins configuration
     // pin B5, TIM3 CH2
-    hw_pwm* motor_A_In1 = new hw_pwm (3, 20000, 100);
+    hw_pwm* motor_A_In1 = new hw_pwm (3, MOTOR_PWM_FREQ, motor_pwm_res);
     (*motor_A_In1).activate_pin(GPIOB, 5, TIM_OC2Init, TIM_OC2PreloadConfig);
     // pin B4, TIM3 CH1
-    hw_pwm* motor_A_In2 = new hw_pwm (3, 20000, 100);
+    hw_pwm* motor_A_In2 = new hw_pwm (3, MOTOR_PWM_FREQ, motor_pwm_res);
     (*motor_A_In2).activate_pin(GPIOB, 4, TIM_OC1Init, TIM_OC1PreloadConfig);
     
     // Motor 2 pwm pins configuration
     // pin A0, TIM5 CH1
-    hw_pwm* motor_B_In1 = new hw_pwm (5, 20000, 100);// timers and pins
+    hw_pwm* motor_B_In1 = new hw_pwm (5, MOTOR_PWM_FREQ, motor_pwm_res);// timers and pins
     (*motor_B_In1).activate_pin(GPIOA, 0, TIM_OC1Init, TIM_OC1PreloadConfig); // change pins
     // pin A1, TIM5 CH2
-    hw_pwm* motor_B_In2 = new hw_pwm (5, 20000, 100);// timers and pins
+    hw_pwm* motor_B_In2 = new hw_pwm (5, MOTOR_PWM_FREQ, motor_pwm_res);// timers and pins
     (*motor_B_In2).activate_pin(GPIOA, 1, TIM_OC2Init, TIM_OC2PreloadConfig); // change pins
 
     // Motor drivers
@@ -144,24 +227,157 @@ int main (void)
     Motor* motorB = new Motor(motor_B_In1, motor_B_In2, 1, 2, GPIO_Pin_10,
             GPIOA, RCC_AHB1Periph_GPIOA);
 
+    // Motor B's timer (TIM5) restarts each period on motor A's timer (TIM3) update,
+    // so the pair's new efforts are latched on the same PWM edge
+    if (!motor_B_In1->sync_to_master (motor_A_In1))
+    {
+        *usart_2 << "Motor PWM timers could not be linked" << endl;
+    }
+    MotorPair* motors = new MotorPair (motorA, motorB);
+
+    // Encoders for motor A on TIM4 (B6, B7) and motor B on TIM1 (A8, A9), with speed
+    // estimators and velocity loops which run at the motor task's rate
+    float motor_dt = app_tasks[TASK_MOTORS].period_ms / 1000.0f;
+    quad_speed* speed_A = new quad_speed (new quad_counter (4, 1, 2, usart_2));
+    quad_speed* speed_B = new quad_speed (new quad_counter (1, 1, 2, usart_2));
+    velocity_loop* vel_loop_A = new velocity_loop (speed_A, MOTOR_FULL_SPEED_CPS,
+            MOTOR_VEL_KP, MOTOR_VEL_KI, motor_dt);
+    velocity_loop* vel_loop_B = new velocity_loop (speed_B, MOTOR_FULL_SPEED_CPS,
+            MOTOR_VEL_KP, MOTOR_VEL_KI, motor_dt);
+
+    // Motor currents are sampled on C2 (ADC channel 12) and C3 (channel 13) halfway
+    // through every PWM period, triggered by TIM3's otherwise unused channel 4, and
+    // current loops in the A/D interrupt make the motors' torque follow the efforts
+    float current_dt = (float)MOTOR_CUR_DECIMATE / MOTOR_PWM_FREQ;
+    current_loop* cur_loop_A = new current_loop (MOTOR_AMPS_PER_COUNT, 0, 
+            MOTOR_MAX_CURRENT, MOTOR_CUR_KP, MOTOR_CUR_KI, current_dt);
+    current_loop* cur_loop_B = new current_loop (MOTOR_AMPS_PER_COUNT, 0, 
+            MOTOR_MAX_CURRENT, MOTOR_CUR_KP, MOTOR_CUR_KI, current_dt);
+    torque_drive* torque = new torque_drive (motors, cur_loop_A, cur_loop_B, 
+            new adc_driver (usart_2), MOTOR_CUR_DECIMATE);
+    if (!motor_A_In1->set_adc_trigger (4, motor_pwm_res / 2)
+        || !torque->start (12, 13, ADC_ExternalTrigInjecConv_T3_CC4))
+    {
+        *usart_2 << "Motor current sensing could not be started" << endl;
+        torque = NULL;
+    }
+
+    // Shaping stages make up for the motors' stiction and limit how fast their 
+    // commands change; they act on the torque commands if the current loops run, or
+    // on the efforts if not. Either way they're used once per motor task period
+    const uint8_t deadband_size = sizeof (MOTOR_DEADBAND) / sizeof (MOTOR_DEADBAND[0]);
+    ActuationShaper* shaper_A = new ActuationShaper (MOTOR_DEADBAND, MOTOR_DEADBAND,
+            deadband_size, MOTOR_ZERO_BAND);
+    ActuationShaper* shaper_B = new ActuationShaper (MOTOR_DEADBAND, MOTOR_DEADBAND,
+            deadband_size, MOTOR_ZERO_BAND);
+    shaper_A->set_slew_rate (MOTOR_SLEW_PER_S, motor_dt);
+    shaper_B->set_slew_rate (MOTOR_SLEW_PER_S, motor_dt);
+    if (torque != NULL)
+    {
+        cur_loop_A->set_shaper (shaper_A);
+        cur_loop_B->set_shaper (shaper_B);
+    }
+    else
+    {
+        motorA->set_shaper (shaper_A);
+        motorB->set_shaper (shaper_B);
+    }
+
     //Controller object passed to controller task
     Balance* controller = new Balance();
+    controller->set_speed_sensors (speed_A, speed_B);
 
-	//*********************************************************************************
+    // The controller's gains and setpoints can be read and set from a host computer
+    param_registry* params = new param_registry ();
+    controller->register_params (params);
 
-	//------------------------------------- Tasks -------------------------------------
+    // A host can drive the motors with test signals and record the responses; while
+    // it does, the IMU's task drives the motors instead of the controller
+    sysid_exciter* sysid = new sysid_exciter ();
+    sysid->register_params (params);
+
+    // Time the controller core in each numeric representation, so control_t in
+    // Balance.h can be set to the quickest
+    *usart_2 << "PI core cycles per step: float " << pi_core_cycles<float> (1000)
+             << ", Q15 " << pi_core_cycles<int16_t> (1000) 
+             << ", Q31 " << pi_core_cycles<int32_t> (1000) << endl;
 
-	// This task controls actuation of motorA
-	new task_motor ("Motor_A_task", 1, 240, NULL, motorA);
+	//*********************************************************************************
 
-    // This task controls actuation of motorA
-    new task_motor ("Motor_B_task", 1, 240, NULL, motorB);
+	//------------------------------------- Tasks -------------------------------------
 
-    // This task reads accelerations in X, Y, and Z axis. Only X and Y axis used for this controller
-	new task_imu ("IMU 1 task", 2, 400, NULL, accel1);
+	// The priorities, stack sizes, and periods of these tasks are in task_table.h, 
+	// where the compiler checks them for rate-monotonic order and utilization
+
+#if (USE_CYCLIC_EXECUTIVE == 1)
+	// One task runs the IMU, controller, and motor jobs in that order; the frames in
+	// which each runs are given in task_table.h. Accelerometer B is read right after
+	// A in the same frame, so the controller fuses samples taken together. Each job's
+	// budget is its run time in the task table, which the executive checks
+	CyclicExecutive* p_exec = create_task<CyclicExecutive> (exec_task, usart_2, 
+		(TickType_t)(exec_task.period_ms));
+	imu_sampler* p_sampler = new imu_sampler (accel1, accelerometer_A_data);
+	p_sampler->register_params (params, IMU_A_PARAM_NAMES);
+	p_exec->add ("IMU", imu_job, p_sampler, app_tasks[TASK_IMU].period_ms, 0, 
+				 IMU_READ_WCET_US);
+	imu_sampler* p_sampler_B = new imu_sampler (accel2, accelerometer_B_data, 
+												IMU_B_OFFSETS, IMU_B_SCALES);
+	p_sampler_B->register_params (params, IMU_B_PARAM_NAMES);
+	p_exec->add ("IMU B", imu_job, p_sampler_B, app_tasks[TASK_IMU].period_ms, 0, 
+				 IMU_READ_WCET_US);
+	sysid->set_samplers (p_sampler, p_sampler_B);
+	p_exec->add ("Ident", sysid_job, sysid, app_tasks[TASK_IMU].period_ms, 0, 
+				 IDENT_WCET_US);
+	p_exec->add ("Control", controller_job, 
+				 new controller_runner (controller, params, sysid),
+				 app_tasks[TASK_CONTROLLER].period_ms, EXEC_CONTROL_OFFSET, 
+				 app_tasks[TASK_CONTROLLER].wcet_us);
+	motor_runner* p_motor_runner = new motor_runner (motors, vel_loop_A, vel_loop_B, 
+													 torque);
+	p_exec->add ("Motors", motors_job, p_motor_runner, 
+				 app_tasks[TASK_MOTORS].period_ms, 0, app_tasks[TASK_MOTORS].wcet_us);
+#else
+	// This task controls actuation of both motors
+	motor_runner* p_motor_runner = create_task<task_motor> (app_tasks[TASK_MOTORS], 
+		(emstream*)NULL, motors, vel_loop_A, vel_loop_B, torque)->get_runner ();
+
+	// This task reads accelerations in X, Y, and Z axis from both accelerometers
+	task_imu* p_imu = create_task<task_imu> (app_tasks[TASK_IMU], (emstream*)NULL, 
+											 accel1, accel2, sysid);
+	p_imu->get_sampler (0)->register_params (params, IMU_A_PARAM_NAMES);
+	p_imu->get_sampler (1)->register_params (params, IMU_B_PARAM_NAMES);
 
 	// This task averages acceleration data and uses the controller to determine motor actuation signals
-	new task_controller ("Controller task", 3, 800, usart_2, controller);
+	create_task<task_controller> (app_tasks[TASK_CONTROLLER], usart_2, controller, 
+								  params, sysid);
+
+#endif // USE_CYCLIC_EXECUTIVE
+
+	// Gains and calibrations saved in the top two flash sectors replace the defaults;
+	// they're applied by the controller before it first runs. Saving them stops the
+	// motors first, since the PWM would be left on while a sector is erased
+	flash_store* store = new flash_store ((uint32_t*)0x08040000, FLASH_Sector_6, 
+										  (uint32_t*)0x08060000, FLASH_Sector_7, 
+										  0x20000, usart_2);
+	if (store->begin ())
+	{
+		params->set_store (store);
+		params->set_save_hooks (stop_motors, restart_motors, p_motor_runner);
+		*usart_2 << "Loaded " << params->load () << " saved parameters" << endl;
+	}
+	else
+	{
+		*usart_2 << "Flash parameter store could not be started" << endl;
+	}
+
+	// This task answers a host computer's requests to read and set the parameters
+	create_task<task_params> (app_tasks[TASK_PARAMS], usart_2, params, 
+							  (TickType_t)(app_tasks[TASK_PARAMS].period_ms), sysid);
+
+	// This task prints stack high water marks, suggested stack sizes and heap use
+	// so the stack sizes above can be trimmed to what the tasks really need
+	create_task<task_health> (app_tasks[TASK_HEALTH], usart_2, 
+							  (TickType_t)(app_tasks[TASK_HEALTH].period_ms));
 
 	// Print statement to serial port showing the start of tasks running
     *usart_2 << endl << clrscr << "Scheduler about to run" << endl;
@@ -12,14 +12,121 @@
 #include "motorDriver.h"
 
 
+/** @brief   A register which takes the duty cycles of a motor lead given an invalid
+ *           timer channel, so that they are thrown away rather than written to
+ *           whatever follows the timer's compare registers.
+ */
+static volatile uint32_t unused_ccr;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   The constructor for an actuation shaping stage.
+ *  @details The gains start at 1.0 and the slew rate is not limited.
+ *  @param   fwd_table The deadband offset table for positive commands, or NULL to 
+ *  pass them through unchanged; it must stay in memory while the shaper is used
+ *  @param   rev_table The deadband offset table for negative commands, with positive 
+ *  entries, or NULL to pass them through unchanged
+ *  @param   size The number of entries in each table, at least 2
+ *  @param   zero_band_in Commands with a magnitude below this give zero effort, as does
+ *  a command of zero when this is zero
+ */
+ActuationShaper :: ActuationShaper (const float* fwd_table, const float* rev_table,
+        uint8_t size, float zero_band_in)
+{
+    // A table needs two entries to interpolate between
+    if (size < 2){
+        fwd_table = NULL;
+        rev_table = NULL;
+    }
+    p_fwd_table = fwd_table;
+    p_rev_table = rev_table;
+    table_size = size;
+    zero_band = zero_band_in;
+    fwd_gain = 1.0f;
+    rev_gain = 1.0f;
+    max_step = 0.0f;
+    last_effort = 0.0f;
+}
+
+
+/** @brief   A method which sets the gain for each direction.
+ *  @param   forward The gain for positive commands
+ *  @param   reverse The gain for negative commands
+ */
+void ActuationShaper :: set_gains (float forward, float reverse)
+{
+    fwd_gain = forward;
+    rev_gain = reverse;
+}
+
+
+/** @brief   A method which limits how quickly the effort may change.
+ *  @param   per_second The largest change in effort per second, such as 20.0 to 
+ *  allow going from stopped to full effort in 50 ms, or zero for no limit
+ *  @param   dt_s The time between calls to @c shape() in seconds
+ */
+void ActuationShaper :: set_slew_rate (float per_second, float dt_s)
+{
+    max_step = per_second * dt_s;
+}
+
+
+/** @brief   A method which reshapes a command into an effort.
+ *  @param   command The command from a controller, from -1.0 to 1.0
+ *  @return  The effort to be given to the motor, from -1.0 to 1.0
+ */
+float ActuationShaper :: shape (float command)
+{
+    bool forward = (command >= 0.0f);
+    float magnitude = forward ? command : -command;
+    if (magnitude > 1.0f)
+        magnitude = 1.0f;
+
+    // Look up the effort which gives this much response, interpolating in the table.
+    // A command of zero gives no effort even if the zero band is zero
+    float effort = 0.0f;
+    if (magnitude > 0.0f && magnitude >= zero_band){
+        const float* p_table = forward ? p_fwd_table : p_rev_table;
+        if (p_table != NULL){
+            float position = magnitude * (table_size - 1);
+            uint8_t index = (uint8_t)position;
+            if (index >= table_size - 1)
+                effort = p_table[table_size - 1];
+            else
+                effort = p_table[index] 
+                         + (position - index) * (p_table[index + 1] - p_table[index]);
+        }
+        else
+            effort = magnitude;
+        effort *= forward ? fwd_gain : -rev_gain;
+    }
+
+    // Limit the change from the last effort, then saturate
+    if (max_step > 0.0f){
+        if (effort > last_effort + max_step)
+            effort = last_effort + max_step;
+        else if (effort < last_effort - max_step)
+            effort = last_effort - max_step;
+    }
+    if (effort > 1.0f)
+        effort = 1.0f;
+    else if (effort < -1.0f)
+        effort = -1.0f;
+
+    last_effort = effort;
+    return (effort);
+}
+
+
 //-------------------------------------------------------------------------------------
 /** @brief   The constructor for a Motor object.
  *  @details This constructor initializes the class variables and enables the motors
  *  EN pin
  *  @param   motor_In_1 A hw_pwm pointer which is initialized for one of the motor
- *  leads and has a duty cycle resolution of 100
+ *  leads; any resolution may be used
  *  @param   motor_In_2 A hw_pwm pointer initialized as above for the other motor lead
- *  @param   In_1_chan The channel associated with motor_In_1 for setting the duty cycle
+ *  @param   In_1_chan The channel associated with motor_In_1 for setting the duty cycle,
+ *  from 1 to 4; a lead given any other channel isn't driven
  *  @param   In_2_chan The channel associated with motor_In_2 for setting the duty cycle
  *  @param   EN_pin_num The GPIO_Pin_# for the EN pin
  *  @param   EN_port The GPIOX port for the EN pin where X represents the letter of the pin
@@ -31,10 +138,88 @@ Motor:: Motor(hw_pwm* motor_In_1, hw_pwm* motor_In_2, uint8_t In_1_chan, uint8_t
 {
     // Initialize class variables
     motor_IN1 = motor_In_1;
-    motor_IN2 = motorIn_2;
+    motor_IN2 = motor_In_2;
     IN2_chan = In_2_chan;
     IN1_chan = In_1_chan;
 
+    // Save the compare register addresses and the scaling from actuation signal to
+    // timer counts so that setActuation() only has to multiply and store
+    p_IN1_ccr = motor_IN1->get_ccr_address (IN1_chan);
+    p_IN2_ccr = motor_IN2->get_ccr_address (IN2_chan);
+    if (p_IN1_ccr == NULL)
+    {
+        p_IN1_ccr = &unused_ccr;
+    }
+    if (p_IN2_ccr == NULL)
+    {
+        p_IN2_ccr = &unused_ccr;
+    }
+    max_counts = motor_IN1->get_max_count ();
+    if (motor_IN2->get_max_count () < max_counts)
+    {
+        max_counts = motor_IN2->get_max_count ();
+    }
+    counts_per_unit = ((uint32_t)max_counts << 16) / MOTOR_MAX_PWM;
+    max_counts_float = (float)max_counts;
+    anti_phase = false;
+    p_shaper = NULL;
+
+    enable_pin (EN_pin_num, EN_port, RCC_AHB1Periph);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   The constructor for a Motor driven by one complementary PWM channel.
+ *  @details The PWM's channel must have been set up with 
+ *  @c hw_pwm::activate_complementary_pins(), with the main output going to one motor 
+ *  lead input and the complementary output to the other. One lead is then always 
+ *  driven high while the other is low, apart from the dead time, so the duty cycle 
+ *  sets the average voltage: 0% is full reverse, 50% is stopped, and 100% is full 
+ *  forward. Only one compare register is written for any change, including a change
+ *  of direction.
+ *  @param   motor_pwm A hw_pwm pointer whose channel has complementary outputs
+ *  @param   chan The timer channel of the complementary output pair, from 1 to 4
+ *  @param   EN_pin_num The GPIO_Pin_# for the EN pin
+ *  @param   EN_port The GPIOX port for the EN pin where X represents the letter of the pin
+ *  @param   RCC_AHB1Periph A value associated with initializing the EN pin which uses the
+ *  port.  Ex: RCC_AHB1Periph_GPIOA for EN pin in port A
+ */
+Motor:: Motor(hw_pwm* motor_pwm, uint8_t chan, uint16_t EN_pin_num, 
+        GPIO_TypeDef* EN_port, uint32_t RCC_AHB1Periph)
+{
+    // Both leads come from the same channel
+    motor_IN1 = motor_pwm;
+    motor_IN2 = motor_pwm;
+    IN1_chan = chan;
+    IN2_chan = chan;
+
+    p_IN1_ccr = motor_IN1->get_ccr_address (IN1_chan);
+    if (p_IN1_ccr == NULL)
+    {
+        p_IN1_ccr = &unused_ccr;
+    }
+    p_IN2_ccr = p_IN1_ccr;
+    max_counts = motor_IN1->get_max_count ();
+    counts_per_unit = ((uint32_t)max_counts << 16) / MOTOR_MAX_PWM;
+    max_counts_float = (float)max_counts;
+    anti_phase = true;
+    p_shaper = NULL;
+
+    // Start at 50% duty, which is stopped
+    *p_IN1_ccr = max_counts / 2;
+
+    enable_pin (EN_pin_num, EN_port, RCC_AHB1Periph);
+}
+
+
+/** @brief   A method which sets up the motor driver's EN pin and turns it on.
+ *  @param   EN_pin_num The GPIO_Pin_# for the EN pin
+ *  @param   EN_port The GPIOX port for the EN pin where X represents the letter of the pin
+ *  @param   RCC_AHB1Periph The clock enable value for the EN pin's port
+ */
+void Motor :: enable_pin (uint16_t EN_pin_num, GPIO_TypeDef* EN_port, 
+        uint32_t RCC_AHB1Periph)
+{
     // Initialize Port Clock for Motor EN pin
     RCC_AHB1PeriphClockCmd (RCC_AHB1Periph, ENABLE);
 
@@ -45,35 +230,183 @@ Motor:: Motor(hw_pwm* motor_In_1, hw_pwm* motor_In_2, uint8_t In_1_chan, uint8_t
     GPIO_InitStruct.GPIO_Speed = GPIO_Speed_50MHz; //Speed okay?
     GPIO_InitStruct.GPIO_OType = GPIO_OType_PP; // push pull
     GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_UP; // pull up instead of down/none
-    GPIO_Init (GPIOA, &GPIO_InitStruct);
+    GPIO_Init (EN_port, &GPIO_InitStruct);
 
     // Set EN pin on
+    p_EN_port = EN_port;
+    EN_pin = EN_pin_num;
     GPIO_SetBits(EN_port, EN_pin_num);
 }
 
 
+/** @brief   A method which turns the motor driver on or off with its EN pin.
+ *  @details With EN low the driver's outputs are off whatever the PWM duty cycles 
+ *  are, so this stops the motor even if nothing is updating its duty cycles.
+ *  @param   enabled True to turn the driver on, false to turn it off
+ */
+void Motor :: set_enabled (bool enabled)
+{
+    if (enabled)
+        GPIO_SetBits (p_EN_port, EN_pin);
+    else
+        GPIO_ResetBits (p_EN_port, EN_pin);
+}
+
+
 /** @brief   A method which uses the actuation signal to set a duty cycle.
- *  @details The function saturates the actuation signal to between -100 and 100
- *  meaning that the resolution of the motor_IN objects must be 100.
+ *  @details The function saturates the actuation signal to between -100 and 100 and
+ *  scales it to the PWM resolution with the factor saved by the constructor, then
+ *  writes both compare registers directly. Since compare preload is enabled by 
+ *  @c hw_pwm::activate_pin(), both new values take effect together at the start of
+ *  the next PWM period.
  *  @param   actuationSignal The signed value of duty cycle to be set for the motor.
  *  A positive value will set motor_IN1 and a negative value will set motor_IN2.
  */
 void Motor :: setActuation(int16_t actuationSignal)
 {
-    // Ensure that the actuation signal is below 100% assuming MOTOR_MAX_PWM = 100
-    if (actuationSignal > 100)
-        actuationSignal = 100;
-    if (actuationSignal < -100)
-        actuationSignal = -100;
+    // A shaping stage works on the effort, so use that path
+    if (p_shaper != NULL){
+        set_effort ((float)actuationSignal / MOTOR_MAX_PWM);
+        return;
+    }
 
-    // set up pins of motor for pwm and set pulse width according to actuation signal
-    if (actuationSignal > 0){
-        motor_IN2->set_duty_cycle(IN2_chan, 0);
-        motor_IN1->set_duty_cycle(IN1_chan, actuationSignal);
+    // Ensure that the actuation signal is below 100%
+    if (actuationSignal > MOTOR_MAX_PWM)
+        actuationSignal = MOTOR_MAX_PWM;
+    if (actuationSignal < -MOTOR_MAX_PWM)
+        actuationSignal = -MOTOR_MAX_PWM;
+
+    if (anti_phase){
+        set_effort ((float)actuationSignal / MOTOR_MAX_PWM);
+        return;
+    }
+
+    // Convert the magnitude of the actuation signal to timer counts
+    uint32_t counts = ((uint32_t)(actuationSignal > 0 ? actuationSignal 
+                                                      : -actuationSignal)
+                       * counts_per_unit) >> 16;
+    if (counts > max_counts)
+        counts = max_counts;
+
+    write_counts (actuationSignal > 0, counts);
+}
+
+
+/** @brief   A method which sets the motor effort using the full pwm resolution.
+ *  @details The effort is a fraction of full power, saturated to between -1.0 and 
+ *  1.0, so that the motor can be driven in steps of one timer count rather than one
+ *  percent. In anti-phase mode the effort sets the one compare register, so a change 
+ *  of direction is a single store like any other change. If a shaping stage has been
+ *  set, the effort is reshaped by it first.
+ *  @param   effort The signed fraction of full duty cycle to be set for the motor.
+ *  A positive value will set motor_IN1 and a negative value will set motor_IN2.
+ */
+void Motor :: set_effort (float effort)
+{
+    if (p_shaper != NULL)
+        effort = p_shaper->shape (effort);
+
+    // In anti-phase, -1.0 to 1.0 maps to 0% to 100% duty on the one register
+    if (anti_phase){
+        if (effort > 1.0f)
+            effort = 1.0f;
+        if (effort < -1.0f)
+            effort = -1.0f;
+        *p_IN1_ccr = (uint32_t)((effort + 1.0f) * 0.5f * max_counts_float + 0.5f);
+        return;
+    }
+
+    bool forward = (effort > 0.0f);
+    if (!forward)
+        effort = -effort;
+    if (effort > 1.0f)
+        effort = 1.0f;
+
+    write_counts (forward, (uint32_t)(effort * max_counts_float + 0.5f));
+}
+
+
+/** @brief   A method which writes duty cycle counts to the motor's compare registers.
+ *  @details The count is written to the register for the pin which drives the motor 
+ *  in the chosen direction and the other pin's register is set to zero. Since compare
+ *  preload is enabled, both values take effect at the start of the next PWM period.
+ *  @param   forward True to drive motor_IN1, false to drive motor_IN2
+ *  @param   counts The duty cycle in timer counts, no more than @c max_counts
+ */
+void Motor :: write_counts (bool forward, uint32_t counts)
+{
+    // set pulse width of motor pins according to actuation signal
+    if (forward){
+        *p_IN2_ccr = 0;
+        *p_IN1_ccr = counts;
     }
     else{
-        motor_IN1->set_duty_cycle(IN1_chan, 0);
-        motor_IN2->set_duty_cycle(IN2_chan, -1 * actuationSignal);
+        *p_IN1_ccr = 0;
+        *p_IN2_ccr = counts;
     }
+}
 
+
+/** @brief   A method which holds back new duty cycles for both of the motor's pins.
+ *  @details Until @c release_updates() is called, values written to the compare 
+ *  registers are not used by the timer, so both pins can be changed together.
+ */
+void Motor :: hold_updates (void)
+{
+    motor_IN1->hold_updates ();
+    motor_IN2->hold_updates ();
+}
+
+
+/** @brief   A method which lets held duty cycles take effect.
+ *  @details The new duty cycles are used from the start of the next PWM period.
+ */
+void Motor :: release_updates (void)
+{
+    motor_IN1->release_updates ();
+    motor_IN2->release_updates ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   The constructor for a pair of motors which are updated together.
+ *  @param   p_A A pointer to the first motor
+ *  @param   p_B A pointer to the second motor
+ */
+MotorPair :: MotorPair (Motor* p_A, Motor* p_B)
+{
+    p_motor_A = p_A;
+    p_motor_B = p_B;
+}
+
+
+/** @brief   A method which sets both motors' efforts to take effect together.
+ *  @details Updates of both motors' timers are held while the four compare registers
+ *  are written and then released, so all the new duty cycles are latched at the same
+ *  timer update event. The release of the two timers is a few instructions apart, 
+ *  far less than one PWM period, so an update can only split them if it falls in 
+ *  those few instructions.
+ *  @param   effort_A The effort, from -1.0 to 1.0, for the first motor
+ *  @param   effort_B The effort, from -1.0 to 1.0, for the second motor
+ */
+void MotorPair :: set_both (float effort_A, float effort_B)
+{
+    p_motor_A->hold_updates ();
+    p_motor_B->hold_updates ();
+
+    p_motor_A->set_effort (effort_A);
+    p_motor_B->set_effort (effort_B);
+
+    p_motor_A->release_updates ();
+    p_motor_B->release_updates ();
+}
+
+
+/** @brief   A method which turns both motor drivers on or off with their EN pins.
+ *  @param   enabled True to turn the drivers on, false to turn them off
+ */
+void MotorPair :: set_enabled (bool enabled)
+{
+    p_motor_A->set_enabled (enabled);
+    p_motor_B->set_enabled (enabled);
 }
@@ -2,8 +2,12 @@
 /** @file motorDriver.h
  *    This file contains a class for a motor driver which uses two pwm pins and an
  *    enable pin to control a motor.  The actuation signal is saturated to between
- *    100 and -100 which corresponds to a forwards and backwards 100% duty cycle.
- *    Pwm signal is only output from one pin at a time (other pin is 0% duty cycle)
+ *    100 and -100 which corresponds to a forwards and backwards 100% duty cycle; an
+ *    effort between -1.0 and 1.0 may be given instead to use the full resolution of
+ *    the pwm. Pwm signal is only output from one pin at a time (other pin is 0% duty
+ *    cycle), or a complementary channel of an advanced timer drives the two pins in 
+ *    anti-phase with hardware dead time. An optional shaping stage compensates for 
+ *    the motor's deadband and limits how fast the effort may change
  */
 
 #ifndef MOTORDRIVER_H
@@ -11,6 +15,68 @@
 
 #include "hw_pwm.h"               // Header for pwm driver for motor pins
 
+/** @brief The magnitude of the actuation signal which gives 100% duty cycle
+ */
+const int16_t MOTOR_MAX_PWM = 100;
+
+
+/** @brief   Reshapes a motor command to make up for stiction and uneven response.
+ *  @details Stiction makes small efforts produce no motion at all, so a controller 
+ *  asking for a small correction gets nothing until its integral builds up, and then
+ *  too much; around the setpoint this becomes a limit cycle. This stage maps each 
+ *  command magnitude through a deadband offset table for its direction, so that the
+ *  smallest nonzero command already gives the effort at which the motor breaks away.
+ *  Entry @c i of a table is the effort for a command magnitude of @c i/(size-1), with
+ *  linear interpolation between entries; entry zero is the breakaway effort and the 
+ *  last is normally 1.0. Commands smaller than the zero band give zero effort, so that
+ *  noise doesn't kick the motor back and forth across its deadband. The result is 
+ *  then scaled by a per-direction gain, for motors that run faster one way than the 
+ *  other, and its change per call can be limited to a slew rate. 
+ */
+class ActuationShaper
+{
+protected:
+    /** @brief Deadband offset table for positive commands, or NULL for none
+     */
+    const float* p_fwd_table;
+    /** @brief Deadband offset table for negative commands, or NULL for none
+     */
+    const float* p_rev_table;
+    /** @brief The number of entries in each table
+     */
+    uint8_t table_size;
+    /** @brief Commands whose magnitude is below this give zero effort
+     */
+    float zero_band;
+    /** @brief Gain applied to positive commands
+     */
+    float fwd_gain;
+    /** @brief Gain applied to negative commands
+     */
+    float rev_gain;
+    /** @brief The largest change of effort per call, or zero for no limit
+     */
+    float max_step;
+    /** @brief The effort returned by the previous call
+     */
+    float last_effort;
+public:
+    /** @brief The constructor saves the deadband offset tables and zero band
+     */
+    ActuationShaper (const float* fwd_table, const float* rev_table, uint8_t size,
+            float zero_band_in);
+    /** @brief Set the gains for each direction
+     */
+    void set_gains (float forward, float reverse);
+    /** @brief Limit how fast the effort may change, or turn the limit off with zero
+     */
+    void set_slew_rate (float per_second, float dt_s);
+    /** @brief Reshape one command, from -1.0 to 1.0, into an effort
+     */
+    float shape (float command);
+};
+
+
 class Motor
 {
 protected:
@@ -26,13 +92,97 @@ protected:
     /** @brief The timer channel for the second pwm pin
      */
     uint8_t IN2_chan;
+    /** @brief The output compare register which sets the first pin's duty cycle
+     */
+    volatile uint32_t* p_IN1_ccr;
+    /** @brief The output compare register which sets the second pin's duty cycle
+     */
+    volatile uint32_t* p_IN2_ccr;
+    /** @brief Timer counts per unit of actuation signal, times 65536
+     */
+    uint32_t counts_per_unit;
+    /** @brief The largest count which may be written to either compare register
+     */
+    uint16_t max_counts;
+    /** @brief The largest count as a float, for scaling an effort to timer counts
+     */
+    float max_counts_float;
+    /** @brief True if one complementary channel drives both leads in anti-phase
+     */
+    bool anti_phase;
+    /** @brief The stage which reshapes each effort, or NULL to use efforts as given
+     */
+    ActuationShaper* p_shaper;
+    /** @brief The port of the motor driver's EN pin
+     */
+    GPIO_TypeDef* p_EN_port;
+    /** @brief The GPIO_Pin_# of the motor driver's EN pin
+     */
+    uint16_t EN_pin;
+    /** @brief Write the duty cycle counts for one direction, turning the other off
+     */
+    void write_counts (bool forward, uint32_t counts);
+    /** @brief Set up and turn on the motor driver's EN pin
+     */
+    void enable_pin (uint16_t EN_pin_num, GPIO_TypeDef* EN_port, uint32_t RCC_AHB1Periph);
 public:
     /** @brief The constructor which initializes class variables and sets the EN pin
      */
     Motor(hw_pwm* motor_IN1, hw_pwm* motor_IN2, uint8_t In_1_chan, uint8_t In_2_chan,
             uint16_t EN_pin_num, GPIO_TypeDef* EN_port, uint32_t RCC_AHB1Periph);
+    /** @brief The constructor for a motor driven by one complementary pwm channel
+     */
+    Motor(hw_pwm* motor_pwm, uint8_t chan, uint16_t EN_pin_num, GPIO_TypeDef* EN_port,
+            uint32_t RCC_AHB1Periph);
     /** @brief The function that saturates and sets the duty cycle for the motor
      */
     void setActuation(int16_t actuationSignal);
+    /** @brief The function that sets the motor effort from -1.0 to 1.0 at full resolution
+     */
+    void set_effort (float effort);
+    /** @brief Reshape all efforts with a shaping stage, or stop reshaping with NULL
+     */
+    void set_shaper (ActuationShaper* shaper)
+    {
+        p_shaper = shaper;
+    }
+    /** @brief Hold new duty cycles back until @c release_updates() is called
+     */
+    void hold_updates (void);
+    /** @brief Let held duty cycles take effect at the end of the PWM period
+     */
+    void release_updates (void);
+    /** @brief Turn the motor driver on or off with its EN pin
+     */
+    void set_enabled (bool enabled);
+};
+
+
+/** @brief   Two motors whose new efforts always take effect on the same PWM edge.
+ *  @details The two motors' timers must have been linked with 
+ *  @c hw_pwm::sync_to_master() so that their PWM periods start together. Then 
+ *  @c set_both() holds the updates of both timers, writes both motors' compare 
+ *  registers, and releases the updates, so both motors get their new efforts at the 
+ *  start of the same PWM period rather than whenever each happened to be written.
+ */
+class MotorPair
+{
+protected:
+    /** @brief The first motor, such as the one on the master timer
+     */
+    Motor* p_motor_A;
+    /** @brief The second motor, such as the one on the slave timer
+     */
+    Motor* p_motor_B;
+public:
+    /** @brief The constructor saves pointers to the two motors
+     */
+    MotorPair (Motor* p_A, Motor* p_B);
+    /** @brief Set both motors' efforts so they take effect together
+     */
+    void set_both (float effort_A, float effort_B);
+    /** @brief Turn both motor drivers on or off with their EN pins
+     */
+    void set_enabled (bool enabled);
 };
 #endif
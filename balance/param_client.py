@@ -0,0 +1,203 @@
+# Read and set the balance controller's parameters over its serial port while it
+# runs, using the binary protocol in param_registry.h.
+#
+# Usage:  python param_client.py PORT                  List all parameters
+#         python param_client.py PORT NAME             Show one parameter
+#         python param_client.py PORT NAME VALUE       Set one parameter
+#         python param_client.py PORT --save           Save all parameters in flash
+#         python param_client.py PORT --sysid SIGNAL AMPLITUDE MOTORS [FILE]
+#                                                      Run a system identification
+#                                                      experiment and save it as CSV
+# SIGNAL is prbs, chirp, or step; AMPLITUDE is a fraction of full effort; MOTORS is 1
+# for motor A, 2 for motor B, or 3 for both. The recording, described in sysid.h, is
+# saved in FILE (default sysid.csv). Requires pySerial.
+
+from __future__ import print_function
+import sys
+import time
+import struct
+import zlib
+import serial
+
+
+SYNC_REQUEST = 0xA5
+SYNC_REPLY = 0x5A
+
+CMD_COUNT = 1
+CMD_INFO = 2
+CMD_GET = 3
+CMD_SET = 4
+CMD_SAVE = 5
+
+TYPES = ['float', 'int32', 'uint8', 'bool', 'int16']
+STATUS = ['OK', 'no such parameter', 'out of bounds', 'bad command', 'save failed']
+
+SIGNALS = ['none', 'prbs', 'chirp', 'step']
+SYSID_DUMP_MAGIC = 0x44495953
+SYSID_MAX_RECORDS = 1024
+
+
+#--------------------------------------------------------------------------------------
+
+def request (port, command, payload = b''):
+	"""Send a request and return the reply's status and payload after the status.
+	Text which the program prints on the same port is skipped; a reply which is 
+	garbled by text printed in the middle of it is retried."""
+	body = bytearray ([command, len (payload)]) + bytearray (payload)
+	frame = bytearray ([SYNC_REQUEST]) + body + bytearray ([(-sum (body)) & 0xFF])
+
+	for _ in range (3):
+		port.reset_input_buffer ()
+		port.write (frame)
+		while True:
+			byte = port.read (1)
+			if len (byte) == 0:
+				break
+			if bytearray (byte)[0] != SYNC_REPLY:
+				continue
+			header = bytearray (port.read (2))
+			if len (header) < 2 or header[0] != (command | 0x80):
+				continue
+			rest = bytearray (port.read (header[1] + 1))
+			if len (rest) == header[1] + 1 and (sum (header) + sum (rest)) & 0xFF == 0:
+				return rest[0], bytes (rest[1:-1])
+	raise IOError ('No reply from the controller')
+
+
+def value_bytes (type_index, value):
+	"""Pack a value as four little-endian bytes for the parameter's type."""
+	if TYPES[type_index] == 'float':
+		return struct.pack ('<f', float (value))
+	if TYPES[type_index] in ('int32', 'int16'):
+		return struct.pack ('<i', int (value))
+	return struct.pack ('<I', int (value))
+
+
+def value_from_bytes (type_index, data):
+	"""Unpack a value from four little-endian bytes for the parameter's type."""
+	if TYPES[type_index] == 'float':
+		return struct.unpack ('<f', data)[0]
+	if TYPES[type_index] in ('int32', 'int16'):
+		return struct.unpack ('<i', data)[0]
+	return struct.unpack ('<I', data)[0]
+
+
+def read_table (port):
+	"""Return a list of (name, type index, min, max) for every parameter."""
+	status, data = request (port, CMD_COUNT)
+	table = []
+	for index in range (bytearray (data)[0]):
+		status, data = request (port, CMD_INFO, bytearray ([index]))
+		type_index = bytearray (data)[1]
+		low, high = struct.unpack ('<ff', data[2:10])
+		table.append ((data[10:].decode ('ascii'), type_index, low, high))
+	return table
+
+
+def show (port, table, index):
+	name, type_index, low, high = table[index]
+	status, data = request (port, CMD_GET, bytearray ([index]))
+	print ('%-12s %-6s %-12g [%g, %g]' % (name, TYPES[type_index], 
+		   value_from_bytes (type_index, data[1:5]), low, high))
+
+
+def set_value (port, table, name, value):
+	"""Set a parameter by name, raising an error if the controller refuses."""
+	index = [entry[0] for entry in table].index (name)
+	payload = bytearray ([index]) + value_bytes (table[index][1], value)
+	status, data = request (port, CMD_SET, payload)
+	if status != 0:
+		raise ValueError ('Set %s: %s' % (name, STATUS[status]))
+
+
+def read_dump (port, table):
+	"""Ask for a system identification dump and return its header words and records.
+	A dump which is garbled by text printed on the same port fails its CRC and is
+	asked for again."""
+	for _ in range (3):
+		set_value (port, table, 'id_dump', 1)
+		found = bytearray ()
+		while found[-4:] != bytearray (struct.pack ('<I', SYSID_DUMP_MAGIC)):
+			byte = port.read (1)
+			if len (byte) == 0:
+				break
+			found += bytearray (byte)
+		else:
+			header = bytearray (struct.pack ('<I', SYSID_DUMP_MAGIC)) \
+					 + bytearray (port.read (12))
+			if len (header) < 16:
+				continue
+			words = struct.unpack ('<4I', bytes (header))
+			count, size = words[1] & 0xFFFF, words[1] >> 16
+			data = bytearray (port.read (count * size))
+			crc = bytearray (port.read (4))
+			if len (data) == count * size and len (crc) == 4 \
+					and struct.unpack ('<I', bytes (crc))[0] \
+					== zlib.crc32 (bytes (header + data)) & 0xFFFFFFFF:
+				records = [struct.unpack ('<8h', bytes (data[start:start + 16]))
+						   for start in range (0, count * size, size)]
+				return words, records
+	raise IOError ('No good dump from the controller')
+
+
+def run_sysid (port, signal, amplitude, motors, file_name):
+	"""Run a system identification experiment and save its recording as CSV."""
+	table = read_table (port)
+	set_value (port, table, 'id_signal', SIGNALS.index (signal))
+	set_value (port, table, 'id_amp', amplitude)
+	set_value (port, table, 'id_motors', motors)
+	set_value (port, table, 'id_start', 1)
+
+	# A full dump takes about a second and a half to send at 115200 baud
+	port.timeout = 3.0
+
+	# The period isn't known until the first dump, so wait until a dump says it's done
+	while True:
+		time.sleep (1.0)
+		words, records = read_dump (port, table)
+		if not words[2] & 0x100:
+			break
+		print ('Recorded %d of %d samples' % (len (records), SYSID_MAX_RECORDS))
+
+	period = words[3] * 1e-6
+	with open (file_name, 'w') as csv:
+		csv.write ('time,effort_A,effort_B,ax_A,ay_A,az_A,ax_B,ay_B,az_B\n')
+		for number, record in enumerate (records):
+			csv.write ('%.6f,%.5f,%.5f,%d,%d,%d,%d,%d,%d\n' % ((number * period,
+					   record[0] / 32767.0, record[1] / 32767.0) + record[2:]))
+	print ('Saved %d samples at %g ms in %s' % (len (records), period * 1000.0, 
+		   file_name))
+
+
+#--------------------------------------------------------------------------------------
+
+if __name__ == '__main__':
+	if len (sys.argv) < 2:
+		print ('Usage: python param_client.py PORT [NAME [VALUE]]')
+		sys.exit (1)
+
+	port = serial.Serial (sys.argv[1], 115200, timeout = 0.5)
+	if sys.argv[2:] == ['--save']:
+		# Saving may have to erase a flash sector, which takes a second or two
+		port.timeout = 3.0
+		status, data = request (port, CMD_SAVE)
+		print ('Save: %s' % STATUS[status])
+		sys.exit (0)
+	if sys.argv[2:3] == ['--sysid'] and len (sys.argv) >= 6:
+		run_sysid (port, sys.argv[3], float (sys.argv[4]), int (sys.argv[5]), 
+				   sys.argv[6] if len (sys.argv) > 6 else 'sysid.csv')
+		sys.exit (0)
+
+	table = read_table (port)
+	names = [entry[0] for entry in table]
+
+	if len (sys.argv) == 2:
+		for index in range (len (table)):
+			show (port, table, index)
+	else:
+		index = names.index (sys.argv[2])
+		if len (sys.argv) > 3:
+			payload = bytearray ([index]) + value_bytes (table[index][1], sys.argv[3])
+			status, data = request (port, CMD_SET, payload)
+			print ('Set %s: %s' % (sys.argv[2], STATUS[status]))
+		show (port, table, index)
@@ -0,0 +1,125 @@
+//**************************************************************************************
+/** @file pi_core.h
+ *    This file contains a PI controller core which can be compiled for float, Q15, or
+ *    Q31 numbers, so the balance controller can use whichever is quickest while giving
+ *    the same results to within the fixed point resolution.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _PI_CORE_H_
+#define _PI_CORE_H_
+
+#include "fixed_point.h"                    // Float, Q15, and Q31 arithmetic
+#include "cycle_count.h"                    // For timing the core's step
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Proportional-integral controller core for one numeric representation.
+ *  @details The error input and the output are normalized to between -1.0 and 1.0, so
+ *  the caller divides its error by the error's full scale and multiplies the output by 
+ *  the actuator's. The integral is kept as its contribution to the output, which 
+ *  saturates at the output's limits, so it can't wind up past them. @c T is @c float,
+ *  @c int16_t for Q15, or @c int32_t for Q31; the gains are given as floats and 
+ *  converted once by @c set_gains().
+ */
+
+template <class T> class pi_core
+{
+protected:
+	/** @brief The arithmetic for this core's numeric representation
+	 */
+	typedef fixed_traits<T> num;
+
+	/** @brief Output per unit of normalized error
+	 */
+	scaled_gain<T> kp;
+
+	/** @brief Integral output added per step per unit of normalized error
+	 */
+	scaled_gain<T> ki_dt;
+
+	/** @brief The integral term's present contribution to the output
+	 */
+	T integral;
+
+public:
+	/** @brief The constructor makes a core with zero gains
+	 */
+	pi_core (void)
+	{
+		set_gains (0.0f, 0.0f, 0.0f);
+	}
+
+	/** @brief   Set the gains and reset the integral.
+	 *  @param   kp_in Proportional gain, in output per unit of normalized error
+	 *  @param   ki_in Integral gain, in output per unit of normalized error-seconds
+	 *  @param   dt_s The time between calls to @c step() in seconds
+	 *  @param   keep_integral True to keep the integral, which is in output units, so
+	 *           that gains can be changed while running without a jump in the output
+	 */
+	void set_gains (float kp_in, float ki_in, float dt_s, bool keep_integral = false)
+	{
+		kp = num::make_gain (kp_in);
+		ki_dt = num::make_gain (ki_in * dt_s);
+		if (!keep_integral)
+		{
+			integral = num::from_float (0.0f);
+		}
+	}
+
+	/** @brief   Run the controller once.
+	 *  @param   error The normalized error, from -1.0 to 1.0 in this core's numbers
+	 *  @return  The normalized output, from -1.0 to 1.0
+	 */
+	T step (T error)
+	{
+		integral = num::add (integral, num::mul (error, ki_dt));
+		return (num::add (num::mul (error, kp), integral));
+	}
+
+	/** @brief   Run the controller once on float values, converting at each end.
+	 *  @param   error The normalized error, from -1.0 to 1.0
+	 *  @return  The normalized output, from -1.0 to 1.0
+	 */
+	float step_float (float error)
+	{
+		return (num::to_float (step (num::from_float (error))));
+	}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Measure the average time taken by one step of a PI core.
+ *  @details A core with typical gains is stepped over a sweep of errors, including 
+ *  conversion from and to float as the balance controller does, and the average 
+ *  number of CPU cycles per step is returned. The DWT cycle counter is turned on if 
+ *  it isn't already.
+ *  @param   steps The number of steps to time
+ *  @return  The average number of CPU cycles per step
+ */
+
+template <class T> uint32_t pi_core_cycles (uint16_t steps)
+{
+	pi_core<T> core;
+	core.set_gains (3.0f, 2.0f, 0.01f);
+
+	// The result is kept in a volatile so the optimizer can't drop the steps
+	volatile float output = 0.0f;
+	float error = -0.5f;
+	float increment = 1.0f / steps;
+
+	cycle_count_enable ();
+	uint32_t start = cycle_count ();
+	for (uint16_t count = 0; count < steps; count++)
+	{
+		output = core.step_float (error);
+		error += increment;
+	}
+	uint32_t cycles = cycle_count () - start;
+	(void)output;
+
+	return (cycles / steps);
+}
+
+#endif // _PI_CORE_H_
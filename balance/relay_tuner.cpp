@@ -0,0 +1,151 @@
+//**************************************************************************************
+/** @file relay_tuner.cpp
+ *    This file contains the source for a relay feedback experiment which measures a
+ *    control loop's ultimate gain and period and finds PI gains from them.
+ */
+//**************************************************************************************
+
+#include <math.h>
+#include "relay_tuner.h"
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Constructor for a relay feedback auto-tuner.
+ *  @param   relay_amplitude The size of the relay output, which should be large 
+ *  enough to give an oscillation well above the noise but small enough to be safe
+ *  @param   error_hysteresis How far the error must cross zero before the relay 
+ *  switches; this should be a little larger than the noise in the error
+ *  @param   cycles The number of oscillation cycles to measure, after a first one 
+ *  which is ignored while the oscillation settles
+ *  @param   timeout_s The time in seconds after which the experiment is abandoned
+ *  @param   dt_s The time between calls to @c step() in seconds
+ */
+
+relay_tuner::relay_tuner (float relay_amplitude, float error_hysteresis, 
+						  uint8_t cycles, float timeout_s, float dt_s)
+{
+	amplitude = relay_amplitude;
+	hysteresis = error_hysteresis;
+	cycles_to_measure = cycles;
+	timeout_steps = (uint32_t)(timeout_s / dt_s);
+	dt = dt_s;
+	state = RELAY_IDLE;
+	output = 0.0f;
+	ultimate_gain = 0.0f;
+	ultimate_period = 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Start a new relay feedback experiment.
+ *  @details The previous results are discarded. The relay starts out positive.
+ */
+
+void relay_tuner::start (void)
+{
+	state = RELAY_RUNNING;
+	output = amplitude;
+	steps = 0;
+	last_rise = 0;
+	rises = 0;
+	max_error = -HUGE_VALF;
+	min_error = HUGE_VALF;
+	period_total = 0;
+	peak_total = 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the relay feedback experiment for one period.
+ *  @details This method switches the relay when the error crosses zero by more than
+ *  the hysteresis. Each switch from negative to positive ends a cycle of the 
+ *  oscillation; the cycle's length and the error's peak to peak size are added to
+ *  totals, except for the first cycle. When enough cycles have been measured, the 
+ *  ultimate gain is found from the describing function of a relay with hysteresis, 
+ *  @f$ K_u = 4 d / (\pi \sqrt{a^2 - \epsilon^2}) @f$, where @a d is the relay 
+ *  amplitude, @a a is half the peak to peak error, and @f$ \epsilon @f$ is the 
+ *  hysteresis.
+ *  @param   error The control error, setpoint minus measurement
+ *  @return  The controller output: the relay output while the experiment runs, zero
+ *  if it has finished or failed
+ */
+
+float relay_tuner::step (float error)
+{
+	if (state != RELAY_RUNNING)
+	{
+		return (0.0f);
+	}
+
+	if (++steps > timeout_steps)
+	{
+		state = RELAY_FAILED;
+		return (0.0f);
+	}
+
+	if (error > max_error)
+	{
+		max_error = error;
+	}
+	if (error < min_error)
+	{
+		min_error = error;
+	}
+
+	if (output > 0.0f && error < -hysteresis)
+	{
+		output = -amplitude;
+	}
+	else if (output < 0.0f && error > hysteresis)
+	{
+		output = amplitude;
+
+		// The first cycle starts at the first rise and is ignored while the 
+		// oscillation settles; each later rise ends a measured cycle
+		if (rises > 1)
+		{
+			period_total += steps - last_rise;
+			peak_total += max_error - min_error;
+		}
+		last_rise = steps;
+		max_error = -HUGE_VALF;
+		min_error = HUGE_VALF;
+
+		if (++rises > cycles_to_measure + 1)
+		{
+			float half_peak = peak_total / (2.0f * cycles_to_measure);
+			float radicand = half_peak * half_peak - hysteresis * hysteresis;
+			if (radicand <= 0.0f)
+			{
+				state = RELAY_FAILED;
+				return (0.0f);
+			}
+			ultimate_gain = 4.0f * amplitude / ((float)M_PI * sqrtf (radicand));
+			ultimate_period = (float)period_total * dt / cycles_to_measure;
+			state = RELAY_DONE;
+			return (0.0f);
+		}
+	}
+	return (output);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find PI controller gains from the results of the experiment.
+ *  @details The Ziegler-Nichols rules give a proportional gain of 0.45 times the 
+ *  ultimate gain and an integral time of the ultimate period divided by 1.2.
+ *  @param   kp Set to the proportional gain, in controller output per unit of error
+ *  @param   ki Set to the integral gain, in output per unit of error per second
+ *  @return  True if the experiment finished and the gains were set, false if not
+ */
+
+bool relay_tuner::get_pi_gains (float& kp, float& ki)
+{
+	if (state != RELAY_DONE)
+	{
+		return (false);
+	}
+	kp = 0.45f * ultimate_gain;
+	ki = kp * 1.2f / ultimate_period;
+	return (true);
+}
@@ -0,0 +1,135 @@
+//**************************************************************************************
+/** @file relay_tuner.h
+ *    This file contains the header for a relay feedback experiment which measures a
+ *    control loop's ultimate gain and period and finds PI gains from them.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _RELAY_TUNER_H_
+#define _RELAY_TUNER_H_
+
+#include <stdint.h>
+
+
+/** @brief   States of a relay feedback experiment.
+ */
+typedef enum relay_tune_state
+{
+	RELAY_IDLE,                             ///< Not started
+	RELAY_RUNNING,                          ///< Oscillating and measuring
+	RELAY_DONE,                             ///< Finished; the results are valid
+	RELAY_FAILED                            ///< No steady oscillation before timeout
+} relay_tune_state_t;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Relay feedback (Astrom-Hagglund) auto-tuner for one control axis
+ *  @details While the experiment runs, the tuner takes the controller's place: each
+ *  call to @c step() returns plus or minus the relay amplitude depending on the sign
+ *  of the error, with some hysteresis so that noise doesn't make the relay chatter. 
+ *  Most plants then settle into an oscillation at the frequency where the loop's 
+ *  phase lag is 180 degrees. The tuner measures the period and the peak to peak size
+ *  of the error over several cycles, ignoring the first while the oscillation 
+ *  settles, and from them finds the ultimate gain, at which a proportional 
+ *  controller would just oscillate. Ziegler-Nichols rules turn these into PI gains.
+ *  The class only does arithmetic, so it runs the same way against a plant model on 
+ *  a host computer as it does on the microcontroller.
+ */
+
+class relay_tuner
+{
+protected:
+	/** @brief The relay output's size, in the controller's output units
+	 */
+	float amplitude;
+
+	/** @brief The error beyond which the relay switches, in the error's units
+	 */
+	float hysteresis;
+
+	/** @brief The number of oscillation cycles which are measured
+	 */
+	uint8_t cycles_to_measure;
+
+	/** @brief The number of steps after which the experiment fails
+	 */
+	uint32_t timeout_steps;
+
+	/** @brief The time between calls to @c step() in seconds
+	 */
+	float dt;
+
+	/** @brief The present state of the experiment
+	 */
+	relay_tune_state_t state;
+
+	/** @brief The present relay output
+	 */
+	float output;
+
+	/** @brief The number of steps since the experiment started
+	 */
+	uint32_t steps;
+
+	/** @brief The step at which the relay last switched from negative to positive
+	 */
+	uint32_t last_rise;
+
+	/** @brief The number of times the relay has switched from negative to positive
+	 */
+	uint8_t rises;
+
+	/** @brief The largest and smallest errors since the last rising switch
+	 */
+	float max_error, min_error;
+
+	/** @brief Totals of the measured cycles' periods in steps and peak to peak errors
+	 */
+	uint32_t period_total;
+	float peak_total;
+
+	/** @brief The measured ultimate gain and period in seconds
+	 */
+	float ultimate_gain, ultimate_period;
+
+public:
+	// The constructor saves the experiment's settings
+	relay_tuner (float relay_amplitude, float error_hysteresis, uint8_t cycles, 
+				 float timeout_s, float dt_s);
+
+	// Start a new experiment
+	void start (void);
+
+	// Run the experiment once, returning the controller output
+	float step (float error);
+
+	// Find PI gains from the measured ultimate gain and period
+	bool get_pi_gains (float& kp, float& ki);
+
+	/** @brief   Get the present state of the experiment.
+	 *  @return  The state, which is @c RELAY_DONE when the results can be used
+	 */
+	relay_tune_state_t get_state (void)
+	{
+		return (state);
+	}
+
+	/** @brief   Get the measured ultimate gain.
+	 *  @return  The ultimate gain, in controller output per unit of error
+	 */
+	float get_ultimate_gain (void)
+	{
+		return (ultimate_gain);
+	}
+
+	/** @brief   Get the measured ultimate period.
+	 *  @return  The ultimate period in seconds
+	 */
+	float get_ultimate_period (void)
+	{
+		return (ultimate_period);
+	}
+};
+
+#endif // _RELAY_TUNER_H_
@@ -33,10 +33,12 @@
 #include "emstream.h"                       // Base class for byte stream classes
 #include "adc_driver.h"                     // Has ADC queue size
 #include "taskshare.h"                      // Include definitions of shared variable
+#include "stampedshare.h"                   // Shares with sequence numbers and time
 #include "taskqueue.h"                      // and queue classes
 #include "textqueue.h"                      // Queues that only carry text
 #include "logger_config.h"                  // Data logger configuration parser
 #include "acceldata.h"                      // structures for accelerometer data
+#include "semphr.h"                         // Mutex for the serial port
 
 
 
@@ -47,21 +49,26 @@
 // declared exactly once, without the keyword 'extern', in one .cpp file as well as 
 // being declared extern here. 
 
-/*  Value of actuation signal calculated by control loop to be passed to the motorA
+/*  Effort from -1.0 to 1.0 calculated by control loop to be passed to the motorA
  */
-extern TaskShare<int16_t>* motor_A_actuation_signal;
+extern TaskShare<float>* motor_A_actuation_signal;
 
-/*  Value of actuation signal calculated by control loop to be passed to the motorB
+/*  Effort from -1.0 to 1.0 calculated by control loop to be passed to the motorB
  */
 
-extern TaskShare<int16_t>* motor_B_actuation_signal;
+extern TaskShare<float>* motor_B_actuation_signal;
 
 /*  Buffer size 10 of X,Y, and Z axis of accelerometer A
  */
-extern TaskShare <accelBuf>* accelerometer_A_data;
+extern StampedShare <accelBuf>* accelerometer_A_data;
 
 /*  Buffer size 10 of X,Y, and Z axis of accelerometer B
  */
-extern TaskShare <accelBuf>* accelerometer_B_data;
+extern StampedShare <accelBuf>* accelerometer_B_data;
+
+/*  Mutex which a task holds while it writes to the serial port once the scheduler 
+ *  runs, so that replies to the host and reports from other tasks don't interleave
+ */
+extern SemaphoreHandle_t serial_mutex;
 
 #endif // _SHARES_H_
@@ -0,0 +1,305 @@
+//**************************************************************************************
+/** @file sysid.cpp
+ *    This file contains the source for a system identification experiment which drives
+ *    the motors with a test signal and records the accelerometers' responses.
+ */
+//**************************************************************************************
+
+#include <math.h>
+#include "sysid.h"
+#include "shares.h"                         // The motors' actuation signals
+#include "task_table.h"                     // Has the IMU's period
+#include "flash_store.h"                    // Has the CRC used for dumps
+
+/* The recording is kept in a static array rather than on the RTOS heap, which
+ * couldn't spare this much.
+ */
+static sysid_record_t records[SYSID_MAX_RECORDS];
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Convert a number to an @c int16_t, limiting it to the type's range.
+ *  @param   value The number to be converted
+ *  @return  The nearest @c int16_t
+ */
+
+static int16_t to_int16 (float value)
+{
+	if (value > 32767.0f)
+	{
+		return (32767);
+	}
+	if (value < -32768.0f)
+	{
+		return (-32768);
+	}
+	return ((int16_t)lroundf (value));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create a system identification exciter.
+ *  @details The exciter is called at the IMU's rate, after its samplers.
+ *  @param   p_A The sampler of accelerometer A, or NULL to give it later
+ *  @param   p_B The sampler of accelerometer B, or NULL to give it later
+ */
+
+sysid_exciter::sysid_exciter (imu_sampler* p_A, imu_sampler* p_B)
+{
+	p_sampler_A = p_A;
+	p_sampler_B = p_B;
+	dt = app_tasks[TASK_IMU].period_ms / 1000.0f;
+	signal = SYSID_PRBS;
+	amplitude = 0.2f;
+	motors = 3;
+	start_request = false;
+	stop_request = false;
+	dump_request = false;
+	tilt_limit = SYSID_TILT_LIMIT_MG;
+	running_signal = SYSID_NONE;
+	running = false;
+	aborted = false;
+	count = 0;
+	lfsr = 0x1FF;
+	phase = 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Give the exciter the samplers whose data it records.
+ *  @param   p_A The sampler of accelerometer A
+ *  @param   p_B The sampler of accelerometer B, or NULL if there is none
+ */
+
+void sysid_exciter::set_samplers (imu_sampler* p_A, imu_sampler* p_B)
+{
+	p_sampler_A = p_A;
+	p_sampler_B = p_B;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add the experiment's settings to a parameter registry.
+ *  @details The flags which start and stop an experiment and dump its record aren't 
+ *  saved in flash with the other settings.
+ *  @param   p_params The registry to which the settings are added
+ */
+
+void sysid_exciter::register_params (param_registry* p_params)
+{
+	p_params->add ("id_signal", &signal, SYSID_PRBS, SYSID_STEP);
+	p_params->add ("id_amp", &amplitude, 0.0f, SYSID_MAX_AMPLITUDE);
+	p_params->add ("id_motors", &motors, 1, 3);
+	p_params->add ("id_tilt", &tilt_limit, 50.0f, 1000.0f);
+	p_params->add ("id_start", &start_request, false);
+	p_params->add ("id_stop", &stop_request, false);
+	p_params->add ("id_dump", &dump_request, false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Start an experiment with the signal set up by the host.
+ *  @details The old recording is discarded and the signal generators start again, so
+ *  each experiment with the same settings drives the motors the same way. Without
+ *  accelerometer A's sampler there would be nothing to record and no tilt to watch,
+ *  so no experiment is started.
+ */
+
+void sysid_exciter::start (void)
+{
+	if (p_sampler_A == NULL)
+	{
+		return;
+	}
+	running_signal = signal;
+	lfsr = 0x1FF;
+	phase = 0.0f;
+	count = 0;
+	aborted = false;
+	stop_request = false;
+	running = true;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Compute the test signal's next value.
+ *  @details The PRBS comes from a 9 bit maximal length shift register, so it repeats
+ *  every 511 bits, each held for @c SYSID_PRBS_HOLD samples. The chirp's frequency
+ *  rises linearly over the recording. The step comes a tenth of the way through the
+ *  recording, so the platform's starting state is recorded too.
+ *  @return  The effort, from -1.0 to 1.0
+ */
+
+float sysid_exciter::next_input (void)
+{
+	switch (running_signal)
+	{
+		case SYSID_PRBS:
+			if (count % SYSID_PRBS_HOLD == 0)
+			{
+				uint16_t feedback = ((lfsr >> 8) ^ (lfsr >> 4)) & 1;
+				lfsr = ((lfsr << 1) | feedback) & 0x1FF;
+			}
+			return ((lfsr & 1) ? amplitude : -amplitude);
+
+		case SYSID_CHIRP:
+		{
+			float end_hz = 0.25f / dt;
+			if (end_hz > SYSID_CHIRP_END_HZ)
+			{
+				end_hz = SYSID_CHIRP_END_HZ;
+			}
+			float freq = SYSID_CHIRP_START_HZ
+						 + (end_hz - SYSID_CHIRP_START_HZ) * count / SYSID_MAX_RECORDS;
+			float input = amplitude * sinf (phase);
+			phase += 2.0f * (float)M_PI * freq * dt;
+			if (phase > 2.0f * (float)M_PI)
+			{
+				phase -= 2.0f * (float)M_PI;
+			}
+			return (input);
+		}
+
+		case SYSID_STEP:
+			return ((count < SYSID_MAX_RECORDS / 10) ? 0.0f : amplitude);
+
+		default:
+			return (0.0f);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check whether the experiment must be stopped before the buffer is full.
+ *  @details The host may ask for a stop, and the platform mustn't be driven past the
+ *  tilt limit; accelerometer A's X and Y readings are nearly the tilts in mG.
+ *  @return  True if the experiment must stop now
+ */
+
+bool sysid_exciter::must_stop (void)
+{
+	if (stop_request)
+	{
+		stop_request = false;
+		return (true);
+	}
+	const accelData& latest = p_sampler_A->get_latest ();
+	return (fabsf (latest.data[0]) > tilt_limit || fabsf (latest.data[1]) > tilt_limit);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Drive the motors and record one sample if an experiment is running.
+ *  @details This must be called right after the IMU's samplers, in the same task, so
+ *  the newest samples are the ones just taken. The effort recorded with each sample
+ *  is the one which has been driving the motors since the sample before, so the
+ *  response to each effort starts in the next record. A motor which isn't being 
+ *  driven by the test signal is held at zero effort. When the recording is full, or
+ *  when @c must_stop() says so, both motors are stopped and the controller takes 
+ *  over again.
+ */
+
+void sysid_exciter::step (void)
+{
+	if (start_request)
+	{
+		start_request = false;
+		start ();
+	}
+	if (!running)
+	{
+		stop_request = false;
+		return;
+	}
+	if (must_stop ())
+	{
+		motor_A_actuation_signal->put (0.0f);
+		motor_B_actuation_signal->put (0.0f);
+		aborted = true;
+		running = false;
+		return;
+	}
+
+	sysid_record_t& record = records[count];
+	record.effort[0] = to_int16 (motor_A_actuation_signal->get () * 32767.0f);
+	record.effort[1] = to_int16 (motor_B_actuation_signal->get () * 32767.0f);
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		record.accel_A[axis] = (p_sampler_A == NULL) ? 0
+							   : to_int16 (p_sampler_A->get_latest ().data[axis]);
+		record.accel_B[axis] = (p_sampler_B == NULL) ? 0
+							   : to_int16 (p_sampler_B->get_latest ().data[axis]);
+	}
+
+	float input = next_input ();
+	count++;
+	if (count >= SYSID_MAX_RECORDS)
+	{
+		input = 0.0f;
+		running = false;
+	}
+	motor_A_actuation_signal->put ((motors & 1) ? input : 0.0f);
+	motor_B_actuation_signal->put ((motors & 2) ? input : 0.0f);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check whether the host has asked for a dump.
+ *  @return  True if a dump has been asked for since this was last called
+ */
+
+bool sysid_exciter::take_dump_request (void)
+{
+	if (dump_request)
+	{
+		dump_request = false;
+		return (true);
+	}
+	return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Send bytes of a dump and add them to its CRC.
+ *  @param   ser_dev The serial device on which the bytes are sent
+ *  @param   p_data A pointer to the bytes
+ *  @param   length The number of bytes
+ *  @param   crc The CRC so far, which is updated
+ */
+
+void sysid_exciter::send (emstream& ser_dev, const void* p_data, uint16_t length,
+						  uint32_t& crc)
+{
+	const uint8_t* p_byte = (const uint8_t*)p_data;
+	for (uint16_t index = 0; index < length; index++)
+	{
+		ser_dev.putchar (p_byte[index]);
+	}
+	crc = flash_store::crc32 (p_data, length, crc);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Send the recording in binary.
+ *  @details The format is described with @c sysid_exciter. If an experiment is still
+ *  running, the records taken so far are sent. The Cortex-M4 is little-endian, so the
+ *  numbers are sent as they are in memory.
+ *  @param   ser_dev The serial device on which the dump is sent
+ */
+
+void sysid_exciter::dump (emstream& ser_dev)
+{
+	uint16_t records_sent = count;
+	uint32_t header[4] =
+	{
+		SYSID_DUMP_MAGIC,
+		records_sent | ((uint32_t)sizeof (sysid_record_t) << 16),
+		(uint32_t)running_signal | (running ? 0x100U : 0U) | (aborted ? 0x200U : 0U),
+		(uint32_t)app_tasks[TASK_IMU].period_ms * 1000U
+	};
+	uint32_t crc = 0;
+
+	send (ser_dev, header, sizeof (header), crc);
+	send (ser_dev, records, records_sent * sizeof (sysid_record_t), crc);
+	send (ser_dev, &crc, sizeof (crc), crc);
+}
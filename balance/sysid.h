@@ -0,0 +1,207 @@
+//**************************************************************************************
+/** @file sysid.h
+ *    This file contains the header for a system identification experiment which drives
+ *    the motors with a test signal and records the accelerometers' responses, so that
+ *    a model of the platform can be fitted on a host computer.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _SYSID_H_
+#define _SYSID_H_
+
+#include <stdint.h>
+#include "emstream.h"                       // Serial device for the dump
+#include "param_registry.h"                 // The experiment is set up by parameters
+#include "task_imu.h"                       // Has the samplers whose data is recorded
+
+
+/** @brief   Test signals with which the motors can be driven.
+ */
+typedef enum sysid_signal
+{
+	SYSID_NONE = 0,                         ///< No signal chosen
+	SYSID_PRBS = 1,                         ///< Pseudo-random binary sequence
+	SYSID_CHIRP = 2,                        ///< Sine wave sweeping up in frequency
+	SYSID_STEP = 3                          ///< Zero, then a step to the amplitude
+} sysid_signal_t;
+
+/** @brief   The number of samples recorded in one experiment.
+ *  @details Each takes 16 bytes of RAM. At the IMU's 5 ms period this is about five
+ *  seconds, and at 1 ms (see @c USE_HIGH_RATE_CONTROL) about one second.
+ */
+const uint16_t SYSID_MAX_RECORDS = 1024;
+
+/** @brief   Number of samples for which each bit of the PRBS is held.
+ */
+const uint8_t SYSID_PRBS_HOLD = 2;
+
+/** @brief   Frequency at which the chirp starts, in Hz.
+ */
+const float SYSID_CHIRP_START_HZ = 0.2f;
+
+/** @brief   Highest frequency to which the chirp sweeps, in Hz; it sweeps to a quarter
+ *           of the sample rate if that's lower.
+ */
+const float SYSID_CHIRP_END_HZ = 20.0f;
+
+/** @brief   The largest test signal, as a fraction of full effort, which a host may
+ *           set with "id_amp".
+ */
+const float SYSID_MAX_AMPLITUDE = 0.5f;
+
+/** @brief   Default tilt, as accelerometer A's X or Y reading in mG, at which an 
+ *           experiment is stopped; about 20 degrees.
+ */
+const float SYSID_TILT_LIMIT_MG = 350.0f;
+
+/** @brief   The first four bytes of a dump, which spell "SYID".
+ */
+const uint32_t SYSID_DUMP_MAGIC = 0x44495953;
+
+
+/** @brief   One recorded sample.
+ *  @details The efforts are Q15 numbers, so 32767 is full effort forward, and the
+ *  accelerations are in mG.
+ */
+typedef struct sysid_record
+{
+	int16_t effort[2];                      ///< Efforts given to motors A and B
+	int16_t accel_A[3];                     ///< Accelerometer A's X, Y, Z
+	int16_t accel_B[3];                     ///< Accelerometer B's X, Y, Z
+} sysid_record_t;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Drives the motors with a test signal and records the IMU's response.
+ *  @details A host sets up an experiment through the parameters "id_signal" (a
+ *  @c sysid_signal_t), "id_amp" (the signal's size as a fraction of full effort), and
+ *  "id_motors" (1 for motor A, 2 for motor B, or 3 for both), and starts it by
+ *  setting "id_start" to 1. @c step() is called right after each pair of IMU samples
+ *  is taken; while the experiment runs it puts the next value of the test signal into
+ *  the chosen motors' shares and records it with the newest samples from both
+ *  accelerometers, so the inputs and responses are recorded at the full sensor rate
+ *  and line up sample for sample. A motor which isn't chosen is held at zero effort.
+ *  The balance controller leaves the motors alone while @c is_running() is true, and
+ *  starts again from rest afterwards. When the buffer is full, both motors are 
+ *  stopped. They're also stopped and the experiment ended early if the host sets 
+ *  "id_stop" to 1, or if accelerometer A's X or Y reading goes past "id_tilt" mG.
+ *
+ *  Setting "id_dump" to 1 asks for the recording to be sent in binary; the parameter
+ *  task sends it with @c dump(). A dump starts with four little-endian 32 bit words:
+ *  @c SYSID_DUMP_MAGIC; the number of records plus 65536 times the size of a record;
+ *  the signal, plus 256 if the experiment is still running and 512 if it was stopped
+ *  early; and the sample period in microseconds. The records follow, and then the 
+ *  CRC-32 of the header and records as computed by @c flash_store::crc32(). Other 
+ *  tasks may print text on the same port, so a dump whose CRC doesn't match should 
+ *  be asked for again.
+ */
+
+class sysid_exciter
+{
+protected:
+	/** @brief The samplers of accelerometers A and B, whose newest samples are recorded
+	 */
+	imu_sampler* p_sampler_A;
+
+	/** @brief The sampler of accelerometer B
+	 */
+	imu_sampler* p_sampler_B;
+
+	/** @brief The time between calls to @c step() in seconds
+	 */
+	float dt;
+
+	/** @brief The test signal chosen by the host, a @c sysid_signal_t
+	 */
+	uint8_t signal;
+
+	/** @brief The test signal's size as a fraction of full effort
+	 */
+	float amplitude;
+
+	/** @brief Which motors are driven: bit 0 for motor A, bit 1 for motor B
+	 */
+	uint8_t motors;
+
+	/** @brief Set by the host to start an experiment
+	 */
+	bool start_request;
+
+	/** @brief Set by the host to stop an experiment early
+	 */
+	bool stop_request;
+
+	/** @brief Set by the host to ask for a dump
+	 */
+	bool dump_request;
+
+	/** @brief Accelerometer A's X or Y reading in mG past which an experiment stops
+	 */
+	float tilt_limit;
+
+	/** @brief The signal of the experiment which is running or was run last
+	 */
+	uint8_t running_signal;
+
+	/** @brief True while an experiment is running
+	 */
+	volatile bool running;
+
+	/** @brief True if the last experiment was stopped before the buffer was full
+	 */
+	bool aborted;
+
+	/** @brief The number of samples recorded in this experiment
+	 */
+	volatile uint16_t count;
+
+	/** @brief The PRBS generator's shift register
+	 */
+	uint16_t lfsr;
+
+	/** @brief The chirp's phase in radians
+	 */
+	float phase;
+
+	// Start an experiment with the signal set up by the host
+	void start (void);
+
+	// Compute the test signal's next value
+	float next_input (void);
+
+	// Check whether the experiment must be stopped early
+	bool must_stop (void);
+
+	// Send bytes of the dump and add them to its CRC
+	void send (emstream& ser_dev, const void* p_data, uint16_t length, uint32_t& crc);
+
+public:
+	// The constructor makes an exciter which records from the given samplers
+	sysid_exciter (imu_sampler* p_A = NULL, imu_sampler* p_B = NULL);
+
+	// Give the exciter the samplers whose data it records
+	void set_samplers (imu_sampler* p_A, imu_sampler* p_B);
+
+	// Add the experiment's settings to a parameter registry
+	void register_params (param_registry* p_params);
+
+	// Drive the motors and record one sample if an experiment is running
+	void step (void);
+
+	// Check whether the host has asked for a dump; the request is cleared
+	bool take_dump_request (void);
+
+	// Send the recording in binary
+	void dump (emstream& ser_dev);
+
+	/** @brief   Check whether an experiment is driving the motors.
+	 *  @return  True while the controller must leave the motors alone
+	 */
+	bool is_running (void)
+	{
+		return (running);
+	}
+};
+
+#endif // _SYSID_H_
@@ -16,6 +16,109 @@
 //**************************************************************************************
 
 #include "task_controller.h"
+#include "task_table.h"                      // Has this task's period
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Constructor for a controller runner.
+ *  @details This constructor saves a pointer to the controller and sets the 
+ *           controller's proportional and integral gains.
+ *  @param   balance_controller A pointer to a Balance controller used to call functions
+ *  to determine the actuation signal
+ *  @param   p_params_in A pointer to the registry of the controller's parameters, 
+ *  whose new values are applied before each run of the controller, or NULL if none
+ *  @param   p_sysid_in A pointer to a system identification exciter, during whose runs
+ *  the controller leaves the motors alone, or NULL if there is none
+ */
+
+controller_runner::controller_runner (Balance* balance_controller, 
+									  param_registry* p_params_in,
+									  sysid_exciter* p_sysid_in)
+{
+	controller = balance_controller;
+	p_params = p_params_in;
+	p_sysid = p_sysid_in;
+	last_sequence = 0;
+	missed_updates = 0;
+	stale_stops = 0;
+	stopped = true;
+
+	// Input proportional and integral gains
+	controller->set_gains();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the controller once if new accelerometer data has arrived.
+ *  @details This method runs the controller only when the IMU has written new
+ *           accelerometer data since the previous call. If the data is older than
+ *           @c ACCEL_STALE_MS, both motors are commanded to zero. Parameters which a
+ *           host has set since the last run are applied first, so each run sees a 
+ *           consistent set of them. While a system identification run is driving the
+ *           motors, the controller isn't run at all. Whenever the motors have been 
+ *           stopped or driven by the identification run, the controller is reset 
+ *           with @c Balance::reset() before it runs again, as its integrals and its
+ *           estimate of the handle's motion no longer match the platform.
+ */
+
+void controller_runner::step (void)
+{
+	if (p_params != NULL && p_params->apply_pending ())
+	{
+		controller->apply_params ();
+	}
+	if (p_sysid != NULL && p_sysid->is_running ())
+	{
+		stopped = true;
+		return;
+	}
+
+	// Accelerometer B is read just after A, so once A has new data B has too; if B 
+	// isn't delivering, accelerometer A is used alone
+	if (accelerometer_A_data->get_if_newer (buffer, last_sequence))
+	{
+		if (stopped)
+		{
+			controller->reset ();
+			stopped = false;
+		}
+		if (accelerometer_B_data->is_stale (ACCEL_STALE_MS))
+		{
+			controller->convert(buffer);   // Averages the recent acceleration values
+		}
+		else
+		{
+			controller->convert(buffer, accelerometer_B_data->get ());
+		}
+		controller->set_setpoint();         // Feeds the handle's motion forward
+		controller->control();           	// Applies PI control to output actuation
+	}
+	else
+	{
+		missed_updates++;
+
+		// Old data means the IMU task has stalled, so don't leave the motors on
+		if (accelerometer_A_data->is_stale (ACCEL_STALE_MS))
+		{
+			motor_A_actuation_signal->put (0.0f);
+			motor_B_actuation_signal->put (0.0f);
+			stopped = true;
+			stale_stops++;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print the number of missed updates and stale data stops.
+ *  @param   ser_dev A reference to the serial device on which to print the counts
+ */
+
+void controller_runner::print_counts (emstream& ser_dev)
+{
+	ser_dev << PMS ("no new data: ") << missed_updates
+			<< PMS (", stale stops: ") << stale_stops;
+}
 
 
 //-------------------------------------------------------------------------------------
@@ -28,34 +131,66 @@
  *  @param   serpt A pointer to a serial device on which debugging messages are shown
  *  @param   balance_controller A pointer to a Balance controller used to call functions
  *  to determine the actuation signal
+ *  @param   p_params A pointer to the registry of the controller's parameters, or NULL
+ *  @param   p_sysid A pointer to a system identification exciter, or NULL if none
  */
 
 task_controller::task_controller (const char* p_name, unsigned portBASE_TYPE prio, size_t stacked,
-					  emstream* serpt, Balance* balance_controller)
-	: TaskBase (p_name, prio, stacked, serpt)
+					  emstream* serpt, Balance* balance_controller, 
+					  param_registry* p_params, sysid_exciter* p_sysid)
+	: TaskBase (p_name, prio, stacked, serpt), 
+	  runner (balance_controller, p_params, p_sysid)
 {
-	controller = balance_controller;
+	reporting_autotune = false;
 }
 
 //-------------------------------------------------------------------------------------
 /** @brief   The run method that calculates the actuation signal of motors x and y.
- *  @details This method
+ *  @details This method runs the controller once each period; see 
+ *           @c controller_runner::step(). When relay auto-tuning of the controller's
+ *           gains, started through the "autotune" parameter, finishes, the results 
+ *           are printed.
  */
 
 void task_controller::run (void)
 {
 	// This counter is used to run through the for (;;) loop at precise intervals
  	TickType_t xLastWakeTime = xTaskGetTickCount ();
- 	accelBuf buffer = accelerometer_A_data->get();
-	// Input proportional and integral gains
-	controller->set_gains();
 	for (;;)
 	{
-        // Only uses one accelerometer at this time
-		buffer = accelerometer_A_data->get();
-		controller->convert(buffer);           // Averages the prevous 5 acceleration values
- 		controller->control();           		// Applies PI control to output actuation
+		runner.step ();
+
+		if (runner.get_controller ()->autotune_running ())
+		{
+			reporting_autotune = true;
+		}
+		else if (reporting_autotune && p_serial != NULL
+				 && xSemaphoreTake (serial_mutex, 0) == pdTRUE)
+		{
+			// The controller mustn't wait for the serial port, so if another task 
+			// is using it the results are printed in a later period
+			runner.get_controller ()->print_autotune (*p_serial);
+			xSemaphoreGive (serial_mutex);
+			reporting_autotune = false;
+		}
+
 		runs++;                                // Track how many runs through the loop
-		delay_from_for_ms (xLastWakeTime, 10);
+		delay_from_for_ms (xLastWakeTime, app_tasks[TASK_CONTROLLER].period_ms);
 	}
 }
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print the status of this task.
+ *  @details This method prints the usual task status and then the number of runs in
+ *           which no new accelerometer data was available and the number of times 
+ *           the motors were stopped because the data was stale. 
+ *  @param   ser_dev A reference to the serial device on which to print the status
+ */
+
+void task_controller::print_status (emstream& ser_dev)
+{
+	TaskBase::print_status (ser_dev);
+	ser_dev << PMS ("\t");
+	runner.print_counts (ser_dev);
+}
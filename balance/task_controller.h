@@ -16,8 +16,86 @@
 
 #include "taskbase.h"                       // Base class for tasks
 #include "shares.h"                         // Lists shares and queues between tasks
+#include "sysid.h"                          // Identification runs take over the motors
+#include "task_table.h"                     // Periods of the tasks
 
 
+/** @brief   Age in milliseconds beyond which accelerometer data is considered stale.
+ *  @details The IMU task writes new data once each of its periods, so data older than
+ *           four of them means that task has stalled; the motors are then turned off.
+ */
+const TickType_t ACCEL_STALE_MS = 4 * app_tasks[TASK_IMU].period_ms;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Runs one period of the balance controller on the newest accelerometer data
+ *  @details Each call to @c step() runs the controller only if the IMU has written new
+ *  accelerometer data since the previous call, so the same samples are never processed
+ *  twice. If the data becomes older than @c ACCEL_STALE_MS, the IMU has stopped 
+ *  delivering and both motors are commanded to zero rather than being left running on
+ *  an old actuation signal. It is used by @c task_controller, or can be run directly 
+ *  by a cyclic executive.
+ */
+
+class controller_runner
+{
+protected:
+	/** @brief The controller that is used to implement the control algorithm
+	 */
+	Balance *controller;
+
+	/** @brief Sequence number of the accelerometer data most recently used
+	 */
+	uint32_t last_sequence;
+
+	/** @brief Number of periods in which no new accelerometer data arrived
+	 */
+	uint32_t missed_updates;
+
+	/** @brief Number of times the accelerometer data went stale and motors were stopped
+	 */
+	uint32_t stale_stops;
+
+	/** @brief True while the motors are stopped or driven by something else, so that
+	 *  the controller is reset before it runs again
+	 */
+	bool stopped;
+
+	/** @brief Buffer into which the newest accelerometer data is copied
+	 */
+	accelBuf buffer;
+
+	/** @brief Registry of the controller's tunable parameters, or NULL if none
+	 */
+	param_registry* p_params;
+
+	/** @brief System identification exciter which may take over the motors, or NULL
+	 */
+	sysid_exciter* p_sysid;
+
+public:
+	/** @brief The constructor saves the controller and sets its gains
+	 */
+	controller_runner (Balance* balance_controller, param_registry* p_params_in = NULL,
+					   sysid_exciter* p_sysid_in = NULL);
+
+	/** @brief Run the controller once if there is new accelerometer data
+	 */
+	void step (void);
+
+	/** @brief Print the counts of missed updates and stale data stops
+	 */
+	void print_counts (emstream& ser_dev);
+
+	/** @brief   Get the controller which this runner runs.
+	 *  @return  A pointer to the balance controller
+	 */
+	Balance* get_controller (void)
+	{
+		return (controller);
+	}
+};
+
 
 //-------------------------------------------------------------------------------------
 /** @brief   Task which uses accelerometer data to calculate motor actuation signals
@@ -28,17 +106,26 @@
 class task_controller : public TaskBase
 {
 protected:
-	/** @brief The controller that is used by the task to implement the control algorithm
+	/** @brief The object which runs the controller each period
 	 */
-	Balance *controller;
+	controller_runner runner;
+
+	/** @brief True while an auto-tune is running, so the results can be printed
+	 */
+	bool reporting_autotune;
+
 public:
 	/** @brief The constructor sets up the task object
 	 */
 	task_controller (const char* p_name, unsigned portBASE_TYPE prio, size_t stacked,
-		emstream* serpt, Balance* controller);
+		emstream* serpt, Balance* controller, param_registry* p_params = NULL,
+		sysid_exciter* p_sysid = NULL);
 
 	/** @brief The run method call the functions of the controller in a loop
 	 */
 	void run (void);
+
+	// Print the task's status including how often sensor data was late
+	void print_status (emstream& ser_dev);
 };
 #endif //_TASK_CONTROLLER_H_
\ No newline at end of file
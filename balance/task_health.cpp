@@ -0,0 +1,53 @@
+//**************************************************************************************
+/** \file task_health.cpp
+ *    This file contains the source for a memory health task which periodically prints
+ *    stack and heap use on a serial device.
+ */
+//**************************************************************************************
+
+#include "task_health.h"
+#include "shares.h"                         // Has the serial port's mutex
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   This constructor creates a memory health task.
+ *  @param   p_name A name for this task
+ *  @param   prio The priority at which this task will run (should be the lowest)
+ *  @param   stacked The stack space to be used by the task
+ *  @param   serpt A pointer to the serial device on which reports are printed
+ *  @param   report_ms The number of milliseconds between reports
+ */
+
+task_health::task_health (const char* p_name, unsigned portBASE_TYPE prio,
+						  size_t stacked, emstream* serpt, TickType_t report_ms)
+	: TaskBase (p_name, prio, stacked, serpt)
+{
+	ms_per_report = report_ms;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   The run method that prints the memory health report.
+ *  @details This method waits one report period so the other tasks have been through
+ *  their loops a few times, then prints a report of stack and heap use each period.
+ */
+
+void task_health::run (void)
+{
+	// This counter is used to run through the for (;;) loop at precise intervals
+	TickType_t LastWakeTime = xTaskGetTickCount ();
+
+	for (;;)
+	{
+		delay_from_for_ms (LastWakeTime, ms_per_report);
+
+		if (p_serial != NULL)
+		{
+			xSemaphoreTake (serial_mutex, portMAX_DELAY);
+			*p_serial << endl;
+			print_memory_health (p_serial);
+			xSemaphoreGive (serial_mutex);
+		}
+		runs++;                             // Track how many runs through the loop
+	}
+}
@@ -0,0 +1,41 @@
+//**************************************************************************************
+/** @file task_health.h
+ *    This file contains the headers for a memory health task which periodically prints
+ *    how much stack each task has used, suggested stack sizes, and heap use.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _TASK_HEALTH_H_
+#define _TASK_HEALTH_H_
+
+#include "taskbase.h"                       // This is a task; here's its parent
+#include "emstream.h"                       // Serial device on which reports are shown
+
+//-------------------------------------------------------------------------------------
+/** @brief   Task which reports stack and heap use on a serial device.
+ *  @details This task runs at low priority and prints a memory health report every
+ *  few seconds. The report shows each task's stack high water mark and a suggested
+ *  stack size so the hand-guessed stack sizes in @c main() can be tightened, freeing
+ *  RAM for larger sensor buffers.
+ */
+
+class task_health : public TaskBase
+{
+protected:
+	/** @brief The number of milliseconds between reports
+	 */
+	TickType_t ms_per_report;
+
+	/** @brief The run function for the task. No states in this run function
+	 */
+	void run (void);
+
+public:
+	/** @brief The constructor for the task
+	 */
+	task_health (const char* p_name, unsigned portBASE_TYPE prio, size_t stacked,
+		emstream* serpt, TickType_t report_ms = 5000);
+};
+
+#endif // _TASK_HEALTH_H_
@@ -7,6 +7,107 @@
 //**************************************************************************************
 
 #include "task_imu.h"
+#include "task_table.h"                      // Has this task's period
+#include "sysid.h"                           // Identification runs record the samples
+
+// Accelerometer A keeps the names it had before there was an accelerometer B, so 
+// calibrations already saved in flash are still found
+const char* const IMU_A_PARAM_NAMES[6] = 
+	{"imu_off_x", "imu_off_y", "imu_off_z", "imu_cal_x", "imu_cal_y", "imu_cal_z"};
+const char* const IMU_B_PARAM_NAMES[6] = 
+	{"imu_b_off_x", "imu_b_off_y", "imu_b_off_z", 
+	 "imu_b_cal_x", "imu_b_cal_y", "imu_b_cal_z"};
+
+//-------------------------------------------------------------------------------------
+/** @brief   This constructor creates an accelerometer sampler.
+ *  @param   accelerometerIn A pointer to an initialized and active accelerometer
+ *  @param   p_share_in A pointer to the share into which samples are written
+ *  @param   offsets_in The accelerometer's offsets in counts on the X, Y, and Z axes
+ *  @param   scales_in The accelerometer's scale factors in counts per mG
+ */
+
+imu_sampler::imu_sampler (mma8452q* accelerometerIn, StampedShare<accelBuf>* p_share_in,
+						  const int16_t* offsets_in, const float* scales_in)
+{
+	accelerometer = accelerometerIn;
+	p_share = p_share_in;
+	dataIndex = 0;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		offset[i] = offsets_in[i];
+		calibrate[i] = scales_in[i];
+		for (uint8_t j = 0; j < ACCEL_BUF_SIZE; j++)
+		{
+			buffer.accel_buffer[j].data[i] = 0.0f;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read one sample from the accelerometer and put it in the share.
+ *  @details This method replaces the oldest sample in the buffer of recent samples 
+ *  with a new calibrated reading of each axis and puts the buffer in the share. All 
+ *  three axes are read in one I2C transaction, and as this sampler is the share's only
+ *  writer it keeps its own copy of the buffer rather than getting it back from the
+ *  share, which saves a copy made with interrupts off. If the reading fails, the 
+ *  share isn't written, so its data goes stale rather than wrong; the previous sample
+ *  is repeated in the buffer so that the two accelerometers' buffers stay in step, 
+ *  each place holding samples from A and B which were taken at the same time.
+ */
+
+void imu_sampler::sample (void)
+{
+	int16_t raw[3];
+	bool read_ok = (accelerometer != NULL && accelerometer->get_all_axes (raw));
+
+	if (!read_ok)
+	{
+		uint8_t previous = (dataIndex == 0) ? ACCEL_BUF_SIZE - 1 : dataIndex - 1;
+		buffer.accel_buffer[dataIndex] = buffer.accel_buffer[previous];
+	}
+	else
+	{
+		for (uint8_t i = 0; i<3; i++)
+		{
+			buffer.accel_buffer[dataIndex].data[i] = (raw[i] - offset[i]) / calibrate[i];
+		}
+	}
+	dataIndex++;
+	if(dataIndex >= ACCEL_BUF_SIZE)
+	{
+		dataIndex = 0;
+	}
+	// Put the data in the task share
+	if (read_ok)
+	{
+		p_share->put(buffer);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add the accelerometer's offsets and scale factors to a parameter registry.
+ *  @details A host can then set them while the program runs and save them in flash,
+ *  so the calibration survives a reset. Each value is written by one store, so a value
+ *  applied while a sample is being calibrated can't be half written.
+ *  @param   p_params The registry to which the calibration values are added
+ *  @param   p_names The names of the X, Y, and Z offsets followed by the X, Y, and Z 
+ *           scale factors, such as @c IMU_A_PARAM_NAMES
+ */
+
+void imu_sampler::register_params (param_registry* p_params, const char* const* p_names)
+{
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		p_params->add (p_names[i], &offset[i], -4096, 4096);
+	}
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		p_params->add (p_names[3 + i], &calibrate[i], 1.0f, 100.0f);
+	}
+}
+
 
 //-------------------------------------------------------------------------------------
 /** @brief   This constructor creates an imu task.
@@ -14,51 +115,49 @@
  *  @param   prio The priority at which this task will run
  *  @param   stacked The stack space to be used by the task
  *  @param   serpt A pointer to a serial device on which debugging messages are shown
- *  @param   accelerometerIn A pointer to an accelerometer
+ *  @param   accelerometerIn A pointer to accelerometer A
+ *  @param   accelerometer_B A pointer to accelerometer B, or NULL if there is none
+ *  @param   p_sysid_in A pointer to a system identification exciter which is run
+ *           after each pair of samples, or NULL if there is none
  */
 
 task_imu::task_imu (const char* p_name, unsigned portBASE_TYPE prio,
-							  size_t stacked, emstream* serpt, mma8452q* accelerometerIn)
-	: TaskBase (p_name, prio, stacked, serpt)
+							  size_t stacked, emstream* serpt, mma8452q* accelerometerIn,
+							  mma8452q* accelerometer_B, sysid_exciter* p_sysid_in)
+	: TaskBase (p_name, prio, stacked, serpt), 
+	  sampler (accelerometerIn, accelerometer_A_data),
+	  sampler_B (accelerometer_B, accelerometer_B_data, IMU_B_OFFSETS, IMU_B_SCALES)
 {
-	// Initializes class variables
-	accelerometer = accelerometerIn;
+	ms_per_sample = app_tasks[TASK_IMU].period_ms;
+	p_sysid = p_sysid_in;
+	if (p_sysid != NULL)
+	{
+		p_sysid->set_samplers (&sampler, &sampler_B);
+	}
 }
 
 //-------------------------------------------------------------------------------------
-/** @brief   The run method that runs the motor task code.
- *  @details This method sets the actuation signal of each motor
+/** @brief   The run method that runs the imu task code.
+ *  @details This method reads one sample from each accelerometer each period
  */
 
 void task_imu::run (void)
 {
 	// This counter is used to run through the for (;;) loop at precise intervals
  	TickType_t LastWakeTime = xTaskGetTickCount ();
- 	uint8_t i;
- 	uint8_t dataIndex = 0;
- 	// buffer struct used in task share
- 	accelBuf buffer;
 
  	// In the main loop, read the accelerometer data and set it to the next available
 	// index of the task share structure
 	for (;;)
 	{
-		// get the old accelerometer data to be updated
-	    buffer = accelerometer_A_data->get();
-	    for (i = 0; i<3; i++)
-	    {
-            buffer.accel_buffer[dataIndex].data[i] =
-                    (accelerometer->get_one_axis(i) - offsetA[i]) / calibrateA[i];
-        }
-        dataIndex++;
-        if(dataIndex > 5)
-        {
-            dataIndex = 0;
-        }
-        // Put the data back in the task share
-        accelerometer_A_data->put(buffer);
+		sampler.sample ();
+		sampler_B.sample ();
+		if (p_sysid != NULL)
+		{
+			p_sysid->step ();
+		}
 
         runs++;                                 // Track how many runs through the loop
-        delay_from_for_ms (LastWakeTime, 5);    // Timing for 200Hz
+        delay_from_for_ms (LastWakeTime, ms_per_sample);
 	}
 }
@@ -14,12 +14,104 @@
 #include "shares.h"                         // Task queues and shared variables
 #include "mma8452q.h"	                 // Class for a motor driver
 #include "emstream.h"
+#include "param_registry.h"             // Calibrations can be set by a host
+
+class sysid_exciter;                    // Records the samples in identification runs
+
+/** @brief   Accelerometer A's offsets, in counts, on the X, Y, and Z axes.
+ */
+const int16_t IMU_A_OFFSETS[3] = {-500, 300, 50};
+
+/** @brief   Accelerometer A's scale factors, in counts per mG.
+ */
+const float IMU_A_SCALES[3] = {16.425, 16.1, 16.15};
+
+/** @brief   Accelerometer B's offsets; nominal until it has been calibrated.
+ */
+const int16_t IMU_B_OFFSETS[3] = {0, 0, 0};
+
+/** @brief   Accelerometer B's scale factors; nominal until it has been calibrated.
+ */
+const float IMU_B_SCALES[3] = {16.384, 16.384, 16.384};
+
+/** @brief   Names under which accelerometer A's offsets and scales are registered.
+ */
+extern const char* const IMU_A_PARAM_NAMES[6];
+
+/** @brief   Names under which accelerometer B's offsets and scales are registered.
+ */
+extern const char* const IMU_B_PARAM_NAMES[6];
 
 //-------------------------------------------------------------------------------------
-/** @brief   Task which reads acceleration data from an accelerometer
+/** @brief   Reads one sample from an accelerometer into a shared ring of samples.
+ *  @details Each call to @c sample() reads the X, Y, and Z axis accelerations from an 
+ *  mma8452q accelerometer, calibrates them, and writes them into the next place in the
+ *  buffer of the @c ACCEL_BUF_SIZE most recent samples held in a share. It is used by
+ *  @c task_imu, or can be run directly by a cyclic executive. Nothing is written if 
+ *  the accelerometer isn't working, so the share goes stale.
+ */
+
+class imu_sampler
+{
+protected:
+	/** @brief   A pointer to an mma8452q accelerometer used by this sampler. 
+	 *  Accelerometer must be initialized and active
+	 */
+    mma8452q* accelerometer;
+
+	/** @brief   The share into which samples are written.
+	 */
+	StampedShare<accelBuf>* p_share;
+
+	/** @brief   The recent samples, kept here so that the share needn't be read back.
+	 */
+	accelBuf buffer;
+
+	/** @brief   Index in the buffer at which the next sample is written.
+	 */
+	uint8_t dataIndex;
+
+    /** @brief Values used in calibration of IMU from its offset
+	 */
+    int16_t offset[3];
+
+	/** @brief Values used in calibrating IMU to mG
+     */
+	float calibrate[3];
+
+public:
+	/** @brief The constructor saves the accelerometer, share, and calibration
+	 */
+	imu_sampler (mma8452q* accelerometerIn, StampedShare<accelBuf>* p_share_in,
+				 const int16_t* offsets_in = IMU_A_OFFSETS, 
+				 const float* scales_in = IMU_A_SCALES);
+
+	/** @brief Read one sample and put it in the share
+	 */
+	void sample (void);
+
+	/** @brief   Get the newest sample.
+	 *  @return  The calibrated sample most recently put in the share
+	 */
+	const accelData& get_latest (void)
+	{
+		return (buffer.accel_buffer[(dataIndex + ACCEL_BUF_SIZE - 1) % ACCEL_BUF_SIZE]);
+	}
+
+	/** @brief Make the calibration values tunable and savable through a registry
+	 */
+	void register_params (param_registry* p_params, const char* const* p_names);
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Task which reads acceleration data from the platform's accelerometers
  *  @details This task reads the X, Y, and Z axis accelerations from an mma8452q
- *  accelerometer and updates a task share called accelerometer_data which is a buffer
- *  that holds the previous 5 acceleration data points
+ *  accelerometer and updates a task share called accelerometer_A_data which is a 
+ *  buffer that holds the most recent acceleration data points. If there's a second 
+ *  accelerometer, it is read straight afterwards into accelerometer_B_data, so the 
+ *  two samples are close enough together in time to be combined. Both are read by
+ *  this one task because they share an I2C bus, which can't be used by two tasks.
  */
 
 class task_imu : public TaskBase
@@ -29,18 +121,18 @@ protected:
 	 */
 	portTickType ms_per_sample;
 
-	/** @brief   A pointer to an mma8452q accelerometer used by this task. Accelerometer
-	 * must be initialized and active
+	/** @brief   The sampler which reads accelerometer A and fills its share.
 	 */
-    mma8452q* accelerometer;
+	imu_sampler sampler;
 
-    /** @brief Values used in calibration of IMU from its offset
+	/** @brief   The sampler for accelerometer B, which does nothing if there's none.
 	 */
-    int16_t offsetA[3] = {-500, 300, 50};
+	imu_sampler sampler_B;
 
-	/** @brief Values used in calibrating IMU to mG
-     */
-	float calibrateA[3] = {16.425, 16.1, 16.15};
+	/** @brief   The system identification exciter run after each pair of samples, or
+	 *           NULL if there is none.
+	 */
+	sysid_exciter* p_sysid;
 
 	/** @brief The run function for the task. No states in this run function
      */
@@ -51,7 +143,18 @@ public:
 	/** @brief The constructor for the task
      */
 	task_imu (const char* p_name, unsigned portBASE_TYPE prio,
-							  size_t stacked, emstream* serpt, mma8452q* accelerometerIn);
+							  size_t stacked, emstream* serpt, mma8452q* accelerometerIn,
+							  mma8452q* accelerometer_B = NULL,
+							  sysid_exciter* p_sysid_in = NULL);
+
+	/** @brief   Get one of the samplers which this task runs.
+	 *  @param   which 0 for accelerometer A's sampler or 1 for accelerometer B's
+	 *  @return  A pointer to the sampler
+	 */
+	imu_sampler* get_sampler (uint8_t which = 0)
+	{
+		return ((which == 0) ? &sampler : &sampler_B);
+	}
 };
 
 #endif // _TASK_IMU_H_
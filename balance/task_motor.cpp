@@ -1,13 +1,102 @@
 //**************************************************************************************
 /** \file task_motor.cpp
  *    This file contains the source for a motor task which is a child of basetask. It
- *    takes an initialized motor driver and a motor value and sets the actuatuon of the
- *    motor using a task share.  The motor value distinguishes which task share to use.
+ *    takes a pair of initialized motor drivers and sets the actuation of both motors
+ *    from their task shares through velocity loops which use the motors' encoders, 
+ *    so that both new efforts take effect on the same PWM edge.
  */
 //**************************************************************************************
 
 #include "emstream.h"
 #include "task_motor.h"
+#include "task_table.h"                     // Has this task's period
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   This constructor creates a motor runner.
+ *  @param   motors_in A pointer to the pair of motor drivers, motor A first
+ *  @param   loop_A A pointer to motor A's velocity loop, or NULL for open loop
+ *  @param   loop_B A pointer to motor B's velocity loop, or NULL for open loop
+ */
+
+motor_runner::motor_runner (MotorPair* motors_in, velocity_loop* loop_A, 
+							velocity_loop* loop_B, torque_drive* torque)
+{
+	motors = motors_in;
+	p_loop_A = loop_A;
+	p_loop_B = loop_B;
+	p_torque = torque;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the velocity loops once and set both motors' efforts.
+ */
+
+void motor_runner::step (void)
+{
+	float effort_A = motor_A_actuation_signal->get();
+	float effort_B = motor_B_actuation_signal->get();
+
+	if (p_loop_A != NULL)
+	{
+		effort_A = p_loop_A->step (effort_A);
+	}
+	if (p_loop_B != NULL)
+	{
+		effort_B = p_loop_B->step (effort_B);
+	}
+
+	if (p_torque != NULL)
+	{
+		p_torque->set_torques (effort_A, effort_B);
+	}
+	else
+	{
+		motors->set_both (effort_A, effort_B);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Stop both motors at once and turn their drivers off.
+ *  @details This is for times when the CPU is about to be held up, as while flash 
+ *  is being erased. The A/D interrupt which runs the current loops would stall then
+ *  too and couldn't bring the motors to a zero torque command, so the current loops
+ *  are paused, zero duty cycles are written to the motors directly, and the drivers'
+ *  EN pins are pulled low. Both efforts are set to zero in their shares, so the 
+ *  motors stay stopped until the controller next runs. Nothing runs the motors 
+ *  again until @c restart() is called.
+ */
+
+void motor_runner::stop (void)
+{
+	motor_A_actuation_signal->put (0.0f);
+	motor_B_actuation_signal->put (0.0f);
+
+	if (p_torque != NULL)
+	{
+		p_torque->pause ();
+	}
+	motors->set_both (0.0f, 0.0f);
+	motors->set_enabled (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Turn the motors' drivers back on after @c stop().
+ *  @details The current loops, if they're used, run again from zero torque, and the
+ *  next @c step() sets the motors from the efforts in their shares.
+ */
+
+void motor_runner::restart (void)
+{
+	motors->set_enabled (true);
+	if (p_torque != NULL)
+	{
+		p_torque->resume ();
+	}
+}
 
 
 //-------------------------------------------------------------------------------------
@@ -16,24 +105,28 @@
  *  @param   prio The priority at which this task will run (should be low)
  *  @param   stacked The stack space to be used by the task (not much)
  *  @param   serpt A pointer to a serial device on which debugging messages are shown
- *  @param   motor_in A pointer to a motor driver
- *  @param   motor_num A value to distinguish which task share to use. 0 = motorA 1 = motorB
+ *  @param   motors_in A pointer to the pair of motor drivers, motor A first
+ *  @param   loop_A A pointer to motor A's velocity loop, or NULL for open loop
+ *  @param   loop_B A pointer to motor B's velocity loop, or NULL for open loop
+ *  @param   torque A pointer to the motors' current loops, or NULL to set the 
+ *  motors' efforts directly
  */
 
 task_motor::task_motor (const char* p_name, unsigned portBASE_TYPE prio,
-    size_t stacked, emstream* serpt, Motor* motor_in, uint8_t motor_num)
-	: TaskBase (p_name, prio, stacked, serpt)
+    size_t stacked, emstream* serpt, MotorPair* motors_in, velocity_loop* loop_A,
+    velocity_loop* loop_B, torque_drive* torque)
+	: TaskBase (p_name, prio, stacked, serpt), 
+	  runner (motors_in, loop_A, loop_B, torque)
 {
-	// Initialize motor and motor value constructor
-	motor = motor_in;
-	motor_val = motor_num;
+	// Initialize update period
+	ms_per_sample = app_tasks[TASK_MOTORS].period_ms;
 }
 
 
 //-------------------------------------------------------------------------------------
 /** @brief   The run method that runs the motor task code.
- *  @details This method sets the actuation signal of the motor from the appropriate task
- *  share
+ *  @details This method runs the velocity loops and sets the actuation signals of both
+ *  motors at the same time
  */
 
 void task_motor::run (void)
@@ -41,18 +134,11 @@ void task_motor::run (void)
 	// This counter is used to run through the for (;;) loop at precise intervals
  	TickType_t LastWakeTime = xTaskGetTickCount ();
 
-	// In the main loop, set actuation signal of the motor from a task share
+	// In the main loop, set actuation signal of the motors from the task shares
 	for (;;)
 	{
-	    if(!motor_val)
-        {
-            motor->setActuation(motor_A_actuation_signal->get());
-        }
-        else
-        {
-            motor->setActuation(motor_B_actuation_signal->get());
-        }
+		runner.step ();
 		runs++;                             // Track how many runs through the loop
- 		delay_from_for_ms (LastWakeTime, 10);    // delay to allow for 100Hz timig
+ 		delay_from_for_ms (LastWakeTime, ms_per_sample);
 	}
 }
@@ -1,7 +1,7 @@
 //**************************************************************************************
 /** @file task_motor.h
- *    This file contains the headers for a motor task which takes a motorDriver object
- *    and sets its actuation signal according to a task share
+ *    This file contains the headers for a motor task which takes a pair of motorDriver
+ *    objects and sets their actuation signals according to task shares
  *
  */
 
@@ -14,29 +14,106 @@
 #include "taskbase.h"                       // This is a task; here's its parent
 #include "shares.h"                         // Task queues and shared variables
 #include "motorDriver.h"	                 // Class for a motor driver
+#include "velocity_loop.h"                  // Inner speed loop for each motor
+#include "current_loop.h"                   // Innermost current loops for the motors
+
+/** @brief   Motor no-load speed at full effort in encoder counts per second.
+ *  @details This converts the balance controller's effort into a speed command for 
+ *  the velocity loops; it should be measured by running a motor at full effort.
+ */
+const float MOTOR_FULL_SPEED_CPS = 20000.0f;
+
+/** @brief   Velocity loop proportional gain: half effort for an error of full speed.
+ */
+const float MOTOR_VEL_KP = 0.5f / MOTOR_FULL_SPEED_CPS;
+
+/** @brief   Velocity loop integral gain, a tenth of a second time constant.
+ */
+const float MOTOR_VEL_KI = 10.0f * MOTOR_VEL_KP;
+
+/** @brief   Deadband offset table: the command needed for each fifth of full response.
+ *  @details The first entry is the command at which the motor just breaks away from
+ *  stiction. It should be found for each motor and direction by slowly raising the 
+ *  command until the wheel turns.
+ */
+const float MOTOR_DEADBAND[] = {0.08f, 0.31f, 0.54f, 0.77f, 1.0f};
+
+/** @brief   Commands smaller than this are treated as zero by the shaping stage.
+ */
+const float MOTOR_ZERO_BAND = 0.01f;
+
+/** @brief   The fastest the shaped command may change, in full scale per second.
+ */
+const float MOTOR_SLEW_PER_S = 50.0f;
+
 
 //-------------------------------------------------------------------------------------
-/** @brief   Task which takes in an initialized motor and sets the actuation signal
- *  @details This task acquires actuation signal from a control task and sets the
- *  actuation to each motor
+/** @brief   Sets both motors' efforts from their shares through their velocity loops
+ *  @details Each call to @c step() gets the efforts commanded by the balance 
+ *  controller, passes each through its motor's velocity loop if there is one, and sets
+ *  both motors together. If there is a @c torque_drive, the efforts are given to it
+ *  as torque commands for the current loops, which set the motors from the A/D 
+ *  interrupt. It is used by @c task_motor, or can be run directly by a cyclic 
+ *  executive.
+ */
+
+class motor_runner
+{
+protected:
+	/** @brief   A pointer to the pair of motor drivers.
+	 */
+    MotorPair* motors;
+
+	/** @brief   Velocity loop for motor A, or NULL to run it open loop.
+	 */
+	velocity_loop* p_loop_A;
+
+	/** @brief   Velocity loop for motor B, or NULL to run it open loop.
+	 */
+	velocity_loop* p_loop_B;
+
+	/** @brief   The motors' current loops, or NULL to set the motors' efforts directly.
+	 */
+	torque_drive* p_torque;
+
+public:
+	/** @brief The constructor saves the motors and velocity and current loops
+	 */
+	motor_runner (MotorPair* motors_in, velocity_loop* loop_A = NULL, 
+				  velocity_loop* loop_B = NULL, torque_drive* torque = NULL);
+
+	/** @brief Run the velocity loops once and set both motors
+	 */
+	void step (void);
+
+	/** @brief Stop both motors at once and turn their drivers off
+	 */
+	void stop (void);
+
+	/** @brief Turn the motors' drivers back on after @c stop()
+	 */
+	void restart (void);
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Task which takes in a pair of initialized motors and sets their actuation
+ *  @details This task acquires the actuation signals for both motors from a control 
+ *  task, runs each motor's velocity loop, and sets them together, so both motors get 
+ *  their new efforts on the same PWM edge. It runs faster than the control task so the
+ *  velocity loops can correct the motors between balance controller updates.
  */
 
 class task_motor : public TaskBase
 {
 protected:
-	/** @brief   The number of milliseconds per sample taken by this task.
+	/** @brief   The number of milliseconds per update made by this task.
 	 */
 	portTickType ms_per_sample;
 
-	/** @brief   A pointer to motor drivers used by this task.
+	/** @brief   The object which runs the velocity loops and sets the motors.
 	 */
-    Motor* motor;
-
-    /** @brief   A value to distinguish motors for the task shares used.
-     * 0 = motor_A_actuationSignal
-     * 1 = motor_B_actuationSignal
-     */
-    uint8_t motor_val;
+	motor_runner runner;
 
 	/** @brief  The function which does all the work for the motor task
 	 */
@@ -46,7 +123,17 @@ public:
     /** @brief This constructor creates the motor task
      */
     task_motor (const char* p_name, unsigned portBASE_TYPE prio,
-        size_t stacked, emstream* serpt, Motor* MotorIn, uint8_t motor_num);
+        size_t stacked, emstream* serpt, MotorPair* motors_in,
+        velocity_loop* loop_A = NULL, velocity_loop* loop_B = NULL,
+        torque_drive* torque = NULL);
+
+	/** @brief   Get the object which runs the velocity loops and sets the motors.
+	 *  @return  A pointer to the motor runner
+	 */
+	motor_runner* get_runner (void)
+	{
+		return (&runner);
+	}
 };
 
 #endif // _TASK_MOTOR_H_
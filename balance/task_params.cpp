@@ -0,0 +1,67 @@
+//**************************************************************************************
+/** \file task_params.cpp
+ *    This file contains the source for a task which lets a host computer read and set
+ *    the balance controller's parameters over a serial port.
+ */
+//**************************************************************************************
+
+#include "task_params.h"
+#include "shares.h"                         // Has the serial port's mutex
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   This constructor creates a parameter serving task.
+ *  @param   p_name A name for this task
+ *  @param   prio The priority at which this task will run (should be low)
+ *  @param   stacked The stack space to be used by the task
+ *  @param   serpt A pointer to the serial device on which requests arrive and replies
+ *           are sent
+ *  @param   p_params_in A pointer to the registry of parameters to be served
+ *  @param   check_ms The number of milliseconds between checks for new characters
+ *  @param   p_sysid_in A pointer to a system identification exciter whose recordings
+ *           are dumped when a host asks, or NULL if there is none
+ */
+
+task_params::task_params (const char* p_name, unsigned portBASE_TYPE prio,
+						  size_t stacked, emstream* serpt, param_registry* p_params_in,
+						  TickType_t check_ms, sysid_exciter* p_sysid_in)
+	: TaskBase (p_name, prio, stacked, serpt)
+{
+	p_params = p_params_in;
+	ms_per_check = check_ms;
+	p_sysid = p_sysid_in;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   The run method that answers parameter requests.
+ *  @details Each period this method gives every character which has arrived to the 
+ *  parameter registry, which replies whenever it has a complete request. A system
+ *  identification dump which the host has asked for is sent after the reply.
+ */
+
+void task_params::run (void)
+{
+	// This counter is used to run through the for (;;) loop at precise intervals
+	TickType_t LastWakeTime = xTaskGetTickCount ();
+
+	for (;;)
+	{
+		// Replies and dumps are written while holding the serial port's mutex, so 
+		// another task's report can't land in the middle of one
+		if (p_serial != NULL && xSemaphoreTake (serial_mutex, portMAX_DELAY) == pdTRUE)
+		{
+			while (p_serial->check_for_char ())
+			{
+				p_params->receive (p_serial->getchar (), *p_serial);
+			}
+			if (p_sysid != NULL && p_sysid->take_dump_request ())
+			{
+				p_sysid->dump (*p_serial);
+			}
+			xSemaphoreGive (serial_mutex);
+		}
+		runs++;                             // Track how many runs through the loop
+		delay_from_for_ms (LastWakeTime, ms_per_check);
+	}
+}
@@ -0,0 +1,52 @@
+//**************************************************************************************
+/** @file task_params.h
+ *    This file contains the headers for a task which lets a host computer read and set
+ *    the balance controller's parameters over a serial port while the program runs.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _TASK_PARAMS_H_
+#define _TASK_PARAMS_H_
+
+#include "taskbase.h"                       // This is a task; here's its parent
+#include "emstream.h"                       // Serial device on which requests arrive
+#include "param_registry.h"                 // The parameters which can be tuned
+#include "sysid.h"                          // Identification runs are dumped from here
+
+//-------------------------------------------------------------------------------------
+/** @brief   Task which answers parameter requests from a host computer.
+ *  @details This task reads characters from its serial device and passes them to a
+ *  @c param_registry, which decodes the binary get and set requests and sends the 
+ *  replies. New values are applied by the controller task at the start of its next 
+ *  cycle, not by this task. This is the only task which reads the serial device.
+ */
+
+class task_params : public TaskBase
+{
+protected:
+	/** @brief The registry of parameters which are served
+	 */
+	param_registry* p_params;
+
+	/** @brief The number of milliseconds between checks for new characters
+	 */
+	TickType_t ms_per_check;
+
+	/** @brief System identification exciter whose recordings are dumped, or NULL
+	 */
+	sysid_exciter* p_sysid;
+
+	/** @brief The run function for the task. No states in this run function
+	 */
+	void run (void);
+
+public:
+	/** @brief The constructor for the task
+	 */
+	task_params (const char* p_name, unsigned portBASE_TYPE prio, size_t stacked,
+		emstream* serpt, param_registry* p_params_in, TickType_t check_ms = 20,
+		sysid_exciter* p_sysid_in = NULL);
+};
+
+#endif // _TASK_PARAMS_H_
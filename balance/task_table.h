@@ -0,0 +1,181 @@
+//**************************************************************************************
+/** @file task_table.h
+ *    This file contains the table of tasks and shares for the balancing platform. Each
+ *    task's priority, stack size, period, and estimated run time, and the tasks which
+ *    each share connects, are written here once; the compiler checks the tables and
+ *    @c main() creates the tasks from them.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _TASK_TABLE_H_
+#define _TASK_TABLE_H_
+
+#include "tasktable.h"                      // Task and share table checking
+
+
+/** @brief   Set to 1 to run the IMU, controller, and motor jobs in one cyclic executive.
+ *  @details When this is 0, each job has its own task as listed in @c app_tasks. When
+ *           it's 1, one @c CyclicExecutive task described by @c exec_task runs the 
+ *           jobs in the order IMU, controller, motors at the periods given
+ *           in @c app_tasks, saving three stacks and the handoffs between tasks. 
+ */
+#ifndef USE_CYCLIC_EXECUTIVE
+#define USE_CYCLIC_EXECUTIVE        0
+#endif
+
+/** @brief   Set to 1 to run the IMU, controller, and motors every millisecond.
+ *  @details When this is 0, the controller runs at 100 Hz on IMU samples taken every
+ *           5 ms. When it's 1, all three run at 1 kHz; each frame of the cyclic 
+ *           executive then samples both accelerometers, runs the controller, and sets
+ *           the motors, so the loop is closed within one millisecond. This works with
+ *           separate tasks too, where the priorities make the three run in that order
+ *           each millisecond, but each handoff then costs a context switch. The 
+ *           MMA8452Q converts at most 800 times a second, so about one sample in five
+ *           repeats the one before; the controller averages five times as many 
+ *           samples, so its average still spans @c ACCEL_AVERAGE_MS. The executive's
+ *           status shows how much of each frame every job uses; see 
+ *           @c CyclicExecutive::print_status(). The schedule at either rate is checked
+ *           on the host against a virtual clock by test/test_schedule.cpp.
+ */
+#ifndef USE_HIGH_RATE_CONTROL
+#define USE_HIGH_RATE_CONTROL       0
+#endif
+
+
+/** @brief   Indices of the tasks in @c app_tasks.
+ */
+enum app_task_index
+{
+	TASK_IMU,                               ///< Reads the accelerometer
+	TASK_CONTROLLER,                        ///< Computes the motor actuation signals
+	TASK_MOTORS,                            ///< Drives both motors together
+	TASK_PARAMS,                            ///< Serves parameter requests from a host
+	TASK_HEALTH,                            ///< Prints stack and heap use
+	NUM_APP_TASKS
+};
+
+/** @brief   Worst-case run time in microseconds of one burst read of an accelerometer.
+ *  @details The I2C port is bit-banged, so a read's time is set by the driver's delay
+ *           loops: at 100 MHz each bit written takes about 2.4 us and each bit read 
+ *           about 1.4 us, so the three bytes written and six read in a burst read of
+ *           all three axes, with their acknowledgements, take about 160 us. This is 
+ *           that figure with a quarter again for margin. The executive checks every
+ *           job's run time against its budget; see @c CyclicExecutive::print_status().
+ */
+const uint32_t IMU_READ_WCET_US = 200;
+
+/** @brief   Worst-case run time in microseconds of one system identification step.
+ *  @details A step records one sample from each accelerometer and may write a motor
+ *           effort; it's a few hundred instructions.
+ */
+const uint32_t IDENT_WCET_US = 20;
+
+/** @brief   Worst-case run time in microseconds of the IMU task or jobs in one period.
+ */
+const uint32_t IMU_WCET_US = 2 * IMU_READ_WCET_US + IDENT_WCET_US;
+
+#if (USE_HIGH_RATE_CONTROL == 1)
+/** @brief   The tasks in the balancing platform program, for 1 kHz control.
+ *  @details The IMU, controller, and motor tasks share the 1 ms period, and their 
+ *           priorities make them run in that order when they wake together. The 
+ *           IMU's run time is two accelerometer reads and an identification step; 
+ *           the controller's and motors' are estimates to be checked against the
+ *           executive's measurements.
+ */
+constexpr TaskSpec app_tasks[NUM_APP_TASKS] =
+{
+	//  Name                Priority  Stack  Period ms  WCET us
+	{ "IMU task",           4,        400,   1,         IMU_WCET_US },
+	{ "Controller task",    3,        800,   1,         150 },
+	{ "Motor task",         2,        240,   1,         60 },
+	{ "Parameters",         1,        300,   20,        500 },
+	{ "Health",             0,        200,   5000,      40000 },
+};
+
+/** @brief   The cyclic executive task used when @c USE_CYCLIC_EXECUTIVE is 1.
+ *  @details Every frame runs all the IMU, controller, and motor jobs, in that order,
+ *           so the frame's run time is the sum of theirs.
+ */
+constexpr TaskSpec exec_task = 
+	{ "Executive",          4,        800,   1,         
+	  app_tasks[TASK_IMU].wcet_us + app_tasks[TASK_CONTROLLER].wcet_us 
+	  + app_tasks[TASK_MOTORS].wcet_us };
+
+/** @brief   Frames after the accelerometers' jobs in which the controller job runs.
+ */
+const uint16_t EXEC_CONTROL_OFFSET = 0;
+
+#else
+/** @brief   The tasks in the balancing platform program.
+ *  @details Priorities are rate-monotonic: the 2 ms motor task, which runs the motors'
+ *           velocity loops, is highest, then the 5 ms IMU task and the 10 ms 
+ *           controller. One motor task drives both motors so that they get new
+ *           efforts on the same PWM edge. The parameter task answers a host's 
+ *           requests to read and set the controller's gains. The IMU's run time is 
+ *           two accelerometer reads and an identification step; the others are 
+ *           estimates, and the parameter and health tasks' are mostly waiting on the
+ *           serial port.
+ */
+constexpr TaskSpec app_tasks[NUM_APP_TASKS] =
+{
+	//  Name                Priority  Stack  Period ms  WCET us
+	{ "IMU task",           3,        400,   5,         IMU_WCET_US },
+	{ "Controller task",    2,        800,   10,        150 },
+	{ "Motor task",         4,        240,   2,         60 },
+	{ "Parameters",         1,        300,   20,        500 },
+	{ "Health",             0,        200,   5000,      40000 },
+};
+
+/** @brief   The cyclic executive task used when @c USE_CYCLIC_EXECUTIVE is 1.
+ *  @details Its frame time divides all the jobs' periods; its stack must be big enough
+ *           for the hungriest job, the controller. Accelerometer B's job runs right
+ *           after A's in the same frame, so each pair of samples which the controller
+ *           fuses was taken a fraction of a millisecond apart; the controller runs in
+ *           the next frame. The busiest frames have both IMU jobs, the system 
+ *           identification job, and the motor job.
+ */
+constexpr TaskSpec exec_task = 
+	{ "Executive",          4,        800,   1,         
+	  app_tasks[TASK_IMU].wcet_us + app_tasks[TASK_MOTORS].wcet_us };
+
+/** @brief   Frames after the accelerometers' jobs in which the controller job runs.
+ */
+const uint16_t EXEC_CONTROL_OFFSET = 1;
+#endif // USE_HIGH_RATE_CONTROL
+
+/** @brief   Indices of the shares in @c app_shares.
+ */
+enum app_share_index
+{
+	SHARE_ACCEL_A,                          ///< Accelerometer A readings
+	SHARE_ACCEL_B,                          ///< Accelerometer B readings
+	SHARE_MOTOR_A,                          ///< Motor A actuation signal
+	SHARE_MOTOR_B,                          ///< Motor B actuation signal
+	NUM_APP_SHARES
+};
+
+/** @brief   The shares which connect the tasks in the balancing platform program.
+ */
+constexpr ShareSpec app_shares[NUM_APP_SHARES] =
+{
+	//  Name                Writer              Reader              Held
+	{ "Accel A data",       TASK_IMU,           TASK_CONTROLLER,    false },
+	{ "Accel B data",       TASK_IMU,           TASK_CONTROLLER,    false },
+	{ "MotorA act",         TASK_CONTROLLER,    TASK_MOTORS,        true },
+	{ "MotorB act",         TASK_CONTROLLER,    TASK_MOTORS,        true },
+};
+
+static_assert (tasks_valid (app_tasks), 
+			   "A task's priority is too high or its stack size is zero");
+static_assert (tasks_rate_monotonic (app_tasks), 
+			   "Task priorities are not in rate-monotonic order");
+static_assert (tasks_schedulable (app_tasks), 
+			   "Task utilization is over the rate-monotonic bound");
+static_assert (exec_task.priority < configMAX_PRIORITIES 
+			   && exec_task.wcet_us <= exec_task.period_ms * 1000UL,
+			   "The cyclic executive's frame is too short for its jobs");
+static_assert (shares_connected (app_tasks, app_shares), 
+			   "A share doesn't connect two tasks or is read faster than it's written");
+
+#endif // _TASK_TABLE_H_
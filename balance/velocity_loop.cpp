@@ -0,0 +1,73 @@
+//**************************************************************************************
+/** @file velocity_loop.cpp
+ *    This file contains the source for an inner velocity control loop which makes a
+ *    motor's speed follow the effort commanded by the balance controller.
+ */
+//**************************************************************************************
+
+#include "velocity_loop.h"
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Constructor for a velocity loop.
+ *  @param   p_speed_in A pointer to the speed estimator for the motor's encoder
+ *  @param   full_speed_cps The motor's no-load speed at full effort, in encoder counts
+ *  per second; this converts the effort command to a speed command
+ *  @param   kp_in The proportional gain in effort per count per second of error
+ *  @param   ki_in The integral gain in effort per count of accumulated error
+ *  @param   dt_s The time between calls to @c step() in seconds
+ */
+
+velocity_loop::velocity_loop (quad_speed* p_speed_in, float full_speed_cps, 
+							  float kp_in, float ki_in, float dt_s)
+{
+	p_speed = p_speed_in;
+	full_speed = full_speed_cps;
+	kp = kp_in;
+	ki = ki_in;
+	dt = dt_s;
+	integral = 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the velocity loop once.
+ *  @details This method updates the encoder speed estimate, compares it with the speed
+ *  corresponding to the effort command, and returns the commanded effort plus PI 
+ *  correction, saturated to between -1.0 and 1.0. While the output is saturated the 
+ *  integral is not allowed to grow further in the same direction.
+ *  @param   effort_command The effort from the balance controller, -1.0 to 1.0
+ *  @return  The effort to be given to the motor, -1.0 to 1.0
+ */
+
+float velocity_loop::step (float effort_command)
+{
+	float error = effort_command * full_speed - p_speed->update ();
+
+	float new_integral = integral + ki * error * dt;
+	float effort = effort_command + kp * error + new_integral;
+
+	// Saturate, keeping the integral only if it isn't pushing further into the limit
+	if (effort > 1.0f)
+	{
+		effort = 1.0f;
+		if (new_integral < integral)
+		{
+			integral = new_integral;
+		}
+	}
+	else if (effort < -1.0f)
+	{
+		effort = -1.0f;
+		if (new_integral > integral)
+		{
+			integral = new_integral;
+		}
+	}
+	else
+	{
+		integral = new_integral;
+	}
+
+	return (effort);
+}
@@ -0,0 +1,66 @@
+//**************************************************************************************
+/** @file velocity_loop.h
+ *    This file contains the header for an inner velocity control loop which makes a
+ *    motor's speed follow the effort commanded by the balance controller, using speed
+ *    measured from the motor's encoder.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _VELOCITY_LOOP_H_
+#define _VELOCITY_LOOP_H_
+
+#include "quad_speed.h"                     // Encoder speed estimator
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   PI velocity loop which runs beneath the balance controller
+ *  @details The balance controller's output is an effort from -1.0 to 1.0. This loop
+ *  takes that effort as a speed command, where 1.0 means the speed the motor reaches
+ *  at full effort with no load, and adds proportional and integral correction to the 
+ *  effort so that the measured speed follows the command. The commanded effort itself
+ *  is fed forward, so with both gains at zero the loop passes the effort through 
+ *  unchanged and the motor runs open loop as before. The loop runs faster than the 
+ *  balance controller so that friction, deadband, and load changes in the motor are
+ *  corrected before the balance controller sees them.
+ */
+
+class velocity_loop
+{
+protected:
+	/** @brief The speed estimator for the motor's encoder
+	 */
+	quad_speed* p_speed;
+
+	/** @brief The motor's no-load speed at full effort in encoder counts per second
+	 */
+	float full_speed;
+
+	/** @brief Proportional gain in effort per count per second of speed error
+	 */
+	float kp;
+
+	/** @brief Integral gain in effort per count of accumulated speed error
+	 */
+	float ki;
+
+	/** @brief The time between runs of the loop in seconds
+	 */
+	float dt;
+
+	/** @brief The integral term's present contribution to the effort
+	 */
+	float integral;
+
+public:
+	/** @brief The constructor saves the speed estimator, scaling, and gains
+	 */
+	velocity_loop (quad_speed* p_speed_in, float full_speed_cps, float kp_in, 
+				   float ki_in, float dt_s);
+
+	/** @brief Run the loop once, returning the effort for the motor
+	 */
+	float step (float effort_command);
+};
+
+#endif // _VELOCITY_LOOP_H_
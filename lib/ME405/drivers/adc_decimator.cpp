@@ -0,0 +1,219 @@
+//*************************************************************************************
+/** @file    adc_decimator.cpp
+ *  @brief   Source for a task which filters and decimates A/D scans in the background.
+ *  @details This file contains the source for a task which runs blocks of A/D scans,
+ *           delivered by DMA, through CIC decimating filters. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+#include "adc_decimator.h"                  // Header for this class
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create a decimating filter task for a set of A/D channels.
+ *  @details The constructor saves the scan setup, creates the queue for blocks of 
+ *           scans, and finds the filter's scaling. Scanning starts when the task runs,
+ *           after the scheduler has started. If the filter's gain times the largest 
+ *           A/D reading won't fit in 32 bits, the order is reduced until it does.
+ *  @param   a_name A name for this task
+ *  @param   a_priority The priority at which this task will run, which should be high
+ *  @param   a_stack_size The stack space to be used by the task (not much)
+ *  @param   p_ser_dev A pointer to a serial device for the status printout
+ *  @param   p_adc_in A pointer to the A/D converter driver
+ *  @param   a_channels_mask A bitmask with a one for each channel to be scanned
+ *  @param   a_trigger The timer event which starts each scan, such as 
+ *           @c ADC_ExternalTrigConv_T2_TRGO; the timer must be set up separately
+ *  @param   a_scans_per_block The number of scans in each block from the DMA; the
+ *           task runs once per block
+ *  @param   a_ratio The number of samples of each channel per filter output
+ *  @param   an_order The order of the CIC filter, from 1 (a boxcar average) to
+ *           @c ADC_CIC_MAX_ORDER (default 1)
+ */
+
+adc_decimator::adc_decimator (const char* a_name, unsigned portBASE_TYPE a_priority, 
+							  size_t a_stack_size, emstream* p_ser_dev, 
+							  adc_driver* p_adc_in, adc_ch_mask_t a_channels_mask, 
+							  uint32_t a_trigger, uint16_t a_scans_per_block, 
+							  uint16_t a_ratio, uint8_t an_order)
+	: TaskBase (a_name, a_priority, a_stack_size, p_ser_dev)
+{
+	p_adc = p_adc_in;
+	channels_mask = a_channels_mask;
+	trigger = a_trigger;
+	scans_per_block = a_scans_per_block;
+	p_queue = new TaskQueue<adc_block> (ADC_DECIM_QUEUE_SIZE, a_name);
+
+	// Channels are scanned in order of channel number
+	num_channels = 0;
+	for (uint8_t channel = 0; channel < ADC_NUM_CHANNELS; channel++)
+	{
+		slot_of_channel[channel] = -1;
+		if (channels_mask & (1 << channel))
+		{
+			slot_of_channel[channel] = num_channels++;
+		}
+	}
+
+	ratio = (a_ratio > 0) ? a_ratio : 1;
+	order = an_order;
+	if (order < 1)
+	{
+		order = 1;
+	}
+	else if (order > ADC_CIC_MAX_ORDER)
+	{
+		order = ADC_CIC_MAX_ORDER;
+	}
+
+	// Find the gain, R^N, reducing the order until the largest output fits
+	uint64_t gain;
+	for (;;)
+	{
+		gain = 1;
+		for (uint8_t stage = 0; stage < order; stage++)
+		{
+			gain *= ratio;
+		}
+		if (gain * ADC_MAX_OUTPUT <= 0xFFFFFFFFULL || order == 1)
+		{
+			break;
+		}
+		order--;
+	}
+	scale = 1.0f / (float)gain;
+
+	for (uint8_t slot = 0; slot < ADC_NUM_CHANNELS; slot++)
+	{
+		for (uint8_t stage = 0; stage < ADC_CIC_MAX_ORDER; stage++)
+		{
+			integrators[slot][stage] = 0;
+			combs[slot][stage] = 0;
+		}
+		outputs[slot] = 0.0f;
+	}
+	phase = 0;
+	num_outputs = 0;
+	next_block = 0;
+	blocks_missed = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Start the A/D scan and filter each block of scans as it arrives.
+ */
+
+void adc_decimator::run (void)
+{
+	if (!p_adc->timer_scan_mode (channels_mask, trigger, scans_per_block, p_queue))
+	{
+		DBG (p_serial, PMS ("A/D decimator: no channels to scan") << endl);
+		for (;;)
+		{
+			vTaskSuspend (NULL);
+		}
+	}
+
+	for (;;)
+	{
+		adc_block block = p_queue->get ();
+
+		// Block numbers which were skipped mean this task fell behind the DMA
+		blocks_missed += block.number - next_block;
+		next_block = block.number + 1;
+
+		filter_block (block);
+		runs++;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run one block of scans through each channel's CIC filter.
+ *  @details The integrators run on every sample. When @c ratio samples have been 
+ *           taken, the last integrator's value goes through the combs, each of which
+ *           subtracts its input from one output ago, and the result is scaled to A/D 
+ *           counts. 
+ *  @param   block The block of scans to be filtered
+ */
+
+void adc_decimator::filter_block (const adc_block& block)
+{
+	const adc_sample_t* p_sample = block.p_samples;
+
+	for (uint16_t scan = 0; scan < block.num_scans; scan++)
+	{
+		for (uint8_t slot = 0; slot < num_channels; slot++)
+		{
+			uint32_t* p_int = integrators[slot];
+			uint32_t value = *p_sample++;
+			for (uint8_t stage = 0; stage < order; stage++)
+			{
+				p_int[stage] += value;
+				value = p_int[stage];
+			}
+		}
+
+		if (++phase >= ratio)
+		{
+			phase = 0;
+			for (uint8_t slot = 0; slot < num_channels; slot++)
+			{
+				uint32_t* p_comb = combs[slot];
+				uint32_t value = integrators[slot][order - 1];
+				for (uint8_t stage = 0; stage < order; stage++)
+				{
+					uint32_t delayed = p_comb[stage];
+					p_comb[stage] = value;
+					value -= delayed;
+				}
+				outputs[slot] = value * scale;
+			}
+			num_outputs++;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Get the newest oversampled reading from one channel.
+ *  @details This method returns at once with the most recent filter output. 
+ *  @param   channel The A/D channel whose reading is wanted
+ *  @return  The reading in A/D counts, with fractional bits, or -1.0 if the channel
+ *           isn't being scanned
+ */
+
+float adc_decimator::get (uint8_t channel)
+{
+	if (channel >= ADC_NUM_CHANNELS || slot_of_channel[channel] < 0)
+	{
+		return (-1.0f);
+	}
+	return (outputs[slot_of_channel[channel]]);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print the filter setup and counts along with the task status.
+ *  @param   ser_dev A reference to the serial device on which to print
+ */
+
+void adc_decimator::print_status (emstream& ser_dev)
+{
+	TaskBase::print_status (ser_dev);
+	ser_dev << PMS ("\tCIC ") << order << PMS ("x") << ratio << PMS (", outputs: ") 
+			<< num_outputs << PMS (", missed: ") << blocks_missed 
+			<< PMS ("/") << p_adc->get_blocks_dropped ();
+}
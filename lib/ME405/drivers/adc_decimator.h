@@ -0,0 +1,148 @@
+//*************************************************************************************
+/** @file    adc_decimator.h
+ *  @brief   Header for a task which filters and decimates A/D scans in the background.
+ *  @details This file contains a task which takes blocks of A/D scans delivered by 
+ *           DMA in @c adc_driver's timer scan mode and passes each channel through a
+ *           CIC (cascaded integrator-comb) decimating filter. Oversampled, 
+ *           higher-resolution readings of every scanned channel are then always 
+ *           available without waiting for any conversions. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _ADC_DECIMATOR_H_
+#define _ADC_DECIMATOR_H_
+
+#include "taskbase.h"                       // The decimator runs as a task
+#include "taskqueue.h"                      // Queue of blocks from the A/D's DMA
+#include "adc_driver.h"                     // A/D converter driver with DMA scanning
+
+
+/// The highest order of CIC filter which the decimator can run
+const uint8_t ADC_CIC_MAX_ORDER = 3;
+
+/// The number of blocks of scans which may wait for the decimator
+const uint8_t ADC_DECIM_QUEUE_SIZE = 2;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Task which oversamples A/D channels through a decimating CIC filter.
+ *  @details When the task starts, it puts the A/D converter into timer scan mode, in
+ *           which DMA delivers blocks of scans of the chosen channels, triggered by a
+ *           timer, through a queue. Each channel's samples go through a CIC filter of
+ *           order @c N and decimation ratio @c R: @c N integrators run at the sample 
+ *           rate and, after every @c R samples, @c N combs find one output. An order
+ *           1 filter is a boxcar average of @c R samples; higher orders attenuate 
+ *           aliased noise more at the same ratio. The output is divided by the 
+ *           filter's gain, @c R^N, so it's in A/D counts, but with fractional bits: 
+ *           averaging @c R samples of white noise gains about half a bit of 
+ *           resolution for each doubling of @c R. 
+ *
+ *           The integrators use 32-bit unsigned arithmetic, whose wrap-around cancels
+ *           out in the combs as long as the filter gain times the largest A/D reading
+ *           fits in 32 bits; the constructor reduces the order until it does. 
+ *
+ *           Readers call @c get() for a channel's newest output, which returns at
+ *           once. The task does a few additions per sample and runs once per block, 
+ *           so it should have a high priority but needs little stack. 
+ */
+
+class adc_decimator : public TaskBase
+{
+protected:
+	/// The A/D converter which scans the channels
+	adc_driver* p_adc;
+
+	/// The queue through which the A/D's DMA delivers blocks of scans
+	TaskQueue<adc_block>* p_queue;
+
+	/// The channels which are scanned
+	adc_ch_mask_t channels_mask;
+
+	/// The timer event which starts each scan
+	uint32_t trigger;
+
+	/// The number of scans in each block from the DMA
+	uint16_t scans_per_block;
+
+	/// The position of each channel in a scan, or -1 if the channel isn't scanned
+	int8_t slot_of_channel[ADC_NUM_CHANNELS];
+
+	/// The number of channels in each scan
+	uint8_t num_channels;
+
+	/// The number of input samples per output, @c R
+	uint16_t ratio;
+
+	/// The number of integrator and comb stages, @c N
+	uint8_t order;
+
+	/// One over the filter's gain, @c R^N, to scale outputs to A/D counts
+	float scale;
+
+	/// The number of samples taken toward the next output
+	uint16_t phase;
+
+	/// Integrator stages for each channel position in a scan
+	uint32_t integrators[ADC_NUM_CHANNELS][ADC_CIC_MAX_ORDER];
+
+	/// Comb stage delays for each channel position in a scan
+	uint32_t combs[ADC_NUM_CHANNELS][ADC_CIC_MAX_ORDER];
+
+	/// The newest output for each channel position in a scan, in A/D counts
+	volatile float outputs[ADC_NUM_CHANNELS];
+
+	/// The number of outputs found since the task started
+	uint32_t num_outputs;
+
+	/// The number of the block expected next from the DMA
+	uint32_t next_block;
+
+	/// The number of blocks skipped because this task fell behind
+	uint32_t blocks_missed;
+
+	// Run one block of scans through the filters
+	void filter_block (const adc_block& block);
+
+public:
+	// The constructor saves the scan setup and finds the filter's scaling
+	adc_decimator (const char* a_name, unsigned portBASE_TYPE a_priority, 
+				   size_t a_stack_size, emstream* p_ser_dev, adc_driver* p_adc_in,
+				   adc_ch_mask_t a_channels_mask, uint32_t a_trigger, 
+				   uint16_t a_scans_per_block, uint16_t a_ratio, 
+				   uint8_t an_order = 1);
+
+	// The task starts the scan and then filters each block as it arrives
+	void run (void);
+
+	// Get the newest oversampled reading from one channel
+	float get (uint8_t channel);
+
+	/** @brief   Get the number of oversampled outputs found so far.
+	 *  @details A reader can compare this with a count it saved earlier to find out
+	 *           whether a new output is ready.
+	 *  @return  The number of outputs found for each channel since scanning started
+	 */
+	uint32_t get_num_outputs (void)
+	{
+		return (num_outputs);
+	}
+
+	// Print the filter setup and counts along with the task status
+	void print_status (emstream& ser_dev);
+};
+
+#endif // _ADC_DECIMATOR_H_
@@ -32,6 +32,7 @@
 //*************************************************************************************
 
 #include "adc_driver.h"
+#include "misc.h"                           // Header for interrupt controller
 
 
 /** @brief   Buffer which holds A/D conversion results.
@@ -41,6 +42,30 @@
  */
 static adc_sample_t adc_data_buffer[ADC_NUM_CHANNELS];
 
+/// The function called by the A/D interrupt when an injected group is done
+static adc_callback_t injected_callback = NULL;
+
+/// The context pointer given to @c injected_callback
+static void* p_injected_context = NULL;
+
+/// The queue into which timer scan mode puts blocks of scans
+static TaskQueue<adc_block>* p_scan_queue = NULL;
+
+/// The block description for each half of the DMA buffer
+static adc_block scan_halves[2];
+
+/// The number of blocks which have been filled since timer scan mode was started
+static uint32_t scan_block_count = 0;
+
+/// The number of blocks which were lost, either to a full queue or a late interrupt
+static uint32_t scan_blocks_dropped = 0;
+
+/// The DMA buffer for timer scan mode, kept so that a later call can reuse it
+static adc_sample_t* p_scan_buffer = NULL;
+
+/// The number of samples which @c p_scan_buffer can hold
+static uint32_t scan_buffer_size = 0;
+
 
 //-------------------------------------------------------------------------------------
 /** @brief   Constructor for the simplified ADC driver.
@@ -103,6 +128,292 @@ void adc_driver::single_conversion_mode (void)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** @brief   Set up a group of conversions which a timer starts, with a callback.
+ *  @details This method uses the A/D's injected group, which converts up to four 
+ *           channels in sequence when a timer event arrives and then interrupts. The
+ *           conversions run without any attention from software, so they happen at 
+ *           exactly the same point in every timer period; a PWM timer's compare event
+ *           can be used to sample motor current at the same point in every PWM cycle
+ *           (see @c hw_pwm::set_adc_trigger()). The results are read with 
+ *           @c injected() from the callback, which runs in the A/D interrupt. 
+ *           Regular conversions with @c read_once() can still be used meanwhile. 
+ *  @param   channels An array of the channels to be converted, in order
+ *  @param   count The number of channels in the array, from 1 to 4
+ *  @param   trigger The timer event which starts the conversions, such as
+ *           @c ADC_ExternalTrigInjecConv_T3_CC4
+ *  @param   callback The function to be called when each group has been converted
+ *  @param   p_context A pointer which is given to the callback function
+ *  @return  @c true if the group was set up, @c false if the channels were invalid
+ */
+
+bool adc_driver::timer_injected_mode (const uint8_t* channels, uint8_t count, 
+									  uint32_t trigger, adc_callback_t callback, 
+									  void* p_context)
+{
+	if (count < 1 || count > ADC_MAX_INJECTED)
+	{
+		ADC_DBG ("A/D error: " << count << " injected channels" << endl);
+		return (false);
+	}
+	for (uint8_t index = 0; index < count; index++)
+	{
+		if (channels[index] >= ADC_NUM_CHANNELS)
+		{
+			ADC_DBG ("A/D error: No channel " << channels[index] << endl);
+			return (false);
+		}
+	}
+
+	// Set up the A/D as for single conversions unless it's already running, perhaps
+	// in timer scan mode; scan mode, which converts the whole group, is on either way
+	if (!(ADC1->CR2 & ADC_CR2_ADON))
+	{
+		single_conversion_mode ();
+	}
+
+	// The sequence length must be set before the channels are given their ranks
+	ADC_InjectedSequencerLengthConfig (ADC1, count);
+	for (uint8_t index = 0; index < count; index++)
+	{
+		set_analog_pin (channels[index]);
+		ADC_InjectedChannelConfig (ADC1, channels[index], index + 1, 
+								   ADC_SampleTime_28Cycles);
+	}
+
+	injected_callback = callback;
+	p_injected_context = p_context;
+
+	ADC_ExternalTrigInjectedConvConfig (ADC1, trigger);
+	ADC_ExternalTrigInjectedConvEdgeConfig (ADC1, 
+											ADC_ExternalTrigInjecConvEdge_Rising);
+
+	// Interrupt when the whole group has been converted
+	ADC_ClearITPendingBit (ADC1, ADC_IT_JEOC);
+	ADC_ITConfig (ADC1, ADC_IT_JEOC, ENABLE);
+
+	NVIC_InitTypeDef NVIC_InitStruct;
+	NVIC_InitStruct.NVIC_IRQChannel                   = ADC_IRQn;
+	NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStruct.NVIC_IRQChannelSubPriority        = 0;
+	NVIC_InitStruct.NVIC_IRQChannelCmd                = ENABLE;
+	NVIC_Init (&NVIC_InitStruct);
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Scan a set of channels each time a timer triggers, delivering the data
+ *           in blocks by DMA.
+ *  @details This method puts the A/D into timer scan mode (@c ADC_mode_timer_scan_set).
+ *           Each trigger from the timer converts every channel in the mask once, and 
+ *           DMA stream 0 of DMA2 moves each result into a circular buffer holding two
+ *           blocks of @c scans_per_block scans. When the DMA has filled one half of 
+ *           the buffer it carries on into the other half and its interrupt puts an 
+ *           @c adc_block describing the full half into the queue. The CPU does 
+ *           nothing at all for each sample, so channels can be sampled at tens of 
+ *           kilohertz; the task reading the queue runs once per block. The timer must 
+ *           be set up separately to give the trigger at the sampling rate. An 
+ *           @c hw_pwm made at the sampling rate can be used, with a compare channel 
+ *           set up by @c hw_pwm::set_adc_trigger(); its period is exactly its 
+ *           resolution in timer counts, so it triggers at the rate it was given. 
+ *
+ *           Injected conversions (see @c timer_injected_mode()) can run at the same 
+ *           time, but @c read_once() must not be used, as it takes over the regular 
+ *           conversion sequence which the scan uses.
+ *  @param   channels_mask A bitmask with a one for each channel to be scanned
+ *  @param   trigger The timer event which starts each scan, such as 
+ *           @c ADC_ExternalTrigConv_T2_TRGO
+ *  @param   scans_per_block The number of scans in each block put into the queue
+ *  @param   p_queue The queue which receives the blocks; one or two items are enough
+ *           if its reader keeps up
+ *  @return  @c true if scanning was started, @c false if the mask has no channels
+ */
+
+bool adc_driver::timer_scan_mode (adc_ch_mask_t channels_mask, uint32_t trigger, 
+								  uint16_t scans_per_block, 
+								  TaskQueue<adc_block>* p_queue)
+{
+	uint8_t num_channels = 0;
+	for (uint8_t chan_num = 0; chan_num < ADC_NUM_CHANNELS; chan_num++)
+	{
+		if (channels_mask & (1 << chan_num))
+		{
+			num_channels++;
+		}
+	}
+	if (num_channels == 0 || scans_per_block == 0)
+	{
+		ADC_DBG ("A/D error: Nothing to scan" << endl);
+		return (false);
+	}
+
+	// ADC1 is served by DMA2 stream 0, channel 0. Stop it before touching the buffer,
+	// in case scanning was already running
+	RCC_AHB1PeriphClockCmd (RCC_AHB1Periph_DMA2, ENABLE);
+	DMA_Cmd (DMA2_Stream0, DISABLE);
+	DMA_DeInit (DMA2_Stream0);
+
+	// The buffer holds two blocks, one being filled while the other is read. One from
+	// an earlier call is reused if it's big enough, as heap_1 can't free it anyway
+	uint32_t block_length = (uint32_t)scans_per_block * num_channels;
+	if (2 * block_length > scan_buffer_size)
+	{
+		delete[] p_scan_buffer;
+		p_scan_buffer = new adc_sample_t[2 * block_length];
+		if (p_scan_buffer == NULL)
+		{
+			scan_buffer_size = 0;
+			ADC_DBG ("A/D error: No memory for scan buffer" << endl);
+			return (false);
+		}
+		scan_buffer_size = 2 * block_length;
+	}
+	adc_sample_t* p_buffer = p_scan_buffer;
+
+	for (uint8_t half = 0; half < 2; half++)
+	{
+		scan_halves[half].p_samples = p_buffer + half * block_length;
+		scan_halves[half].num_scans = scans_per_block;
+		scan_halves[half].num_channels = num_channels;
+	}
+	scan_block_count = 0;
+	scan_blocks_dropped = 0;
+	p_scan_queue = p_queue;
+
+	DMA_InitTypeDef DMA_InitStruct;
+	DMA_InitStruct.DMA_Channel            = DMA_Channel_0;
+	DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&(ADC1->DR);
+	DMA_InitStruct.DMA_Memory0BaseAddr    = (uint32_t)p_buffer;
+	DMA_InitStruct.DMA_DIR                = DMA_DIR_PeripheralToMemory;
+	DMA_InitStruct.DMA_BufferSize         = 2 * block_length;
+	DMA_InitStruct.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+	DMA_InitStruct.DMA_MemoryInc          = DMA_MemoryInc_Enable;
+	DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	DMA_InitStruct.DMA_MemoryDataSize     = DMA_MemoryDataSize_HalfWord;
+	DMA_InitStruct.DMA_Mode               = DMA_Mode_Circular;
+	DMA_InitStruct.DMA_Priority           = DMA_Priority_High;
+	DMA_InitStruct.DMA_FIFOMode           = DMA_FIFOMode_Disable;
+	DMA_InitStruct.DMA_FIFOThreshold      = DMA_FIFOThreshold_HalfFull;
+	DMA_InitStruct.DMA_MemoryBurst        = DMA_MemoryBurst_Single;
+	DMA_InitStruct.DMA_PeripheralBurst    = DMA_PeripheralBurst_Single;
+	DMA_Init (DMA2_Stream0, &DMA_InitStruct);
+
+	// Interrupt when each half of the buffer is full. The handler uses the queue, so
+	// its priority must be no more urgent than FreeRTOS allows for such interrupts.
+	// NVIC_SetPriority() takes the priority as FreeRTOS numbers it whatever the 
+	// priority grouping, which NVIC_Init() would need to be 4 for the same result
+	DMA_ITConfig (DMA2_Stream0, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	NVIC_SetPriority (DMA2_Stream0_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+	NVIC_EnableIRQ (DMA2_Stream0_IRQn);
+	DMA_Cmd (DMA2_Stream0, ENABLE);
+
+	// Set up the A/D to convert the whole sequence on each rising edge of the trigger
+	RCC_APB2PeriphClockCmd (RCC_APB2Periph_ADC1, ENABLE);
+
+	ADC_CommonInitTypeDef ADC_AllStruct;
+	ADC_AllStruct.ADC_Mode = ADC_Mode_Independent;
+	ADC_AllStruct.ADC_Prescaler = ADC_Prescaler_Div4;
+	ADC_AllStruct.ADC_DMAAccessMode = ADC_DMAAccessMode_Disabled;
+	ADC_AllStruct.ADC_TwoSamplingDelay = ADC_TwoSamplingDelay_10Cycles;
+	ADC_CommonInit (&ADC_AllStruct);
+
+	ADC_InitTypeDef ADC_InitStruct;
+	ADC_InitStruct.ADC_Resolution = ADC_Resolution_12b;
+	ADC_InitStruct.ADC_ScanConvMode = ENABLE;
+	ADC_InitStruct.ADC_ContinuousConvMode = DISABLE;
+	ADC_InitStruct.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_Rising;
+	ADC_InitStruct.ADC_ExternalTrigConv = trigger;
+	ADC_InitStruct.ADC_DataAlign = ADC_DataAlign_Right;
+	ADC_InitStruct.ADC_NbrOfConversion = num_channels;
+	ADC_Init (ADC1, &ADC_InitStruct);
+
+	set_channel_list (channels_mask);
+
+	// Keep asking for DMA after each sequence, as the DMA buffer is circular
+	ADC_DMARequestAfterLastTransferCmd (ADC1, ENABLE);
+	ADC_DMACmd (ADC1, ENABLE);
+	ADC_Cmd (ADC1, ENABLE);
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find how many blocks of scans have been lost.
+ *  @details A block is lost if the task which reads the queue has fallen so far 
+ *           behind that the queue is still full when the next block is ready, or if
+ *           the DMA interrupt was held off so long that both halves of the buffer 
+ *           filled before it ran; the first half is then already being overwritten.
+ *  @return  The number of blocks dropped since timer scan mode was started
+ */
+
+uint32_t adc_driver::get_blocks_dropped (void)
+{
+	return (scan_blocks_dropped);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Interrupt handler for the DMA stream which moves A/D scan data.
+ *  @details This handler runs when the DMA has filled either half of the scan buffer.
+ *           It puts a description of the half which was just filled into the queue. 
+ *           If both halves have filled, the first is counted as lost but still 
+ *           given a block number, so the reader can see the gap.
+ */
+
+extern "C" void DMA2_Stream0_IRQHandler (void)
+{
+	uint8_t half = 2;
+
+	if (DMA_GetITStatus (DMA2_Stream0, DMA_IT_HTIF0) == SET)
+	{
+		DMA_ClearITPendingBit (DMA2_Stream0, DMA_IT_HTIF0);
+		half = 0;
+	}
+	if (DMA_GetITStatus (DMA2_Stream0, DMA_IT_TCIF0) == SET)
+	{
+		DMA_ClearITPendingBit (DMA2_Stream0, DMA_IT_TCIF0);
+		if (half == 0)
+		{
+			scan_block_count++;
+			scan_blocks_dropped++;
+		}
+		half = 1;
+	}
+
+	if (half < 2 && p_scan_queue)
+	{
+		scan_halves[half].number = scan_block_count++;
+		if (!p_scan_queue->ISR_put (scan_halves[half]))
+		{
+			scan_blocks_dropped++;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Interrupt handler for the A/D converter.
+ *  @details This handler runs when a group of injected conversions is finished. It
+ *           clears the interrupt and calls the function given to 
+ *           @c adc_driver::timer_injected_mode(), if there is one. 
+ */
+
+extern "C" void ADC_IRQHandler (void)
+{
+	if (ADC_GetITStatus (ADC1, ADC_IT_JEOC) == SET)
+	{
+		ADC_ClearITPendingBit (ADC1, ADC_IT_JEOC);
+		if (injected_callback)
+		{
+			injected_callback (p_injected_context);
+		}
+	}
+}
+
+
 //-------------------------------------------------------------------------------------
 /** @brief   Take a single A/D reading from the given channel.
  *  @details This method reads the A/D converter once from the given channel and
@@ -245,56 +556,29 @@ void adc_driver::set_channel (uint8_t new_channel)
 
 void adc_driver::set_channel_list (adc_ch_mask_t channels_mask)
 {
-	(void)channels_mask;
-
-// 	// Set the sequence registers all to zero
-// 	adc_group_config.sqr3 = 0;
-// 	adc_group_config.sqr2 = 0;
-// 	adc_group_config.sqr1 = 0;
-// 
-// 	// Scan through the channel bitmask, and for each active channel, give it a
-// 	// sequence number and configure its pin
-// 	adc_ch_mask_t test_mask = 1;
-// 	uint32_t num_channels = 0;
-// 	for (uint8_t chan_num = 0; chan_num < ADC_NUM_CHANNELS; chan_num++)
-// 	{
-// 		// If each channel is active...
-// 		if (channels_mask & test_mask)
-// 		{
-// 			*p_serial << endl << "Ch: " << chan_num << endl;
-// 	
-// 			// Set an entry in the correct sequence register and increment the count
-// 			// of active channels
-// 			set_SQR_register (chan_num, ++num_channels);
-// 
-// 			// Setup pin(s) of our MCU as analog inputs
-// 			palSetPadMode (ADC1_channel_map[chan_num].port, 
-// 						   ADC1_channel_map[chan_num].pin, 
-// 						   PAL_MODE_INPUT_ANALOG);
-// 		}
-// 
-// 		// Advance the test bitmask to the next bit in the channel mask
-// 		test_mask <<= 1;
-// 	}
-// 
-// 	// Now that we've counted the channels, set the count in the register
-// 	adc_group_config.sqr1 = ADC_SQR1_NUM_CH (num_channels);
-// 
-// 	// Set the register that indicates how many channels are being measured
-// 	adc_group_config.circular = FALSE;            // No need for a ring buffer
-// 	adc_group_config.num_channels = num_channels; // How many channels to convert
-// 	adc_group_config.end_cb = NULL;               // Callback function
-// 	adc_group_config.error_cb = NULL;             // No error callback (yet)
-// 	adc_group_config.cr1 = 0;
-// 	adc_group_config.cr2 = ADC_CR2_SWSTART;       // Started by a software trigger
-// 
-// 	// Set the sample time for every channel to be the same value for simplicity
-// 	adc_group_config.smpr1 = ADC_SMPR_ALL_56_CYC & 00777777777;
-// 	adc_group_config.smpr2 = ADC_SMPR_ALL_56_CYC;
-// 
-// 	// Save the channel list so that if someone asks to re-set the same list, we'll
-// 	// know that nothing needs to be done
-// 	channel_list = channels_mask;
+	// Give each active channel the next rank in the regular sequence and set its pin
+	// as an analog input
+	uint8_t num_channels = 0;
+	for (uint8_t chan_num = 0; chan_num < ADC_NUM_CHANNELS; chan_num++)
+	{
+		if (channels_mask & (1 << chan_num))
+		{
+			set_analog_pin (chan_num);
+			ADC_RegularChannelConfig (ADC1, chan_num, ++num_channels, 
+									  ADC_SampleTime_15Cycles);
+		}
+	}
+
+	// Set the length of the sequence, which is stored as one less than the count
+	if (num_channels > 0)
+	{
+		ADC1->SQR1 = (ADC1->SQR1 & ~ADC_SQR1_L) 
+					 | ((uint32_t)(num_channels - 1) << 20);
+	}
+
+	// Save the channel list so that if someone asks to re-set the same list, we'll
+	// know that nothing needs to be done
+	channel_list = channels_mask;
 }
 
 
@@ -38,6 +38,7 @@
 #include "stm32f4xx.h"                      // Has special function register names
 #include "stm32f4xx_rcc.h"                // Extra special function timer register 
 #include "stm32f4xx_adc.h"                  // Really special registers for the A/D
+#include "stm32f4xx_dma.h"                  // DMA controller which moves scan data
 
 #include "FreeRTOS.h"                       // Main header for FreeRTOS
 #include "task.h"                           // Header for FreeRTOS tasks
@@ -45,6 +46,7 @@
 #include "semphr.h"                         // Header for FreeRTOS semaphores/mutices
 
 #include "emstream.h"                       // Header for ME405 library output streams
+#include "taskqueue.h"                      // Queue which delivers blocks of scans
 
 
 /** @brief   Debugging printout for the A/D converter.
@@ -62,14 +64,13 @@
 /** @brief   Type of integer which holds an A/D channel mask.
  *  @details This is an integral type which is just large enough to hold a bitmask 
  *           that specifies which channels are being measured. For an 8-channel A/D,
- *           use a @c uint8_t for example. 
+ *           use a @c uint8_t for example. This is chosen by processor because the
+ *           preprocessor can't see the value of @c ADC_NUM_CHANNELS.
  */
-#if (ADC_NUM_CHANNELS <= 8)
+#ifdef __AVR
 	typedef uint8_t adc_ch_mask_t;
-#elif(ADC_NUM_CHANNELS <= 16)
-	typedef uint16_t adc_ch_mask_t;
 #else
-	typedef uint32_t adc_ch_mask_t;
+	typedef uint16_t adc_ch_mask_t;
 #endif
 
 /** @brief   Type of integer which holds samples from the A/D converter.
@@ -211,6 +212,39 @@ typedef enum
 } adc_mode;
 
 
+//-------------------------------------------------------------------------------------
+/** @brief   Type of function called by the A/D interrupt when a triggered group of
+ *           injected conversions is complete.
+ *  @details The function is given the context pointer which was passed to
+ *           @c adc_driver::timer_injected_mode(). It runs in an interrupt service 
+ *           routine, so it must be short and may only call FreeRTOS functions whose 
+ *           names end in @c FromISR. 
+ */
+typedef void (*adc_callback_t)(void* p_context);
+
+/// The largest number of channels in an injected conversion group
+const uint8_t ADC_MAX_INJECTED = 4;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A block of scans put into a queue by the A/D converter's DMA.
+ *  @details In timer scan mode, the DMA controller fills one half of a buffer while
+ *           a task reads the other half. Each time a half is filled, one of these is
+ *           put into the queue given to @c adc_driver::timer_scan_mode(). The scans 
+ *           follow one another in the block, and each scan holds one sample from 
+ *           each channel in the mask, lowest numbered channel first. The samples 
+ *           stay valid only until the DMA comes back around to fill this half again,
+ *           one block's time later, so the task must finish with them by then. 
+ */
+typedef struct
+{
+	const adc_sample_t* p_samples;          ///< The first sample of the first scan
+	uint16_t num_scans;                     ///< The number of scans in the block
+	uint8_t num_channels;                   ///< The number of samples in each scan
+	uint32_t number;                        ///< Count of blocks filled since starting
+} adc_block;
+
+
 //-------------------------------------------------------------------------------------
 /** @brief   Class which encapsulates a simplified A/D converter driver.
  *  @details This class is a simplified C++ wrapper for an analog to digital converter
@@ -258,6 +292,46 @@ public:
 	// Function to activate the A/D in one conversion at a time mode
 	void single_conversion_mode (void);
 
+	// Scan channels by DMA each time a timer triggers, queueing blocks of scans
+	bool timer_scan_mode (adc_ch_mask_t channels_mask, uint32_t trigger, 
+						  uint16_t scans_per_block, TaskQueue<adc_block>* p_queue);
+
+	// Find how many blocks were lost because the queue was full
+	uint32_t get_blocks_dropped (void);
+
+	// Set up a group of conversions started by a timer, with a completion callback
+	bool timer_injected_mode (const uint8_t* channels, uint8_t count, 
+							  uint32_t trigger, adc_callback_t callback, 
+							  void* p_context);
+
+	/** @brief   Get the result of one conversion in the injected group.
+	 *  @details This method reads one of the injected data registers, which hold the 
+	 *           results of the group set up by @c timer_injected_mode() until the 
+	 *           group is next converted. It is quick enough to call from the callback.
+	 *  @param   rank The position of the channel in the group, from 0 to 
+	 *           @c ADC_MAX_INJECTED - 1
+	 *  @return  The most recent conversion of that channel
+	 */
+	adc_sample_t injected (uint8_t rank)
+	{
+		return ((adc_sample_t)(*(&(ADC1->JDR1) + rank)));
+	}
+
+	/** @brief   Turn the injected group's interrupt, and so its callback, on or off.
+	 *  @details The conversions go on while the interrupt is off; when it's turned 
+	 *           on again, any group finished meanwhile is forgotten, so the callback
+	 *           next runs for a fresh group.
+	 *  @param   enabled True to call the callback after each group, false not to
+	 */
+	void set_injected_interrupt (bool enabled)
+	{
+		if (enabled)
+		{
+			ADC_ClearITPendingBit (ADC1, ADC_IT_JEOC);
+		}
+		ADC_ITConfig (ADC1, ADC_IT_JEOC, enabled ? ENABLE : DISABLE);
+	}
+
 	/** @brief   Turn the A/D hardware on.
 	 *  @details This method turns on the A/D hardware by activating the clock for
 	 *           the A/D and turning the microcontroller's internal A/D power switch
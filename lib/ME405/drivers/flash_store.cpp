@@ -0,0 +1,470 @@
+//*************************************************************************************
+/** @file    flash_store.cpp
+ *  @brief   Source for a small key/value store kept in two sectors of internal flash.
+ *  @details This file contains the methods of a log-structured key/value store. The 
+ *           layout of the sectors and records is described in flash_store.h.
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+#include <string.h>                         // For memcpy() and memcmp()
+#include "stm32f4xx_flash.h"                // Flash erasing and programming
+#include "flash_store.h"                    // Header for this file
+
+
+/// The number of words at the start of each sector before the first record.
+#define FLASH_STORE_HEADER_WORDS    2
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find the number of flash words taken by a record.
+ *  @param   length The number of data bytes in the record
+ *  @return  The number of words for the key and length, the data, and the CRC
+ */
+
+static constexpr uint32_t record_words (uint16_t length)
+{
+	return (1 + (length + 3) / 4 + 1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Compute the CRC which is stored at the end of a record.
+ *  @details The CRC covers the word holding the key and length, then the data bytes.
+ *  A CRC which happens to be all ones is changed to zero, because all ones is what 
+ *  an unwritten word looks like.
+ *  @param   p_record A pointer to the record's first word
+ *  @return  The CRC to be stored in the record's last word
+ */
+
+static uint32_t record_crc (const uint32_t* p_record)
+{
+	uint32_t crc = flash_store::crc32 (p_record, 4);
+	crc = flash_store::crc32 (p_record + 1, p_record[0] >> 16, crc);
+	return ((crc == 0xFFFFFFFF) ? 0 : crc);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create a key/value store in two flash sectors.
+ *  @details The sectors must be the same size and must not hold any of the program;
+ *  the linker script should leave them out of the memory which the program uses. 
+ *  Nothing is read or written until @c begin() is called.
+ *  @param   p_sector_a A pointer to the start of the first sector
+ *  @param   sector_a_id The flash library's number for the first sector, such as 
+ *           @c FLASH_Sector_6
+ *  @param   p_sector_b A pointer to the start of the second sector
+ *  @param   sector_b_id The flash library's number for the second sector
+ *  @param   sector_bytes The size of each sector in bytes
+ *  @param   p_ser A serial device on which to show debugging messages (default NULL)
+ */
+
+flash_store::flash_store (uint32_t* p_sector_a, uint32_t sector_a_id, 
+						  uint32_t* p_sector_b, uint32_t sector_b_id, 
+						  uint32_t sector_bytes, emstream* p_ser)
+{
+	p_sectors[0] = p_sector_a;
+	p_sectors[1] = p_sector_b;
+	sector_ids[0] = sector_a_id;
+	sector_ids[1] = sector_b_id;
+	sector_words = sector_bytes / 4;
+	active = 0;
+	sequence = 0;
+	used_words = 0;
+	num_keys = 0;
+	compactions = 0;
+	failed_key = FLASH_STORE_NO_KEY;
+	failed_for_room = false;
+	p_serial = p_ser;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find the log, check it, and build the index.
+ *  @details The valid sector with the higher sequence number holds the log. If 
+ *  neither sector is valid, as when the store is first used, the first sector is 
+ *  erased and made into an empty log. If the log has a damaged record, most likely
+ *  from a loss of power while it was being written, the good records are copied to
+ *  the other sector, which then holds the log.
+ *  @return  True if the store is ready to use, false if the flash couldn't be written,
+ *           in which case nothing can be stored
+ */
+
+bool flash_store::begin (void)
+{
+	bool valid[2];
+	for (uint8_t which = 0; which < 2; which++)
+	{
+		valid[which] = (p_sectors[which][0] == FLASH_STORE_MAGIC);
+	}
+
+	if (!valid[0] && !valid[1])
+	{
+		DBG (p_serial, PMS ("Flash store: starting a new log") << endl);
+		uint32_t header[FLASH_STORE_HEADER_WORDS] = {FLASH_STORE_MAGIC, 1};
+		if (!erase (0) || !program (p_sectors[0] + 1, header + 1, 1)
+			|| !program (p_sectors[0], header, 1))
+		{
+			return (false);
+		}
+		active = 0;
+		sequence = 1;
+		used_words = FLASH_STORE_HEADER_WORDS;
+		num_keys = 0;
+		return (true);
+	}
+
+	if (valid[0] && valid[1])
+	{
+		active = (p_sectors[1][1] > p_sectors[0][1]) ? 1 : 0;
+	}
+	else
+	{
+		active = valid[1] ? 1 : 0;
+	}
+	sequence = p_sectors[active][1];
+
+	if (!scan ())
+	{
+		DBG (p_serial, PMS ("Flash store: damaged record at word ") << used_words 
+			 << PMS (", copying good records") << endl);
+		if (!compact ())
+		{
+			used_words = 0;
+			return (false);
+		}
+	}
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read the active sector's log and build the index.
+ *  @details The log ends at the first unwritten word. The index gets the place of the
+ *  newest record for each key.
+ *  @return  True if every record was good, false if a damaged one was found; in that
+ *  case the index holds the records before the damaged one
+ */
+
+bool flash_store::scan (void)
+{
+	const uint32_t* p_sector = p_sectors[active];
+
+	num_keys = 0;
+	used_words = FLASH_STORE_HEADER_WORDS;
+	while (used_words < sector_words && p_sector[used_words] != 0xFFFFFFFF)
+	{
+		const uint32_t* p_record = p_sector + used_words;
+		uint16_t key = (uint16_t)(p_record[0] & 0xFFFF);
+		uint16_t length = (uint16_t)(p_record[0] >> 16);
+		uint32_t words = record_words (length);
+
+		if (key == FLASH_STORE_NO_KEY || length > FLASH_STORE_MAX_DATA
+			|| used_words + words > sector_words
+			|| p_record[words - 1] != record_crc (p_record))
+		{
+			return (false);
+		}
+
+		index_entry* p_entry = find (key);
+		if (p_entry == NULL)
+		{
+			if (num_keys >= FLASH_STORE_MAX_KEYS)
+			{
+				return (false);
+			}
+			p_entry = index + num_keys++;
+			p_entry->key = key;
+		}
+		p_entry->length = length;
+		p_entry->p_record = p_record;
+		used_words += words;
+	}
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Copy the newest records to the other sector and make it active.
+ *  @details The other sector is erased and the records copied into it. Its sequence
+ *  number is written next and the magic number last, so if power is lost before the
+ *  copy is complete the old sector is still the valid one with the newest sequence.
+ *  @return  True if the records were copied, false if the flash couldn't be written
+ */
+
+bool flash_store::compact (void)
+{
+	uint8_t other = 1 - active;
+	uint32_t* p_dest = p_sectors[other] + FLASH_STORE_HEADER_WORDS;
+
+	if (!erase (other))
+	{
+		return (false);
+	}
+	for (uint8_t key_index = 0; key_index < num_keys; key_index++)
+	{
+		uint32_t words = record_words (index[key_index].length);
+		if (!program (p_dest, index[key_index].p_record, words))
+		{
+			return (false);
+		}
+		p_dest += words;
+	}
+
+	uint32_t header[FLASH_STORE_HEADER_WORDS] = {FLASH_STORE_MAGIC, sequence + 1};
+	if (!program (p_sectors[other] + 1, header + 1, 1) 
+		|| !program (p_sectors[other], header, 1))
+	{
+		return (false);
+	}
+
+	// Only now that the copy is complete does the index point into the new sector
+	p_dest = p_sectors[other] + FLASH_STORE_HEADER_WORDS;
+	for (uint8_t key_index = 0; key_index < num_keys; key_index++)
+	{
+		index[key_index].p_record = p_dest;
+		p_dest += record_words (index[key_index].length);
+	}
+	active = other;
+	sequence++;
+	used_words = p_dest - p_sectors[other];
+	compactions++;
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find a key's place in the index.
+ *  @param   key The key to be found
+ *  @return  A pointer to the key's index entry, or NULL if the key isn't stored
+ */
+
+flash_store::index_entry* flash_store::find (uint16_t key)
+{
+	for (uint8_t key_index = 0; key_index < num_keys; key_index++)
+	{
+		if (index[key_index].key == key)
+		{
+			return (index + key_index);
+		}
+	}
+	return (NULL);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read the data stored with a key.
+ *  @param   key The key whose data is to be read
+ *  @param   p_data A pointer to where the data is to be copied
+ *  @param   length The number of bytes expected, which must match the stored record
+ *  @return  True if the data was read, false if the key isn't stored or was stored
+ *           with a different length
+ */
+
+bool flash_store::get (uint16_t key, void* p_data, uint16_t length)
+{
+	index_entry* p_entry = find (key);
+	if (p_entry == NULL || p_entry->length != length)
+	{
+		return (false);
+	}
+	memcpy (p_data, p_entry->p_record + 1, length);
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Store data with a key, replacing any data stored earlier with it.
+ *  @details If the same data is already stored with the key, nothing is written, so
+ *  saving unchanged settings doesn't wear the flash. If the active sector is full, 
+ *  the log is first copied to the other sector, which stops the CPU while it's 
+ *  erased. Failures are recorded rather than printed, as this method may be called
+ *  with the scheduler suspended; @c report_errors() prints them later.
+ *  @param   key The key, which may be any number except @c FLASH_STORE_NO_KEY
+ *  @param   p_data A pointer to the data to be stored
+ *  @param   length The number of bytes, up to @c FLASH_STORE_MAX_DATA
+ *  @return  True if the data was stored, false if the key or length can't be used, 
+ *           there's no room for another key, the flash couldn't be written, or the 
+ *           store hasn't been started by @c begin()
+ */
+
+bool flash_store::put (uint16_t key, const void* p_data, uint16_t length)
+{
+	if (key == FLASH_STORE_NO_KEY || length > FLASH_STORE_MAX_DATA || used_words == 0)
+	{
+		return (false);
+	}
+
+	index_entry* p_entry = find (key);
+	if (p_entry != NULL && p_entry->length == length
+		&& memcmp (p_entry->p_record + 1, p_data, length) == 0)
+	{
+		return (true);
+	}
+	if (p_entry == NULL && num_keys >= FLASH_STORE_MAX_KEYS)
+	{
+		return (false);
+	}
+
+	// Build the whole record in RAM; the CRC is its last word, so it's written last
+	uint32_t record[record_words (FLASH_STORE_MAX_DATA)];
+	uint32_t words = record_words (length);
+	record[words - 2] = 0;
+	record[0] = (uint32_t)key | ((uint32_t)length << 16);
+	memcpy (record + 1, p_data, length);
+	record[words - 1] = record_crc (record);
+
+	if (used_words + words > sector_words)
+	{
+		if (!compact () || used_words + words > sector_words)
+		{
+			failed_key = key;
+			failed_for_room = true;
+			return (false);
+		}
+	}
+
+	uint32_t* p_dest = p_sectors[active] + used_words;
+	used_words += words;
+	if (!program (p_dest, record, words))
+	{
+		failed_key = key;
+		failed_for_room = false;
+		return (false);
+	}
+
+	if (p_entry == NULL)
+	{
+		p_entry = index + num_keys++;
+		p_entry->key = key;
+	}
+	p_entry->length = length;
+	p_entry->p_record = p_dest;
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Show the last failure of @c put() on the serial device, if there was one.
+ *  @details This must only be called while the scheduler is running, as printing may
+ *  wait for the serial port.
+ *  @return  True if a failure had been recorded since this method was last called
+ */
+
+bool flash_store::report_errors (void)
+{
+	if (failed_key == FLASH_STORE_NO_KEY)
+	{
+		return (false);
+	}
+
+	if (failed_for_room)
+	{
+		DBG (p_serial, PMS ("Flash store: no room for key ") << failed_key << endl);
+	}
+	else
+	{
+		DBG (p_serial, PMS ("Flash store: error writing key ") << failed_key << endl);
+	}
+	failed_key = FLASH_STORE_NO_KEY;
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Compute the standard CRC-32 of some bytes.
+ *  @details This is the CRC used by Ethernet and zip files, computed four bits at a 
+ *  time with a 16 entry table to save flash. A long block can be done in pieces by 
+ *  passing each piece's result as the next piece's starting CRC.
+ *  @param   p_data A pointer to the bytes
+ *  @param   length The number of bytes
+ *  @param   crc The CRC of the bytes before these, or 0 for the first piece
+ *  @return  The CRC of all the bytes so far
+ */
+
+uint32_t flash_store::crc32 (const void* p_data, uint32_t length, uint32_t crc)
+{
+	static const uint32_t table[16] =
+	{
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 
+		0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 
+		0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+	};
+	const uint8_t* p_byte = (const uint8_t*)p_data;
+
+	crc = ~crc;
+	while (length--)
+	{
+		crc ^= *p_byte++;
+		crc = (crc >> 4) ^ table[crc & 0x0F];
+		crc = (crc >> 4) ^ table[crc & 0x0F];
+	}
+	return (~crc);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Erase one of the two sectors.
+ *  @details After the sector is erased the flash data cache is cleared, so that old
+ *  contents of the sector can't be read from it.
+ *  @param   which The sector to be erased, 0 or 1
+ *  @return  True if the sector was erased, false if there was a flash error
+ */
+
+bool flash_store::erase (uint8_t which)
+{
+	FLASH_Unlock ();
+	FLASH_ClearFlag (FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR 
+					 | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+	bool ok = (FLASH_EraseSector (sector_ids[which], VoltageRange_3) == FLASH_COMPLETE);
+	FLASH_Lock ();
+
+	FLASH_DataCacheCmd (DISABLE);
+	FLASH_DataCacheReset ();
+	FLASH_DataCacheCmd (ENABLE);
+
+	return (ok);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Program words into erased flash.
+ *  @details The words are programmed one at a time in order, so the last word is 
+ *  written last.
+ *  @param   p_dest A pointer to the first flash word to be programmed
+ *  @param   p_words A pointer to the words to be written
+ *  @param   count The number of words
+ *  @return  True if all the words were programmed, false if there was a flash error
+ */
+
+bool flash_store::program (uint32_t* p_dest, const uint32_t* p_words, uint32_t count)
+{
+	bool ok = true;
+
+	FLASH_Unlock ();
+	FLASH_ClearFlag (FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR 
+					 | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+	for (uint32_t word = 0; word < count && ok; word++)
+	{
+		ok = (FLASH_ProgramWord ((uint32_t)(uintptr_t)(p_dest + word), p_words[word]) 
+			  == FLASH_COMPLETE);
+	}
+	FLASH_Lock ();
+
+	return (ok);
+}
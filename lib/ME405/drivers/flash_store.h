@@ -0,0 +1,182 @@
+//*************************************************************************************
+/** @file    flash_store.h
+ *  @brief   Headers for a small key/value store kept in two sectors of internal flash.
+ *  @details This file contains a class which keeps numbered blocks of data, such as 
+ *           tuned gains and sensor calibrations, in the microcontroller's own flash 
+ *           memory so that they survive a reset. Records are appended to a log in one
+ *           sector; when it fills, the newest copy of each record is copied to the 
+ *           other sector and the two swap roles, so each sector is erased only once 
+ *           per fill. Each record has a CRC, and each sector is marked as valid only 
+ *           when it is complete, so losing power during a write loses at most the 
+ *           record being written.
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _FLASH_STORE_H_
+#define _FLASH_STORE_H_
+
+#include <stdint.h>                         // Integer types with known sizes
+#include "emstream.h"                       // Serial device for debugging messages
+
+
+/// The number of different keys which can be stored.
+const uint8_t FLASH_STORE_MAX_KEYS = 32;
+
+/// The largest number of data bytes in one record.
+const uint16_t FLASH_STORE_MAX_DATA = 64;
+
+/// The first word of a sector which holds a valid log.
+const uint32_t FLASH_STORE_MAGIC = 0x4B565331;
+
+/// A key which can't be used, because it's what an erased record looks like.
+const uint16_t FLASH_STORE_NO_KEY = 0xFFFF;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A log-structured key/value store in two sectors of internal flash.
+ *  @details Each sector starts with a header of two words: a sequence number, 
+ *  written first, and @c FLASH_STORE_MAGIC, written last when the sector is complete.
+ *  The valid sector with the highest sequence number holds the log. Each record in 
+ *  the log is a word holding its key and length, the data padded to whole words, 
+ *  and a CRC-32 of the key, length, and data; the CRC is written last, so a record 
+ *  which was cut off by a power loss fails its check. A record whose key is already
+ *  in the log replaces the earlier one. 
+ *
+ *  When the store is started by @c begin(), the log is read once to build an index 
+ *  of where the newest record for each key is, so later reads don't search the flash.
+ *  If a damaged record is found, the good records are copied to the other sector.
+ *
+ *  The CPU stops while a flash sector is being erased, which takes one or two 
+ *  seconds for the large sectors, so data should only be stored while nothing which
+ *  needs precise timing is running. Erasing and programming are done by virtual 
+ *  methods so that a descendent class can keep the sectors in RAM for testing.
+ *
+ *  Example:
+ *  @code
+ *  flash_store* p_store = new flash_store ((uint32_t*)0x08040000, FLASH_Sector_6,
+ *                                          (uint32_t*)0x08060000, FLASH_Sector_7,
+ *                                          0x20000, p_serial);
+ *  p_store->begin ();
+ *  p_store->put (GAIN_KEY, &gain, sizeof (gain));
+ *  ...
+ *  if (!p_store->get (GAIN_KEY, &gain, sizeof (gain)))
+ *  {
+ *      gain = DEFAULT_GAIN;
+ *  }
+ *  @endcode
+ */
+
+class flash_store
+{
+protected:
+	/// Where in the index each key's newest record is.
+	struct index_entry
+	{
+		uint16_t key;                       ///< The record's key
+		uint16_t length;                    ///< Number of data bytes in the record
+		const uint32_t* p_record;           ///< The record's first word in flash
+	};
+
+	/// Pointers to the first words of the two sectors.
+	uint32_t* p_sectors[2];
+
+	/// The flash library's numbers for the two sectors, used to erase them.
+	uint32_t sector_ids[2];
+
+	/// The number of words in each sector.
+	uint32_t sector_words;
+
+	/// The sector which holds the log, 0 or 1.
+	uint8_t active;
+
+	/// The sequence number of the active sector.
+	uint32_t sequence;
+
+	/// Words of the active sector used so far, or 0 if the store hasn't been started.
+	uint32_t used_words;
+
+	/// The index of the newest record for each key.
+	index_entry index[FLASH_STORE_MAX_KEYS];
+
+	/// The number of keys in the index.
+	uint8_t num_keys;
+
+	/// The number of times the log has been copied to the other sector.
+	uint32_t compactions;
+
+	/// The key which @c put() last failed to store, or @c FLASH_STORE_NO_KEY if none.
+	uint16_t failed_key;
+
+	/// True if that failure was for want of room rather than a flash error.
+	bool failed_for_room;
+
+	/// A serial device on which to show debugging messages, or NULL for none.
+	emstream* p_serial;
+
+	// Read the active sector's log and build the index
+	bool scan (void);
+
+	// Copy the newest records to the other sector and make it active
+	bool compact (void);
+
+	// Find a key's place in the index
+	index_entry* find (uint16_t key);
+
+	// Erase one of the two sectors
+	virtual bool erase (uint8_t which);
+
+	// Program words into erased flash
+	virtual bool program (uint32_t* p_dest, const uint32_t* p_words, uint32_t count);
+
+public:
+	// The constructor saves the sectors' locations
+	flash_store (uint32_t* p_sector_a, uint32_t sector_a_id, uint32_t* p_sector_b, 
+				 uint32_t sector_b_id, uint32_t sector_bytes, emstream* p_ser = NULL);
+
+	// Find the log, check it, and build the index
+	bool begin (void);
+
+	// Read a record's data
+	bool get (uint16_t key, void* p_data, uint16_t length);
+
+	// Write a record, replacing any earlier one with the same key
+	bool put (uint16_t key, const void* p_data, uint16_t length);
+
+	// Show any failure of put() which hasn't yet been reported
+	bool report_errors (void);
+
+	// Compute a CRC-32 of some bytes
+	static uint32_t crc32 (const void* p_data, uint32_t length, uint32_t crc = 0);
+
+	/** @brief   Get the number of unused bytes in the active sector.
+	 *  @return  The number of bytes left before the log must be copied
+	 */
+	uint32_t get_free_bytes (void)
+	{
+		return ((sector_words - used_words) * 4);
+	}
+
+	/** @brief   Get the number of times the log has been copied to the other sector.
+	 *  @return  The number of copies since @c begin() was called
+	 */
+	uint32_t get_compactions (void)
+	{
+		return (compactions);
+	}
+};
+
+#endif // _FLASH_STORE_H_
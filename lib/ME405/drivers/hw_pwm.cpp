@@ -36,8 +36,9 @@
  *           to configure pins for use as PWM outputs. 
  *  @param   timer_number The number of the timer/counter to use, such as 1 for @c TIM1
  *  @param   frequency The frequency in Hz at which the PWM wave should run
- *  @param   resolution The maximum number to which the PWM timer/counter will count,
- *                      which determines the number of levels the PWM output can have
+ *  @param   resolution The number of timer counts in each PWM period, which is the
+ *                      duty cycle count for 100% duty; @c full_resolution() gives 
+ *                      the largest useful value for a given frequency
  */
 
 hw_pwm::hw_pwm (uint8_t timer_number,
@@ -51,8 +52,10 @@ hw_pwm::hw_pwm (uint8_t timer_number,
 	// Save pointers needed by this object
 	p_timer = PWM_TMR_SET[num_timer-1].p_timer;
 
-	// Set the maximum allowable PWM value
-	max_count = resolution - 1;
+	// Set the maximum allowable PWM value. A compare value equal to the number of 
+	// counts per period keeps the output on for the whole period
+	max_count = resolution;
+	max_count_float = (float)resolution;
 
     // Enable the clock to the timer which will be used by the PWM
 	PWM_TMR_SET[num_timer-1].clock_enable_function 
@@ -73,7 +76,7 @@ hw_pwm::hw_pwm (uint8_t timer_number,
 
 	// Set up the time base for the timer
     TIM_TimeBaseInitTypeDef TimeBaseStruct;
-    TimeBaseStruct.TIM_Period = resolution;
+    TimeBaseStruct.TIM_Period = resolution - 1;
     TimeBaseStruct.TIM_Prescaler = prescale;
     TimeBaseStruct.TIM_ClockDivision = 0;
     TimeBaseStruct.TIM_CounterMode = TIM_CounterMode_Up;
@@ -105,6 +108,30 @@ void hw_pwm::activate_pin (GPIO_TypeDef* port,
 						   void (*tim_init_fn)(TIM_TypeDef*, TIM_OCInitTypeDef*),
 						   void (*tim_preload_fn)(TIM_TypeDef*, uint16_t)
 						  )
+{
+	// Set up the pin and connect it to the timer
+	setup_af_pin (port, pin_number);
+
+	// Configure the output compare used by the PWM. TIM_Pulse sets inital duty cycle
+	TIM_OCInitTypeDef OCInitStruct;
+    OCInitStruct.TIM_OCMode = TIM_OCMode_PWM1;
+    OCInitStruct.TIM_OutputState = TIM_OutputState_Enable;
+    OCInitStruct.TIM_Pulse = 0;
+    OCInitStruct.TIM_OCPolarity = TIM_OCPolarity_High;
+    tim_init_fn (p_timer, &OCInitStruct);
+    tim_preload_fn (p_timer, TIM_OCPreload_Enable);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set up a GPIO pin as an alternate function output of this PWM's timer.
+ *  @details This method turns on the clock to the pin's port, makes the pin a push-
+ *           pull alternate function output, and connects it to the timer. 
+ *  @param   port The GPIO port used for the PWM pin, such as @c GPIOB
+ *  @param   pin_number The pin designation of the PWM pin, such as @c 8
+ */
+
+void hw_pwm::setup_af_pin (GPIO_TypeDef* port, uint16_t pin_number)
 {
 	// Enable the clock to the GPIO port. Use a wacky equation to find the clock
 	// number which corresponds to RCC_AHB1Periph_GPIOA, RCC_AHB1Periph_GPIOB, etc.
@@ -128,24 +155,128 @@ void hw_pwm::activate_pin (GPIO_TypeDef* port,
 
 	// Connect the port pin to its alternate source, which is the PWM
 	GPIO_PinAFConfig (port, pin_number, PWM_TMR_SET[num_timer-1].alt_function);
+}
 
-	// Configure the output compare used by the PWM. TIM_Pulse sets inital duty cycle
+
+//-------------------------------------------------------------------------------------
+/** @brief   Activate a PWM output pin and its complementary pin, with dead time.
+ *  @details This method sets up one channel of an advanced control timer (@c TIM1 or
+ *           @c TIM8) to drive a pin and the channel's complementary (CHxN) pin. The
+ *           complementary pin is on whenever the main pin is off, except that the 
+ *           hardware keeps both off for the dead time after each switch so that the
+ *           high and low side switches of a half bridge are never on together. With
+ *           both legs of a motor bridge driven this way, the switch which isn't 
+ *           pulsing carries the current while the other is off (synchronous 
+ *           rectification), and one compare register sets both direction and size of 
+ *           the output: 50% duty is zero average voltage. The main output enable of
+ *           the timer is turned on, with both pins going low if it's turned off. 
+ *  @param   port The GPIO port used for the main PWM pin, such as @c GPIOA
+ *  @param   pin The pin number of the main PWM pin, such as @c 8 for @c TIM1_CH1
+ *  @param   n_port The GPIO port used for the complementary pin, such as @c GPIOB
+ *  @param   n_pin The pin number of the complementary pin, such as @c 13 for 
+ *                 @c TIM1_CH1N
+ *  @param   tim_init_fn Function used to initialize timer/counter's output compare 
+ *                       unit, such as @c TIM_OC1Init
+ *  @param   tim_preload_fn Function to enable peripheral preload register, such as
+ *                          @c TIM_OC1PreloadConfig
+ *  @param   dead_time_ns The dead time in nanoseconds; the driver chip's data sheet
+ *                        gives the time needed. The same dead time is used for all
+ *                        of the timer's channels
+ *  @return  @c true if the pins were set up, @c false if this PWM's timer doesn't have
+ *           complementary outputs
+ */
+
+bool hw_pwm::activate_complementary_pins (GPIO_TypeDef* port, uint16_t pin, 
+						GPIO_TypeDef* n_port, uint16_t n_pin,
+						void (*tim_init_fn)(TIM_TypeDef*, TIM_OCInitTypeDef*),
+						void (*tim_preload_fn)(TIM_TypeDef*, uint16_t),
+						uint16_t dead_time_ns)
+{
+	// Only the advanced control timers have complementary outputs and dead time
+	if (num_timer != 1 && num_timer != 8)
+	{
+		return (false);
+	}
+
+	setup_af_pin (port, pin);
+	setup_af_pin (n_port, n_pin);
+
+	// Both outputs are active high and go low when the outputs are idle
 	TIM_OCInitTypeDef OCInitStruct;
-    OCInitStruct.TIM_OCMode = TIM_OCMode_PWM1;
-    OCInitStruct.TIM_OutputState = TIM_OutputState_Enable;
-    OCInitStruct.TIM_Pulse = 0;
-    OCInitStruct.TIM_OCPolarity = TIM_OCPolarity_High;
-    tim_init_fn (p_timer, &OCInitStruct);
-    tim_preload_fn (p_timer, TIM_OCPreload_Enable);
+	OCInitStruct.TIM_OCMode = TIM_OCMode_PWM1;
+	OCInitStruct.TIM_OutputState = TIM_OutputState_Enable;
+	OCInitStruct.TIM_OutputNState = TIM_OutputNState_Enable;
+	OCInitStruct.TIM_Pulse = 0;
+	OCInitStruct.TIM_OCPolarity = TIM_OCPolarity_High;
+	OCInitStruct.TIM_OCNPolarity = TIM_OCNPolarity_High;
+	OCInitStruct.TIM_OCIdleState = TIM_OCIdleState_Reset;
+	OCInitStruct.TIM_OCNIdleState = TIM_OCNIdleState_Reset;
+	tim_init_fn (p_timer, &OCInitStruct);
+	tim_preload_fn (p_timer, TIM_OCPreload_Enable);
+
+	// Set the dead time; the break input isn't used
+	TIM_BDTRInitTypeDef BDTRInitStruct;
+	BDTRInitStruct.TIM_OSSRState = TIM_OSSRState_Enable;
+	BDTRInitStruct.TIM_OSSIState = TIM_OSSIState_Enable;
+	BDTRInitStruct.TIM_LOCKLevel = TIM_LOCKLevel_OFF;
+	BDTRInitStruct.TIM_DeadTime = dead_time_code (dead_time_ns);
+	BDTRInitStruct.TIM_Break = TIM_Break_Disable;
+	BDTRInitStruct.TIM_BreakPolarity = TIM_BreakPolarity_High;
+	BDTRInitStruct.TIM_AutomaticOutput = TIM_AutomaticOutput_Disable;
+	TIM_BDTRConfig (p_timer, &BDTRInitStruct);
+
+	// Advanced timers' outputs stay off until the main output enable bit is set
+	TIM_CtrlPWMOutputs (p_timer, ENABLE);
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find the dead time generator setting for a dead time in nanoseconds.
+ *  @details The 8-bit dead time setting in an advanced timer's BDTR register uses 
+ *           its top bits to choose one of four ranges with coarser steps for longer
+ *           times. This function picks the finest range which can reach the given 
+ *           time and rounds up, so the dead time is never shorter than asked for. It
+ *           assumes the timer runs from the system core clock with no clock division,
+ *           as in @c full_resolution(). Times beyond the longest possible (1008 timer
+ *           clocks, about 10 us at 100 MHz) give the longest dead time. 
+ *  @param   dead_time_ns The desired dead time in nanoseconds
+ *  @return  The dead time generator setting for the BDTR register's DTG bits
+ */
+
+uint8_t hw_pwm::dead_time_code (uint32_t dead_time_ns)
+{
+	// Dead time in timer clock cycles, rounded up
+	uint32_t clocks_per_us = SystemCoreClock / 1000000UL;
+	uint32_t ticks = (dead_time_ns * clocks_per_us + 999) / 1000;
+
+	if (ticks <= 127)                       // 0xxxxxxx: DTG steps of 1 clock
+	{
+		return ((uint8_t)ticks);
+	}
+	if (ticks <= 2 * 127)                   // 10xxxxxx: (64 + DTG) steps of 2
+	{
+		return ((uint8_t)(0x80 | ((ticks + 1) / 2 - 64)));
+	}
+	if (ticks <= 8 * 63)                    // 110xxxxx: (32 + DTG) steps of 8
+	{
+		return ((uint8_t)(0xC0 | ((ticks + 7) / 8 - 32)));
+	}
+	if (ticks <= 16 * 63)                   // 111xxxxx: (32 + DTG) steps of 16
+	{
+		return ((uint8_t)(0xE0 | ((ticks + 15) / 16 - 32)));
+	}
+	return (0xFF);
 }
 
 
 //-------------------------------------------------------------------------------------
 /** @brief   Set the duty cycle for the PWM output on one PWM pin.
  *  @details This method sets the duty cycle for a GPIO pin's PWM output. The duty 
- *           cycle must be a number between 0 and the maximum count of the 
- *           timer/counter used by the PWM generator, which was set in the constructor
- *           of the @c stm32_pwm object associated with this pin. 
+ *           cycle must be a number between 0 and the resolution of the PWM 
+ *           generator, which was set in the constructor of the @c stm32_pwm object 
+ *           associated with this pin; the resolution gives a 100% duty cycle. 
  *  @param   channel The channel of the timer/counter being used for this PWM output
  *  @param   new_duty_cycle The new duty cycle number to set
  */
@@ -163,3 +294,140 @@ void hw_pwm::set_duty_cycle (uint8_t channel, uint16_t new_duty_cycle)
 	// (It's still a little more elegant than a bunch of if-then's or a switch/case)
 	*(&(p_timer->CCR1) + (channel - 1)) = new_duty_cycle;
 }
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set the duty cycle for one PWM pin as a fraction of full on.
+ *  @details This method scales a duty cycle from 0.0 to 1.0 to the resolution of the
+ *           PWM generator, so code which uses it needn't know the resolution. Values
+ *           outside the range are limited to 0.0 and 1.0. 
+ *  @param   channel The channel of the timer/counter being used for this PWM output
+ *  @param   fraction The new duty cycle, from 0.0 (always off) to 1.0 (always on)
+ */
+
+void hw_pwm::set_duty_fraction (uint8_t channel, float fraction)
+{
+	if (fraction <= 0.0f)
+	{
+		fraction = 0.0f;
+	}
+	else if (fraction > 1.0f)
+	{
+		fraction = 1.0f;
+	}
+
+	*(&(p_timer->CCR1) + (channel - 1)) = (uint16_t)(fraction * max_count_float + 0.5f);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find the finest resolution a timer can have at a given PWM frequency.
+ *  @details With the prescaler set to divide by one, a timer counts once per timer 
+ *           clock cycle, so the number of counts per PWM period is the timer clock
+ *           frequency divided by the PWM frequency. With the clock configuration for 
+ *           which the constructor's prescaler formula is written, that's the system 
+ *           core clock divided by the PWM frequency -- 5000 counts at 20 kHz with a 
+ *           100 MHz clock. The result is limited to what fits in 16 bits. 
+ *  @param   frequency The frequency of the PWM wave in Hz
+ *  @return  The resolution to give the constructor for the finest possible steps
+ */
+
+uint16_t hw_pwm::full_resolution (uint32_t frequency)
+{
+	uint32_t counts = SystemCoreClock / frequency;
+
+	return ((counts > 0xFFFF) ? 0xFFFF : (uint16_t)counts);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Make this PWM's timer restart each period in step with another's timer.
+ *  @details This method sets up the other PWM's timer as a master which sends its 
+ *           update event out as a trigger, and this PWM's timer as a slave which 
+ *           resets its counter, and updates its compare registers from their preload
+ *           registers, whenever that trigger arrives. Both timers should have the same 
+ *           frequency and resolution. Afterwards, new duty cycles written to both 
+ *           timers while updates are held with @c hold_updates() take effect on the 
+ *           same PWM edge when updates are released. 
+ *
+ *           The internal trigger connections between timers are fixed in hardware; 
+ *           this method knows the ones among @c TIM2 through @c TIM5 (see the timer
+ *           internal trigger connection tables in the reference manual). 
+ *  @param   p_master A pointer to the PWM whose timer will be the master
+ *  @return  @c true if the timers were linked, @c false if there's no internal 
+ *           trigger from the master's timer to this one
+ */
+
+bool hw_pwm::sync_to_master (hw_pwm* p_master)
+{
+	// Internal trigger ITR0 - ITR3 inputs of timers 2 through 5, given as the number
+	// of the timer which drives each one; 0 means no timer this method can use
+	static const uint8_t itr_source[4][4] =
+	{
+		{1, 8, 3, 4},                       // TIM2
+		{1, 2, 5, 4},                       // TIM3
+		{1, 2, 3, 8},                       // TIM4
+		{2, 3, 4, 8}                        // TIM5
+	};
+	static const uint16_t itr_select[4] = 
+		{TIM_TS_ITR0, TIM_TS_ITR1, TIM_TS_ITR2, TIM_TS_ITR3};
+
+	if (num_timer < 2 || num_timer > 5)
+	{
+		return (false);
+	}
+
+	for (uint8_t itr = 0; itr < 4; itr++)
+	{
+		if (itr_source[num_timer - 2][itr] == p_master->num_timer)
+		{
+			// The master sends its update event out as a trigger
+			TIM_SelectOutputTrigger (p_master->p_timer, TIM_TRGOSource_Update);
+			TIM_SelectMasterSlaveMode (p_master->p_timer, TIM_MasterSlaveMode_Enable);
+
+			// This timer's counter is reset, and its registers updated, by the trigger
+			TIM_SelectInputTrigger (p_timer, itr_select[itr]);
+			TIM_SelectSlaveMode (p_timer, TIM_SlaveMode_Reset);
+
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Use a channel of this PWM's timer to start A/D conversions each period.
+ *  @details This method puts a channel whose pin isn't used into PWM mode 2 with its
+ *           output turned off. Its internal output then rises when the counter 
+ *           reaches the given count in every period, and the A/D converter can be 
+ *           set to start conversions on that edge (for example, with 
+ *           @c ADC_ExternalTrigInjecConv_T3_CC4 for channel 4 of @c TIM3). Motor
+ *           current can then be measured at the same point in every PWM cycle, away
+ *           from the switching edges of the other channels. 
+ *  @param   channel The channel of the timer/counter, from 1 to 4
+ *  @param   count The count within each period at which the trigger occurs; it must
+ *           be less than the PWM's resolution
+ *  @return  @c true if the channel was set up, @c false if the arguments are invalid
+ */
+
+bool hw_pwm::set_adc_trigger (uint8_t channel, uint16_t count)
+{
+	static void (* const init_fns[4])(TIM_TypeDef*, TIM_OCInitTypeDef*) = 
+		{TIM_OC1Init, TIM_OC2Init, TIM_OC3Init, TIM_OC4Init};
+
+	if (channel < 1 || channel > 4 || count >= max_count)
+	{
+		return (false);
+	}
+
+	TIM_OCInitTypeDef TIM_OCInitStruct;
+	TIM_OCStructInit (&TIM_OCInitStruct);
+	TIM_OCInitStruct.TIM_OCMode = TIM_OCMode_PWM2;
+	TIM_OCInitStruct.TIM_OutputState = TIM_OutputState_Disable;
+	TIM_OCInitStruct.TIM_Pulse = count;
+	init_fns[channel - 1] (p_timer, &TIM_OCInitStruct);
+
+	return (true);
+}
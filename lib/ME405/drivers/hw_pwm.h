@@ -100,13 +100,19 @@ protected:
 	/// A pointer to the timer/counter used by this PWM generator.
 	TIM_TypeDef* p_timer;
 
-	/** @brief   The maximum value to which the timer/counter will count.
-	 *  @details This value is the maximum number to which the timer/counter for this
-	 *           PWM generator will count before rolling over to zero. It sets the 
-	 *           resolution of the PWM generator. 
+	/** @brief   The duty cycle count which gives a 100% duty cycle.
+	 *  @details This value is the number of timer counts in one PWM period; the 
+	 *           timer/counter counts from zero to one less than this number and then
+	 *           rolls over. It sets the resolution of the PWM generator. 
 	 */
 	uint16_t max_count;
 
+	/// The duty cycle count for a 100% duty cycle as a float, for scaling fractions.
+	float max_count_float;
+
+	// Set up a GPIO pin as an alternate function output of this PWM's timer
+	void setup_af_pin (GPIO_TypeDef* port, uint16_t pin_number);
+
 public:
 	// Constructor sets up timer N at frequency F and resolution Q
 	hw_pwm (uint8_t timer_number, uint32_t frequency, uint16_t resolution);
@@ -118,8 +124,76 @@ public:
 					   void (*tim_preload_fn)(TIM_TypeDef*, uint16_t)
 					  );
 
+	// Method which sets up a pin and its complement with dead time (TIM1, TIM8 only)
+	bool activate_complementary_pins (GPIO_TypeDef* port, uint16_t pin, 
+						GPIO_TypeDef* n_port, uint16_t n_pin,
+						void (*tim_init_fn)(TIM_TypeDef*, TIM_OCInitTypeDef*),
+						void (*tim_preload_fn)(TIM_TypeDef*, uint16_t),
+						uint16_t dead_time_ns);
+
+	// Find the dead time generator setting closest to a time in nanoseconds
+	static uint8_t dead_time_code (uint32_t dead_time_ns);
+
 	// Method which sets the PWM duty cycle for one PWM channel
 	void set_duty_cycle (uint8_t channel, uint16_t new_duty_cycle);
+
+	// Method which sets the duty cycle as a fraction from 0.0 to 1.0
+	void set_duty_fraction (uint8_t channel, float fraction);
+
+	// Find the finest resolution a timer can have at a given PWM frequency
+	static uint16_t full_resolution (uint32_t frequency);
+
+	// Make this PWM's timer restart each period in step with another PWM's timer
+	bool sync_to_master (hw_pwm* p_master);
+
+	// Use a spare channel's compare event to start A/D conversions each period
+	bool set_adc_trigger (uint8_t channel, uint16_t count);
+
+	/** @brief   Stop new duty cycles from taking effect until @c release_updates().
+	 *  @details This method sets the timer's update disable bit, so duty cycle values
+	 *           written to the (preloaded) compare registers are held back rather 
+	 *           than being copied to the active registers at the end of the period. 
+	 *           Several channels, or several timers which have been synchronized with
+	 *           @c sync_to_master(), can then be given new duty cycles which all take
+	 *           effect on the same PWM edge. 
+	 */
+	void hold_updates (void)
+	{
+		p_timer->CR1 |= TIM_CR1_UDIS;
+	}
+
+	/** @brief   Let held duty cycles take effect at the end of the current period.
+	 */
+	void release_updates (void)
+	{
+		p_timer->CR1 &= (uint16_t)~TIM_CR1_UDIS;
+	}
+
+	/** @brief   Get the address of the output compare register for one channel.
+	 *  @details Code which must update a duty cycle very quickly can save this address
+	 *           once and then write duty cycle counts to it directly, skipping the 
+	 *           channel lookup and bounds check in @c set_duty_cycle(). The caller 
+	 *           is then responsible for never writing more than @c get_max_count().
+	 *  @param   channel The channel of the timer/counter, from 1 to 4
+	 *  @return  A pointer to the channel's output compare register, or @c NULL if the
+	 *           channel number isn't from 1 to 4
+	 */
+	volatile uint32_t* get_ccr_address (uint8_t channel)
+	{
+		if (channel < 1 || channel > 4)
+		{
+			return (NULL);
+		}
+		return (&(p_timer->CCR1) + (channel - 1));
+	}
+
+	/** @brief   Get the largest duty cycle count which this PWM can output.
+	 *  @return  The maximum duty cycle count
+	 */
+	uint16_t get_max_count (void)
+	{
+		return (max_count);
+	}
 };
 
 
@@ -182,6 +182,36 @@ int16_t mma8452q::get_one_axis (uint8_t the_axis)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** @brief   Read the acceleration on all three axes in one I2C transaction.
+ *  @details The X, Y, and Z data registers follow one another in the MMA8452Q, so one
+ *           burst read gets all six bytes. This costs one address and register write
+ *           instead of three, taking about a third as long on the bus as three calls
+ *           to @c get_one_axis(), and the three axes come from the same conversion. 
+ *           The readings are in the same units as those from @c get_one_axis().
+ *  @param   p_data A pointer to an array into which the X, Y, and Z readings are put
+ *  @return  @c true if the readings were taken or @c false if there's no working 
+ *           accelerometer or the I2C transaction failed
+ */
+
+bool mma8452q::get_all_axes (int16_t* p_data)
+{
+	uint8_t raw_data[6];                    // Bytes in the order MSB, LSB for X, Y, Z
+
+	if (!working || p_I2C->read (i2c_address, 0x01, raw_data, 6))
+	{
+		return (false);
+	}
+
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		p_data[axis] = (int16_t)(((uint16_t)raw_data[2 * axis] << 8) 
+								 | raw_data[2 * axis + 1]);
+	}
+	return (true);
+}
+
+
 //-------------------------------------------------------------------------------------
 /** @brief   Method to set the full-scale acceleration range to +/-2, 4, or 8 g's.
  *  @details Before this method is called, the accelerometer must be put into standby
@@ -132,6 +132,9 @@ public:
 	// This method reads the current acceleration in one direction: 0 = X, 1 = Y, 2 = Z
 	int16_t get_one_axis (uint8_t);
 
+	// This method reads all three axes in one I2C transaction
+	bool get_all_axes (int16_t* p_data);
+
 	// Method to set the acceleration range to 2, 4, or 8 g's
 	void set_range (mma8452q_range_t range);
 
@@ -35,9 +35,9 @@
  *           channels of that timer/counter to use for the A and B encoder inputs,
  *           this constructor calls code which is mostly supplied by macros to 
  *           initialize the timer/counter, software counter, and GPIO pins. 
- *  @param   timer The STM32 timer/counter used, from @c TIM1 to @c TIM8
- *  @param   A_channel The timer/counter channel to use for encoder signal A
- *  @param   B_channel The timer/counter channel to use for encoder signal B
+ *  @param   timer The number of the STM32 timer/counter used: 1 to 5 or 8
+ *  @param   A_channel The timer/counter channel, 1 or 2, to use for encoder signal A
+ *  @param   B_channel The timer/counter channel, 1 or 2, to use for encoder signal B
  *  @param   p_ser_dev A pointer to a serial device which is used to print debugging
  *                     messages (only defined if @c QUAD_SER_DBG has been defined)
  */
@@ -59,97 +59,61 @@ quad_counter::quad_counter (uint8_t timer, uint16_t A_channel, uint16_t B_channe
 	// Make sure the timer number is valid and the channel numbers are valid; if not,
 	// the timer pointer will be NULL and this object won't do anything
 	p_timer = NULL;
-	if (A_channel <= 15 && B_channel <= 15)
+	if (A_channel >= 1 && A_channel <= 2 && B_channel >= 1 && B_channel <= 2
+		&& ((timer >= 1 && timer <= 5) || timer == 8))
 	{
-		if (timer >= 1 && timer <= 5)
-		{
-			tc_set = TC_SET[timer - 1];
-		}
-		else if (timer == 8)
-		{
-			tc_set = TC_SET[5];
-		}
-		else
-		{
-			QUAD_DBG ("ERROR: Invalid quadrature decoder configuration" << endl);
-			return;
-		}
+		tc_set = TC_SET[(timer == 8) ? 5 : (timer - 1)];
+	}
+	else
+	{
+		QUAD_DBG ("ERROR: Invalid quadrature decoder configuration" << endl);
+		return;
 	}
-
-// 	// Save a pointer to the timer/counter being used for this object
-// 	p_timer = tc_set.p_timer;
-// 
-// 	// Enable the clock to the GPIO port which is used for the pins
-// 	RCC_AHB1PeriphClockCmd (tc_set.gpio_clock, ENABLE);
-// 
-// 	// Set up the pins used as channel A and B as inputs with pullup resitors on
-// 	QUAD_DBG ("Channels " << A_channel << " and " << B_channel << endl);
-// 	GPIO_InitTypeDef GPIO_InitStruct;
-// 	GPIO_StructInit (&GPIO_InitStruct);
-// 	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF;
-// 	GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_UP;
-// 	GPIO_InitStruct.GPIO_Pin = 1 << (tc_set.pin_number[A_channel-1]);
-// 	GPIO_Init (tc_set.p_port, &GPIO_InitStruct);
-// 	GPIO_InitStruct.GPIO_Pin = 1 << (tc_set.pin_number[B_channel-1]);
-// 	GPIO_Init (tc_set.p_port, &GPIO_InitStruct);
-// 
-// 	QUAD_DBG ("Pins: " << tc_set.pin_number[A_channel-1]
-// 		<< " and " << tc_set.pin_number[B_channel-1] << endl);
-// 	QUAD_DBG ("Pin mask: " << bin 
-// 		<< (uint16_t)((1 << (tc_set.pin_number[A_channel-1]))
-// 			| (1 << (tc_set.pin_number[B_channel-1]))) << dec << endl);
-//  
-// 	// Connect the pins to the alternate functions of encoder A/B sources
-// 	GPIO_PinAFConfig (tc_set.p_port, tc_set.pin_number[A_channel-1], 
-// 					  tc_set.alt_function);
-// 	GPIO_PinAFConfig (tc_set.p_port, tc_set.pin_number[B_channel-1], 
-// 					  tc_set.alt_function);
-// 
-// 	// Enable the timer/counter's clock signal
-// 	RCC_APB1PeriphClockCmd (tc_set.timer_clock, ENABLE);
-// 
-// 	// Configure the encoder interface
-// 	TIM_EncoderInterfaceConfig (p_timer, TIM_EncoderMode_TI12, 
-// 								TIM_ICPolarity_Rising, 
-// 								TIM_ICPolarity_Rising);
-// 	TIM_SetAutoreload (p_timer, 0xFFFF);
-// 
-// 	// Turn on the timer/counter being used
-// 	TIM_Cmd (p_timer, ENABLE);
-//
 
 	// Save a pointer to the timer/counter being used for this object
-	p_timer = TIM4;
+	p_timer = tc_set.p_timer;
 
 	// Enable the clock to the GPIO port which is used for the pins
-	RCC_AHB1PeriphClockCmd (RCC_AHB1Periph_GPIOB, ENABLE);
+	RCC_AHB1PeriphClockCmd (tc_set.gpio_clock, ENABLE);
 
-	// Set up the pins used as channel A and B as inputs with pullup resitors on
+	// Set up the pins used as channel A and B as alternate function inputs
 	GPIO_InitTypeDef GPIO_InitStruct;
 	GPIO_StructInit (&GPIO_InitStruct);
 	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF;
 	GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_NOPULL;
 	GPIO_InitStruct.GPIO_Speed = GPIO_Speed_25MHz;
-	GPIO_InitStruct.GPIO_Pin = GPIO_Pin_6;
-	GPIO_Init (GPIOB, &GPIO_InitStruct);
-	GPIO_InitStruct.GPIO_Pin = GPIO_Pin_7;
-	GPIO_Init (GPIOB, &GPIO_InitStruct);
+	GPIO_InitStruct.GPIO_Pin = 1 << (tc_set.pin_number[A_channel-1]);
+	GPIO_Init (tc_set.p_port, &GPIO_InitStruct);
+	GPIO_InitStruct.GPIO_Pin = 1 << (tc_set.pin_number[B_channel-1]);
+	GPIO_Init (tc_set.p_port, &GPIO_InitStruct);
 
-	// Enable the timer/counter's clock signal
-	RCC_APB1PeriphClockCmd (RCC_APB1Periph_TIM4, ENABLE);
+	QUAD_DBG ("Pins: " << tc_set.pin_number[A_channel-1]
+		<< " and " << tc_set.pin_number[B_channel-1] << endl);
+
+	// Enable the timer/counter's clock signal; TIM1 and TIM8 are on the APB2 bus
+	if (timer == 1 || timer == 8)
+	{
+		RCC_APB2PeriphClockCmd (tc_set.timer_clock, ENABLE);
+	}
+	else
+	{
+		RCC_APB1PeriphClockCmd (tc_set.timer_clock, ENABLE);
+	}
 
 	// Configure the encoder interface
-	TIM_EncoderInterfaceConfig (TIM4, TIM_EncoderMode_TI12, 
+	TIM_EncoderInterfaceConfig (p_timer, TIM_EncoderMode_TI12, 
 								TIM_ICPolarity_Rising, 
 								TIM_ICPolarity_Rising);
-	TIM_SetAutoreload (TIM4, 0xFFFF);
+	TIM_SetAutoreload (p_timer, 0xFFFF);
 
 	// Connect the pins to the alternate functions of encoder A/B sources
-	GPIO_PinAFConfig (GPIOB, 6, GPIO_AF_TIM4);
-	GPIO_PinAFConfig (GPIOB, 7, GPIO_AF_TIM4);
-	
+	GPIO_PinAFConfig (tc_set.p_port, tc_set.pin_number[A_channel-1], 
+					  tc_set.alt_function);
+	GPIO_PinAFConfig (tc_set.p_port, tc_set.pin_number[B_channel-1], 
+					  tc_set.alt_function);
+
 	// Turn on the timer/counter being used
-	TIM_Cmd (TIM4, ENABLE);
+	TIM_Cmd (p_timer, ENABLE);
 
 	// Might as well begin with the software encoder counter set to zero
 	zero ();
@@ -0,0 +1,115 @@
+//*************************************************************************************
+/** @file    quad_speed.cpp
+ *  @brief   Source code for a class which estimates speed from a quadrature encoder.
+ *  @details This file contains the source for a speed estimator which uses a count of
+ *           encoder edges at high speed and the time between edges at low speed. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+#include "quad_speed.h"                     // Header for this class
+#include "cycle_count.h"                    // Timing with the CPU cycle counter
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create a speed estimator for a quadrature encoder.
+ *  @details This constructor starts the CPU cycle counter, which is used to time the
+ *           estimation windows, and starts the first window at the encoder's present
+ *           position. 
+ *  @param   p_quad A pointer to the encoder counter whose speed is to be found
+ *  @param   a_min_counts The number of counts which must pass before a window is 
+ *                        closed; larger numbers give smoother but slower estimates
+ *  @param   max_window_us The longest time in microseconds to wait for edges before 
+ *                         the speed is taken to be zero
+ */
+
+quad_speed::quad_speed (quad_counter* p_quad, uint16_t a_min_counts, 
+						uint32_t max_window_us)
+{
+	p_counter = p_quad;
+	min_counts = (a_min_counts > 0) ? a_min_counts : 1;
+
+	cycle_count_enable ();
+	cycles_per_second = (float)SystemCoreClock;
+	max_window_cycles = (SystemCoreClock / 1000000UL) * max_window_us;
+
+	window_count = p_counter->get ();
+	window_time = cycle_count ();
+	last_change_count = window_count;
+	last_change_time = window_time;
+	speed = 0.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read the encoder and update the speed estimate.
+ *  @details This method should be called regularly, at least several times per
+ *           @c max_window_us. When a window has collected @c min_counts edges, the 
+ *           speed is the number of counts divided by the time from the window's start
+ *           to the last update in which the count changed, and a new window begins 
+ *           there. While a window is still open, the speed is only reduced if that is
+ *           needed to be consistent with no further edges having arrived. 
+ *  @return  The speed in encoder counts per second
+ */
+
+float quad_speed::update (void)
+{
+	QUAD_CTR_TYPE count = p_counter->get ();
+	uint32_t now = cycle_count ();
+
+	// Remember when the count last changed, as that's the nearest we know to an edge
+	if (count != last_change_count)
+	{
+		last_change_count = count;
+		last_change_time = now;
+	}
+
+	QUAD_CTR_TYPE counts = last_change_count - window_count;
+	uint32_t cycles = last_change_time - window_time;
+
+	if ((counts >= min_counts || counts <= -(QUAD_CTR_TYPE)min_counts) && cycles > 0)
+	{
+		// Enough edges; close the window at the last change and start a new one there
+		speed = (float)counts * cycles_per_second / (float)cycles;
+		window_count = last_change_count;
+		window_time = last_change_time;
+	}
+	else
+	{
+		uint32_t waited = now - last_change_time;
+		if (waited >= max_window_cycles)
+		{
+			// No edges for too long; the shaft has stopped
+			speed = 0.0f;
+			window_count = count;
+			window_time = now;
+		}
+		else if (waited > 0)
+		{
+			// The speed can't be more than one count in the time since the last one
+			float limit = cycles_per_second / (float)waited;
+			if (speed > limit)
+			{
+				speed = limit;
+			}
+			else if (speed < -limit)
+			{
+				speed = -limit;
+			}
+		}
+	}
+
+	return (speed);
+}
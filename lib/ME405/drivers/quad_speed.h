@@ -0,0 +1,109 @@
+//*************************************************************************************
+/** @file    quad_speed.h
+ *  @brief   Headers for a class which estimates speed from a quadrature encoder.
+ *  @details This file contains a class which uses a @c quad_counter to estimate the 
+ *           speed of a shaft. Counting encoder edges over a fixed interval gives good
+ *           estimates at high speed but only a few coarse levels at low speed, while
+ *           timing the interval between edges does the opposite; this class switches 
+ *           between the two automatically. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _QUAD_SPEED_H_
+#define _QUAD_SPEED_H_
+
+#include "quad_counter.h"                   // The encoder counter whose speed is found
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Estimates speed from a quadrature encoder by a period/frequency hybrid.
+ *  @details Each call to @c update() reads the encoder and the CPU cycle counter. The
+ *           estimate is made over a window which begins at an instant when the count
+ *           changed. The window is closed, and a new speed computed, as soon as at 
+ *           least @c min_counts edges have been seen, ending the window at the most 
+ *           recent update in which the count changed:
+ *           \li At high speed many edges arrive between updates, so each window is 
+ *               one update long and the estimate is edges divided by time, the 
+ *               @a frequency method.
+ *           \li At low speed the window stretches over several updates until enough
+ *               edges have passed, and the estimate is the number of edges divided by
+ *               the time between the first and last updates with an edge, which is the
+ *               @a period method with time measured at the update instants. 
+ *           \li If no edges arrive for @c max_window_us the shaft is taken to be 
+ *               stopped. Before then, the speed is limited to what is consistent with
+ *               no edge having arrived yet, so a stopping shaft's speed falls smoothly.
+ *
+ *           Speeds are in encoder counts per second; each count is one edge of either
+ *           channel, so there are four counts per encoder line. 
+ */
+
+class quad_speed
+{
+protected:
+	/// The encoder counter which is read.
+	quad_counter* p_counter;
+
+	/// The number of counts needed before a window is closed.
+	uint16_t min_counts;
+
+	/// The longest window, in CPU clock cycles, before the speed is taken as zero.
+	uint32_t max_window_cycles;
+
+	/// Encoder count at the start of the current window.
+	QUAD_CTR_TYPE window_count;
+
+	/// CPU cycle count at the start of the current window.
+	uint32_t window_time;
+
+	/// Encoder count the last time an update saw the count change.
+	QUAD_CTR_TYPE last_change_count;
+
+	/// CPU cycle count the last time an update saw the count change.
+	uint32_t last_change_time;
+
+	/// The most recent speed estimate in counts per second.
+	float speed;
+
+	/// CPU clock cycles per second as a float, for converting to counts per second.
+	float cycles_per_second;
+
+public:
+	// The constructor saves the counter and the window settings
+	quad_speed (quad_counter* p_quad, uint16_t a_min_counts = 4, 
+				uint32_t max_window_us = 100000UL);
+
+	// Read the encoder and update the speed estimate; call this periodically
+	float update (void);
+
+	/** @brief   Get the most recent speed estimate without reading the encoder.
+	 *  @return  The speed in encoder counts per second
+	 */
+	float get_speed (void)
+	{
+		return (speed);
+	}
+
+	/** @brief   Get the most recent position from the encoder.
+	 *  @return  The encoder count as of the most recent update
+	 */
+	QUAD_CTR_TYPE get_position (void)
+	{
+		return (last_change_count);
+	}
+};
+
+#endif  // _QUAD_SPEED_H_
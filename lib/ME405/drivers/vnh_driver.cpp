@@ -104,7 +104,9 @@ vnh_driver::vnh_driver (GPIO_TypeDef* port_for_INA, uint16_t pin_for_INA,
 /** @brief   Method to apply torque to the motor at a given PWM level and direction.
  *  @details This method causes the motor driver to be put into clockwise or 
  *           counterclockwise mode and the PWM duty cycle set according to the 
- *           absolute value of the given level. 
+ *           absolute value of the given level. A level whose magnitude equals the 
+ *           PWM driver's resolution, @c hw_pwm::get_max_count(), gives 100% duty;
+ *           larger magnitudes are limited to that. 
  *  @param   pwm_level The absolute value of this number controls PWM duty cycle and
  *                     the sign controls which way the motor torque will be applied
  */
@@ -123,12 +125,14 @@ void vnh_driver::actuate (int16_t pwm_level)
 		INB_port->ODR |= INB_pin_mask;
 	}
 
-	// Set the duty cycle according to the magnitude of the PWM level
+	// Set the duty cycle according to the magnitude of the PWM level. The magnitude
+	// is found as unsigned, as -32768 has no positive int16_t counterpart
+	uint16_t magnitude = (uint16_t)pwm_level;
 	if (pwm_level < 0)
 	{
-		pwm_level = -pwm_level;
+		magnitude = (uint16_t)(-(int32_t)pwm_level);
 	}
-	p_pwm->set_duty_cycle (pwm_channel, pwm_level);
+	p_pwm->set_duty_cycle (pwm_channel, magnitude);
 }
 
 
@@ -138,7 +142,9 @@ void vnh_driver::actuate (int16_t pwm_level)
  *           to ground by the motor driver chip when the PWM signal is high. The given
  *           level controls the fraction of the time during which the PWM signal is 
  *           high and hence how strongly the motor will brake. 
- *  @param   pwm_level The duty cycle of the PWM, controlling how strong the braking is
+ *  @param   pwm_level The duty cycle of the PWM, controlling how strong the braking is;
+ *                     the PWM driver's resolution, @c hw_pwm::get_max_count(), brakes
+ *                     fully
  */
 
 void vnh_driver::brake (uint16_t pwm_level)
@@ -0,0 +1,89 @@
+//*************************************************************************************
+/** @file    cycle_count.h
+ *  @brief   Functions which time short pieces of code with the CPU's cycle counter.
+ *  @details The Cortex-M4 has a 32-bit counter in its Data Watchpoint and Trace (DWT)
+ *           unit which counts every CPU clock cycle. These functions turn the counter
+ *           on and read it so that the run time of a function or task loop can be 
+ *           measured to one clock cycle, far finer than the RTOS tick. At 100 MHz 
+ *           the counter wraps around after about 42 seconds, so it is only useful for
+ *           timing intervals shorter than that. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _CYCLE_COUNT_H_
+#define _CYCLE_COUNT_H_
+
+#include <stdint.h>                         // Integer types with known sizes
+#include "stm32f4xx.h"                      // Has CoreDebug and SystemCoreClock
+
+
+/* The version of core_cm4.h in this library doesn't describe the DWT unit, so the two
+ * registers needed here are given by their addresses in the ARMv7-M memory map. 
+ */
+
+/// The DWT control register, which has the cycle counter enable bit
+#define CYC_DWT_CTRL      (*(volatile uint32_t*)0xE0001000UL)
+
+/// The DWT cycle count register
+#define CYC_DWT_CYCCNT    (*(volatile uint32_t*)0xE0001004UL)
+
+/// Bit in the DWT control register which starts the cycle counter
+#define CYC_CYCCNTENA     (1UL << 0)
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Turn on the DWT cycle counter.
+ *  @details This function enables the trace unit and starts the cycle counter. It may
+ *           be called more than once; the counter isn't reset if it's already running.
+ */
+
+inline void cycle_count_enable (void)
+{
+	if (!(CYC_DWT_CTRL & CYC_CYCCNTENA))
+	{
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		CYC_DWT_CYCCNT = 0;
+		CYC_DWT_CTRL |= CYC_CYCCNTENA;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read the DWT cycle counter.
+ *  @details The difference of two readings, computed with unsigned 32-bit arithmetic,
+ *           is correct even if the counter has wrapped around once between them. 
+ *  @return  The number of CPU clock cycles since the counter was started
+ */
+
+inline uint32_t cycle_count (void)
+{
+	return (CYC_DWT_CYCCNT);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Convert a number of CPU clock cycles into microseconds.
+ *  @param   cycles The number of clock cycles
+ *  @return  The time taken by that many cycles, in microseconds
+ */
+
+inline uint32_t cycles_to_us (uint32_t cycles)
+{
+	return (cycles / (SystemCoreClock / 1000000UL));
+}
+
+#endif  // _CYCLE_COUNT_H_
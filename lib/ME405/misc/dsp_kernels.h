@@ -0,0 +1,369 @@
+//*************************************************************************************
+/** @file    dsp_kernels.h
+ *  @brief   PID, biquad, and FIR filters which use the CMSIS DSP kernels if they can.
+ *  @details This file contains small filter and controller classes which run the
+ *           CMSIS DSP library's @c arm_pid_f32(), @c arm_biquad_cascade_df1_f32(),
+ *           and @c arm_fir_f32() kernels when @c USE_CMSIS_DSP is 1, and portable
+ *           C++ versions of the same algorithms otherwise. The portable versions keep
+ *           their coefficients and state in the same order as the CMSIS instances, so
+ *           either may step a filter and the results agree to within float rounding;
+ *           test/test_dsp_kernels.cpp checks this on the host against the CMSIS 
+ *           kernels. Only the CMSIS headers are in this tree, so @c USE_CMSIS_DSP 
+ *           needs the CMSIS DSP library for the Cortex-M4F, such as 
+ *           @c libarm_cortexM4lf_math.a, to be linked and @c -DUSE_CMSIS_DSP=1 to be
+ *           added to the compiler's flags.
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _DSP_KERNELS_H_
+#define _DSP_KERNELS_H_
+
+#include <stdint.h>                         // Integer types with known sizes
+
+/** @brief   Set to 1, usually on the compiler's command line, to use the CMSIS DSP
+ *           library's kernels; this needs the library to be linked.
+ */
+#ifndef USE_CMSIS_DSP
+	#define USE_CMSIS_DSP           0
+#endif
+
+#if (USE_CMSIS_DSP == 1)
+	#ifndef ARM_MATH_CM4
+		#define ARM_MATH_CM4                // arm_math.h needs to know the core
+	#endif
+	#include "stm32f4xx.h"                  // Core and FPU settings for arm_math.h
+	#include "arm_math.h"                   // The CMSIS DSP library's kernels
+
+	/// @brief   The PID controller's coefficients and state, as CMSIS keeps them.
+	typedef arm_pid_instance_f32 dsp_pid_instance;
+#else
+	/// @brief   The PID controller's coefficients and state, laid out as in the CMSIS
+	///          library's @c arm_pid_instance_f32.
+	typedef struct
+	{
+		float A0;                           ///< Kp + Ki + Kd
+		float A1;                           ///< -Kp - 2 Kd
+		float A2;                           ///< Kd
+		float state[3];                     ///< x[n-1], x[n-2], y[n-1]
+		float Kp;                           ///< The proportional gain
+		float Ki;                           ///< The integral gain per step
+		float Kd;                           ///< The derivative gain per step
+	} dsp_pid_instance;
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A PID controller in the incremental form used by @c arm_pid_f32().
+ *  @details Each step computes @f$ y[n] = y[n-1] + A_0 x[n] + A_1 x[n-1] + A_2 x[n-2]
+ *           @f$ with @f$ A_0 = K_p + K_i + K_d @f$, @f$ A_1 = -K_p - 2 K_d @f$, and
+ *           @f$ A_2 = K_d @f$, where @f$ K_i @f$ is per step. As the output is kept
+ *           rather than the integral, it is limited to -1.0 to 1.0 after each step,
+ *           which also keeps the integral from winding up, and changing the gains
+ *           doesn't make the output jump. The methods are named as in @c pi_core so
+ *           either can be used for a PI controller with normalized error and output.
+ */
+
+class dsp_pid
+{
+protected:
+	/** @brief The gains, derived coefficients, and state
+	 */
+	dsp_pid_instance instance;
+
+public:
+	/** @brief   Make a controller with zero gains.
+	 */
+	dsp_pid (void)
+	{
+		set_gains (0.0f, 0.0f, 0.0f);
+	}
+
+	/** @brief   Set the proportional, integral, and derivative gains.
+	 *  @param   kp Proportional gain, in output per unit of error
+	 *  @param   ki Integral gain, in output per unit of error-seconds
+	 *  @param   dt_s The time between calls to @c step_float() in seconds
+	 *  @param   keep_output True to keep the state, so that gains can be changed while
+	 *           running without a jump in the output; false to reset it to zero
+	 *  @param   kd Derivative gain, in output per unit of error per second
+	 */
+	void set_gains (float kp, float ki, float dt_s, bool keep_output = false,
+					float kd = 0.0f)
+	{
+		instance.Kp = kp;
+		instance.Ki = ki * dt_s;
+		instance.Kd = (dt_s > 0.0f) ? kd / dt_s : 0.0f;
+		instance.A0 = instance.Kp + instance.Ki + instance.Kd;
+		instance.A1 = -instance.Kp - 2.0f * instance.Kd;
+		instance.A2 = instance.Kd;
+		if (!keep_output)
+		{
+			instance.state[0] = 0.0f;
+			instance.state[1] = 0.0f;
+			instance.state[2] = 0.0f;
+		}
+	}
+
+	/** @brief   Run the controller once, using the CMSIS kernel if it's enabled.
+	 *  @param   error The error, normally from -1.0 to 1.0
+	 *  @return  The output, from -1.0 to 1.0
+	 */
+	float step_float (float error)
+	{
+		#if (USE_CMSIS_DSP == 1)
+			arm_pid_f32 (&instance, error);
+		#else
+			step_reference (error);
+		#endif
+		return (limit_output ());
+	}
+
+	/** @brief   Run the controller once with the portable version of the kernel.
+	 *  @param   error The error, normally from -1.0 to 1.0
+	 *  @return  The output, from -1.0 to 1.0
+	 */
+	float step_reference (float error)
+	{
+		float out = (instance.A0 * error) + (instance.A1 * instance.state[0]) 
+					+ (instance.A2 * instance.state[1]) + instance.state[2];
+		instance.state[1] = instance.state[0];
+		instance.state[0] = error;
+		instance.state[2] = out;
+		return (limit_output ());
+	}
+
+protected:
+	/** @brief   Limit the kept output to -1.0 to 1.0.
+	 *  @return  The limited output
+	 */
+	float limit_output (void)
+	{
+		float& out = instance.state[2];
+		if (out > 1.0f)
+		{
+			out = 1.0f;
+		}
+		else if (out < -1.0f)
+		{
+			out = -1.0f;
+		}
+		return (out);
+	}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A cascade of biquad sections in direct form I.
+ *  @details Each section computes @f$ y[n] = b_0 x[n] + b_1 x[n-1] + b_2 x[n-2] +
+ *           a_1 y[n-1] + a_2 y[n-2] @f$, with the feedback coefficients' signs as in
+ *           the CMSIS library, which are the opposite of those in most textbooks. The
+ *           state of each section is x[n-1], x[n-2], y[n-1], y[n-2], as in CMSIS.
+ *  @param   STAGES The number of second order sections
+ */
+
+template <uint8_t STAGES> class dsp_biquad
+{
+protected:
+	/** @brief b0, b1, b2, a1, a2 for each section in turn
+	 */
+	float coeffs[5 * STAGES];
+
+	/** @brief x[n-1], x[n-2], y[n-1], y[n-2] for each section in turn
+	 */
+	float state[4 * STAGES];
+
+	#if (USE_CMSIS_DSP == 1)
+		/// @brief The CMSIS instance, which points to the coefficients and state
+		arm_biquad_casd_df1_inst_f32 instance;
+	#endif
+
+	/** This copy constructor is poisoned so that it can't be used. A copy's CMSIS 
+	 *  instance would point to the original's coefficients and state.
+	 *  @param that A reference to a filter which ought not be copied
+	 */
+	dsp_biquad (const dsp_biquad& that) = delete;
+
+	/** This assignment operator is poisoned for the same reason as the copy 
+	 *  constructor.
+	 *  @param that A reference to a filter which ought not be copied
+	 */
+	dsp_biquad& operator= (const dsp_biquad& that) = delete;
+
+public:
+	/** @brief   Make a filter with the given coefficients and zero state.
+	 *  @param   p_coeffs b0, b1, b2, a1, a2 for each section, in CMSIS's signs
+	 */
+	dsp_biquad (const float* p_coeffs)
+	{
+		for (uint8_t index = 0; index < 5 * STAGES; index++)
+		{
+			coeffs[index] = p_coeffs[index];
+		}
+		#if (USE_CMSIS_DSP == 1)
+			arm_biquad_cascade_df1_init_f32 (&instance, STAGES, coeffs, state);
+		#endif
+		reset ();
+	}
+
+	/** @brief   Set the filter's state to zero.
+	 */
+	void reset (void)
+	{
+		for (uint8_t index = 0; index < 4 * STAGES; index++)
+		{
+			state[index] = 0.0f;
+		}
+	}
+
+	/** @brief   Filter one sample, using the CMSIS kernel if it's enabled.
+	 *  @param   input The new input sample
+	 *  @return  The filter's output
+	 */
+	float step (float input)
+	{
+		#if (USE_CMSIS_DSP == 1)
+			float output;
+			arm_biquad_cascade_df1_f32 (&instance, &input, &output, 1);
+			return (output);
+		#else
+			return (step_reference (input));
+		#endif
+	}
+
+	/** @brief   Filter one sample with the portable version of the kernel.
+	 *  @param   input The new input sample
+	 *  @return  The filter's output
+	 */
+	float step_reference (float input)
+	{
+		float x = input;
+		for (uint8_t stage = 0; stage < STAGES; stage++)
+		{
+			const float* b = coeffs + 5 * stage;
+			float* s = state + 4 * stage;
+			float y = (b[0] * x) + (b[1] * s[0]) + (b[2] * s[1])
+					  + (b[3] * s[2]) + (b[4] * s[3]);
+			s[1] = s[0];
+			s[0] = x;
+			s[3] = s[2];
+			s[2] = y;
+			x = y;
+		}
+		return (x);
+	}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A finite impulse response filter which takes one sample at a time.
+ *  @details The output is @f$ y[n] = \sum_k b_k x[n-k] @f$. As in the CMSIS library,
+ *           the coefficients are given in time reversed order, @f$ b_{N-1} @f$ first,
+ *           and the state holds the most recent @a TAPS samples, oldest first.
+ *  @param   TAPS The number of coefficients
+ */
+
+template <uint8_t TAPS> class dsp_fir
+{
+protected:
+	/** @brief The coefficients in time reversed order
+	 */
+	float coeffs[TAPS];
+
+	/** @brief The most recent samples, oldest first; CMSIS needs room for one block
+	 *  of new samples after the @a TAPS - 1 old ones, and the blocks here are 1 long
+	 */
+	float state[TAPS];
+
+	#if (USE_CMSIS_DSP == 1)
+		/// @brief The CMSIS instance, which points to the coefficients and state
+		arm_fir_instance_f32 instance;
+	#endif
+
+	/** This copy constructor is poisoned so that it can't be used. A copy's CMSIS 
+	 *  instance would point to the original's coefficients and state.
+	 *  @param that A reference to a filter which ought not be copied
+	 */
+	dsp_fir (const dsp_fir& that) = delete;
+
+	/** This assignment operator is poisoned for the same reason as the copy 
+	 *  constructor.
+	 *  @param that A reference to a filter which ought not be copied
+	 */
+	dsp_fir& operator= (const dsp_fir& that) = delete;
+
+public:
+	/** @brief   Make a filter with the given coefficients and zero state.
+	 *  @param   p_coeffs The coefficients in time reversed order
+	 */
+	dsp_fir (const float* p_coeffs)
+	{
+		for (uint8_t index = 0; index < TAPS; index++)
+		{
+			coeffs[index] = p_coeffs[index];
+		}
+		#if (USE_CMSIS_DSP == 1)
+			arm_fir_init_f32 (&instance, TAPS, coeffs, state, 1);
+		#endif
+		reset ();
+	}
+
+	/** @brief   Set the filter's state to zero.
+	 */
+	void reset (void)
+	{
+		for (uint8_t index = 0; index < TAPS; index++)
+		{
+			state[index] = 0.0f;
+		}
+	}
+
+	/** @brief   Filter one sample, using the CMSIS kernel if it's enabled.
+	 *  @param   input The new input sample
+	 *  @return  The filter's output
+	 */
+	float step (float input)
+	{
+		#if (USE_CMSIS_DSP == 1)
+			float output;
+			arm_fir_f32 (&instance, &input, &output, 1);
+			return (output);
+		#else
+			return (step_reference (input));
+		#endif
+	}
+
+	/** @brief   Filter one sample with the portable version of the kernel.
+	 *  @param   input The new input sample
+	 *  @return  The filter's output
+	 */
+	float step_reference (float input)
+	{
+		state[TAPS - 1] = input;
+		float acc = 0.0f;
+		for (uint8_t index = 0; index < TAPS; index++)
+		{
+			acc += state[index] * coeffs[index];
+		}
+		for (uint8_t index = 0; index < TAPS - 1; index++)
+		{
+			state[index] = state[index + 1];
+		}
+		return (acc);
+	}
+};
+
+
+#endif  // _DSP_KERNELS_H_
@@ -0,0 +1,228 @@
+//*************************************************************************************
+/** @file    fixed_point.h
+ *  @brief   Arithmetic which works the same way on float, Q15, and Q31 numbers.
+ *  @details This file contains a traits template which gives float, Q15 (@c int16_t), 
+ *           and Q31 (@c int32_t) numbers the same set of saturating operations, so 
+ *           that filters and controllers can be written once as templates and then 
+ *           compiled for whichever representation is wanted. A Q15 or Q31 number 
+ *           represents a value from -1.0 up to just under 1.0, as in the CMSIS DSP 
+ *           library's @c q15_t and @c q31_t types; float numbers are given the same 
+ *           range by saturating them at -1.0 and 1.0. Gains which may be larger than 
+ *           one are held as a mantissa and a power of two, as the CMSIS fixed point 
+ *           filters do with their @c postShift. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _FIXED_POINT_H_
+#define _FIXED_POINT_H_
+
+#include <stdint.h>                         // Integer types with known sizes
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A gain of any size, as a mantissa times a power of two.
+ *  @details The value of the gain is @c mantissa times 2 to the power @c shift. The
+ *           mantissa of a fixed point gain is normalized to at least one half in 
+ *           magnitude, so small gains keep their precision and large ones don't 
+ *           overflow; a float gain is held whole with a shift of zero. Gains are made
+ *           with @c fixed_traits<T>::make_gain().
+ */
+template <class T> struct scaled_gain
+{
+	T mantissa;                             ///< The gain divided by 2^shift
+	int8_t shift;                           ///< The power of two by which to multiply
+};
+
+
+/// The number of places a fixed point gain may be shifted either way
+const int8_t FIXED_MAX_SHIFT = 15;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Conversions and saturating arithmetic for one number representation.
+ *  @details This template is specialized for @c float, @c int16_t (Q15), and 
+ *           @c int32_t (Q31). Each specialization has the same static functions:
+ *           @li @c from_float() converts a value from -1.0 to 1.0, saturating
+ *           @li @c to_float() converts back to float
+ *           @li @c add() adds two numbers, saturating at the ends of the range
+ *           @li @c mul() multiplies by a @c scaled_gain, saturating the result
+ *           @li @c make_gain() makes a @c scaled_gain from a float
+ */
+template <class T> struct fixed_traits;
+
+
+/** @brief   Float arithmetic with the same saturating range as Q15 and Q31.
+ */
+template <> struct fixed_traits<float>
+{
+	/// Saturate a value to between -1.0 and 1.0
+	static float sat (float value)
+	{
+		return ((value > 1.0f) ? 1.0f : ((value < -1.0f) ? -1.0f : value));
+	}
+
+	/// Convert a float, saturating it to between -1.0 and 1.0
+	static float from_float (float value)
+	{
+		return (sat (value));
+	}
+
+	/// Convert to a float
+	static float to_float (float value)
+	{
+		return (value);
+	}
+
+	/// Add two numbers, saturating the sum
+	static float add (float a, float b)
+	{
+		return (sat (a + b));
+	}
+
+	/// Multiply by a gain, saturating the product
+	static float mul (float a, const scaled_gain<float>& gain)
+	{
+		return (sat (a * gain.mantissa));
+	}
+
+	/// Make a gain which is held whole
+	static scaled_gain<float> make_gain (float value)
+	{
+		scaled_gain<float> gain = {value, 0};
+		return (gain);
+	}
+};
+
+
+/** @brief   Common code for Q15 and Q31 numbers with @c BITS fractional bits.
+ *  @details @c T is the number type and @c W a type twice as wide which holds 
+ *           products and sums before they are saturated.
+ */
+template <class T, class W, uint8_t BITS> struct fixed_traits_q
+{
+	/// The largest value of the type, just under 1.0
+	static W max_value (void)
+	{
+		return (((W)1 << BITS) - 1);
+	}
+
+	/// The smallest value of the type, -1.0
+	static W min_value (void)
+	{
+		return (-((W)1 << BITS));
+	}
+
+	/// Saturate a wide intermediate result into the range of the type
+	static T sat (W value)
+	{
+		if (value > max_value ())
+		{
+			return ((T)max_value ());
+		}
+		if (value < min_value ())
+		{
+			return ((T)min_value ());
+		}
+		return ((T)value);
+	}
+
+	/// Convert a float from -1.0 to 1.0, saturating and rounding to nearest
+	static T from_float (float value)
+	{
+		float scaled = value * (float)((W)1 << BITS);
+		if (scaled >= (float)max_value ())
+		{
+			return ((T)max_value ());
+		}
+		if (scaled <= (float)min_value ())
+		{
+			return ((T)min_value ());
+		}
+		return ((T)(W)(scaled + ((scaled >= 0.0f) ? 0.5f : -0.5f)));
+	}
+
+	/// Convert to a float
+	static float to_float (T value)
+	{
+		return ((float)value / (float)((W)1 << BITS));
+	}
+
+	/// Add two numbers, saturating the sum
+	static T add (T a, T b)
+	{
+		return (sat ((W)a + (W)b));
+	}
+
+	/** @brief   Multiply by a gain, saturating the product.
+	 *  @details The product of two numbers with @c BITS fractional bits has twice as
+	 *           many; it is rounded and shifted back down, less the gain's shift, and 
+	 *           saturated. Rounding rather than truncating keeps an integrator which
+	 *           adds up many small products from drifting. Since a gain's shift is 
+	 *           never more than @c FIXED_MAX_SHIFT, which is no more than @c BITS, the 
+	 *           product is never shifted up. 
+	 */
+	static T mul (T a, const scaled_gain<T>& gain)
+	{
+		uint8_t down = BITS - gain.shift;
+		W half = (down > 0) ? ((W)1 << (down - 1)) : 0;
+		W product = (W)a * (W)gain.mantissa + half;
+		return (sat (product >> down));
+	}
+
+	/// Make a gain with a mantissa from one half to one in magnitude
+	static scaled_gain<T> make_gain (float value)
+	{
+		scaled_gain<T> gain = {0, 0};
+		if (value == 0.0f)
+		{
+			return (gain);
+		}
+		float magnitude = (value < 0.0f) ? -value : value;
+		while (magnitude >= 1.0f && gain.shift < FIXED_MAX_SHIFT)
+		{
+			magnitude *= 0.5f;
+			value *= 0.5f;
+			gain.shift++;
+		}
+		while (magnitude < 0.5f && gain.shift > -FIXED_MAX_SHIFT)
+		{
+			magnitude *= 2.0f;
+			value *= 2.0f;
+			gain.shift--;
+		}
+		gain.mantissa = from_float (value);
+		return (gain);
+	}
+};
+
+
+/** @brief   Q15 arithmetic, with 32-bit intermediate results.
+ */
+template <> struct fixed_traits<int16_t> 
+	: public fixed_traits_q<int16_t, int32_t, 15>
+{
+};
+
+
+/** @brief   Q31 arithmetic, with 64-bit intermediate results.
+ */
+template <> struct fixed_traits<int32_t> 
+	: public fixed_traits_q<int32_t, int64_t, 31>
+{
+};
+
+#endif // _FIXED_POINT_H_
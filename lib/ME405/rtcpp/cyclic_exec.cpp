@@ -0,0 +1,219 @@
+//*************************************************************************************
+/** @file    cyclic_exec.cpp
+ *  @brief   Source code for a task which runs several periodic functions at fixed 
+ *           rates.
+ *  @details This file contains the source for a cyclic executive, a task which runs a
+ *           set of short periodic functions in a fixed order each frame and measures
+ *           how long each one takes. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+#include "cyclic_exec.h"                    // Header for this class
+#include "cycle_count.h"                    // Timing with the CPU cycle counter
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create a cyclic executive task.
+ *  @details This constructor creates the RTOS task in which the periodic functions 
+ *           will run. No functions are run until they're added with @c add().
+ *  @param   a_name A name for the task
+ *  @param   a_priority The task's priority, which should be at least as high as that
+ *                      of any task the periodic functions would otherwise run in
+ *  @param   a_stack_size The stack size in words, which must be enough for the 
+ *                        hungriest of the periodic functions
+ *  @param   p_ser_dev A pointer to a serial device for debugging messages
+ *  @param   a_frame_ms The time between frames in milliseconds
+ */
+
+CyclicExecutive::CyclicExecutive (const char* a_name, unsigned portBASE_TYPE a_priority,
+								  size_t a_stack_size, emstream* p_ser_dev, 
+								  TickType_t a_frame_ms)
+	: TaskBase (a_name, a_priority, a_stack_size, p_ser_dev)
+{
+	num_slots = 0;
+	frame_ms = a_frame_ms;
+	frame_number = 0;
+	overruns = 0;
+	max_frame_cycles = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add a function to be run periodically by the executive.
+ *  @details This method must be called before the RTOS scheduler is started. The 
+ *           functions run in the order in which they're added. 
+ *  @param   a_name A short name printed with the function's timing statistics
+ *  @param   p_func A pointer to the function to be run
+ *  @param   p_context A pointer which is passed to the function each time it runs
+ *  @param   period_ms The function's period in milliseconds, which must be a 
+ *                     multiple of the frame time
+ *  @param   offset_frames The frame within each period in which the function runs;
+ *                         this must be less than the number of frames per period
+ *  @param   budget_us The function's worst-case run time in microseconds, as 
+ *                     assumed when the schedule was planned, or 0 for none
+ *  @return  @c true if the function was added, @c false if there was no room or the 
+ *           period or offset was invalid
+ */
+
+bool CyclicExecutive::add (const char* a_name, void (*p_func)(void*), void* p_context,
+						   TickType_t period_ms, uint16_t offset_frames, 
+						   uint32_t budget_us)
+{
+	if (num_slots >= EXEC_MAX_SLOTS)
+	{
+		DBG (p_serial, PMS ("ERROR: No room in executive for ") << a_name << endl);
+		return (false);
+	}
+
+	if (period_ms < frame_ms || (period_ms % frame_ms) != 0 
+		|| offset_frames >= period_ms / frame_ms)
+	{
+		DBG (p_serial, PMS ("ERROR: Period ") << period_ms << PMS (" ms for ") 
+			 << a_name << PMS (" doesn't fit ") << frame_ms << PMS (" ms frames") 
+			 << endl);
+		return (false);
+	}
+
+	exec_slot& slot = slots[num_slots];
+	slot.name = a_name;
+	slot.p_function = p_func;
+	slot.p_context = p_context;
+	slot.divisor = period_ms / frame_ms;
+	slot.offset = offset_frames;
+	slot.runs = 0;
+	slot.last_cycles = 0;
+	slot.max_cycles = 0;
+	slot.budget_cycles = budget_us * (SystemCoreClock / 1000000UL);
+	slot.over_budget = 0;
+	num_slots++;
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run the periodic functions which are due in each frame.
+ *  @details Each frame, this method calls every function whose period is due, in the
+ *           order in which the functions were added, timing each one with the CPU 
+ *           cycle counter. If the functions in a frame take longer than the frame 
+ *           time, an overrun is counted; the next frame then starts right away. 
+ */
+
+void CyclicExecutive::run (void)
+{
+	// This counter is used to run through the for (;;) loop at precise intervals
+	TickType_t LastWakeTime = xTaskGetTickCount ();
+
+	cycle_count_enable ();
+	uint32_t frame_cycles_allowed = (SystemCoreClock / 1000UL) * frame_ms;
+
+	for (;;)
+	{
+		uint32_t frame_start = cycle_count ();
+
+		for (uint8_t index = 0; index < num_slots; index++)
+		{
+			exec_slot& slot = slots[index];
+			if ((frame_number % slot.divisor) == slot.offset)
+			{
+				uint32_t start = cycle_count ();
+				slot.p_function (slot.p_context);
+				slot.last_cycles = cycle_count () - start;
+				if (slot.last_cycles > slot.max_cycles)
+				{
+					slot.max_cycles = slot.last_cycles;
+				}
+				if (slot.budget_cycles != 0 && slot.last_cycles > slot.budget_cycles)
+				{
+					slot.over_budget++;
+				}
+				slot.runs++;
+			}
+		}
+
+		uint32_t frame_cycles = cycle_count () - frame_start;
+		if (frame_cycles > max_frame_cycles)
+		{
+			max_frame_cycles = frame_cycles;
+		}
+		if (frame_cycles > frame_cycles_allowed)
+		{
+			overruns++;
+		}
+
+		frame_number++;
+		runs++;
+		delay_from_for_ms (LastWakeTime, frame_ms);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print the status of the executive and the timing of its functions.
+ *  @details This method prints the usual task status, the number of frames which ran
+ *           over, and the longest frame and the share of the frame time it used; then
+ *           a line for each periodic function with its period, run count, most recent
+ *           and longest run times, and the share of a frame its longest run takes; a
+ *           function with a budget also shows the budget and how many runs took 
+ *           longer than it. 
+ *           The last line is the CPU budget: the fraction of all the CPU's time the 
+ *           functions would take if each always took as long as its longest run. 
+ *           This should be well under 100% to leave time for lower priority tasks.
+ *  @param   ser_dev A reference to the serial device on which to print the status
+ */
+
+void CyclicExecutive::print_status (emstream& ser_dev)
+{
+	uint32_t frame_cycles_allowed = (SystemCoreClock / 1000UL) * frame_ms;
+	uint32_t load_permille = 0;
+
+	TaskBase::print_status (ser_dev);
+	ser_dev << PMS ("\toverruns: ") << overruns << PMS (", max frame: ") 
+			<< cycles_to_us (max_frame_cycles) << PMS (" us (") 
+			<< percent_of (max_frame_cycles, frame_cycles_allowed) << PMS ("%)");
+
+	for (uint8_t index = 0; index < num_slots; index++)
+	{
+		exec_slot& slot = slots[index];
+		ser_dev << endl << PMS ("  ") << slot.name << PMS ("\t") 
+				<< (slot.divisor * frame_ms) << PMS (" ms\t") << slot.runs 
+				<< PMS ("\t") << cycles_to_us (slot.last_cycles) << PMS ("/") 
+				<< cycles_to_us (slot.max_cycles) << PMS (" us\t") 
+				<< percent_of (slot.max_cycles, frame_cycles_allowed) << PMS ("%");
+		if (slot.budget_cycles != 0)
+		{
+			ser_dev << PMS ("\tbudget ") << cycles_to_us (slot.budget_cycles) 
+					<< PMS (" us, over: ") << slot.over_budget;
+		}
+		load_permille += (uint32_t)(((uint64_t)slot.max_cycles * 1000UL) 
+									/ ((uint64_t)frame_cycles_allowed * slot.divisor));
+	}
+	ser_dev << endl << PMS ("  CPU budget: ") << (load_permille / 10) << PMS (".") 
+			<< (load_permille % 10) << PMS ("% worst case");
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find what percentage one number of CPU cycles is of another.
+ *  @param   cycles The number of cycles taken
+ *  @param   allowed The number of cycles which makes 100 percent
+ *  @return  The percentage, rounded down
+ */
+
+uint32_t CyclicExecutive::percent_of (uint32_t cycles, uint32_t allowed)
+{
+	return ((uint32_t)(((uint64_t)cycles * 100UL) / allowed));
+}
@@ -0,0 +1,131 @@
+//*************************************************************************************
+/** @file    cyclic_exec.h
+ *  @brief   Header for a task which runs several periodic functions at fixed rates.
+ *  @details This file contains a class which runs a set of short periodic functions
+ *           from a single RTOS task in a fixed order. It's an alternative to making a
+ *           separate task for each small periodic job, which costs a stack and a 
+ *           context switch per job and adds a handoff delay wherever one job's output
+ *           is the next job's input. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _CYCLIC_EXEC_H_
+#define _CYCLIC_EXEC_H_
+
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+#include "task.h"                           // Needed for the task functions
+#include "taskbase.h"                       // The executive is a task
+
+
+/// The largest number of functions which one cyclic executive can run.
+const uint8_t EXEC_MAX_SLOTS = 8;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Task which runs registered periodic functions from one timed loop.
+ *  @details A cyclic executive wakes up once per @a frame, a fixed interval such as
+ *           5 ms, and calls each registered function whose period is due in that 
+ *           frame. Functions run in the order in which they were added, so a function
+ *           which produces data should be added before the function which uses it; 
+ *           then the data is used in the same frame, with no waiting for another task
+ *           to be scheduled. Each function's period must be a multiple of the frame
+ *           time, and an offset (in frames) can be given to spread slow functions out
+ *           over different frames. 
+ * 
+ *           The executive measures how long each function takes, in CPU clock cycles,
+ *           and keeps the most recent and longest times. These are printed along 
+ *           with the task status, as are a count of frames whose functions took longer
+ *           than the frame time and the share of the CPU's time all the functions use
+ *           at their longest. A function can be given a budget, the worst-case run 
+ *           time assumed for it in the application's task table; runs which take 
+ *           longer are counted and shown, so a budget which was guessed too low shows
+ *           up on the target. The periodic functions must never block, as they all
+ *           share one task. 
+ *
+ *  @section Usage
+ *  Functions take one @c void* parameter, which is usually a pointer to the object on
+ *  which they work. They are added to the executive before the scheduler starts:
+ *  @code
+ *  void read_sensor (void* p_context)
+ *  {
+ *      ((my_sensor*)p_context)->read ();
+ *  }
+ *  ...
+ *  CyclicExecutive* p_exec = new CyclicExecutive ("Exec", 3, 600, p_serial, 5);
+ *  p_exec->add ("Sensor", read_sensor, p_sensor, 5);
+ *  p_exec->add ("Control", run_controller, p_controller, 10);
+ *  @endcode
+ */
+
+class CyclicExecutive : public TaskBase
+{
+	protected:
+		/// The information the executive keeps about each periodic function.
+		struct exec_slot
+		{
+			const char* name;               ///< Name printed with timing statistics
+			void (*p_function)(void*);      ///< The function to be run
+			void* p_context;                ///< Parameter passed to the function
+			uint16_t divisor;               ///< Function runs once per this many frames
+			uint16_t offset;                ///< Frame within each period when it runs
+			uint32_t runs;                  ///< How many times the function has run
+			uint32_t last_cycles;           ///< CPU cycles used by the most recent run
+			uint32_t max_cycles;            ///< CPU cycles used by the longest run
+			uint32_t budget_cycles;         ///< Longest run expected, 0 for no budget
+			uint32_t over_budget;           ///< How many runs took longer than that
+		};
+
+		/// The periodic functions, in the order in which they run within a frame.
+		exec_slot slots[EXEC_MAX_SLOTS];
+
+		/// The number of periodic functions which have been added.
+		uint8_t num_slots;
+
+		/// The time between frames in milliseconds.
+		TickType_t frame_ms;
+
+		/// The number of frames which have been run.
+		uint32_t frame_number;
+
+		/// Number of frames whose functions took longer than the frame time.
+		uint32_t overruns;
+
+		/// The largest number of CPU cycles used by all the functions in one frame.
+		uint32_t max_frame_cycles;
+
+		// Find what percentage one number of CPU cycles is of another
+		static uint32_t percent_of (uint32_t cycles, uint32_t allowed);
+
+	public:
+		// The constructor creates the executive task with no functions to run
+		CyclicExecutive (const char* a_name, unsigned portBASE_TYPE a_priority,
+						 size_t a_stack_size, emstream* p_ser_dev, 
+						 TickType_t a_frame_ms);
+
+		// Add a function to be run periodically
+		bool add (const char* a_name, void (*p_func)(void*), void* p_context,
+				  TickType_t period_ms, uint16_t offset_frames = 0, 
+				  uint32_t budget_us = 0);
+
+		// The task's run method calls the functions which are due in each frame
+		void run (void);
+
+		// Print the task status followed by each function's timing
+		void print_status (emstream& ser_dev);
+};
+
+#endif  // _CYCLIC_EXEC_H_
@@ -0,0 +1,303 @@
+//*************************************************************************************
+/** @file    stampedshare.h
+ *  @brief   Shared data which carries a sequence number and time stamp so that tasks
+ *           can tell whether it is new and how old it is.
+ *  @details This file contains a template class for data which is shared between 
+ *           tasks in the same way as by a @c TaskShare, but each time the data is 
+ *           written a sequence number is incremented and the RTOS tick count is 
+ *           saved. A reading task can then skip work when nothing new has arrived 
+ *           and notice when the writing task has stopped producing data. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _STAMPEDSHARE_H_
+#define _STAMPEDSHARE_H_
+
+#include <string.h>                         // C language string handling functions
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+#include "task.h"                           // Header for the RTOS tick count
+#include "baseshare.h"                      // Base class for shared data items
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Class for shared data which carries a sequence number and a time stamp.
+ *  @details This class works like @c TaskShare<DataType>, keeping one copy of the most
+ *           recently written data protected by critical sections, but it also keeps 
+ *           a count of how many times the data has been written and the RTOS tick 
+ *           count at the time of the most recent write. The sequence number lets a 
+ *           reading task find out cheaply whether the data has changed since it last
+ *           looked, and the time stamp lets it find out how old the data is, so a 
+ *           task whose data source has stalled can notice within one period. 
+ * 
+ *  @section Usage
+ *  The share is created in @c main() and declared @c extern in @c shares.h just like
+ *  a @c TaskShare. The writing task uses @c put() as usual. A reading task keeps the
+ *  sequence number of the last data it used and asks for newer data:
+ *  @code
+ *  uint32_t last_seen = 0;
+ *  accelBuf buffer;
+ *  ...
+ *  if (p_my_share->get_if_newer (buffer, last_seen))
+ *  {
+ *      // Use the new data in buffer
+ *  }
+ *  else if (p_my_share->age_ms () > 20)
+ *  {
+ *      // The writing task seems to have stopped; do something safe
+ *  }
+ *  @endcode
+ *  The sequence number starts at zero and the first @c put() makes it one, so a 
+ *  reader which starts with @c last_seen equal to zero won't use data which was never
+ *  written. 
+ */
+
+template <class DataType> class StampedShare : public BaseShare
+{
+	protected:
+		DataType the_data;                  ///< Holds the data to be shared
+		uint32_t sequence;                  ///< Number of times data has been written
+		TickType_t time_stamp;              ///< RTOS tick count at the latest write
+
+	public:
+		/** @brief   Construct a shared data item with a sequence number and stamp.
+		 *  @details This constructor sets the sequence number to zero, meaning that
+		 *           no data has been written yet. The data itself is @b not 
+		 *           initialized. 
+		 *  @param   p_name A name to be shown in the list of task shares
+		 */
+		StampedShare<DataType> (const char* p_name) : BaseShare (p_name)
+		{
+			sequence = 0;
+			time_stamp = 0;
+		}
+
+		// Write data into the share, bumping the sequence number and time stamp
+		void put (const DataType& new_data);
+
+		// Write data into the share from within an ISR only
+		void ISR_put (const DataType& new_data);
+
+		// Read the data from the share
+		DataType get (void);
+
+		// Read the data from the share from within an ISR only
+		DataType ISR_get (void);
+
+		// Read the data only if it has been written since the given sequence number
+		bool get_if_newer (DataType& data, uint32_t& last_sequence);
+
+		/** @brief   Return the number of times the data has been written.
+		 *  @details A 32-bit number can be read in one instruction on an ARM, so no
+		 *           critical section is needed here. 
+		 *  @return  The current sequence number, which is zero if nothing has been
+		 *           written yet
+		 */
+		uint32_t get_sequence (void)
+		{
+			return (sequence);
+		}
+
+		// Find how many RTOS ticks ago the data was written
+		TickType_t age (void);
+
+		/** @brief   Find approximately how many milliseconds ago the data was written.
+		 *  @details Whole seconds are converted separately from the remaining ticks, 
+		 *           so the multiplication can't overflow however old the data is.
+		 *  @return  The age of the data in milliseconds
+		 */
+		TickType_t age_ms (void)
+		{
+			uint32_t ticks = (uint32_t)age ();
+			return ((TickType_t)((ticks / configTICK_RATE_HZ) * 1000UL
+				+ ((ticks % configTICK_RATE_HZ) * 1000UL) / configTICK_RATE_HZ));
+		}
+
+		/** @brief   Check if the data is older than a given age or was never written.
+		 *  @param   max_age_ms The oldest data, in milliseconds, considered fresh
+		 *  @return  @c true if the data is too old or has never been written
+		 */
+		bool is_stale (TickType_t max_age_ms)
+		{
+			return (sequence == 0 || age_ms () > max_age_ms);
+		}
+
+		// Print the share's status within a list of all shares' statuses
+		void print_in_list (emstream* p_ser_dev);
+}; // class StampedShare<DataType>
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Put data into the shared data item.
+ *  @details This method writes new data into the share, increments the sequence 
+ *           number, and saves the current RTOS tick count as the time stamp, all 
+ *           within one critical section so readers always see matching data, 
+ *           sequence number, and time stamp. 
+ *  @param   new_data The data which is to be written
+ */
+
+template <class DataType>
+inline void StampedShare<DataType>::put (const DataType& new_data)
+{
+	TickType_t now = xTaskGetTickCount ();
+
+	portENTER_CRITICAL ();
+	the_data = new_data;
+	sequence++;
+	time_stamp = now;
+	portEXIT_CRITICAL ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Put data into the shared data item from within an ISR.
+ *  @details This method writes data, the sequence number, and the time stamp from 
+ *           within an interrupt service routine. As with @c TaskShare::ISR_put(), no
+ *           critical section is used. It must only be called from within an ISR.
+ *  @param   new_data The data which is to be written into the shared data item
+ */
+
+template <class DataType>
+void StampedShare<DataType>::ISR_put (const DataType& new_data)
+{
+	the_data = new_data;
+	sequence++;
+	time_stamp = xTaskGetTickCountFromISR ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read data from the shared data item.
+ *  @details This method reads the data with critical section protection, ignoring 
+ *           the sequence number and time stamp. 
+ *  @return  The current value of the shared data item
+ */
+
+template <class DataType>
+DataType StampedShare<DataType>::get (void)
+{
+	DataType temporary_copy;
+
+	portENTER_CRITICAL ();
+	temporary_copy = the_data;
+	portEXIT_CRITICAL ();
+
+	return (temporary_copy);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read data from the shared data item, from within an ISR.
+ *  @details This method must only be called from within an interrupt service routine,
+ *           not a normal task, because no critical section protection is used. 
+ *  @return  The current value of the shared data item
+ */
+
+template <class DataType>
+DataType StampedShare<DataType>::ISR_get (void)
+{
+	return (the_data);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read the data only if it has been written since the caller last read it.
+ *  @details This method compares the share's sequence number with the one the caller
+ *           saw last. If they differ, the data is copied to the caller, the caller's
+ *           sequence number is updated, and @c true is returned. Otherwise nothing is
+ *           copied, which saves both the copy and whatever work the caller would have
+ *           done on data it has already processed. If the caller's sequence number 
+ *           falls more than one behind, data was written which the caller never saw.
+ *  @param   data Reference to a variable into which new data will be copied
+ *  @param   last_sequence Reference to the sequence number of the data the caller
+ *                         last read; it's updated when new data is copied
+ *  @return  @c true if new data was copied, @c false if there was nothing new
+ */
+
+template <class DataType>
+bool StampedShare<DataType>::get_if_newer (DataType& data, uint32_t& last_sequence)
+{
+	// Checking the sequence number first is a single read, so the critical section
+	// is only entered when there's something to copy
+	if (sequence == last_sequence)
+	{
+		return (false);
+	}
+
+	portENTER_CRITICAL ();
+	data = the_data;
+	last_sequence = sequence;
+	portEXIT_CRITICAL ();
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find how many RTOS ticks have passed since the data was last written.
+ *  @details If the data has never been written, the age is the time since the RTOS
+ *           was started. 
+ *  @return  The age of the data in RTOS ticks
+ */
+
+template <class DataType>
+TickType_t StampedShare<DataType>::age (void)
+{
+	TickType_t stamp;
+
+	portENTER_CRITICAL ();
+	stamp = time_stamp;
+	portEXIT_CRITICAL ();
+
+	return (xTaskGetTickCount () - stamp);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print the share's status within a list of all shared data items.
+ *  @details This method prints the share's name, its type, and the number of times
+ *           it has been written, then calls this same method for the next item of 
+ *           thread-safe data in the linked list of items. 
+ *  @param   p_ser_dev Pointer to a serial device on which to print the status
+ */
+
+template <class DataType>
+void StampedShare<DataType>::print_in_list (emstream* p_ser_dev)
+{
+	// Print this share's name and pad it to 16 characters
+	*p_ser_dev << name;
+	for (uint8_t cols = strlen (name); cols < 16; cols++)
+	{
+		p_ser_dev->putchar (' ');
+	}
+
+	p_ser_dev->puts ("stamped\t");
+
+	// Print the number of writes so far
+	*p_ser_dev << sequence;
+
+	// End the line
+	*p_ser_dev << endl;
+
+	// Call the next item
+	if (p_next != NULL)
+	{
+		p_next->print_in_list (p_ser_dev);
+	}
+}
+
+
+#endif  // _STAMPEDSHARE_H_
@@ -69,6 +69,24 @@ extern TaskBase* last_created_task_pointer;
 #define task_priority(x) ((x) < (configMAX_PRIORITIES) ? \
                 ((tskIDLE_PRIORITY) + (x)) : (configMAX_PRIORITIES))
 
+/** @brief   Percentage of the measured stack use added as a safety margin when a
+ *           stack size is suggested.
+ *  @details The stack high water mark only shows the deepest stack use seen so far,
+ *           and rarely taken code paths (error printouts, for example) may go deeper
+ *           than anything seen during a test run. This much extra space, as a 
+ *           percentage of the space which has been seen to be used, is added to the
+ *           measured stack use by @c TaskBase::suggested_stack(). 
+ */
+const uint8_t STACK_MARGIN_PERCENT = 25;
+
+/** @brief   Minimum number of stack items added as a margin to a suggested stack.
+ *  @details This many stack items (words on an ARM, bytes on an AVR) are always 
+ *           added to the measured stack use when a stack size is suggested, even if 
+ *           @c STACK_MARGIN_PERCENT would give a smaller margin. It leaves room for
+ *           an interrupt's stack frame to be pushed on top of a nearly full stack.
+ */
+const size_t STACK_MARGIN_MIN = 32;
+
 
 /// @cond NO_DOXY 
 //-------------------------------------------------------------------------------------
@@ -512,6 +530,25 @@ class TaskBase
 			{
 				return (uxTaskGetStackHighWaterMark(handle));
 			}
+
+			/** @brief   Return the largest amount of stack this task has been seen
+			 *           to use.
+			 *  @details This method subtracts the stack high water mark from the 
+			 *           task's total stack size to find how much of the stack has
+			 *           been used at the deepest point seen so far. The number is in
+			 *           the same units as the stack size given to the constructor. 
+			 *  @return  The number of stack items which have been used
+			 */
+			size_t stack_used (void)
+			{
+				return (total_stack - uxTaskGetStackHighWaterMark (handle));
+			}
+
+			// Suggest a stack size for this task based on measured stack use
+			size_t suggested_stack (void);
+
+			// Print this task's stack use line, then ask the next task to do so
+			size_t print_stack_use_in_list (emstream* p_ser_dev);
 		#endif
 
 		/** @brief   Print a display of this task's stack space. 
@@ -631,6 +668,15 @@ void print_task_list (emstream* ser_dev);
 // This function has all the tasks print their stacks
 void print_task_stacks (emstream* ser_dev);
 
+// Suggest a stack size from a measured stack use and a total stack size
+size_t suggest_stack_size (size_t used, size_t total);
+
+// Print stack use, suggested stack sizes, and heap use for all tasks
+void print_memory_health (emstream* ser_dev);
+
+// Get the smallest amount of free heap space seen so far
+size_t heap_low_water (void);
+
 // Get time from the RTOS tick count, converted to seconds
 float get_tick_time_float (void);
 
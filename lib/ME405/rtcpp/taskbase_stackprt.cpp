@@ -1,7 +1,10 @@
 //**************************************************************************************
 /** \file taskbase_stackprt.cpp
  *    This file contains functions to print the stacks of all the tasks for debugging
- *    and educational purposes. 
+ *    and educational purposes. It also contains a memory health report which shows 
+ *    how much of each task's stack has been used, suggests tighter stack sizes, and 
+ *    shows how much of the heap has been used, plus the stack overflow hook which 
+ *    FreeRTOS calls when @c configCHECK_FOR_STACK_OVERFLOW is enabled. 
  *
  *  Revisions:
  *    \li 12-02-2012 JRR Split off from time_stamp.cpp to save memory in machine file
@@ -23,6 +26,7 @@
  *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 //**************************************************************************************
 
+#include <string.h>                         // For strlen() to line up columns
 #include "taskbase.h"                       // Pull in the base class header file
 
 
@@ -72,3 +76,185 @@ void TaskBase::print_stack_in_list (emstream* p_ser_dev)
 		prev_task_pointer->print_stack_in_list (p_ser_dev);
 	}
 }
+
+
+#if (INCLUDE_uxTaskGetStackHighWaterMark == 1)
+
+//-------------------------------------------------------------------------------------
+/** @brief   Suggest a stack size from the measured stack use.
+ *  @details This function adds a safety margin to the largest stack use which has
+ *           been measured and rounds the result up to a multiple of 8 stack items so 
+ *           the numbers are easy to copy into the task constructor calls in 
+ *           @c main(). The margin is @c STACK_MARGIN_PERCENT percent of the measured
+ *           use but never less than @c STACK_MARGIN_MIN items. The suggestion is only
+ *           as good as the test run which produced the high water mark, so the 
+ *           program should be exercised thoroughly (including its error printouts)
+ *           before stack sizes are reduced. 
+ *  @param   used The largest number of stack items seen to be in use
+ *  @param   total The total stack size, which is returned if the suggestion would be
+ *                 larger than the stack size already allocated
+ *  @return  The suggested stack size, in the same units as @c used and @c total
+ */
+
+size_t suggest_stack_size (size_t used, size_t total)
+{
+	size_t margin = (used * STACK_MARGIN_PERCENT) / 100;
+	if (margin < STACK_MARGIN_MIN)
+	{
+		margin = STACK_MARGIN_MIN;
+	}
+
+	size_t suggestion = (used + margin + 7) & ~((size_t)7);
+
+	// A task which has come close to running out of stack is never told to shrink
+	return ((suggestion < total) ? suggestion : total);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Suggest a stack size for this task based on its measured stack use.
+ *  @details This method finds how much of the task's stack has been used, as shown by
+ *           the high water mark, and adds a safety margin to it. See 
+ *           @c suggest_stack_size() for how the margin is computed. 
+ *  @return  The suggested stack size for this task
+ */
+
+size_t TaskBase::suggested_stack (void)
+{
+	return (suggest_stack_size (stack_used (), total_stack));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print one line showing this task's stack use, then ask the next task to
+ *           do the same.
+ *  @details This method prints the task's name, total stack size, the amount of stack
+ *           used and left at the high water mark, and a suggested stack size. Then it
+ *           finds the previously created task and asks it to print its line, so all 
+ *           the tasks (except the idle task) will print their stack use. 
+ *  @param   p_ser_dev The serial device to which each task prints its stack use
+ *  @return  The stack space which this task and the ones after it in the list could
+ *           give back if their stack sizes were set to the suggested sizes
+ */
+
+size_t TaskBase::print_stack_use_in_list (emstream* p_ser_dev)
+{
+	const char* p_name = (const char*)(pcTaskGetTaskName (handle));
+
+	*p_ser_dev << p_name << '\t';
+	if (strlen (p_name) < 8)
+	{
+		*p_ser_dev << '\t';
+	}
+	*p_ser_dev << (ems_size_t)total_stack << '\t' << (ems_size_t)stack_used () << '\t'
+			   << (ems_size_t)stack_left () << '\t' << (ems_size_t)suggested_stack () 
+			   << endl;
+
+	size_t reclaimable = total_stack - suggested_stack ();
+	if (prev_task_pointer != NULL)
+	{
+		reclaimable += prev_task_pointer->print_stack_use_in_list (p_ser_dev);
+	}
+	return (reclaimable);
+}
+
+#endif // INCLUDE_uxTaskGetStackHighWaterMark
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Get the smallest amount of free heap space seen so far.
+ *  @details The heap manager used in this project (@c heap_1.c) never frees memory,
+ *           so the free heap only shrinks and the current free space is also the
+ *           smallest ever seen. This function keeps its own low water mark anyway so
+ *           that the number stays correct if a heap manager which frees memory is
+ *           used instead. The mark is only updated when this function is called, so
+ *           it should be called periodically, as by @c print_memory_health(). 
+ *  @return  The smallest number of free bytes in the heap seen so far
+ */
+
+size_t heap_low_water (void)
+{
+	static size_t lowest_free = configTOTAL_HEAP_SIZE;
+
+	size_t free_now = xPortGetFreeHeapSize ();
+	if (free_now < lowest_free)
+	{
+		lowest_free = free_now;
+	}
+	return (lowest_free);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print a report of stack and heap use for all the tasks.
+ *  @details This function prints a table with one line for each task showing the 
+ *           task's total stack size, the deepest stack use seen so far, the space 
+ *           left at that point, and a suggested stack size. Stack sizes are shown in 
+ *           the units used by @c xTaskCreate(), which are 4-byte words on an ARM. The
+ *           total amount of stack space which could be given back by using the 
+ *           suggested sizes is printed below the table, followed by the current and
+ *           smallest ever free heap space. It's meant to be called every few seconds 
+ *           by a low priority task while the system is being tested. 
+ *  @param   ser_dev Pointer to a serial device on which the report will be printed
+ */
+
+void print_memory_health (emstream* ser_dev)
+{
+	#if (INCLUDE_uxTaskGetStackHighWaterMark == 1)
+		*ser_dev << PMS ("Task\t\tStack\tUsed\tFree\tSuggest") << endl;
+		*ser_dev << PMS ("----\t\t-----\t----\t----\t-------") << endl;
+
+		// Each task prints its own line and asks the previously created task to do so
+		size_t reclaimable = 0;
+		if (last_created_task_pointer != NULL)
+		{
+			reclaimable = last_created_task_pointer->print_stack_use_in_list (ser_dev);
+		}
+
+		// The idle task isn't in the list of tasks, so it's printed separately
+		size_t idle_left = uxTaskGetStackHighWaterMark (xTaskGetIdleTaskHandle ());
+		size_t idle_used = configMINIMAL_STACK_SIZE - idle_left;
+		*ser_dev << PMS ("IDLE\t\t") << (ems_size_t)configMINIMAL_STACK_SIZE << '\t' 
+				 << (ems_size_t)idle_used << '\t' << (ems_size_t)idle_left << '\t' 
+				 << (ems_size_t)suggest_stack_size (idle_used, configMINIMAL_STACK_SIZE)
+				 << endl;
+
+		*ser_dev << PMS ("Reclaimable stack: ") << (ems_size_t)reclaimable << endl;
+	#endif
+
+	*ser_dev << PMS ("Heap free: ") << (ems_size_t)xPortGetFreeHeapSize () 
+			 << PMS (" now, ") << (ems_size_t)heap_low_water () 
+			 << PMS (" lowest, of ") << (ems_size_t)configTOTAL_HEAP_SIZE << endl;
+}
+
+
+#if (configCHECK_FOR_STACK_OVERFLOW > 0)
+
+/** @brief   Name of the task whose stack overflowed, or @c NULL if none has.
+ *  @details This pointer is set by the stack overflow hook just before the system is
+ *           halted so that the culprit can be found with a debugger. 
+ */
+volatile const char* overflowed_task_name = NULL;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Function called by FreeRTOS when a task's stack has overflowed.
+ *  @details FreeRTOS calls this function during a context switch if it finds that the
+ *           task being switched out has run past the end of its stack. Memory near 
+ *           that stack has already been overwritten by then, so printing anything is
+ *           not safe; the name of the task is saved where a debugger can find it and
+ *           the system is halted the same way as by @c configASSERT(). 
+ *  @param   task The handle of the task whose stack overflowed
+ *  @param   task_name The name of the task whose stack overflowed
+ */
+
+extern "C" void vApplicationStackOverflowHook (TaskHandle_t task, char* task_name)
+{
+	(void)task;
+	overflowed_task_name = task_name;
+
+	taskDISABLE_INTERRUPTS ();
+	for (;;);
+}
+
+#endif // configCHECK_FOR_STACK_OVERFLOW
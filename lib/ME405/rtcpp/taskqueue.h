@@ -67,6 +67,15 @@
  *  the RTOS scheduler will ensure that other tasks get to run even while the reading
  *  task is blocking itself waiting for data. 
  * 
+ *  When a task produces or consumes data in bursts, such as a block of A/D readings or
+ *  several sensor samples, @c put_many() and @c get_many() move a whole array of items
+ *  with one call. FreeRTOS queues copy one item per queue call, so each item still
+ *  costs one, but all those calls are made inside one critical section; while there 
+ *  is room or data the batch isn't interleaved with items from other tasks, and each 
+ *  method returns the number of items actually moved. The variants 
+ *  @c ISR_put_many() and @c ISR_get_many() do the same from within an interrupt 
+ *  service routine. 
+ * 
  *  In some cases, one may need to use less normal reading and writing methods. Methods
  *  whose name begins with @c ISR_ are to be used only within a hardware interrupt
  *  service routine. If one needs to put data at the front of the queue instead of the
@@ -189,6 +198,20 @@ template <class dataType> class TaskQueue : public BaseShare
 		// Get an item from the queue from within an interrupt service routine
 		dataType ISR_get (void);
 
+		// Put an array of items into the back of the queue with one call
+		size_t put_many (const dataType* p_items, size_t count, 
+						 TickType_t wait_time = portMAX_DELAY);
+
+		// Put an array of items into the back of the queue from within an ISR
+		size_t ISR_put_many (const dataType* p_items, size_t count);
+
+		// Get up to a given number of items from the queue with one call
+		size_t get_many (dataType* p_items, size_t max_count, 
+						 TickType_t wait_time = portMAX_DELAY);
+
+		// Get up to a given number of items from the queue from within an ISR
+		size_t ISR_get_many (dataType* p_items, size_t max_count);
+
 		// Look at the first item in the queue but don't remove it
 		dataType look_at (void);
 
@@ -497,6 +520,189 @@ inline dataType TaskQueue<dataType>::ISR_look_at (void)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** @brief   Put an array of items into the back of the queue with one call.
+ *  @details This method puts a batch of items into the back of the queue in the order
+ *           in which they're found in the array. If the queue has room, all the items
+ *           which fit are queued inside a single critical section, one queue call 
+ *           each, so the batch can't be interleaved with items from other tasks or 
+ *           interrupts. If the queue is full, the calling task first waits up to 
+ *           @c wait_time ticks for room for the first item, outside the critical 
+ *           section, so in that case another writer's items may get in between the 
+ *           first item and the rest. If the queue fills up, the items which didn't 
+ *           fit are not queued, and the return value tells how many were. Any task 
+ *           woken by the new data runs when the critical section ends. This method 
+ *           must @b not be used within an ISR; use @c ISR_put_many() there. 
+ *  @param   p_items Pointer to an array of items to be put into the queue
+ *  @param   count The number of items in the array
+ *  @param   wait_time How many RTOS ticks to wait for space for the first item 
+ *                     (default @c portMAX_DELAY, which waits forever)
+ *  @return  The number of items which were put into the queue
+ */
+
+template <class dataType>
+size_t TaskQueue<dataType>::put_many (const dataType* p_items, size_t count, 
+									  TickType_t wait_time)
+{
+	size_t num_put = 0;
+	if (count == 0)
+	{
+		return (0);
+	}
+
+	// A task can't block inside a critical section, so if the queue is full, wait 
+	// outside it for room for the first item
+	portENTER_CRITICAL ();
+	if (uxQueueSpacesAvailable (handle) == 0)
+	{
+		portEXIT_CRITICAL ();
+		if (xQueueSendToBack (handle, p_items, wait_time) != pdTRUE)
+		{
+			return (0);
+		}
+		num_put = 1;
+		portENTER_CRITICAL ();
+	}
+	while (num_put < count 
+		   && xQueueSendToBack (handle, p_items + num_put, 0) == pdTRUE)
+	{
+		num_put++;
+	}
+	uint16_t fillage = uxQueueMessagesWaiting (handle);
+	portEXIT_CRITICAL ();
+
+	// Keep track of the maximum fillage of the queue
+	if (fillage > max_full)
+	{
+		max_full = fillage;
+	}
+
+	return (num_put);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Put an array of items into the back of the queue from within an ISR.
+ *  @details This method puts as many items from the array as will fit into the back
+ *           of the queue from within an interrupt service routine. Interrupts which
+ *           might use the queue are masked while the batch is being queued. If
+ *           putting the data into the queue has woken a task of higher priority than
+ *           the one which was interrupted, a context switch is requested when the 
+ *           batch is done. This method must \b not be used within non-ISR code. 
+ *  @param   p_items Pointer to an array of items to be put into the queue
+ *  @param   count The number of items in the array
+ *  @return  The number of items which were put into the queue
+ */
+
+template <class dataType>
+size_t TaskQueue<dataType>::ISR_put_many (const dataType* p_items, size_t count)
+{
+	// This value is set to true if a context switch should occur due to this data
+	signed portBASE_TYPE shouldSwitch = pdFALSE;
+
+	size_t num_put = 0;
+	UBaseType_t saved_mask = portSET_INTERRUPT_MASK_FROM_ISR ();
+	while (num_put < count 
+		   && xQueueSendToBackFromISR (handle, p_items + num_put, &shouldSwitch) 
+			  == pdTRUE)
+	{
+		num_put++;
+	}
+	uint16_t fillage = uxQueueMessagesWaitingFromISR (handle);
+	portCLEAR_INTERRUPT_MASK_FROM_ISR (saved_mask);
+
+	// Keep track of the maximum fillage of the queue
+	if (fillage > max_full)
+	{
+		max_full = fillage;
+	}
+
+	// Ask for a context switch if the data woke a higher priority task, if the port
+	// has a way to do so (the AVR port doesn't)
+	#ifdef portEND_SWITCHING_ISR
+		portEND_SWITCHING_ISR (shouldSwitch);
+	#endif
+
+	return (num_put);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Get up to a given number of items from the queue with one call.
+ *  @details This method removes items from the front of the queue and copies them 
+ *           into the given array, oldest first, until the array is full or the queue
+ *           is empty. The calling task waits up to @c wait_time ticks for an item to
+ *           arrive, looking at it without removing it; then all the items taken, the
+ *           first included, are removed inside a single critical section, one queue 
+ *           call each, so they're consecutive items of the queue. If another task 
+ *           reads the same queue, it may take the item which was waited for, and 
+ *           zero can be returned even though the wait succeeded. This method must 
+ *           @b not be used within an ISR; use @c ISR_get_many() there. 
+ *  @param   p_items Pointer to an array into which items will be copied
+ *  @param   max_count The largest number of items which fit in the array
+ *  @param   wait_time How many RTOS ticks to wait for the first item to arrive
+ *                     (default @c portMAX_DELAY, which waits forever)
+ *  @return  The number of items which were copied into the array
+ */
+
+template <class dataType>
+size_t TaskQueue<dataType>::get_many (dataType* p_items, size_t max_count, 
+									  TickType_t wait_time)
+{
+	if (max_count == 0 || xQueuePeek (handle, p_items, wait_time) != pdTRUE)
+	{
+		return (0);
+	}
+
+	size_t num_got = 0;
+	portENTER_CRITICAL ();
+	while (num_got < max_count 
+		   && xQueueReceive (handle, p_items + num_got, 0) == pdTRUE)
+	{
+		num_got++;
+	}
+	portEXIT_CRITICAL ();
+
+	return (num_got);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Get up to a given number of items from the queue from within an ISR.
+ *  @details This method removes items from the front of the queue and copies them 
+ *           into the given array until the array is full or the queue is empty. It
+ *           never waits. If removing data has woken a task waiting to put items into
+ *           the queue whose priority is higher than that of the interrupted task, a
+ *           context switch is requested. This method must \b not be used within 
+ *           non-ISR code. 
+ *  @param   p_items Pointer to an array into which items will be copied
+ *  @param   max_count The largest number of items which fit in the array
+ *  @return  The number of items which were copied into the array
+ */
+
+template <class dataType>
+size_t TaskQueue<dataType>::ISR_get_many (dataType* p_items, size_t max_count)
+{
+	portBASE_TYPE task_awakened = pdFALSE;  // Checks if a context switch is needed
+
+	size_t num_got = 0;
+	UBaseType_t saved_mask = portSET_INTERRUPT_MASK_FROM_ISR ();
+	while (num_got < max_count 
+		   && xQueueReceiveFromISR (handle, p_items + num_got, &task_awakened) 
+			  == pdTRUE)
+	{
+		num_got++;
+	}
+	portCLEAR_INTERRUPT_MASK_FROM_ISR (saved_mask);
+
+	#ifdef portEND_SWITCHING_ISR
+		portEND_SWITCHING_ISR (task_awakened);
+	#endif
+
+	return (num_got);
+}
+
+
 //-------------------------------------------------------------------------------------
 /** @brief   Print the queue's status to a serial device.
  *  @details This method makes a printout of the queue's status on the given serial 
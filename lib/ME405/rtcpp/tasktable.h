@@ -0,0 +1,248 @@
+//*************************************************************************************
+/** @file    tasktable.h
+ *  @brief   Compile-time description and checking of an application's set of tasks.
+ *  @details This file contains a structure which describes one task -- its name, 
+ *           priority, stack size, period, and estimated run time -- and a structure
+ *           which describes one shared data item connecting two tasks. An application
+ *           declares a @c constexpr table of each, and the functions in this file 
+ *           check the tables while the program is being compiled: priorities must be
+ *           in rate-monotonic order, the total processor utilization must fit under
+ *           the Liu and Layland bound, and each share must connect two real tasks. 
+ *           The @c create_task() function template then creates each task using the
+ *           numbers from its table entry. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _TASKTABLE_H_
+#define _TASKTABLE_H_
+
+#include <stdint.h>                         // Integer types with known sizes
+#include <stddef.h>                         // Has size_t
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Description of one task in an application's task table.
+ *  @details One of these structures is written for each task, normally in a 
+ *           @c constexpr array so that the functions below can check the whole set of
+ *           tasks at compile time. A task which isn't periodic, such as one which 
+ *           waits on a queue, has a period of zero; it isn't counted in the 
+ *           utilization but must have a lower priority than every periodic task.
+ */
+
+struct TaskSpec
+{
+	const char* name;                       ///< The task's name as given to the RTOS
+	unsigned portBASE_TYPE priority;        ///< RTOS priority; higher runs first
+	size_t stack_size;                      ///< Stack size in words (StackType_t)
+	uint16_t period_ms;                     ///< Period in milliseconds, 0 if aperiodic
+	uint32_t wcet_us;                       ///< Estimated worst-case run time per period
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Description of a shared data item which connects two tasks.
+ *  @details The writer and reader are indices into the task table. A reader which 
+ *           runs faster than its writer will see the same data repeatedly, so this
+ *           is flagged at compile time unless @c hold is set, which says the reader
+ *           deliberately keeps using the latest value -- as an inner control loop 
+ *           holds the setpoint from a slower outer loop. A reader which only wants 
+ *           new data should use a @c StampedShare and skip data it has already seen.
+ */
+
+struct ShareSpec
+{
+	const char* name;                       ///< The share's name as given to its ctor
+	uint8_t writer;                         ///< Index of the task which writes it
+	uint8_t reader;                         ///< Index of the task which reads it
+	bool hold;                              ///< True if a faster reader is intended
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check one pair of tasks for rate-monotonic priority order.
+ *  @details A task with a shorter period must have a higher priority than a task with
+ *           a longer one; tasks with equal periods may have any priorities. A task 
+ *           with period zero must have a lower priority than any periodic task. 
+ *  @param   a The first task in the pair
+ *  @param   b The second task in the pair
+ *  @return  @c true if the pair's priorities are in rate-monotonic order
+ */
+
+constexpr bool rm_pair_ok (const TaskSpec& a, const TaskSpec& b)
+{
+	return ((a.period_ms == 0 && b.period_ms == 0) ? true
+		  : (a.period_ms == 0) ? (a.priority < b.priority)
+		  : (b.period_ms == 0) ? (b.priority < a.priority)
+		  : (a.period_ms < b.period_ms) ? (a.priority > b.priority)
+		  : (b.period_ms < a.period_ms) ? (b.priority > a.priority)
+		  : true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check that a whole table of tasks has rate-monotonic priorities.
+ *  @details This function compares every pair of tasks using @c rm_pair_ok(). It's
+ *           written recursively because C++11 @c constexpr functions can't loop. 
+ *  @param   tasks The table of tasks
+ *  @param   i Index of the first task in the pair being checked (leave default)
+ *  @param   j Index of the second task in the pair being checked (leave default)
+ *  @return  @c true if all the priorities are in rate-monotonic order
+ */
+
+template <size_t N>
+constexpr bool tasks_rate_monotonic (const TaskSpec (&tasks)[N], size_t i = 0, 
+									 size_t j = 1)
+{
+	return ((i >= N) ? true
+		  : (j >= N) ? tasks_rate_monotonic (tasks, i + 1, i + 2)
+		  : (rm_pair_ok (tasks[i], tasks[j]) && tasks_rate_monotonic (tasks, i, j + 1)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check that every task's priority and stack size are usable.
+ *  @param   tasks The table of tasks
+ *  @param   i Index of the task being checked (leave default)
+ *  @return  @c true if every priority is below @c configMAX_PRIORITIES and every 
+ *           stack size is nonzero
+ */
+
+template <size_t N>
+constexpr bool tasks_valid (const TaskSpec (&tasks)[N], size_t i = 0)
+{
+	return ((i >= N) ? true
+		  : (tasks[i].priority < configMAX_PRIORITIES && tasks[i].stack_size > 0
+			 && tasks_valid (tasks, i + 1)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Count the periodic tasks in a task table.
+ *  @param   tasks The table of tasks
+ *  @param   i Index of the task being checked (leave default)
+ *  @return  The number of tasks whose period isn't zero
+ */
+
+template <size_t N>
+constexpr size_t periodic_task_count (const TaskSpec (&tasks)[N], size_t i = 0)
+{
+	return ((i >= N) ? 0
+		  : ((tasks[i].period_ms != 0) ? 1 : 0) + periodic_task_count (tasks, i + 1));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find the total processor utilization of the tasks in a table.
+ *  @details Each periodic task uses @c wcet_us / (@c period_ms * 1000) of the 
+ *           processor. The result is in parts per thousand, and each task's share is
+ *           rounded up so the total is never optimistic. 
+ *  @param   tasks The table of tasks
+ *  @param   i Index of the task being added in (leave default)
+ *  @return  Total utilization in parts per thousand
+ */
+
+template <size_t N>
+constexpr uint32_t tasks_utilization_permille (const TaskSpec (&tasks)[N], 
+											   size_t i = 0)
+{
+	return ((i >= N) ? 0
+		  : ((tasks[i].period_ms == 0) ? 0 
+			 : (tasks[i].wcet_us + tasks[i].period_ms - 1) / tasks[i].period_ms)
+			+ tasks_utilization_permille (tasks, i + 1));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Liu and Layland's rate-monotonic utilization bound in parts per thousand.
+ *  @details A set of @a n periodic tasks with rate-monotonic priorities is sure to 
+ *           meet all its deadlines if its utilization is under n (2^(1/n) - 1). The 
+ *           values are rounded down; above ten tasks the limit, ln 2, is used. 
+ *  @param   n The number of periodic tasks
+ *  @return  The utilization bound in parts per thousand
+ */
+
+constexpr uint32_t rm_bound_permille (size_t n)
+{
+	return ((n <= 1) ? 1000 : (n == 2) ? 828 : (n == 3) ? 779 : (n == 4) ? 756
+		  : (n == 5) ? 743  : (n == 6) ? 734 : (n == 7) ? 728 : (n == 8) ? 724
+		  : (n == 9) ? 720  : (n == 10) ? 717 : 693);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check that a task table's utilization is under the rate-monotonic bound.
+ *  @param   tasks The table of tasks
+ *  @return  @c true if the periodic tasks are schedulable by the Liu and Layland test
+ */
+
+template <size_t N>
+constexpr bool tasks_schedulable (const TaskSpec (&tasks)[N])
+{
+	return (tasks_utilization_permille (tasks) 
+			<= rm_bound_permille (periodic_task_count (tasks)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check that every share in a table connects two different, real tasks.
+ *  @details Each share's writer and reader must be valid indices into the task table
+ *           and must not be the same task, and the reader must not run more often 
+ *           than the writer unless the writer is aperiodic or the share is marked as 
+ *           being held. 
+ *  @param   tasks The table of tasks
+ *  @param   shares The table of shares
+ *  @param   i Index of the share being checked (leave default)
+ *  @return  @c true if all the shares are connected sensibly
+ */
+
+template <size_t NT, size_t NS>
+constexpr bool shares_connected (const TaskSpec (&tasks)[NT], 
+								 const ShareSpec (&shares)[NS], size_t i = 0)
+{
+	return ((i >= NS) ? true
+		  : (shares[i].writer < NT && shares[i].reader < NT 
+			 && shares[i].writer != shares[i].reader
+			 && (tasks[shares[i].writer].period_ms == 0 || shares[i].hold
+				 || tasks[shares[i].reader].period_ms >= tasks[shares[i].writer].period_ms)
+			 && shares_connected (tasks, shares, i + 1)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create a task using the name, priority, and stack size in its table entry.
+ *  @details This function passes the name, priority, and stack size from a 
+ *           @c TaskSpec to the task class's constructor, followed by whatever other 
+ *           arguments that constructor needs:
+ *  @code
+ *  create_task<task_imu> (my_tasks[TASK_IMU], p_serial, p_accelerometer);
+ *  @endcode
+ *           The task object is created with @c new. As the RTOS heap never frees 
+ *           memory, this is the same as static allocation done once at startup. 
+ *  @param   spec The entry from the task table which describes this task
+ *  @param   args Other arguments to the task's constructor, beginning with the 
+ *           pointer to a serial device
+ *  @return  A pointer to the newly created task
+ */
+
+template <class TaskType, class... Args>
+TaskType* create_task (const TaskSpec& spec, Args... args)
+{
+	return (new TaskType (spec.name, spec.priority, spec.stack_size, args...));
+}
+
+#endif  // _TASKTABLE_H_
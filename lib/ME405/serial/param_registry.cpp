@@ -0,0 +1,623 @@
+//*************************************************************************************
+/** @file    param_registry.cpp
+ *  @brief   Source for a registry of tunable parameters which can be read and set 
+ *           over a serial line with a compact binary protocol.
+ *  @details This file contains the methods of the parameter registry. The protocol
+ *           is described with @c param_command_t in param_registry.h. 
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+#include <string.h>                         // For memcpy() and strcmp()
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+#include "task.h"                           // Critical sections, suspending tasks
+#include "param_registry.h"                 // Header for this file
+
+
+/// Receiver state waiting for a request's sync byte.
+#define PARAM_RX_SYNC       0
+
+/// Receiver state waiting for the command byte.
+#define PARAM_RX_COMMAND    1
+
+/// Receiver state waiting for the length byte.
+#define PARAM_RX_LENGTH     2
+
+/// Receiver state collecting payload bytes.
+#define PARAM_RX_PAYLOAD    3
+
+/// Receiver state waiting for the checksum byte.
+#define PARAM_RX_CHECKSUM   4
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Put a 32-bit number into a buffer in little-endian order.
+ *  @param   p_buffer The place where the four bytes are to be put
+ *  @param   bits The number to be put there
+ */
+
+static void put_le32 (uint8_t* p_buffer, uint32_t bits)
+{
+	for (uint8_t index = 0; index < 4; index++)
+	{
+		p_buffer[index] = (uint8_t)(bits >> (8 * index));
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Get a 32-bit number from a buffer in little-endian order.
+ *  @param   p_buffer The four bytes holding the number
+ *  @return  The number
+ */
+
+static uint32_t get_le32 (const uint8_t* p_buffer)
+{
+	return ((uint32_t)p_buffer[0] | ((uint32_t)p_buffer[1] << 8) 
+			| ((uint32_t)p_buffer[2] << 16) | ((uint32_t)p_buffer[3] << 24));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Get the raw bits of a float.
+ *  @param   value The float
+ *  @return  The float's four bytes as a number
+ */
+
+static uint32_t float_bits (float value)
+{
+	uint32_t bits;
+	memcpy (&bits, &value, sizeof (bits));
+	return (bits);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Create an empty parameter registry.
+ *  @details The table is allocated once here, so it should be made at startup.
+ *  @param   max_entries_in The number of parameters for which to make room
+ */
+
+param_registry::param_registry (uint8_t max_entries_in)
+{
+	entries = new param_entry[max_entries_in];
+	num_entries = 0;
+	max_entries = max_entries_in;
+	rx_state = PARAM_RX_SYNC;
+	p_store = NULL;
+	p_before_save = NULL;
+	p_after_save = NULL;
+	p_save_hook_arg = NULL;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add a parameter of any type to the table.
+ *  @param   name The parameter's name, which must be a string that is never freed
+ *  @param   type The type of the parameter's variable
+ *  @param   min_value The smallest value to which the parameter may be set
+ *  @param   max_value The largest value to which the parameter may be set
+ *  @param   p_value A pointer to the parameter's variable
+ *  @param   saved True if the value is saved in the flash store by @c save()
+ *  @return  True if the parameter was added, false if the table is full or if its
+ *           value is saved under the same flash key as another saved parameter's
+ */
+
+bool param_registry::add_entry (const char* name, param_type_t type, float min_value, 
+								float max_value, void* p_value, bool saved)
+{
+	if (num_entries >= max_entries)
+	{
+		return (false);
+	}
+
+	// Two names whose keys match would overwrite each other's saved values
+	if (saved)
+	{
+		uint16_t key = store_key (name);
+		for (uint8_t index = 0; index < num_entries; index++)
+		{
+			if (entries[index].saved && store_key (entries[index].name) == key)
+			{
+				return (false);
+			}
+		}
+	}
+
+	param_entry* p_entry = entries + num_entries;
+	p_entry->name = name;
+	p_entry->type = type;
+	p_entry->min_value = min_value;
+	p_entry->max_value = max_value;
+	p_entry->p_value = p_value;
+	p_entry->saved = saved;
+	p_entry->pending = false;
+	num_entries++;
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add a @c float parameter.
+ *  @param   name The parameter's name, which must be a string that is never freed
+ *  @param   p_value A pointer to the parameter's variable
+ *  @param   min_value The smallest value to which the parameter may be set
+ *  @param   max_value The largest value to which the parameter may be set
+ *  @return  True if the parameter was added, false if the table is full or the
+ *           parameter's flash key is taken; see @c add_entry()
+ */
+
+bool param_registry::add (const char* name, float* p_value, float min_value, 
+						  float max_value)
+{
+	return (add_entry (name, PARAM_FLOAT, min_value, max_value, p_value));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add an @c int32_t parameter.
+ *  @param   name The parameter's name, which must be a string that is never freed
+ *  @param   p_value A pointer to the parameter's variable
+ *  @param   min_value The smallest value to which the parameter may be set
+ *  @param   max_value The largest value to which the parameter may be set
+ *  @return  True if the parameter was added, false if the table is full or the
+ *           parameter's flash key is taken; see @c add_entry()
+ */
+
+bool param_registry::add (const char* name, int32_t* p_value, int32_t min_value, 
+						  int32_t max_value)
+{
+	return (add_entry (name, PARAM_INT32, (float)min_value, (float)max_value, p_value));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add a @c uint8_t parameter.
+ *  @param   name The parameter's name, which must be a string that is never freed
+ *  @param   p_value A pointer to the parameter's variable
+ *  @param   min_value The smallest value to which the parameter may be set
+ *  @param   max_value The largest value to which the parameter may be set
+ *  @return  True if the parameter was added, false if the table is full or the
+ *           parameter's flash key is taken; see @c add_entry()
+ */
+
+bool param_registry::add (const char* name, uint8_t* p_value, uint8_t min_value, 
+						  uint8_t max_value)
+{
+	return (add_entry (name, PARAM_UINT8, min_value, max_value, p_value));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add a @c bool parameter, which is sent as 0 or 1.
+ *  @param   name The parameter's name, which must be a string that is never freed
+ *  @param   p_value A pointer to the parameter's variable
+ *  @param   saved False for a flag which triggers an action, so that it's never 
+ *           saved in the flash store (default true)
+ *  @return  True if the parameter was added, false if the table is full or the
+ *           parameter's flash key is taken; see @c add_entry()
+ */
+
+bool param_registry::add (const char* name, bool* p_value, bool saved)
+{
+	return (add_entry (name, PARAM_BOOL, 0.0f, 1.0f, p_value, saved));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Add an @c int16_t parameter.
+ *  @param   name The parameter's name, which must be a string that is never freed
+ *  @param   p_value A pointer to the parameter's variable
+ *  @param   min_value The smallest value to which the parameter may be set
+ *  @param   max_value The largest value to which the parameter may be set
+ *  @return  True if the parameter was added, false if the table is full or the
+ *           parameter's flash key is taken; see @c add_entry()
+ */
+
+bool param_registry::add (const char* name, int16_t* p_value, int16_t min_value, 
+						  int16_t max_value)
+{
+	return (add_entry (name, PARAM_INT16, min_value, max_value, p_value));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find a parameter by name.
+ *  @param   name The name of the parameter
+ *  @return  The parameter's index, or -1 if there's no parameter with that name
+ */
+
+int16_t param_registry::find (const char* name)
+{
+	for (uint8_t index = 0; index < num_entries; index++)
+	{
+		if (strcmp (entries[index].name, name) == 0)
+		{
+			return (index);
+		}
+	}
+	return (-1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Read a parameter's present value.
+ *  @details Integers are returned as their two's complement bits and floats as their
+ *  IEEE 754 bits. A value which has been set but not yet applied isn't returned.
+ *  @param   index The parameter's index, which must be less than @c get_count()
+ *  @return  The parameter's value as four raw bytes
+ */
+
+uint32_t param_registry::get (uint8_t index)
+{
+	param_entry* p_entry = entries + index;
+	switch (p_entry->type)
+	{
+		case PARAM_FLOAT:
+			return (float_bits (*(float*)p_entry->p_value));
+		case PARAM_INT32:
+			return ((uint32_t)*(int32_t*)p_entry->p_value);
+		case PARAM_UINT8:
+			return (*(uint8_t*)p_entry->p_value);
+		case PARAM_BOOL:
+			return (*(bool*)p_entry->p_value ? 1 : 0);
+		case PARAM_INT16:
+			return ((uint32_t)(int32_t)*(int16_t*)p_entry->p_value);
+	}
+	return (0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Check a new value for a parameter and hold it until it's applied.
+ *  @details The value is compared with the parameter's limits; a float which is not
+ *  a number fails the check. A value which passes is held until the next call to 
+ *  @c apply_pending(), replacing any other value held for the same parameter.
+ *  @param   index The parameter's index
+ *  @param   bits The new value as four raw bytes, in the same form as from @c get()
+ *  @return  @c PARAM_OK if the value will be applied, or the reason it won't be
+ */
+
+param_status_t param_registry::set (uint8_t index, uint32_t bits)
+{
+	if (index >= num_entries)
+	{
+		return (PARAM_BAD_INDEX);
+	}
+
+	param_entry* p_entry = entries + index;
+	float value;
+	switch (p_entry->type)
+	{
+		case PARAM_FLOAT:
+			memcpy (&value, &bits, sizeof (value));
+			break;
+		case PARAM_INT32:
+		case PARAM_INT16:
+			value = (float)(int32_t)bits;
+			break;
+		default:
+			value = (float)bits;
+			break;
+	}
+	if (!(value >= p_entry->min_value && value <= p_entry->max_value))
+	{
+		return (PARAM_OUT_OF_BOUNDS);
+	}
+
+	portENTER_CRITICAL ();
+	p_entry->pending_bits = bits;
+	p_entry->pending = true;
+	portEXIT_CRITICAL ();
+
+	return (PARAM_OK);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Copy all the values which have been set into their variables.
+ *  @details This method should be called only by the task which uses the parameters,
+ *  between its cycles. All the held values are copied with interrupts masked, so no
+ *  new value can arrive partway through and the task sees either all or none of a 
+ *  set of changes sent together.
+ *  @return  True if any parameter was changed, so the task can recompute anything 
+ *  which depends on them
+ */
+
+bool param_registry::apply_pending (void)
+{
+	bool changed = false;
+
+	portENTER_CRITICAL ();
+	for (param_entry* p_entry = entries; p_entry < entries + num_entries; p_entry++)
+	{
+		if (p_entry->pending)
+		{
+			switch (p_entry->type)
+			{
+				case PARAM_FLOAT:
+					memcpy (p_entry->p_value, &(p_entry->pending_bits), sizeof (float));
+					break;
+				case PARAM_INT32:
+					*(int32_t*)p_entry->p_value = (int32_t)p_entry->pending_bits;
+					break;
+				case PARAM_UINT8:
+					*(uint8_t*)p_entry->p_value = (uint8_t)p_entry->pending_bits;
+					break;
+				case PARAM_BOOL:
+					*(bool*)p_entry->p_value = (p_entry->pending_bits != 0);
+					break;
+				case PARAM_INT16:
+					*(int16_t*)p_entry->p_value = (int16_t)(int32_t)p_entry->pending_bits;
+					break;
+			}
+			p_entry->pending = false;
+			changed = true;
+		}
+	}
+	portEXIT_CRITICAL ();
+
+	return (changed);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Decode one character of a request.
+ *  @details Characters are collected until a whole frame has been received. A frame
+ *  with a bad checksum or a payload too long for any request is dropped, and the 
+ *  receiver goes back to looking for a sync byte. 
+ *  @param   ch The character which was received
+ *  @param   reply_dev The serial device on which to send the reply
+ */
+
+void param_registry::receive (char ch, emstream& reply_dev)
+{
+	uint8_t byte = (uint8_t)ch;
+
+	switch (rx_state)
+	{
+		case PARAM_RX_SYNC:
+			if (byte == PARAM_SYNC_REQUEST)
+			{
+				rx_state = PARAM_RX_COMMAND;
+			}
+			break;
+
+		case PARAM_RX_COMMAND:
+			rx_command = byte;
+			rx_sum = byte;
+			rx_state = PARAM_RX_LENGTH;
+			break;
+
+		case PARAM_RX_LENGTH:
+			rx_length = byte;
+			rx_sum += byte;
+			rx_count = 0;
+			if (rx_length > PARAM_MAX_REQUEST)
+			{
+				rx_state = PARAM_RX_SYNC;
+			}
+			else
+			{
+				rx_state = (rx_length > 0) ? PARAM_RX_PAYLOAD : PARAM_RX_CHECKSUM;
+			}
+			break;
+
+		case PARAM_RX_PAYLOAD:
+			rx_payload[rx_count++] = byte;
+			rx_sum += byte;
+			if (rx_count >= rx_length)
+			{
+				rx_state = PARAM_RX_CHECKSUM;
+			}
+			break;
+
+		default:
+			rx_state = PARAM_RX_SYNC;
+			if ((uint8_t)(rx_sum + byte) == 0)
+			{
+				execute (reply_dev);
+			}
+			break;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Carry out a request which has been received and send the reply.
+ *  @param   reply_dev The serial device on which to send the reply
+ */
+
+void param_registry::execute (emstream& reply_dev)
+{
+	// The longest reply is an info command's, with a status, index, type, two limits,
+	// and the name
+	uint8_t reply[3 + 2 * 4 + PARAM_MAX_NAME];
+	uint8_t length = 1;
+	uint8_t index = rx_payload[0];
+
+	reply[0] = PARAM_OK;
+	if ((rx_command == PARAM_CMD_INFO || rx_command == PARAM_CMD_GET 
+		 || rx_command == PARAM_CMD_SET) && (rx_length < 1 || index >= num_entries))
+	{
+		reply[0] = (rx_length < 1) ? PARAM_BAD_COMMAND : PARAM_BAD_INDEX;
+		send_reply (reply_dev, reply, length);
+		return;
+	}
+
+	switch (rx_command)
+	{
+		case PARAM_CMD_COUNT:
+			reply[length++] = num_entries;
+			break;
+
+		case PARAM_CMD_INFO:
+		{
+			reply[length++] = index;
+			reply[length++] = (uint8_t)entries[index].type;
+			put_le32 (reply + length, float_bits (entries[index].min_value));
+			length += 4;
+			put_le32 (reply + length, float_bits (entries[index].max_value));
+			length += 4;
+			for (const char* p_char = entries[index].name; 
+				 *p_char != '\0' && length < sizeof (reply); p_char++)
+			{
+				reply[length++] = (uint8_t)*p_char;
+			}
+			break;
+		}
+
+		case PARAM_CMD_GET:
+			reply[length++] = index;
+			put_le32 (reply + length, get (index));
+			length += 4;
+			break;
+
+		case PARAM_CMD_SET:
+			reply[length++] = index;
+			reply[0] = (rx_length == 5) 
+					   ? set (index, get_le32 (rx_payload + 1)) : PARAM_BAD_COMMAND;
+			break;
+
+		case PARAM_CMD_SAVE:
+			reply[0] = save () ? PARAM_OK : PARAM_SAVE_FAILED;
+			break;
+
+		default:
+			reply[0] = PARAM_BAD_COMMAND;
+			break;
+	}
+
+	send_reply (reply_dev, reply, length);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Send a reply frame.
+ *  @param   reply_dev The serial device on which to send the reply
+ *  @param   p_payload The reply's payload, starting with the status byte
+ *  @param   length The number of bytes in the payload
+ */
+
+void param_registry::send_reply (emstream& reply_dev, const uint8_t* p_payload, 
+								 uint8_t length)
+{
+	uint8_t command = rx_command | 0x80;
+	uint8_t sum = command + length;
+
+	reply_dev.putchar ((char)PARAM_SYNC_REPLY);
+	reply_dev.putchar ((char)command);
+	reply_dev.putchar ((char)length);
+	for (uint8_t index = 0; index < length; index++)
+	{
+		reply_dev.putchar ((char)p_payload[index]);
+		sum += p_payload[index];
+	}
+	reply_dev.putchar ((char)(uint8_t)(0 - sum));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Make the key under which a parameter is saved in the flash store.
+ *  @details The key is made from the parameter's name rather than its index, so 
+ *  saved values still find their parameters when parameters are added or moved.
+ *  Different names can give the same key, so @c add_entry() refuses a saved 
+ *  parameter whose key is already used by another.
+ *  @param   name The parameter's name
+ *  @return  The key, which is never @c FLASH_STORE_NO_KEY
+ */
+
+uint16_t param_registry::store_key (const char* name)
+{
+	return ((uint16_t)(flash_store::crc32 (name, strlen (name)) & 0x7FFF));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Save the parameters' present values in the flash store.
+ *  @details Values which are already saved aren't written again, and parameters 
+ *  added with @c saved false aren't saved at all. Saving may stop the CPU for a 
+ *  second or two if the flash store has to erase a sector, and outputs such as the
+ *  motors' PWM would keep their last values all that time; so the scheduler is 
+ *  suspended and the first function given to @c set_save_hooks() is called to stop 
+ *  them before anything is written. The second is called to start them again once
+ *  the scheduler has been resumed, and only then are any failures printed.
+ *  @return  True if every value was saved, false if any wasn't or there's no store
+ */
+
+bool param_registry::save (void)
+{
+	if (p_store == NULL)
+	{
+		return (false);
+	}
+
+	vTaskSuspendAll ();
+	if (p_before_save != NULL)
+	{
+		p_before_save (p_save_hook_arg);
+	}
+
+	bool ok = true;
+	for (uint8_t index = 0; index < num_entries; index++)
+	{
+		if (entries[index].saved)
+		{
+			uint32_t bits = get (index);
+			ok = p_store->put (store_key (entries[index].name), &bits, sizeof (bits))
+				 && ok;
+		}
+	}
+	xTaskResumeAll ();
+	if (p_after_save != NULL)
+	{
+		p_after_save (p_save_hook_arg);
+	}
+	p_store->report_errors ();
+
+	return (ok);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set the parameters from values saved in the flash store.
+ *  @details Each saved value is checked against its parameter's present limits and
+ *  held like a value set by the host, so it takes effect at the next call to 
+ *  @c apply_pending(). Parameters which weren't saved keep their values, as do those
+ *  added with @c saved false even if an older program saved them. This should
+ *  be called once at startup, after all the parameters have been added.
+ *  @return  The number of parameters which were set
+ */
+
+uint8_t param_registry::load (void)
+{
+	uint8_t loaded = 0;
+
+	if (p_store != NULL)
+	{
+		for (uint8_t index = 0; index < num_entries; index++)
+		{
+			uint32_t bits;
+			if (entries[index].saved 
+				&& p_store->get (store_key (entries[index].name), &bits, 
+								 sizeof (bits))
+				&& set (index, bits) == PARAM_OK)
+			{
+				loaded++;
+			}
+		}
+	}
+	return (loaded);
+}
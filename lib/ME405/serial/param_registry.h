@@ -0,0 +1,270 @@
+//*************************************************************************************
+/** @file    param_registry.h
+ *  @brief   A registry of tunable parameters which can be read and set over a serial
+ *           line with a compact binary protocol.
+ *  @details This file contains a class which keeps a table of a program's tunable 
+ *           numbers, each with a name, a type, limits, and a pointer to the variable 
+ *           itself. A host computer can list the parameters and read and set them 
+ *           while the program runs, so gains and setpoints can be tuned without 
+ *           recompiling. New values are held back until the task which uses them 
+ *           calls @c apply_pending() between its cycles, so that task never sees a 
+ *           half-changed set of values. The values can be saved in a @c flash_store 
+ *           and loaded from it at startup.
+ *
+ *  License:
+ *		This file is released under the Lesser GNU Public License, version 2. It is
+ *		intended for educational use only, but its use is not limited thereto. */
+/*		THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *		AND	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *		IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *		ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE 
+ *		LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUEN-
+ *		TIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+ *		OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ *		CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ *		OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ *		OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+//*************************************************************************************
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _PARAM_REGISTRY_H_
+#define _PARAM_REGISTRY_H_
+
+#include <stdint.h>                         // Integer types with known sizes
+#include "emstream.h"                       // Serial devices on which replies are sent
+#include "flash_store.h"                    // Flash memory in which values are saved
+
+
+/** @brief   The types of variable which can be registered as parameters.
+ */
+typedef enum param_type
+{
+	PARAM_FLOAT,                            ///< A @c float
+	PARAM_INT32,                            ///< An @c int32_t
+	PARAM_UINT8,                            ///< A @c uint8_t
+	PARAM_BOOL,                             ///< A @c bool, with limits of 0 and 1
+	PARAM_INT16                             ///< An @c int16_t
+} param_type_t;
+
+/** @brief   Results of parameter commands, sent as the first byte of each reply.
+ */
+typedef enum param_status
+{
+	PARAM_OK,                               ///< The command worked
+	PARAM_BAD_INDEX,                        ///< There's no parameter with that index
+	PARAM_OUT_OF_BOUNDS,                    ///< The new value is outside the limits
+	PARAM_BAD_COMMAND,                      ///< Unknown command or wrong length
+	PARAM_SAVE_FAILED                       ///< The values couldn't be saved
+} param_status_t;
+
+/** @brief   Commands in the binary parameter protocol.
+ *  @details Each request is sent as a frame: the byte @c PARAM_SYNC_REQUEST, the 
+ *  command, the number of payload bytes, the payload, and a checksum chosen so that 
+ *  the command, length, payload, and checksum bytes add up to zero modulo 256. Each
+ *  reply is framed the same way, starting with @c PARAM_SYNC_REPLY, with the command 
+ *  byte's top bit set and a status byte first in its payload. Multi-byte numbers are 
+ *  little-endian and values are always four bytes, floats in IEEE 754 form. Replies 
+ *  may be mixed in with text on the same serial line; the host finds them by their 
+ *  sync byte and checksum.
+ */
+typedef enum param_command
+{
+	PARAM_CMD_COUNT = 1,                    ///< Reply: number of parameters
+	PARAM_CMD_INFO = 2,                     ///< Index; reply: index, type, min, max, name
+	PARAM_CMD_GET = 3,                      ///< Index; reply: index, value
+	PARAM_CMD_SET = 4,                      ///< Index, value; reply: index
+	PARAM_CMD_SAVE = 5                      ///< Reply: status of saving all values
+} param_command_t;
+
+/// The first byte of a request frame.
+const uint8_t PARAM_SYNC_REQUEST = 0xA5;
+
+/// The first byte of a reply frame.
+const uint8_t PARAM_SYNC_REPLY = 0x5A;
+
+/// The largest request payload, which is a set command's index and value.
+const uint8_t PARAM_MAX_REQUEST = 5;
+
+/// The longest parameter name which is sent in full by an info command.
+const uint8_t PARAM_MAX_NAME = 16;
+
+/// The default number of parameters for which a registry has room.
+const uint8_t PARAM_MAX_ENTRIES = 32;
+
+
+/** @brief   One parameter's entry in a registry.
+ */
+struct param_entry
+{
+	const char* name;                       ///< Name shown to the host
+	param_type_t type;                      ///< Type of the variable
+	float min_value;                        ///< Smallest value which may be set
+	float max_value;                        ///< Largest value which may be set
+	void* p_value;                          ///< The variable itself
+	bool saved;                             ///< True if the value goes in the flash store
+	uint32_t pending_bits;                  ///< New value waiting to be applied
+	bool pending;                           ///< True if a new value is waiting
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A table of tunable parameters with a binary get/set protocol.
+ *  @details Parameters are added once at startup with @c add(). After that, a 
+ *  serving task passes each character it receives to @c receive(), which decodes 
+ *  request frames and sends replies. Values which are set are checked against their
+ *  limits and held until @c apply_pending() is called by the task which uses them, 
+ *  which copies all of them into their variables at once with interrupts masked. 
+ *  Only that task should call @c apply_pending(), and it should do so at the start 
+ *  of its cycle; it can then recompute anything which depends on the parameters.
+ *  If a @c flash_store has been given by @c set_store(), a save command writes all
+ *  the present values into it, each under a key made from its name; @c load() reads
+ *  them back at startup as if the host had set them. Flags which trigger an action, 
+ *  such as starting a tuning run, are added with @c saved false so that they're 
+ *  never saved and the action isn't started again at every reset. Because saving may
+ *  erase a flash sector, which stops the CPU for a second or two, a function given 
+ *  to @c set_save_hooks() is called first to put the machine in a safe state, such
+ *  as with its motors off, and another afterwards to start it again.
+ *
+ *  Example:
+ *  @code
+ *  param_registry* p_params = new param_registry ();
+ *  p_params->add ("kp", &kp, 0.0f, 10.0f);
+ *  ...
+ *  // In the serving task
+ *  while (p_serial->check_for_char ())
+ *  {
+ *      p_params->receive (p_serial->getchar (), *p_serial);
+ *  }
+ *  ...
+ *  // In the control task, before each cycle
+ *  if (p_params->apply_pending ())
+ *  {
+ *      recompute_gains ();
+ *  }
+ *  @endcode
+ */
+
+class param_registry
+{
+protected:
+	/// The table of parameters.
+	param_entry* entries;
+
+	/// The number of parameters in the table.
+	uint8_t num_entries;
+
+	/// The number of parameters for which the table has room.
+	uint8_t max_entries;
+
+	/// How far the receiver has got through the present request frame.
+	uint8_t rx_state;
+
+	/// The present request's command byte.
+	uint8_t rx_command;
+
+	/// The present request's payload length.
+	uint8_t rx_length;
+
+	/// The number of payload bytes received so far.
+	uint8_t rx_count;
+
+	/// The running sum of the request's bytes, for the checksum.
+	uint8_t rx_sum;
+
+	/// The present request's payload.
+	uint8_t rx_payload[PARAM_MAX_REQUEST];
+
+	/// The flash store in which values are saved, or NULL if there is none.
+	flash_store* p_store;
+
+	/// A function called before saving to make the machine safe, or NULL for none.
+	void (*p_before_save)(void*);
+
+	/// A function called after saving to undo the one before, or NULL for none.
+	void (*p_after_save)(void*);
+
+	/// The pointer which is passed to the functions called before and after saving.
+	void* p_save_hook_arg;
+
+	// Make a flash store key from a parameter's name
+	static uint16_t store_key (const char* name);
+
+	// Add an entry of any type to the table
+	bool add_entry (const char* name, param_type_t type, float min_value, 
+					float max_value, void* p_value, bool saved = true);
+
+	// Carry out a complete request and send the reply
+	void execute (emstream& reply_dev);
+
+	// Send a reply frame
+	void send_reply (emstream& reply_dev, const uint8_t* p_payload, uint8_t length);
+
+public:
+	// The constructor makes an empty table with room for the given number of entries
+	param_registry (uint8_t max_entries_in = PARAM_MAX_ENTRIES);
+
+	// Add parameters of each type
+	bool add (const char* name, float* p_value, float min_value, float max_value);
+	bool add (const char* name, int32_t* p_value, int32_t min_value, int32_t max_value);
+	bool add (const char* name, uint8_t* p_value, uint8_t min_value, uint8_t max_value);
+	bool add (const char* name, bool* p_value, bool saved = true);
+	bool add (const char* name, int16_t* p_value, int16_t min_value, int16_t max_value);
+
+	// Find a parameter's index from its name
+	int16_t find (const char* name);
+
+	// Read a parameter's present value as four raw bytes
+	uint32_t get (uint8_t index);
+
+	// Check a new value and hold it until it's applied
+	param_status_t set (uint8_t index, uint32_t bits);
+
+	// Copy all the held values into their variables
+	bool apply_pending (void);
+
+	// Decode one received character, replying when a request is complete
+	void receive (char ch, emstream& reply_dev);
+
+	// Save all the parameters' present values in the flash store
+	bool save (void);
+
+	// Set the parameters from values saved in the flash store
+	uint8_t load (void);
+
+	/** @brief   Set the flash store in which the parameters' values are saved.
+	 *  @param   p_store_in A pointer to a flash store which has been started, or NULL
+	 */
+	void set_store (flash_store* p_store_in)
+	{
+		p_store = p_store_in;
+	}
+
+	/** @brief   Set functions to be called just before and just after saving.
+	 *  @details The first is called by @c save() with the scheduler suspended, so no
+	 *  other task can run between it and the end of saving. It should stop anything,
+	 *  such as the motors, which mustn't be left running while the CPU is stopped by
+	 *  erasing a flash sector, including anything run by interrupts which would stall
+	 *  too. The second is called once the scheduler has been resumed, to start them 
+	 *  again.
+	 *  @param   p_before The function called before saving, or NULL for none
+	 *  @param   p_after The function called after saving, or NULL for none
+	 *  @param   p_arg A pointer which is passed to both functions
+	 */
+	void set_save_hooks (void (*p_before)(void*), void (*p_after)(void*), 
+						 void* p_arg = NULL)
+	{
+		p_before_save = p_before;
+		p_after_save = p_after;
+		p_save_hook_arg = p_arg;
+	}
+
+	/** @brief   Get the number of parameters in the registry.
+	 *  @return  The number of parameters which have been added
+	 */
+	uint8_t get_count (void)
+	{
+		return (num_entries);
+	}
+};
+
+#endif // _PARAM_REGISTRY_H_
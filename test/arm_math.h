@@ -0,0 +1,94 @@
+//**************************************************************************************
+/** @file arm_math.h
+ *    This file stands in for the CMSIS DSP library's arm_math.h in the host tests. As
+ *    this directory is searched first, dsp_kernels.h finds it rather than the one in
+ *    lib/CMSIS, whose fixed point kernels cast pointers to 32 bit integers and won't
+ *    compile cleanly for a 64 bit host. Only the floating point PID, biquad, and FIR
+ *    parts are here, copied from CMSIS DSP V1.0.10 with the same types, structure
+ *    layouts, and arithmetic; cmsis_dsp_f32.cpp holds the kernels which aren't inline.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _ARM_MATH_H
+#define _ARM_MATH_H
+
+#include <stdint.h>
+
+
+/// The CMSIS name for a 32 bit float.
+typedef float float32_t;
+
+
+/** @brief   The instance of a floating point PID controller.
+ */
+typedef struct
+{
+	float32_t A0;                           ///< The derived gain Kp + Ki + Kd
+	float32_t A1;                           ///< The derived gain -Kp - 2 Kd
+	float32_t A2;                           ///< The derived gain Kd
+	float32_t state[3];                     ///< The last two inputs and last output
+	float32_t Kp;                           ///< The proportional gain
+	float32_t Ki;                           ///< The integral gain
+	float32_t Kd;                           ///< The derivative gain
+} arm_pid_instance_f32;
+
+
+/** @brief   The instance of a floating point biquad cascade in direct form I.
+ */
+typedef struct
+{
+	uint32_t numStages;                     ///< The number of second order sections
+	float32_t* pState;                      ///< The state, 4 * numStages long
+	float32_t* pCoeffs;                     ///< The coefficients, 5 * numStages long
+} arm_biquad_casd_df1_inst_f32;
+
+
+/** @brief   The instance of a floating point FIR filter.
+ */
+typedef struct
+{
+	uint16_t numTaps;                       ///< The number of coefficients
+	float32_t* pState;                      ///< The state, numTaps + blockSize - 1 long
+	float32_t* pCoeffs;                     ///< The coefficients, time reversed
+} arm_fir_instance_f32;
+
+
+// Set up a biquad cascade in direct form I
+void arm_biquad_cascade_df1_init_f32 (arm_biquad_casd_df1_inst_f32* S,
+									  uint8_t numStages, float32_t* pCoeffs,
+									  float32_t* pState);
+
+// Filter a block of samples through a biquad cascade in direct form I
+void arm_biquad_cascade_df1_f32 (const arm_biquad_casd_df1_inst_f32* S,
+								 float32_t* pSrc, float32_t* pDst, uint32_t blockSize);
+
+// Set up an FIR filter
+void arm_fir_init_f32 (arm_fir_instance_f32* S, uint16_t numTaps, float32_t* pCoeffs,
+					   float32_t* pState, uint32_t blockSize);
+
+// Filter a block of samples through an FIR filter
+void arm_fir_f32 (const arm_fir_instance_f32* S, float32_t* pSrc, float32_t* pDst,
+				  uint32_t blockSize);
+
+
+/** @brief   Run one step of a floating point PID controller, as CMSIS does inline.
+ *  @param   S The controller's instance
+ *  @param   in The error
+ *  @return  The new output
+ */
+static inline float32_t arm_pid_f32 (arm_pid_instance_f32* S, float32_t in)
+{
+	float32_t out;
+
+	// y[n] = y[n-1] + A0 * x[n] + A1 * x[n-1] + A2 * x[n-2]
+	out = (S->A0 * in) + (S->A1 * S->state[0]) + (S->A2 * S->state[1]) + (S->state[2]);
+
+	S->state[1] = S->state[0];
+	S->state[0] = in;
+	S->state[2] = out;
+
+	return (out);
+}
+
+#endif // _ARM_MATH_H
@@ -0,0 +1,285 @@
+//**************************************************************************************
+/** @file cmsis_dsp_f32.cpp
+ *    This file holds the CMSIS DSP library's floating point biquad and FIR kernels
+ *    for the host tests. The tree has only the library's headers, not its sources or
+ *    the built library, so these functions follow the C sources of CMSIS DSP V1.0.10,
+ *    the version of arm_math.h in lib/CMSIS, along the path which is compiled for the
+ *    Cortex-M4: the same loops, unrolled by four where the library's are, and the same
+ *    order of arithmetic, so that they round as the library does. The PID kernel is
+ *    an inline function in arm_math.h itself and so needs nothing here.
+ */
+//**************************************************************************************
+
+#define USE_CMSIS_DSP               1
+
+#include <string.h>
+
+#include "dsp_kernels.h"
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set up a biquad cascade in direct form I, as arm_biquad_cascade_df1_f32.c.
+ *  @param   S The instance to be set up
+ *  @param   numStages The number of second order sections
+ *  @param   pCoeffs b0, b1, b2, a1, a2 for each section
+ *  @param   pState The state, 4 * @a numStages long, which is cleared
+ */
+void arm_biquad_cascade_df1_init_f32 (arm_biquad_casd_df1_inst_f32* S,
+									  uint8_t numStages, float32_t* pCoeffs,
+									  float32_t* pState)
+{
+	S->numStages = numStages;
+	S->pCoeffs = pCoeffs;
+	memset (pState, 0, (4u * (uint32_t)numStages) * sizeof (float32_t));
+	S->pState = pState;
+}
+
+
+/** @brief   Filter a block of samples through a biquad cascade in direct form I.
+ *  @param   S The filter's instance
+ *  @param   pSrc The input samples
+ *  @param   pDst Where the output samples go
+ *  @param   blockSize The number of samples
+ */
+void arm_biquad_cascade_df1_f32 (const arm_biquad_casd_df1_inst_f32* S,
+								 float32_t* pSrc, float32_t* pDst, uint32_t blockSize)
+{
+	float32_t* pIn = pSrc;
+	float32_t* pOut = pDst;
+	float32_t* pState = S->pState;
+	float32_t* pCoeffs = S->pCoeffs;
+	float32_t acc;
+	float32_t b0, b1, b2, a1, a2;
+	float32_t Xn1, Xn2, Yn1, Yn2;
+	float32_t Xn;
+	uint32_t sample, stage = S->numStages;
+
+	do
+	{
+		b0 = *pCoeffs++;
+		b1 = *pCoeffs++;
+		b2 = *pCoeffs++;
+		a1 = *pCoeffs++;
+		a2 = *pCoeffs++;
+
+		Xn1 = pState[0];
+		Xn2 = pState[1];
+		Yn1 = pState[2];
+		Yn2 = pState[3];
+
+		// Four samples at a time, the state variables taking turns to hold the newest
+		sample = blockSize >> 2u;
+		while (sample > 0u)
+		{
+			Xn = *pIn++;
+			Yn2 = (b0 * Xn) + (b1 * Xn1) + (b2 * Xn2) + (a1 * Yn1) + (a2 * Yn2);
+			*pOut++ = Yn2;
+
+			Xn2 = *pIn++;
+			Yn1 = (b0 * Xn2) + (b1 * Xn) + (b2 * Xn1) + (a1 * Yn2) + (a2 * Yn1);
+			*pOut++ = Yn1;
+
+			Xn1 = *pIn++;
+			Yn2 = (b0 * Xn1) + (b1 * Xn2) + (b2 * Xn) + (a1 * Yn1) + (a2 * Yn2);
+			*pOut++ = Yn2;
+
+			Xn = *pIn++;
+			Yn1 = (b0 * Xn) + (b1 * Xn1) + (b2 * Xn2) + (a1 * Yn2) + (a2 * Yn1);
+			*pOut++ = Yn1;
+
+			Xn2 = Xn1;
+			Xn1 = Xn;
+			sample--;
+		}
+
+		// The samples left over
+		sample = blockSize & 0x3u;
+		while (sample > 0u)
+		{
+			Xn = *pIn++;
+			acc = (b0 * Xn) + (b1 * Xn1) + (b2 * Xn2) + (a1 * Yn1) + (a2 * Yn2);
+			*pOut++ = acc;
+
+			Xn2 = Xn1;
+			Xn1 = Xn;
+			Yn2 = Yn1;
+			Yn1 = acc;
+			sample--;
+		}
+
+		*pState++ = Xn1;
+		*pState++ = Xn2;
+		*pState++ = Yn1;
+		*pState++ = Yn2;
+
+		// Each later section filters the one before's output in place
+		pIn = pDst;
+		pOut = pDst;
+		stage--;
+	}
+	while (stage > 0u);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Set up an FIR filter, as arm_fir_init_f32.c.
+ *  @param   S The instance to be set up
+ *  @param   numTaps The number of coefficients
+ *  @param   pCoeffs The coefficients in time reversed order
+ *  @param   pState The state, @a numTaps + @a blockSize - 1 long, which is cleared
+ *  @param   blockSize The largest number of samples filtered at once
+ */
+void arm_fir_init_f32 (arm_fir_instance_f32* S, uint16_t numTaps, float32_t* pCoeffs,
+					   float32_t* pState, uint32_t blockSize)
+{
+	S->numTaps = numTaps;
+	S->pCoeffs = pCoeffs;
+	memset (pState, 0, (numTaps + (blockSize - 1u)) * sizeof (float32_t));
+	S->pState = pState;
+}
+
+
+/** @brief   Filter a block of samples through an FIR filter, as arm_fir_f32.c.
+ *  @param   S The filter's instance
+ *  @param   pSrc The input samples
+ *  @param   pDst Where the output samples go
+ *  @param   blockSize The number of samples
+ */
+void arm_fir_f32 (const arm_fir_instance_f32* S, float32_t* pSrc, float32_t* pDst,
+				  uint32_t blockSize)
+{
+	float32_t* pState = S->pState;
+	float32_t* pCoeffs = S->pCoeffs;
+	float32_t* pStateCurnt;
+	float32_t *px, *pb;
+	float32_t acc0, acc1, acc2, acc3;
+	float32_t x0, x1, x2, x3, c0;
+	uint32_t numTaps = S->numTaps;
+	uint32_t i, tapCnt, blkCnt;
+
+	// New samples go after the numTaps - 1 old ones
+	pStateCurnt = &(S->pState[(numTaps - 1u)]);
+
+	// Four outputs at a time, sharing each coefficient fetched
+	blkCnt = blockSize >> 2;
+	while (blkCnt > 0u)
+	{
+		*pStateCurnt++ = *pSrc++;
+		*pStateCurnt++ = *pSrc++;
+		*pStateCurnt++ = *pSrc++;
+		*pStateCurnt++ = *pSrc++;
+
+		acc0 = 0.0f;
+		acc1 = 0.0f;
+		acc2 = 0.0f;
+		acc3 = 0.0f;
+
+		px = pState;
+		pb = pCoeffs;
+
+		x0 = *px++;
+		x1 = *px++;
+		x2 = *px++;
+
+		tapCnt = numTaps >> 2u;
+		while (tapCnt > 0u)
+		{
+			c0 = *(pb++);
+			x3 = *(px++);
+			acc0 += x0 * c0;
+			acc1 += x1 * c0;
+			acc2 += x2 * c0;
+			acc3 += x3 * c0;
+
+			c0 = *(pb++);
+			x0 = *(px++);
+			acc0 += x1 * c0;
+			acc1 += x2 * c0;
+			acc2 += x3 * c0;
+			acc3 += x0 * c0;
+
+			c0 = *(pb++);
+			x1 = *(px++);
+			acc0 += x2 * c0;
+			acc1 += x3 * c0;
+			acc2 += x0 * c0;
+			acc3 += x1 * c0;
+
+			c0 = *(pb++);
+			x2 = *(px++);
+			acc0 += x3 * c0;
+			acc1 += x0 * c0;
+			acc2 += x1 * c0;
+			acc3 += x2 * c0;
+
+			tapCnt--;
+		}
+
+		tapCnt = numTaps % 0x4u;
+		while (tapCnt > 0u)
+		{
+			c0 = *(pb++);
+			x3 = *(px++);
+			acc0 += x0 * c0;
+			acc1 += x1 * c0;
+			acc2 += x2 * c0;
+			acc3 += x3 * c0;
+
+			x0 = x1;
+			x1 = x2;
+			x2 = x3;
+			tapCnt--;
+		}
+
+		pState = pState + 4;
+
+		*pDst++ = acc0;
+		*pDst++ = acc1;
+		*pDst++ = acc2;
+		*pDst++ = acc3;
+
+		blkCnt--;
+	}
+
+	// The outputs left over, one at a time
+	blkCnt = blockSize % 0x4u;
+	while (blkCnt > 0u)
+	{
+		*pStateCurnt++ = *pSrc++;
+
+		acc0 = 0.0f;
+		px = pState;
+		pb = pCoeffs;
+		i = numTaps;
+		do
+		{
+			acc0 += *px++ * *pb++;
+			i--;
+		}
+		while (i > 0u);
+
+		*pDst++ = acc0;
+		pState = pState + 1;
+		blkCnt--;
+	}
+
+	// Move the newest numTaps - 1 samples to the start of the state for next time
+	pStateCurnt = S->pState;
+
+	tapCnt = (numTaps - 1u) >> 2u;
+	while (tapCnt > 0u)
+	{
+		*pStateCurnt++ = *pState++;
+		*pStateCurnt++ = *pState++;
+		*pStateCurnt++ = *pState++;
+		*pStateCurnt++ = *pState++;
+		tapCnt--;
+	}
+
+	tapCnt = (numTaps - 1u) % 0x4u;
+	while (tapCnt > 0u)
+	{
+		*pStateCurnt++ = *pState++;
+		tapCnt--;
+	}
+}
@@ -0,0 +1,51 @@
+//**************************************************************************************
+/** @file periph_ram.h
+ *    This file contains a function which lets driver code which writes to the STM32's
+ *    peripheral registers run on a host computer. RAM is mapped at the addresses of
+ *    the peripherals, so that @c TIM3, @c GPIOC and so on point to plain memory; the
+ *    drivers and the StdPeriph library then run unchanged, and a test can read back
+ *    the values they wrote to each register. Nothing in the registers responds, of
+ *    course: flags the hardware would set stay clear unless the test sets them.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _PERIPH_RAM_H_
+#define _PERIPH_RAM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+
+/** @brief   Map zeroed RAM at the STM32's peripheral and core peripheral addresses.
+ *  @details The APB and AHB1 peripherals are at @c PERIPH_BASE and the system control
+ *           block and NVIC at @c SCS_BASE. This must be called before anything touches
+ *           a register; calling it again clears all of them.
+ *  @return  @c true if the memory was mapped, @c false if the host wouldn't allow it
+ */
+static inline bool periph_ram_map (void)
+{
+	static const struct { uintptr_t base; size_t size; } regions[] =
+	{
+		{ 0x40000000UL, 0x00080000UL },         // APB1, APB2 and AHB1 peripherals
+		{ 0xE0000000UL, 0x00100000UL },         // Core peripherals
+	};
+
+	for (uint8_t index = 0; index < sizeof (regions) / sizeof (regions[0]); index++)
+	{
+		void* p_region = (void*)regions[index].base;
+		void* p_got = mmap (p_region, regions[index].size, PROT_READ | PROT_WRITE,
+							MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		if (p_got != p_region)
+		{
+			printf ("Can't map RAM at 0x%08lX\n", (unsigned long)regions[index].base);
+			return (false);
+		}
+		memset (p_region, 0, regions[index].size);
+	}
+	return (true);
+}
+
+#endif // _PERIPH_RAM_H_
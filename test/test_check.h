@@ -0,0 +1,67 @@
+//**************************************************************************************
+/** @file test_check.h
+ *    This file contains the checks used by the host tests in this directory. Each
+ *    test is a small program which runs its checks, prints the ones which fail, and
+ *    returns nonzero from @c main() if any did, so that @c make stops there.
+ */
+//**************************************************************************************
+
+// This define prevents this .h file from being included multiple times in a .cpp file
+#ifndef _TEST_CHECK_H_
+#define _TEST_CHECK_H_
+
+#include <stdio.h>
+#include <math.h>
+
+
+/** @brief   The number of checks which have failed so far in this test program.
+ */
+static int test_failures = 0;
+
+/** @brief   The number of checks which have been made so far in this test program.
+ */
+static int test_checks = 0;
+
+
+/** @brief   Check that a condition is true, printing it and where it is if it's not.
+ *  @param   cond The condition which should be true
+ */
+#define CHECK(cond) \
+	do { \
+		test_checks++; \
+		if (!(cond)) \
+		{ \
+			test_failures++; \
+			printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while (0)
+
+/** @brief   Check that a value is within a tolerance of the expected value.
+ *  @param   value The value which was computed
+ *  @param   expected The value which should have been computed
+ *  @param   tol The largest difference between the two which passes
+ */
+#define CHECK_NEAR(value, expected, tol) \
+	do { \
+		double _v = (value), _e = (expected); \
+		test_checks++; \
+		if (!(fabs (_v - _e) <= (tol))) \
+		{ \
+			test_failures++; \
+			printf ("%s:%d: check failed: %s = %g, expected %g within %g\n", \
+					__FILE__, __LINE__, #value, _v, _e, (double)(tol)); \
+		} \
+	} while (0)
+
+
+/** @brief   Print how many checks were made and failed in this test program.
+ *  @param   name The name of the test program
+ *  @return  The exit status for @c main(), 0 if every check passed and 1 if not
+ */
+static inline int test_summary (const char* name)
+{
+	printf ("%s: %d checks, %d failed\n", name, test_checks, test_failures);
+	return (test_failures ? 1 : 0);
+}
+
+#endif // _TEST_CHECK_H_
@@ -0,0 +1,240 @@
+//**************************************************************************************
+/** @file test_dsp_kernels.cpp
+ *    This file tests the PID, biquad, and FIR classes in dsp_kernels.h. It sets
+ *    @c USE_CMSIS_DSP, so that each class's @c step() runs the CMSIS kernel: the PID
+ *    kernel from the host's arm_math.h in this directory and the biquad and FIR 
+ *    kernels from cmsis_dsp_f32.cpp. Every filter is run twice on the same input, once by the
+ *    CMSIS kernel and once by the portable @c step_reference(), and the outputs must
+ *    agree. The portable versions are also checked against responses worked out by
+ *    hand, and the CMSIS kernels' unrolled loops for blocks of samples against the
+ *    same kernels taking one sample at a time.
+ */
+//**************************************************************************************
+
+#define USE_CMSIS_DSP               1
+
+#include <string.h>
+#include <type_traits>
+
+#include "test_check.h"
+#include "dsp_kernels.h"
+
+
+/** @brief   The largest difference allowed between a CMSIS kernel and the portable
+ *           version; they do the same arithmetic in the same order.
+ */
+const double KERNEL_TOL = 1.0e-6;
+
+/** @brief   A two section low pass filter, b0, b1, b2, a1, a2 per section with the
+ *           feedback coefficients' signs as CMSIS uses them.
+ */
+static const float LOWPASS[10] =
+	{ 0.0675f, 0.1349f, 0.0675f, 1.1430f, -0.4128f,
+	  0.0675f, 0.1349f, 0.0675f, 1.1430f, -0.4128f };
+
+/** @brief   An eight sample moving average.
+ */
+static const float AVERAGE[8] =
+	{ 0.125f, 0.125f, 0.125f, 0.125f, 0.125f, 0.125f, 0.125f, 0.125f };
+
+/** @brief   An FIR filter whose coefficients all differ, so that their order shows.
+ */
+static const float RAMP[7] = { 0.7f, 0.6f, 0.5f, 0.4f, 0.3f, 0.2f, 0.1f };
+
+
+// The filters' CMSIS instances point into them, so they mustn't be copied
+static_assert (!std::is_copy_constructible<dsp_biquad<2> >::value, "biquad copies");
+static_assert (!std::is_copy_assignable<dsp_biquad<2> >::value, "biquad assigns");
+static_assert (!std::is_copy_constructible<dsp_fir<8> >::value, "FIR copies");
+static_assert (!std::is_copy_assignable<dsp_fir<8> >::value, "FIR assigns");
+
+
+/** @brief   Make a test input which sweeps up while alternating in sign.
+ *  @param   count The sample number
+ *  @return  The sample, between -1.0 and 1.0
+ */
+static float test_input (uint16_t count)
+{
+	float size = -0.5f + count / 1000.0f;
+	return ((count & 1) ? size : -0.5f * size);
+}
+
+
+/** @brief   Check the PID kernel against the portable version and by hand.
+ */
+static void test_pid (void)
+{
+	// P, PI, and PID gains, the last large enough to hit the output's limits
+	const float gains[3][3] = { { 0.5f, 0.0f, 0.0f }, { 3.0f, 2.0f, 0.0f },
+								{ 3.0f, 2.0f, 0.05f } };
+	double worst = 0.0;
+	for (uint8_t set = 0; set < 3; set++)
+	{
+		dsp_pid kernel, reference;
+		kernel.set_gains (gains[set][0], gains[set][1], 0.01f, false, gains[set][2]);
+		reference.set_gains (gains[set][0], gains[set][1], 0.01f, false,
+							 gains[set][2]);
+		for (uint16_t count = 0; count < 1000; count++)
+		{
+			float x = 0.3f * test_input (count);
+			worst = fmax (worst, fabs (kernel.step_float (x)
+									   - reference.step_reference (x)));
+		}
+	}
+	printf ("PID: CMSIS kernel differs from reference by at most %g\n", worst);
+	CHECK (worst <= KERNEL_TOL);
+
+	// Proportional only: the output is the gain times the error every step
+	dsp_pid pid;
+	pid.set_gains (0.5f, 0.0f, 0.01f);
+	CHECK_NEAR (pid.step_reference (0.4f), 0.2, 1.0e-6);
+	CHECK_NEAR (pid.step_reference (0.4f), 0.2, 1.0e-6);
+	CHECK_NEAR (pid.step_reference (-0.2f), -0.1, 1.0e-6);
+
+	// Integral only: the output grows by Ki * dt * error each step and stops at 1.0,
+	// and as the output rather than the integral is kept, it comes straight back
+	pid.set_gains (0.0f, 10.0f, 0.01f);
+	float out = 0.0f;
+	for (uint8_t step = 0; step < 10; step++)
+	{
+		out = pid.step_reference (0.5f);
+	}
+	CHECK_NEAR (out, 0.5, 1.0e-5);
+	for (uint8_t step = 0; step < 20; step++)
+	{
+		out = pid.step_reference (0.5f);
+	}
+	CHECK (out == 1.0f);
+	CHECK_NEAR (pid.step_reference (-0.5f), 0.95, 1.0e-5);
+
+	// Changing the gains while keeping the output doesn't move it
+	pid.set_gains (0.0f, 5.0f, 0.01f, true);
+	CHECK_NEAR (pid.step_reference (0.0f), 0.95, 1.0e-5);
+	pid.set_gains (0.0f, 5.0f, 0.01f);
+	CHECK (pid.step_reference (0.0f) == 0.0f);
+}
+
+
+/** @brief   Check the biquad kernel against the portable version and by hand.
+ */
+static void test_biquad (void)
+{
+	dsp_biquad<2> kernel (LOWPASS), reference (LOWPASS);
+	double worst = 0.0;
+	for (uint16_t count = 0; count < 1000; count++)
+	{
+		float x = test_input (count);
+		worst = fmax (worst, fabs (kernel.step (x) - reference.step_reference (x)));
+	}
+	printf ("Biquad: CMSIS kernel differs from reference by at most %g\n", worst);
+	CHECK (worst <= KERNEL_TOL);
+
+	// A steady input comes out multiplied by each section's gain at zero frequency
+	double section = (LOWPASS[0] + LOWPASS[1] + LOWPASS[2])
+					 / (1.0 - LOWPASS[3] - LOWPASS[4]);
+	reference.reset ();
+	float out = 0.0f;
+	for (uint16_t count = 0; count < 500; count++)
+	{
+		out = reference.step_reference (1.0f);
+	}
+	CHECK_NEAR (out, section * section, 1.0e-4);
+
+	// The first output is b0 of each section times the input
+	reference.reset ();
+	CHECK_NEAR (reference.step_reference (1.0f), LOWPASS[0] * LOWPASS[5], 1.0e-7);
+}
+
+
+/** @brief   Check the FIR kernel against the portable version and by hand.
+ */
+static void test_fir (void)
+{
+	dsp_fir<8> kernel (AVERAGE), reference (AVERAGE);
+	dsp_fir<7> ramp_kernel (RAMP), ramp_reference (RAMP);
+	double worst = 0.0;
+	for (uint16_t count = 0; count < 1000; count++)
+	{
+		float x = test_input (count);
+		worst = fmax (worst, fabs (kernel.step (x) - reference.step_reference (x)));
+		worst = fmax (worst, fabs (ramp_kernel.step (x)
+								   - ramp_reference.step_reference (x)));
+	}
+	printf ("FIR: CMSIS kernel differs from reference by at most %g\n", worst);
+	CHECK (worst <= KERNEL_TOL);
+
+	// A step into the moving average comes out as a ramp over eight samples
+	reference.reset ();
+	for (uint8_t count = 1; count <= 10; count++)
+	{
+		CHECK_NEAR (reference.step_reference (1.0f), fmin (count, 8) / 8.0, 1.0e-6);
+	}
+
+	// The coefficients are time reversed, so an impulse comes out last one first
+	ramp_reference.reset ();
+	for (uint8_t count = 0; count < 7; count++)
+	{
+		float out = ramp_reference.step_reference ((count == 0) ? 1.0f : 0.0f);
+		CHECK_NEAR (out, RAMP[6 - count], 1.0e-7);
+	}
+}
+
+
+/** @brief   Check the CMSIS kernels on blocks of samples against one at a time.
+ *  @details The filter classes give the kernels one sample at a time, so only the
+ *           kernels' loops for left over samples are used by the controller. Blocks
+ *           of 13 also run the loops which take four samples at a time.
+ */
+static void test_blocks (void)
+{
+	const uint32_t BLOCK = 13;
+	float input[BLOCK], output[BLOCK];
+
+	float biquad_coeffs[10], biquad_state[8];
+	memcpy (biquad_coeffs, LOWPASS, sizeof (biquad_coeffs));
+	arm_biquad_casd_df1_inst_f32 biquad;
+	arm_biquad_cascade_df1_init_f32 (&biquad, 2, biquad_coeffs, biquad_state);
+	dsp_biquad<2> biquad_one (LOWPASS);
+
+	float fir_coeffs[7], fir_state[7 + BLOCK - 1];
+	memcpy (fir_coeffs, RAMP, sizeof (fir_coeffs));
+	arm_fir_instance_f32 fir;
+	arm_fir_init_f32 (&fir, 7, fir_coeffs, fir_state, BLOCK);
+	dsp_fir<7> fir_one (RAMP);
+
+	double worst_biquad = 0.0, worst_fir = 0.0;
+	for (uint16_t block = 0; block < 40; block++)
+	{
+		for (uint32_t index = 0; index < BLOCK; index++)
+		{
+			input[index] = test_input (block * BLOCK + index);
+		}
+		arm_biquad_cascade_df1_f32 (&biquad, input, output, BLOCK);
+		for (uint32_t index = 0; index < BLOCK; index++)
+		{
+			worst_biquad = fmax (worst_biquad,
+								 fabs (output[index] - biquad_one.step (input[index])));
+		}
+		arm_fir_f32 (&fir, input, output, BLOCK);
+		for (uint32_t index = 0; index < BLOCK; index++)
+		{
+			worst_fir = fmax (worst_fir,
+							  fabs (output[index] - fir_one.step (input[index])));
+		}
+	}
+	printf ("Blocks of %u: biquad differs by %g, FIR by %g\n", BLOCK, worst_biquad,
+			worst_fir);
+	CHECK (worst_biquad <= KERNEL_TOL);
+	CHECK (worst_fir <= KERNEL_TOL);
+}
+
+
+int main (void)
+{
+	test_pid ();
+	test_biquad ();
+	test_fir ();
+	test_blocks ();
+
+	return (test_summary ("test_dsp_kernels"));
+}
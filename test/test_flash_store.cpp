@@ -0,0 +1,335 @@
+//**************************************************************************************
+/** @file test_flash_store.cpp
+ *    This file tests the flash key/value store with its two sectors simulated in RAM.
+ *    The simulated flash behaves as the real flash does where it matters: erasing
+ *    sets every bit, programming can only clear bits, and the store is checked never
+ *    to program a word which isn't erased. Power can be cut after any number of
+ *    erase and word program operations; the operation which is cut off is left half
+ *    done, and nothing after it is written. After each cut the store is started
+ *    again on what's left in the simulated flash, and every key must read back the
+ *    value it had before the interrupted write or the one being written, never any
+ *    other.
+ */
+//**************************************************************************************
+
+#include <string.h>
+
+#include "test_check.h"
+#include "flash_store.h"
+
+
+/** @brief   The number of words in each simulated sector, small enough that the log
+ *           is copied to the other sector every few dozen writes.
+ */
+const uint32_t SIM_WORDS = 64;
+
+/** @brief   The number of keys used by the tests.
+ */
+const uint8_t SIM_KEYS = 8;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   A flash store whose two sectors are arrays in RAM, with power cuts.
+ */
+class sim_flash_store : public flash_store
+{
+protected:
+	/// The number of operations after which the power is cut, or -1 for never.
+	int32_t budget;
+
+	/// A pseudo-random number for the bits a half-done operation leaves.
+	uint32_t noise;
+
+	/** @brief   Count one operation and see whether the power is still on.
+	 *  @return  True if the operation can be done, false if the power is cut
+	 */
+	bool use_op (void)
+	{
+		if (budget == 0)
+		{
+			return (false);
+		}
+		if (budget > 0)
+		{
+			budget--;
+		}
+		ops++;
+		return (true);
+	}
+
+	/** @brief   Get a new pseudo-random number.
+	 *  @return  The number
+	 */
+	uint32_t random (void)
+	{
+		noise = noise * 1664525UL + 1013904223UL;
+		return (noise);
+	}
+
+	/** @brief   Erase a simulated sector, or leave it partly erased if power is cut.
+	 *  @param   which The sector, 0 or 1
+	 *  @return  True if the sector was erased
+	 */
+	bool erase (uint8_t which)
+	{
+		bool cut = (budget == 0 && !dead);
+		if (!use_op ())
+		{
+			// An erase sets all the bits together, so a cut one leaves some set
+			for (uint32_t word = 0; cut && word < SIM_WORDS; word++)
+			{
+				sectors[which][word] |= random ();
+			}
+			dead = true;
+			return (false);
+		}
+		memset (sectors[which], 0xFF, sizeof (sectors[which]));
+		return (true);
+	}
+
+	/** @brief   Program simulated words, or leave the last one half done on a cut.
+	 *  @param   p_dest The first word to be programmed
+	 *  @param   p_words The words to be written
+	 *  @param   count The number of words
+	 *  @return  True if all the words were programmed
+	 */
+	bool program (uint32_t* p_dest, const uint32_t* p_words, uint32_t count)
+	{
+		for (uint32_t word = 0; word < count; word++)
+		{
+			bool cut = (budget == 0 && !dead);
+			if (p_dest[word] != 0xFFFFFFFF)
+			{
+				overwrites++;
+			}
+			if (!use_op ())
+			{
+				// Programming clears bits one by one, so a cut one clears only some
+				if (cut)
+				{
+					p_dest[word] &= p_words[word] | random ();
+				}
+				dead = true;
+				return (false);
+			}
+			p_dest[word] &= p_words[word];
+		}
+		return (true);
+	}
+
+public:
+	/// The two simulated sectors.
+	static uint32_t sectors[2][SIM_WORDS];
+
+	/// The number of operations done since the store was made.
+	uint32_t ops;
+
+	/// The number of words programmed which weren't erased first.
+	uint32_t overwrites;
+
+	/// True once the power has been cut.
+	bool dead;
+
+	/** @brief   Make a store on the simulated sectors as they are now.
+	 *  @param   budget_in The number of operations before the power is cut, or -1
+	 *  @param   seed A seed for the bits left by a half-done operation
+	 */
+	sim_flash_store (int32_t budget_in = -1, uint32_t seed = 1)
+		: flash_store (sectors[0], 0, sectors[1], 1, sizeof (sectors[0]))
+	{
+		budget = budget_in;
+		noise = seed;
+		ops = 0;
+		overwrites = 0;
+		dead = false;
+	}
+
+	/** @brief   Make both simulated sectors look like blank flash.
+	 */
+	static void blank (void)
+	{
+		memset (sectors, 0xFF, sizeof (sectors));
+	}
+};
+
+uint32_t sim_flash_store::sectors[2][SIM_WORDS];
+
+
+/** @brief   Read one key's value from a store.
+ *  @param   store The store
+ *  @param   key The key
+ *  @return  The value, or 0xDEADBEEF if the key couldn't be read
+ */
+static uint32_t read_key (flash_store& store, uint16_t key)
+{
+	uint32_t value;
+	return (store.get (key, &value, sizeof (value)) ? value : 0xDEADBEEF);
+}
+
+
+/** @brief   Check writing, reading, replacing, and copying records without cuts.
+ */
+static void test_basic (void)
+{
+	sim_flash_store::blank ();
+	sim_flash_store store;
+	uint32_t value = 0;
+
+	CHECK (store.put (1, &value, sizeof (value)) == false);
+	CHECK (store.begin ());
+	CHECK (store.get (1, &value, sizeof (value)) == false);
+	CHECK (store.put (FLASH_STORE_NO_KEY, &value, sizeof (value)) == false);
+
+	for (uint16_t key = 0; key < SIM_KEYS; key++)
+	{
+		value = 100 + key;
+		CHECK (store.put (key, &value, sizeof (value)));
+	}
+	CHECK (read_key (store, 3) == 103);
+
+	// A read must be the length that was written
+	uint16_t half;
+	CHECK (store.get (3, &half, sizeof (half)) == false);
+
+	// Writing a value which is already stored doesn't use the flash
+	uint32_t ops = store.ops;
+	value = 103;
+	CHECK (store.put (3, &value, sizeof (value)));
+	CHECK (store.ops == ops);
+
+	// Enough writes to fill the sector several times over copy the log each time
+	uint32_t newest[SIM_KEYS];
+	for (uint32_t count = 0; count < 100; count++)
+	{
+		newest[count % SIM_KEYS] = 1000 + count;
+		CHECK (store.put (count % SIM_KEYS, &newest[count % SIM_KEYS], 
+						  sizeof (uint32_t)));
+	}
+	CHECK (store.get_compactions () >= 5);
+	CHECK (store.overwrites == 0);
+
+	// A new store on the same flash finds the newest values
+	sim_flash_store again;
+	CHECK (again.begin ());
+	for (uint16_t key = 0; key < SIM_KEYS; key++)
+	{
+		CHECK (read_key (again, key) == newest[key]);
+	}
+	CHECK (again.ops == 0);
+}
+
+
+/** @brief   Write a sequence of values, cutting the power after each operation in
+ *           turn, and check what a restarted store finds.
+ */
+static void test_power_loss (void)
+{
+	// Start from a log holding every key which is almost full
+	sim_flash_store::blank ();
+	{
+		sim_flash_store store;
+		CHECK (store.begin ());
+		for (uint32_t count = 0; count < 2 * SIM_KEYS + 3; count++)
+		{
+			uint32_t value = count;
+			store.put (count % SIM_KEYS, &value, sizeof (value));
+		}
+	}
+	uint32_t start[2][SIM_WORDS];
+	memcpy (start, sim_flash_store::sectors, sizeof (start));
+
+	// Find out how many operations the writes take without a cut; there are enough
+	// to copy the log to the other sector and back
+	const uint32_t WRITES = 40;
+	uint32_t total_ops;
+	{
+		sim_flash_store store;
+		CHECK (store.begin ());
+		for (uint32_t count = 0; count < WRITES; count++)
+		{
+			uint32_t value = 5000 + count;
+			CHECK (store.put (count % SIM_KEYS, &value, sizeof (value)));
+		}
+		total_ops = store.ops;
+		CHECK (store.get_compactions () >= 2);
+	}
+
+	uint32_t bad_restarts = 0;
+	uint32_t bad_values = 0;
+	uint32_t bad_reports = 0;
+	for (uint32_t cut = 0; cut <= total_ops; cut++)
+	{
+		memcpy (sim_flash_store::sectors, start, sizeof (start));
+
+		// The values each key should have: before the write which was cut off and
+		// after it, which are the same for every key but the one being written
+		uint32_t before[SIM_KEYS];
+		uint32_t after[SIM_KEYS];
+		{
+			sim_flash_store store (cut, cut + 1);
+			bool failed = false;
+			store.begin ();
+			for (uint16_t key = 0; key < SIM_KEYS; key++)
+			{
+				before[key] = after[key] = read_key (store, key);
+			}
+			for (uint32_t count = 0; count < WRITES && !store.dead; count++)
+			{
+				uint16_t key = count % SIM_KEYS;
+				after[key] = 5000 + count;
+				if (store.put (key, &after[key], sizeof (after[key])))
+				{
+					before[key] = after[key];
+				}
+				else
+				{
+					failed = true;
+				}
+			}
+
+			// A failed write is reported once, afterwards
+			if (store.report_errors () != failed || store.report_errors ())
+			{
+				bad_reports++;
+			}
+		}
+
+		// Restart with the power on to stay
+		sim_flash_store store;
+		if (!store.begin ())
+		{
+			bad_restarts++;
+			continue;
+		}
+		for (uint16_t key = 0; key < SIM_KEYS; key++)
+		{
+			uint32_t value = read_key (store, key);
+			if (value != before[key] && value != after[key])
+			{
+				bad_values++;
+				printf ("Cut after %u operations: key %u is %u, not %u or %u\n",
+						cut, key, value, before[key], after[key]);
+			}
+		}
+
+		// The restarted store must still take new values
+		uint32_t value = 9999;
+		CHECK (store.put (0, &value, sizeof (value)));
+		CHECK (read_key (store, 0) == 9999);
+		CHECK (store.overwrites == 0);
+	}
+	printf ("Power cut at each of %u operations: %u failed restarts, %u bad values, "
+			"%u bad reports\n", total_ops + 1, bad_restarts, bad_values, bad_reports);
+	CHECK (bad_restarts == 0);
+	CHECK (bad_values == 0);
+	CHECK (bad_reports == 0);
+}
+
+
+int main (void)
+{
+	test_basic ();
+	test_power_loss ();
+
+	return (test_summary ("test_flash_store"));
+}
@@ -0,0 +1,105 @@
+//**************************************************************************************
+/** @file test_handle_ff.cpp
+ *    This file tests the handle motion estimator. A jolt of the handle should come
+ *    through as motion and then die away, a rotation of the platform which the motor
+ *    speed accounts for shouldn't come through at all, and a bias in the motor speed
+ *    mustn't build up in the estimate however long it lasts.
+ */
+//**************************************************************************************
+
+#include "test_check.h"
+#include "handle_feedforward.h"
+
+
+/** @brief   The controller's period in seconds.
+ */
+const float FF_DT = 0.01f;
+
+/** @brief   Encoder counts per radian of the platform's rotation.
+ */
+const float FF_CPR = 1000.0f;
+
+
+/** @brief   Check the estimate for a jolt of the handle and a matched rotation.
+ */
+static void test_motion (void)
+{
+	handle_feedforward ff (0.3f, 10.0f, 0.35f, FF_DT, FF_CPR);
+
+	// Steady tilt is left to the feedback loop
+	for (int step = 0; step < 100; step++)
+	{
+		ff.update (50.0f, 0.0f);
+	}
+	CHECK_NEAR (ff.get_estimate (), 0.0, 1.0);
+
+	// A sudden push on the handle comes straight through, then fades
+	CHECK_NEAR (ff.update (250.0f, 0.0f), 200.0 * 0.3 / (0.3 + FF_DT), 1.0);
+	for (int step = 0; step < 300; step++)
+	{
+		ff.update (250.0f, 0.0f);
+	}
+	CHECK_NEAR (ff.get_estimate (), 0.0, 1.0);
+
+	// The platform turning at 0.1 rad/s tilts the pivot's reading by 1000 mG per
+	// radian, which the motor's speed accounts for
+	handle_feedforward turn (0.3f, 10.0f, 0.35f, FF_DT, FF_CPR);
+	double worst = 0.0;
+	float angle = 0.0f;
+	for (int step = 0; step < 100; step++)
+	{
+		angle += 0.1f * FF_DT;
+		worst = fmax (worst, fabs (turn.update (1000.0f * angle, 0.1f * FF_CPR)));
+	}
+	printf ("Rotation of 0.1 rad/s for 1 s: worst estimate %.2f mG\n", worst);
+	CHECK (worst < 5.0);
+
+	// Without the rotation's counts, the same turn would look like the handle moving
+	handle_feedforward blind (0.3f, 10.0f, 0.35f, FF_DT, 0.0f);
+	angle = 0.0f;
+	for (int step = 0; step < 100; step++)
+	{
+		angle += 0.1f * FF_DT;
+		blind.update (1000.0f * angle, 0.1f * FF_CPR);
+	}
+	CHECK (blind.get_estimate () > 20.0f);
+}
+
+
+/** @brief   Check that a speed bias leaves the estimate near zero and bounded.
+ */
+static void test_bias (void)
+{
+	handle_feedforward ff (0.3f, 10.0f, 0.35f, FF_DT, FF_CPR);
+
+	// A bias of 20 counts/s, 0.02 rad/s, for ten minutes
+	double worst = 0.0;
+	for (int step = 0; step < 60000; step++)
+	{
+		float estimate = ff.update (0.0f, 20.0f);
+		if (step > 6000)
+		{
+			worst = fmax (worst, fabs (estimate));
+		}
+	}
+	printf ("Speed bias of 20 counts/s for 600 s: worst estimate %.3f mG\n", worst);
+	CHECK (worst < 1.0);
+
+	// A huge bias is limited to the platform's travel, and reset forgets it
+	for (int step = 0; step < 1000; step++)
+	{
+		ff.update (0.0f, 1.0e6f);
+	}
+	CHECK (fabsf (ff.update (0.0f, 0.0f)) < 1000.0f * 0.35f);
+	ff.reset ();
+	CHECK (ff.update (0.0f, 0.0f) == 0.0f);
+}
+
+
+int main (void)
+{
+	test_motion ();
+	test_bias ();
+
+	return (test_summary ("test_handle_ff"));
+}
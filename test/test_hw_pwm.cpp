@@ -0,0 +1,154 @@
+//**************************************************************************************
+/** @file test_hw_pwm.cpp
+ *    This file tests the PWM driver's compare register access and the motor driver
+ *    which writes through it. The timer registers are plain RAM mapped where the
+ *    STM32's timers would be, so the test reads back exactly what the code under test
+ *    wrote to each register.
+ */
+//**************************************************************************************
+
+#include <string.h>
+
+#include "test_check.h"
+#include "periph_ram.h"
+#include "hw_pwm.h"
+#include "motorDriver.h"
+
+
+/** @brief   The CPU clock frequency, which is set by @c SystemInit() on the target.
+ */
+uint32_t SystemCoreClock = 100000000UL;
+
+
+/** @brief   Check the compare register addresses which @c hw_pwm hands out.
+ */
+static void test_ccr_address (void)
+{
+	hw_pwm pwm (3, 20000, 1000);
+
+	CHECK (TIM3->ARR == 999);
+	CHECK (pwm.get_max_count () == 1000);
+
+	CHECK (pwm.get_ccr_address (1) == &(TIM3->CCR1));
+	CHECK (pwm.get_ccr_address (2) == &(TIM3->CCR2));
+	CHECK (pwm.get_ccr_address (3) == &(TIM3->CCR3));
+	CHECK (pwm.get_ccr_address (4) == &(TIM3->CCR4));
+
+	// Channels outside 1 to 4 would point at CNT's neighbours or past CCR4 to BDTR
+	CHECK (pwm.get_ccr_address (0) == NULL);
+	CHECK (pwm.get_ccr_address (5) == NULL);
+	CHECK (pwm.get_ccr_address (255) == NULL);
+
+	// A count of the resolution is 100% duty; anything more is limited to that
+	pwm.set_duty_cycle (2, 2000);
+	CHECK (TIM3->CCR2 == 1000);
+}
+
+
+/** @brief   Check the counts a two-channel motor writes for efforts and signals.
+ */
+static void test_motor (void)
+{
+	hw_pwm pwm (3, 20000, 1000);
+	Motor motor (&pwm, &pwm, 1, 2, GPIO_Pin_1, GPIOC, RCC_AHB1Periph_GPIOC);
+
+	motor.set_effort (0.5f);
+	CHECK (TIM3->CCR1 == 500);
+	CHECK (TIM3->CCR2 == 0);
+
+	motor.set_effort (-1.5f);
+	CHECK (TIM3->CCR1 == 0);
+	CHECK (TIM3->CCR2 == 1000);
+
+	motor.setActuation (MOTOR_MAX_PWM);
+	CHECK (TIM3->CCR1 == 1000);
+	CHECK (TIM3->CCR2 == 0);
+
+	motor.setActuation (-MOTOR_MAX_PWM / 4);
+	CHECK (TIM3->CCR1 == 0);
+	CHECK (TIM3->CCR2 == 250);
+}
+
+
+/** @brief   Check that a motor's driver is turned on and off with its EN pin.
+ */
+static void test_motor_enable (void)
+{
+	hw_pwm pwm (3, 20000, 1000);
+	GPIOC->BSRRL = 0;
+	GPIOC->BSRRH = 0;
+	Motor motor (&pwm, &pwm, 1, 2, GPIO_Pin_1, GPIOC, RCC_AHB1Periph_GPIOC);
+
+	// The constructor turns the driver on
+	CHECK (GPIOC->BSRRL == GPIO_Pin_1);
+
+	GPIOC->BSRRL = 0;
+	motor.set_enabled (false);
+	CHECK (GPIOC->BSRRH == GPIO_Pin_1);
+	CHECK (GPIOC->BSRRL == 0);
+
+	GPIOC->BSRRH = 0;
+	motor.set_enabled (true);
+	CHECK (GPIOC->BSRRL == GPIO_Pin_1);
+	CHECK (GPIOC->BSRRH == 0);
+}
+
+
+/** @brief   Check that a motor given an invalid channel writes no timer register.
+ */
+static void test_motor_bad_channel (void)
+{
+	hw_pwm pwm (3, 20000, 1000);
+	Motor motor (&pwm, &pwm, 1, 0, GPIO_Pin_1, GPIOC, RCC_AHB1Periph_GPIOC);
+
+	TIM3->CCR1 = 123;
+	TIM_TypeDef before_3;
+	TIM_TypeDef before_4;
+	memcpy (&before_3, (const void*)TIM3, sizeof (TIM_TypeDef));
+	memcpy (&before_4, (const void*)TIM4, sizeof (TIM_TypeDef));
+
+	// Driving the lead on channel 0 must only zero channel 1's register
+	motor.set_effort (-1.0f);
+	before_3.CCR1 = 0;
+	CHECK (memcmp (&before_3, (const void*)TIM3, sizeof (TIM_TypeDef)) == 0);
+	CHECK (memcmp (&before_4, (const void*)TIM4, sizeof (TIM_TypeDef)) == 0);
+
+	motor.set_effort (1.0f);
+	CHECK (TIM3->CCR1 == 1000);
+}
+
+
+/** @brief   Check a motor driven by one complementary channel in anti-phase.
+ */
+static void test_motor_anti_phase (void)
+{
+	hw_pwm pwm (1, 20000, 1000);
+	Motor motor (&pwm, 1, GPIO_Pin_1, GPIOC, RCC_AHB1Periph_GPIOC);
+
+	// The constructor leaves the motor stopped at 50% duty
+	CHECK (TIM1->CCR1 == 500);
+
+	motor.set_effort (1.0f);
+	CHECK (TIM1->CCR1 == 1000);
+	motor.set_effort (-1.0f);
+	CHECK (TIM1->CCR1 == 0);
+	motor.set_effort (0.5f);
+	CHECK (TIM1->CCR1 == 750);
+}
+
+
+int main (void)
+{
+	if (!periph_ram_map ())
+	{
+		return (1);
+	}
+
+	test_ccr_address ();
+	test_motor ();
+	test_motor_enable ();
+	test_motor_bad_channel ();
+	test_motor_anti_phase ();
+
+	return (test_summary ("test_hw_pwm"));
+}
@@ -0,0 +1,173 @@
+//**************************************************************************************
+/** @file test_pi_core.cpp
+ *    This file tests the fixed point arithmetic in fixed_point.h and checks that the
+ *    PI controller core gives the same outputs compiled for Q15 and Q31 as for float,
+ *    to within the fixed point resolution, so the balance controller may use any of
+ *    them.
+ */
+//**************************************************************************************
+
+#include "test_check.h"
+#include "pi_core.h"
+
+
+/** @brief   The CPU clock frequency, which is set by @c SystemInit() on the target.
+ */
+uint32_t SystemCoreClock = 100000000UL;
+
+
+/** @brief   One least significant bit of a Q15 number.
+ */
+const double Q15_LSB = 1.0 / 32768.0;
+
+/** @brief   One least significant bit of a Q31 number.
+ */
+const double Q31_LSB = 1.0 / 2147483648.0;
+
+
+/** @brief   The resolution of a float near 1.0, which limits Q31 results once they
+ *           have been converted back to float.
+ */
+const double FLOAT_LSB = 1.0 / 16777216.0;
+
+
+/** @brief   Check conversions, sums and products for one fixed point type.
+ *  @param   lsb The value of the type's least significant bit
+ *  @param   top The largest value the type can hold, just under 1.0 for Q15 and Q31
+ *           and 1.0 for float
+ */
+template <class T> static void test_arithmetic (double lsb, double top)
+{
+	typedef fixed_traits<T> num;
+
+	// Results are checked as floats, so they can't be closer than a float allows
+	double res = fmax (lsb, FLOAT_LSB);
+
+	// Conversions round to nearest and saturate at the top and at -1.0
+	CHECK_NEAR (num::to_float (num::from_float (1.0f)), top, res);
+	CHECK_NEAR (num::to_float (num::from_float (-1.0f)), -1.0, res);
+	CHECK_NEAR (num::to_float (num::from_float (7.0f)), top, res);
+	CHECK_NEAR (num::to_float (num::from_float (-7.0f)), -1.0, res);
+	for (float value = -0.99f; value < 0.99f; value += 0.0173f)
+	{
+		CHECK_NEAR (num::to_float (num::from_float (value)), value, res);
+	}
+
+	// Sums saturate rather than wrapping around
+	CHECK_NEAR (num::to_float (num::add (num::from_float (0.75f),
+										  num::from_float (0.75f))), top, res);
+	CHECK_NEAR (num::to_float (num::add (num::from_float (-0.75f),
+										  num::from_float (-0.75f))), -1.0, res);
+	CHECK_NEAR (num::to_float (num::add (num::from_float (0.25f),
+										  num::from_float (-0.5f))), -0.25, res);
+
+	// Products with gains from well under to well over one, saturating at the ends
+	const float gains[] = {0.0f, 0.0003f, 0.02f, 0.3f, 1.0f, -1.7f, 3.072f, 40.0f};
+	for (uint8_t index = 0; index < sizeof (gains) / sizeof (gains[0]); index++)
+	{
+		scaled_gain<T> gain = num::make_gain (gains[index]);
+		for (float value = -0.95f; value < 0.95f; value += 0.0371f)
+		{
+			double expected = (double)value * gains[index];
+			if (expected > top)
+			{
+				expected = top;
+			}
+			else if (expected < -1.0)
+			{
+				expected = -1.0;
+			}
+
+			// Rounding the value is magnified by the gain, rounding the gain's 
+			// mantissa by its shift, and the product is rounded once more
+			double tol = 2 * res + 0.5 * lsb * fabs (gains[index])
+						 + 0.5 * lsb * fabs (value) * ldexp (1.0, gain.shift);
+			CHECK_NEAR (num::to_float (num::mul (num::from_float (value), gain)),
+						expected, tol);
+		}
+	}
+}
+
+
+/** @brief   Run float, Q15 and Q31 PI cores side by side and compare their outputs.
+ *  @param   kp The proportional gain
+ *  @param   ki The integral gain
+ *  @param   dt The step time in seconds
+ *  @param   amplitude The amplitude of the error signal
+ *  @param   q15_tol The largest difference allowed between Q15 and float outputs
+ *  @param   q31_tol The largest difference allowed between Q31 and float outputs
+ */
+static void test_equivalence (float kp, float ki, float dt, float amplitude,
+							  double q15_tol, double q31_tol)
+{
+	pi_core<float> core_f;
+	pi_core<int16_t> core_15;
+	pi_core<int32_t> core_31;
+	core_f.set_gains (kp, ki, dt);
+	core_15.set_gains (kp, ki, dt);
+	core_31.set_gains (kp, ki, dt);
+
+	double worst_15 = 0.0;
+	double worst_31 = 0.0;
+	uint32_t noise = 12345;
+	for (int step = 0; step < 4000; step++)
+	{
+		// A slow sine with an offset, a step halfway through, and a little noise
+		noise = noise * 1103515245UL + 12345UL;
+		float error = amplitude * sinf (step * 0.01f) - 0.02f
+					  + ((step >= 2000) ? 0.1f : 0.0f)
+					  + 0.001f * (float)((int32_t)(noise >> 16) % 1000) / 1000.0f;
+
+		float out_f = core_f.step_float (error);
+		worst_15 = fmax (worst_15, fabs (core_15.step_float (error) - out_f));
+		worst_31 = fmax (worst_31, fabs (core_31.step_float (error) - out_f));
+	}
+	printf ("Kp %g, Ki %g, amplitude %g: worst difference Q15 %.2e, Q31 %.2e\n",
+			kp, ki, amplitude, worst_15, worst_31);
+	CHECK (worst_15 <= q15_tol);
+	CHECK (worst_31 <= q31_tol);
+}
+
+
+/** @brief   Check that changing the gains can keep or reset the integral.
+ */
+template <class T> static void test_keep_integral (double lsb)
+{
+	pi_core<T> core;
+	core.set_gains (0.0f, 10.0f, 0.01f);
+	for (int step = 0; step < 20; step++)
+	{
+		core.step_float (0.2f);
+	}
+
+	// With no error, only the integral of 20 * 0.2 * 10 * 0.01 = 0.4 comes out
+	CHECK_NEAR (core.step_float (0.0f), 0.4, 20 * lsb);
+	core.set_gains (1.0f, 10.0f, 0.01f, true);
+	CHECK_NEAR (core.step_float (0.0f), 0.4, 20 * lsb);
+	core.set_gains (1.0f, 10.0f, 0.01f);
+	CHECK_NEAR (core.step_float (0.0f), 0.0, lsb);
+}
+
+
+int main (void)
+{
+	test_arithmetic<int16_t> (Q15_LSB, 1.0 - Q15_LSB);
+	test_arithmetic<int32_t> (Q31_LSB, 1.0 - Q31_LSB);
+	test_arithmetic<float> (FLOAT_LSB, 1.0);
+
+	test_keep_integral<float> (FLOAT_LSB);
+	test_keep_integral<int16_t> (Q15_LSB);
+	test_keep_integral<int32_t> (FLOAT_LSB);
+
+	// The balance controller's default gains, scaled as Balance::apply_gains() does
+	test_equivalence (0.15f * 20.48f, 0.1f * 20.48f, 0.01f, 0.3f, 2.0e-3, 1.0e-5);
+
+	// The same gains at the high rate build's 1 ms period, where each step adds only
+	// a few Q15 lsb's to the integral
+	test_equivalence (0.15f * 20.48f, 0.1f * 20.48f, 0.001f, 0.3f, 2.0e-3, 1.0e-5);
+
+	// Large gains which drive the output into saturation much of the time
+	test_equivalence (20.0f, 40.0f, 0.01f, 0.8f, 2.0e-3, 1.0e-5);
+
+	return (test_summary ("test_pi_core"));
+}
@@ -0,0 +1,134 @@
+//**************************************************************************************
+/** @file test_relay_tuner.cpp
+ *    This file runs the relay auto-tuner against the plant 1/(s+1)^3, whose ultimate
+ *    gain and period are known exactly: the phase reaches -180 degrees at a frequency
+ *    of sqrt(3) rad/s, where the gain is 1/8, so Ku is 8 and Tu is 2*pi/sqrt(3), about
+ *    3.63 s. The relay method's describing function estimate should come close, and
+ *    the PI gains found from it should give a stable closed loop.
+ */
+//**************************************************************************************
+
+#include "test_check.h"
+#include "relay_tuner.h"
+
+
+/** @brief   The exact ultimate gain of 1/(s+1)^3.
+ */
+const double EXACT_KU = 8.0;
+
+/** @brief   The exact ultimate period of 1/(s+1)^3 in seconds.
+ */
+const double EXACT_TU = 2.0 * M_PI / sqrt (3.0);
+
+/** @brief   The time step of the simulation and tuner in seconds.
+ */
+const float SIM_DT = 0.001f;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   The plant 1/(s+1)^3, as three first order lags in a row.
+ */
+class third_order_lag
+{
+protected:
+	/// The outputs of the three lags
+	float x1, x2, x3;
+
+public:
+	/// Make the plant at rest
+	third_order_lag (void)
+	{
+		x1 = x2 = x3 = 0.0f;
+	}
+
+	/** @brief   Advance the plant by one time step.
+	 *  @param   input The input held through the step
+	 *  @return  The plant's output at the end of the step
+	 */
+	float step (float input)
+	{
+		x1 += SIM_DT * (input - x1);
+		x2 += SIM_DT * (x1 - x2);
+		x3 += SIM_DT * (x2 - x3);
+		return (x3);
+	}
+};
+
+
+/** @brief   Check the tuner's estimates of Ku and Tu and the PI gains it gives.
+ */
+static void test_third_order (void)
+{
+	relay_tuner tuner (0.3f, 0.001f, 4, 100.0f, SIM_DT);
+	third_order_lag plant;
+	float output = 0.0f;
+
+	tuner.start ();
+	while (tuner.get_state () == RELAY_RUNNING)
+	{
+		output = plant.step (tuner.step (0.0f - output));
+	}
+	CHECK (tuner.get_state () == RELAY_DONE);
+
+	printf ("Ku %.3f (exact %.3f), Tu %.3f s (exact %.3f s)\n",
+			tuner.get_ultimate_gain (), EXACT_KU, tuner.get_ultimate_period (), EXACT_TU);
+
+	// The describing function is an approximation, good to a few percent here
+	CHECK_NEAR (tuner.get_ultimate_gain (), EXACT_KU, 0.05 * EXACT_KU);
+	CHECK_NEAR (tuner.get_ultimate_period (), EXACT_TU, 0.03 * EXACT_TU);
+
+	// Ziegler-Nichols PI gains
+	float kp, ki;
+	CHECK (tuner.get_pi_gains (kp, ki));
+	CHECK_NEAR (kp, 0.45 * tuner.get_ultimate_gain (), 1.0e-5);
+	CHECK_NEAR (ki, kp * 1.2 / tuner.get_ultimate_period (), 1.0e-5);
+
+	// With those gains, a unit step in the setpoint should settle
+	third_order_lag loop_plant;
+	float integral = 0.0f;
+	float y = 0.0f;
+	float worst_late = 0.0f;
+	for (int step = 0; step < (int)(60.0f / SIM_DT); step++)
+	{
+		float error = 1.0f - y;
+		integral += ki * error * SIM_DT;
+		y = loop_plant.step (kp * error + integral);
+		if (step >= (int)(50.0f / SIM_DT))
+		{
+			worst_late = fmaxf (worst_late, fabsf (1.0f - y));
+		}
+	}
+	printf ("Closed loop error after 50 s: %.5f\n", worst_late);
+	CHECK (worst_late < 0.01f);
+}
+
+
+/** @brief   Check that a plant which never oscillates makes the tuner fail.
+ */
+static void test_timeout (void)
+{
+	relay_tuner tuner (0.3f, 0.001f, 4, 2.0f, SIM_DT);
+	float kp = -1.0f, ki = -1.0f;
+
+	// The error stays positive, as if the motors were disconnected
+	tuner.start ();
+	uint32_t steps = 0;
+	while (tuner.get_state () == RELAY_RUNNING && steps < 10000)
+	{
+		tuner.step (0.1f);
+		steps++;
+	}
+	CHECK (tuner.get_state () == RELAY_FAILED);
+	CHECK (steps <= (uint32_t)(2.0f / SIM_DT) + 1);
+	CHECK (!tuner.get_pi_gains (kp, ki));
+	CHECK (kp == -1.0f && ki == -1.0f);
+}
+
+
+int main (void)
+{
+	test_third_order ();
+	test_timeout ();
+
+	return (test_summary ("test_relay_tuner"));
+}
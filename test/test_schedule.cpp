@@ -0,0 +1,278 @@
+//**************************************************************************************
+/** @file test_schedule.cpp
+ *    This file checks the schedule in task_table.h by running it on a virtual clock.
+ *    Each task is given its worst-case run time every period and the scheduler is
+ *    simulated microsecond by microsecond, as FreeRTOS runs it: the highest priority
+ *    task which is ready runs, releases happen on RTOS ticks, and each tick interrupt
+ *    and each switch between tasks costs some time. Over a whole hyperperiod, every
+ *    task must finish each run before its next one is due. The same is done for the
+ *    cyclic executive, whose frames' run times are worked out from its jobs as they're
+ *    added in @c main(); the worst frame must also fit the executive's entry in the
+ *    table. This file checks the table which is selected by USE_HIGH_RATE_CONTROL;
+ *    test_schedule_1khz.cpp includes it to check the 1 kHz table too.
+ */
+//**************************************************************************************
+
+#include <string.h>
+
+#include "test_check.h"
+#include "task_table.h"
+
+
+/** @brief   The time between RTOS ticks in microseconds.
+ */
+const uint32_t TICK_US = 1000000UL / configTICK_RATE_HZ;
+
+/** @brief   The time taken by each RTOS tick interrupt, in microseconds.
+ */
+const uint32_t TICK_ISR_US = 2;
+
+/** @brief   The time taken to switch from one task to another, in microseconds.
+ */
+const uint32_t SWITCH_US = 3;
+
+/** @brief   The largest number of tasks which can be simulated.
+ */
+const uint8_t SIM_MAX_TASKS = 8;
+
+
+/** @brief   One task in the simulation.
+ */
+struct sim_task
+{
+	const char* name;                       ///< The task's name
+	uint32_t priority;                      ///< Its priority, higher running first
+	uint32_t period_us;                     ///< Its period
+	uint32_t wcet_us;                       ///< Its run time, unless it's the executive
+	bool executive;                         ///< True for the cyclic executive
+	uint32_t frame;                         ///< The executive's frame number
+	uint32_t remaining;                     ///< Run time left in its present run
+	uint32_t released;                      ///< When its present run was released
+	uint32_t worst_response;                ///< Longest time from release to finish
+	uint32_t misses;                        ///< Runs not finished when the next was due
+	uint64_t busy;                          ///< Total time it has run
+};
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Find the run time of one frame of the cyclic executive.
+ *  @details The jobs are the ones added in @c main(): both accelerometers and the
+ *  identification step at the IMU's period, the controller at its period and offset,
+ *  and the motors at theirs.
+ *  @param   frame The frame number
+ *  @return  The frame's run time in microseconds
+ */
+static uint32_t frame_wcet (uint32_t frame)
+{
+	uint32_t imu_frames = app_tasks[TASK_IMU].period_ms / exec_task.period_ms;
+	uint32_t control_frames = app_tasks[TASK_CONTROLLER].period_ms
+							  / exec_task.period_ms;
+	uint32_t motor_frames = app_tasks[TASK_MOTORS].period_ms / exec_task.period_ms;
+	uint32_t us = 0;
+
+	if (frame % imu_frames == 0)
+	{
+		us += 2 * IMU_READ_WCET_US + IDENT_WCET_US;
+	}
+	if (frame % control_frames == EXEC_CONTROL_OFFSET)
+	{
+		us += app_tasks[TASK_CONTROLLER].wcet_us;
+	}
+	if (frame % motor_frames == 0)
+	{
+		us += app_tasks[TASK_MOTORS].wcet_us;
+	}
+	return (us);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run a set of tasks on the virtual clock for a given time.
+ *  @param   tasks The tasks, whose results are filled in
+ *  @param   count The number of tasks
+ *  @param   length_us The time to run, which should be a whole hyperperiod
+ *  @return  The fraction of the time the CPU was busy, overheads included
+ */
+static double simulate (sim_task* tasks, uint8_t count, uint32_t length_us)
+{
+	uint32_t overhead = 0;
+	uint64_t busy = 0;
+	int running = -1;
+
+	for (uint8_t index = 0; index < count; index++)
+	{
+		tasks[index].remaining = 0;
+		tasks[index].worst_response = 0;
+		tasks[index].misses = 0;
+		tasks[index].busy = 0;
+		tasks[index].frame = 0;
+	}
+
+	for (uint32_t now = 0; now < length_us; now++)
+	{
+		// Tasks are woken by the tick interrupt
+		if (now % TICK_US == 0)
+		{
+			overhead += TICK_ISR_US;
+			for (uint8_t index = 0; index < count; index++)
+			{
+				sim_task& task = tasks[index];
+				if (now % task.period_us == 0)
+				{
+					if (task.remaining > 0)
+					{
+						task.misses++;
+					}
+					task.remaining = task.executive ? frame_wcet (task.frame++)
+													: task.wcet_us;
+					task.released = now;
+				}
+			}
+		}
+
+		int ready = -1;
+		for (uint8_t index = 0; index < count; index++)
+		{
+			if (tasks[index].remaining > 0
+				&& (ready < 0 || tasks[index].priority > tasks[ready].priority))
+			{
+				ready = index;
+			}
+		}
+		if (ready >= 0 && ready != running)
+		{
+			overhead += SWITCH_US;
+			running = ready;
+		}
+
+		if (overhead > 0)
+		{
+			overhead--;
+			busy++;
+		}
+		else if (ready >= 0)
+		{
+			sim_task& task = tasks[ready];
+			task.busy++;
+			busy++;
+			if (--task.remaining == 0)
+			{
+				uint32_t response = now + 1 - task.released;
+				if (response > task.worst_response)
+				{
+					task.worst_response = response;
+				}
+			}
+		}
+	}
+	return ((double)busy / length_us);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Print each task's share of the CPU and worst response, and check them.
+ *  @param   title The name of the set of tasks
+ *  @param   tasks The tasks, after they've been simulated
+ *  @param   count The number of tasks
+ *  @param   load The fraction of the time the CPU was busy
+ *  @param   length_us The time which was simulated
+ */
+static void report (const char* title, const sim_task* tasks, uint8_t count,
+					double load, uint32_t length_us)
+{
+	printf ("%s: CPU %.1f%% busy\n", title, 100.0 * load);
+	for (uint8_t index = 0; index < count; index++)
+	{
+		const sim_task& task = tasks[index];
+		printf ("  %-16s %5.1f%% of CPU, worst response %6u us of %7u us, %u late\n",
+				task.name, 100.0 * task.busy / length_us, task.worst_response,
+				task.period_us, task.misses);
+		CHECK (task.misses == 0);
+		CHECK (task.worst_response > 0 && task.worst_response <= task.period_us);
+	}
+}
+
+
+/** @brief   Make a simulated task from its entry in the task table.
+ *  @param   spec The task's entry
+ *  @param   executive True if the task is the cyclic executive
+ *  @return  The simulated task
+ */
+static sim_task make_task (const TaskSpec& spec, bool executive = false)
+{
+	sim_task task;
+	memset (&task, 0, sizeof (task));
+	task.name = spec.name;
+	task.priority = spec.priority;
+	task.period_us = spec.period_ms * 1000UL;
+	task.wcet_us = spec.wcet_us;
+	task.executive = executive;
+	return (task);
+}
+
+
+/** @brief   Check the tasks as separate RTOS tasks.
+ */
+static void test_tasks (void)
+{
+	sim_task tasks[SIM_MAX_TASKS];
+	uint32_t hyperperiod = 0;
+	for (uint8_t index = 0; index < NUM_APP_TASKS; index++)
+	{
+		tasks[index] = make_task (app_tasks[index]);
+		if (tasks[index].period_us > hyperperiod)
+		{
+			hyperperiod = tasks[index].period_us;
+		}
+	}
+
+	// Every period divides the longest, so that is the hyperperiod
+	for (uint8_t index = 0; index < NUM_APP_TASKS; index++)
+	{
+		CHECK (hyperperiod % tasks[index].period_us == 0);
+	}
+
+	double load = simulate (tasks, NUM_APP_TASKS, hyperperiod);
+	report ("Separate tasks", tasks, NUM_APP_TASKS, load, hyperperiod);
+}
+
+
+/** @brief   Check the cyclic executive with the parameter and health tasks.
+ */
+static void test_executive (void)
+{
+	uint32_t frames = app_tasks[TASK_CONTROLLER].period_ms * app_tasks[TASK_IMU].period_ms
+					  * app_tasks[TASK_MOTORS].period_ms / exec_task.period_ms;
+	uint32_t worst_frame = 0;
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		if (frame_wcet (frame) > worst_frame)
+		{
+			worst_frame = frame_wcet (frame);
+		}
+	}
+	printf ("Cyclic executive: worst frame %u us, table says %u us\n",
+			worst_frame, exec_task.wcet_us);
+	CHECK (worst_frame <= exec_task.wcet_us);
+
+	sim_task tasks[3] =
+	{
+		make_task (exec_task, true),
+		make_task (app_tasks[TASK_PARAMS]),
+		make_task (app_tasks[TASK_HEALTH])
+	};
+	uint32_t hyperperiod = tasks[2].period_us;
+	double load = simulate (tasks, 3, hyperperiod);
+	report ("Cyclic executive", tasks, 3, load, hyperperiod);
+}
+
+
+int main (void)
+{
+	printf ("%s control\n", (USE_HIGH_RATE_CONTROL == 1) ? "1 kHz" : "100 Hz");
+	test_tasks ();
+	test_executive ();
+
+	return (test_summary ((USE_HIGH_RATE_CONTROL == 1) ? "test_schedule_1khz"
+													   : "test_schedule"));
+}
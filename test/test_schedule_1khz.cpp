@@ -0,0 +1,10 @@
+//**************************************************************************************
+/** @file test_schedule_1khz.cpp
+ *    This file runs the checks in test_schedule.cpp on the task table for 1 kHz 
+ *    control, the one selected when USE_HIGH_RATE_CONTROL is 1.
+ */
+//**************************************************************************************
+
+#define USE_HIGH_RATE_CONTROL       1
+
+#include "test_schedule.cpp"
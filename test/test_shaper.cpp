@@ -0,0 +1,171 @@
+//**************************************************************************************
+/** @file test_shaper.cpp
+ *    This file tests the actuation shaping stage, both on its own and closing a PI
+ *    position loop around a simulated motor with stiction. Without the stage, the PI
+ *    controller's integral has to wind up through the deadband before the motor moves,
+ *    then overshoots, and the position hunts back and forth around the setpoint; with
+ *    the deadband offset table the motor moves as soon as the error does, and the
+ *    hunting should be much smaller.
+ */
+//**************************************************************************************
+
+#include "test_check.h"
+#include "motorDriver.h"
+#include "task_motor.h"
+
+
+/** @brief   The CPU clock frequency, which is set by @c SystemInit() on the target.
+ */
+uint32_t SystemCoreClock = 100000000UL;
+
+
+/** @brief   The effort at which the simulated motor breaks away from standstill,
+ *           the first entry in @c MOTOR_DEADBAND.
+ */
+const float PLANT_STATIC = 0.08f;
+
+/** @brief   The friction effort while the simulated motor is turning.
+ */
+const float PLANT_COULOMB = 0.06f;
+
+/** @brief   The simulated motor's viscous friction, in effort per radian/second.
+ */
+const float PLANT_VISCOUS = 0.2f;
+
+/** @brief   The simulated motor's inertia, in effort per radian/second squared.
+ */
+const float PLANT_INERTIA = 0.01f;
+
+/** @brief   The control period in seconds, that of the motor task.
+ */
+const float PLANT_DT = 0.005f;
+
+/** @brief   The number of integration steps in each control period.
+ */
+const int PLANT_SUBSTEPS = 50;
+
+
+//-------------------------------------------------------------------------------------
+/** @brief   Run a PI position loop around the stiction plant and measure its hunting.
+ *  @param   p_shaper The shaping stage between controller and motor, or NULL for none
+ *  @param   kp The proportional gain, effort per radian
+ *  @param   ki The integral gain, effort per radian-second
+ *  @return  The peak to peak position in radians over the second half of the run
+ */
+static float limit_cycle (ActuationShaper* p_shaper, float kp, float ki)
+{
+	float position = 0.05f;
+	float velocity = 0.0f;
+	float integral = 0.0f;
+	float lowest = 1.0e9f;
+	float highest = -1.0e9f;
+	const float h = PLANT_DT / PLANT_SUBSTEPS;
+
+	for (int step = 0; step < 8000; step++)
+	{
+		// The controller, with its integral and output limited to full effort
+		float error = -position;
+		integral += ki * error * PLANT_DT;
+		integral = fmaxf (-1.0f, fminf (1.0f, integral));
+		float effort = fmaxf (-1.0f, fminf (1.0f, kp * error + integral));
+		if (p_shaper != NULL)
+		{
+			effort = p_shaper->shape (effort);
+		}
+
+		// The motor sticks until the effort beats static friction, then slides
+		// against Coulomb and viscous friction until its velocity comes to zero
+		for (int sub = 0; sub < PLANT_SUBSTEPS; sub++)
+		{
+			float force;
+			if (velocity == 0.0f)
+			{
+				if (fabsf (effort) <= PLANT_STATIC)
+				{
+					continue;
+				}
+				force = effort - copysignf (PLANT_COULOMB, effort);
+			}
+			else
+			{
+				force = effort - copysignf (PLANT_COULOMB, velocity)
+						- PLANT_VISCOUS * velocity;
+			}
+			float new_velocity = velocity + force / PLANT_INERTIA * h;
+			if (velocity != 0.0f && new_velocity * velocity <= 0.0f)
+			{
+				new_velocity = 0.0f;
+			}
+			velocity = new_velocity;
+			position += velocity * h;
+		}
+
+		if (step >= 4000)
+		{
+			lowest = fminf (lowest, position);
+			highest = fmaxf (highest, position);
+		}
+	}
+	return (highest - lowest);
+}
+
+
+/** @brief   Check the shaping of single commands.
+ */
+static void test_shape (void)
+{
+	// With no zero band, zero stays zero and anything else breaks away
+	ActuationShaper no_band (MOTOR_DEADBAND, MOTOR_DEADBAND, 5, 0.0f);
+	CHECK (no_band.shape (0.0f) == 0.0f);
+	CHECK (no_band.shape (-0.0f) == 0.0f);
+	CHECK_NEAR (no_band.shape (0.001f), MOTOR_DEADBAND[0], 0.001f);
+	CHECK_NEAR (no_band.shape (-0.001f), -MOTOR_DEADBAND[0], 0.001f);
+	CHECK (no_band.shape (0.0f) == 0.0f);
+
+	// Within the zero band nothing comes out; the table is interpolated beyond it
+	ActuationShaper shaper (MOTOR_DEADBAND, MOTOR_DEADBAND, 5, MOTOR_ZERO_BAND);
+	CHECK (shaper.shape (MOTOR_ZERO_BAND / 2.0f) == 0.0f);
+	CHECK_NEAR (shaper.shape (0.25f), MOTOR_DEADBAND[1], 1.0e-6f);
+	CHECK_NEAR (shaper.shape (-0.375f), -(MOTOR_DEADBAND[1] + MOTOR_DEADBAND[2]) / 2.0f,
+				1.0e-6f);
+	CHECK_NEAR (shaper.shape (2.0f), 1.0f, 1.0e-6f);
+
+	// Direction gains, then a slew limit of 0.1 per call
+	shaper.set_gains (0.5f, 1.0f);
+	CHECK_NEAR (shaper.shape (1.0f), 0.5f, 1.0e-6f);
+	shaper.set_slew_rate (20.0f, PLANT_DT);
+	CHECK_NEAR (shaper.shape (-1.0f), 0.4f, 1.0e-6f);
+	CHECK_NEAR (shaper.shape (-1.0f), 0.3f, 1.0e-6f);
+}
+
+
+/** @brief   Check that shaping shrinks the stiction limit cycle.
+ */
+static void test_limit_cycle (void)
+{
+	const float gains[][2] = { {2.0f, 20.0f}, {5.0f, 20.0f}, {5.0f, 50.0f} };
+
+	for (uint8_t index = 0; index < sizeof (gains) / sizeof (gains[0]); index++)
+	{
+		ActuationShaper shaper (MOTOR_DEADBAND, MOTOR_DEADBAND, 5, MOTOR_ZERO_BAND);
+		shaper.set_slew_rate (MOTOR_SLEW_PER_S, PLANT_DT);
+
+		float plain = limit_cycle (NULL, gains[index][0], gains[index][1]);
+		float shaped = limit_cycle (&shaper, gains[index][0], gains[index][1]);
+		printf ("Kp %g, Ki %g: limit cycle %.5f rad unshaped, %.5f rad shaped\n",
+				gains[index][0], gains[index][1], plain, shaped);
+
+		// The plant must hunt without shaping for the comparison to mean anything
+		CHECK (plain > 0.002f);
+		CHECK (shaped < plain / 10.0f);
+	}
+}
+
+
+int main (void)
+{
+	test_shape ();
+	test_limit_cycle ();
+
+	return (test_summary ("test_shaper"));
+}